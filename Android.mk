@@ -28,6 +28,7 @@ LOCAL_CORE_COMMON_SRC := \
 	talk/base/firewallsocketserver.cc \
 	talk/base/flags.cc \
 	talk/base/helpers.cc \
+	talk/base/hmacsha1.cc \
 	talk/base/host.cc \
 	talk/base/httpbase.cc \
 	talk/base/httpclient.cc \
@@ -35,6 +36,7 @@ LOCAL_CORE_COMMON_SRC := \
 	talk/base/httprequest.cc \
 	talk/base/httpserver.cc \
 	talk/base/ipaddress.cc \
+	talk/base/lockfreeringbuffer.cc \
 	talk/base/logging.cc \
 	talk/base/md5.cc \
 	talk/base/messagedigest.cc \
@@ -49,6 +51,7 @@ LOCAL_CORE_COMMON_SRC := \
 	talk/base/nssidentity.cc \
 	talk/base/nssstreamadapter.cc \
 	talk/base/optionsfile.cc \
+	talk/base/packetbuffer.cc \
 	talk/base/pathutils.cc \
 	talk/base/physicalsocketserver.cc \
 	talk/base/proxydetect.cc \
@@ -163,6 +166,7 @@ LOCAL_P2P_SRC := \
 	talk/p2p/base/basicpacketsocketfactory.cc \
 	talk/p2p/base/constants.cc \
 	talk/p2p/base/dtlstransportchannel.cc \
+	talk/p2p/base/icecheckscheduler.cc \
 	talk/p2p/base/p2ptransport.cc \
 	talk/p2p/base/p2ptransportchannel.cc \
 	talk/p2p/base/parsing.cc \
@@ -171,6 +175,7 @@ LOCAL_P2P_SRC := \
 	talk/p2p/base/portallocatorsessionproxy.cc \
 	talk/p2p/base/portproxy.cc \
 	talk/p2p/base/pseudotcp.cc \
+	talk/p2p/base/pseudotcpcongestion.cc \
 	talk/p2p/base/relayport.cc \
 	talk/p2p/base/relayserver.cc \
 	talk/p2p/base/rawtransport.cc \
@@ -179,6 +184,7 @@ LOCAL_P2P_SRC := \
 	talk/p2p/base/sessiondescription.cc \
 	talk/p2p/base/sessionmanager.cc \
 	talk/p2p/base/sessionmessages.cc \
+	talk/p2p/base/shardedturnserver.cc \
 	talk/p2p/base/stun.cc \
 	talk/p2p/base/stunport.cc \
 	talk/p2p/base/stunrequest.cc \
@@ -190,6 +196,7 @@ LOCAL_P2P_SRC := \
 	talk/p2p/base/transportdescriptionfactory.cc \
 	talk/p2p/base/turnport.cc \
 	talk/p2p/base/turnserver.cc \
+	talk/p2p/base/udpportmux.cc \
 	talk/p2p/client/basicportallocator.cc \
 	talk/p2p/client/connectivitychecker.cc \
 	talk/p2p/client/httpportallocator.cc \
@@ -210,6 +217,7 @@ LOCAL_P2P_SRC := \
 	talk/session/media/rtcpmuxfilter.cc \
 	talk/session/media/soundclip.cc \
 	talk/session/media/srtpfilter.cc \
+	talk/session/media/ssrcdemuxer.cc \
 	talk/session/media/ssrcmuxfilter.cc \
 	talk/session/media/typingmonitor.cc
 
@@ -786,7 +786,8 @@ bool WebRtcSession::UpdateSessionState(
     if (!PushdownTransportDescription(source, cricket::CA_ANSWER)) {
       return BadSdp(source, kPushDownAnswerTDFailed, err_desc);
     }
-    MaybeEnableMuxingSupport();
+    if (MaybeEnableMuxingSupport())
+      EnableSsrcDemuxing();
     EnableChannels();
     SetState(source == cricket::CS_LOCAL ?
         STATE_SENTACCEPT : STATE_RECEIVEDACCEPT);
@@ -1185,6 +1186,33 @@ void WebRtcSession::EnableChannels() {
     data_channel_->Enable(true);
 }
 
+void WebRtcSession::EnableSsrcDemuxing() {
+  const cricket::ContentGroup* local_bundle_group =
+      BaseSession::local_description()->GetGroupByName(
+          cricket::GROUP_TYPE_BUNDLE);
+  const cricket::ContentGroup* remote_bundle_group =
+      BaseSession::remote_description()->GetGroupByName(
+          cricket::GROUP_TYPE_BUNDLE);
+  if (!local_bundle_group || !remote_bundle_group)
+    return;
+
+  std::vector<cricket::BaseChannel*> channels;
+  channels.push_back(voice_channel_.get());
+  channels.push_back(video_channel_.get());
+  // SCTP data isn't RTP, the data channel keeps reading it by itself.
+  if (data_channel_type_ == cricket::DCT_RTP)
+    channels.push_back(data_channel_.get());
+
+  if (!ssrc_demuxer_)
+    ssrc_demuxer_.reset(new cricket::SsrcDemuxer());
+  for (size_t i = 0; i < channels.size(); ++i) {
+    if (channels[i] &&
+        local_bundle_group->HasContentName(channels[i]->content_name())) {
+      channels[i]->SetSsrcDemuxer(ssrc_demuxer_.get());
+    }
+  }
+}
+
 void WebRtcSession::ProcessNewLocalCandidate(
     const std::string& content_name,
     const cricket::Candidates& candidates) {
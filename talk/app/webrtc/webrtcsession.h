@@ -50,6 +50,7 @@ class StatsReport;
 class Transport;
 class VideoCapturer;
 class BaseChannel;
+class SsrcDemuxer;
 class VideoChannel;
 class VoiceChannel;
 
@@ -214,6 +215,9 @@ class WebRtcSession : public cricket::BaseSession,
   bool CreateDefaultLocalDescription();
   // Enables media channels to allow sending of media.
   void EnableChannels();
+  // Attaches the channels of the negotiated BUNDLE group to |ssrc_demuxer_|,
+  // so the packets of the shared transport are matched to a channel once.
+  void EnableSsrcDemuxing();
   // Creates a JsepIceCandidate and adds it to the local session description
   // and notify observers. Called when a new local candidate have been found.
   void ProcessNewLocalCandidate(const std::string& content_name,
@@ -258,6 +262,8 @@ class WebRtcSession : public cricket::BaseSession,
   std::string BadStateErrMsg(const std::string& type, State state);
   void SetIceConnectionState(PeerConnectionInterface::IceConnectionState state);
 
+  // Declared before the channels, as it must outlive those attached to it.
+  talk_base::scoped_ptr<cricket::SsrcDemuxer> ssrc_demuxer_;
   talk_base::scoped_ptr<cricket::VoiceChannel> voice_channel_;
   talk_base::scoped_ptr<cricket::VideoChannel> video_channel_;
   talk_base::scoped_ptr<cricket::DataChannel> data_channel_;
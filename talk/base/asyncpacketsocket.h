@@ -28,6 +28,7 @@
 #ifndef TALK_BASE_ASYNCPACKETSOCKET_H_
 #define TALK_BASE_ASYNCPACKETSOCKET_H_
 
+#include "talk/base/packetbuffer.h"
 #include "talk/base/sigslot.h"
 #include "talk/base/socket.h"
 
@@ -58,6 +59,16 @@ class AsyncPacketSocket : public sigslot::has_slots<> {
   // Send a packet.
   virtual int Send(const void *pv, size_t cb) = 0;
   virtual int SendTo(const void *pv, size_t cb, const SocketAddress& addr) = 0;
+  // Send a packet without copying it, where the socket can. The socket may
+  // use the packet's headroom for framing but leaves the packet as it found
+  // it; it may also keep a reference, so the caller must not change the
+  // packet's contents afterwards.
+  virtual int SendBuffer(PacketBuffer* packet) {
+    return Send(packet->data(), packet->length());
+  }
+  virtual int SendBufferTo(PacketBuffer* packet, const SocketAddress& addr) {
+    return SendTo(packet->data(), packet->length(), addr);
+  }
 
   // Close the socket.
   virtual int Close() = 0;
@@ -74,10 +85,23 @@ class AsyncPacketSocket : public sigslot::has_slots<> {
   virtual int GetError() const = 0;
   virtual void SetError(int error) = 0;
 
+  // Batched I/O for datagram sockets. Sockets that cannot batch ignore these
+  // calls and keep moving one packet per system call.
+  // Lets up to |count| packets be read per readiness event.
+  virtual void SetRecvBatchSize(size_t count) {}
+  // Lets up to |count| packets passed to SendTo() be held and sent with one
+  // system call, at the latest when control returns to the message loop.
+  // Held packets count as sent; if they are dropped later only a log
+  // message records it.
+  virtual void SetSendBatchSize(size_t count) {}
+  // Sends the held packets right away. Returns the number of packets sent.
+  virtual int FlushSendBatch() { return 0; }
+
   // Emitted each time a packet is read. Used only for UDP and
   // connected TCP sockets.
   sigslot::signal4<AsyncPacketSocket*, const char*, size_t,
-                   const SocketAddress&> SignalReadPacket;
+                   const SocketAddress&,
+                   sigslot::thread_confined> SignalReadPacket;
 
   // Emitted when the socket is currently able to send.
   sigslot::signal1<AsyncPacketSocket*> SignalReadyToSend;
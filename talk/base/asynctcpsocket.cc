@@ -72,7 +72,8 @@ AsyncTCPSocketBase::AsyncTCPSocketBase(AsyncSocket* socket, bool listen,
       insize_(max_packet_size),
       inpos_(0),
       outsize_(max_packet_size),
-      outpos_(0) {
+      outpos_(0),
+      outstart_(0) {
   inbuf_ = new char[insize_];
   outbuf_ = new char[outsize_];
 
@@ -157,14 +158,39 @@ int AsyncTCPSocketBase::SendRaw(const void * pv, size_t cb) {
     return -1;
   }
 
-  memcpy(outbuf_ + outpos_, pv, cb);
-  outpos_ += cb;
+  AppendToOutBuffer(pv, cb);
 
   return FlushOutBuffer();
 }
 
+int AsyncTCPSocketBase::SendDirect(const SocketIoVec* buffers, size_t count) {
+  ASSERT(IsOutBufferEmpty());
+  int res = socket_->SendV(buffers, count);
+  if (res <= 0) {
+    return res;
+  }
+  size_t skip = static_cast<size_t>(res);
+  for (size_t i = 0; i < count; ++i) {
+    if (skip >= buffers[i].size) {
+      skip -= buffers[i].size;
+      continue;
+    }
+    AppendToOutBuffer(static_cast<const char*>(buffers[i].data) + skip,
+                      buffers[i].size - skip);
+    skip = 0;
+  }
+  return res;
+}
+
 int AsyncTCPSocketBase::FlushOutBuffer() {
-  int res = socket_->Send(outbuf_, outpos_);
+  // The queued bytes wrap at most once, so they fit in two buffers.
+  size_t first = _min(outpos_, outsize_ - outstart_);
+  SocketIoVec buffers[2];
+  buffers[0].data = outbuf_ + outstart_;
+  buffers[0].size = first;
+  buffers[1].data = outbuf_;
+  buffers[1].size = outpos_ - first;
+  int res = socket_->SendV(buffers, (buffers[1].size > 0) ? 2 : 1);
   if (res <= 0) {
     return res;
   }
@@ -174,15 +200,17 @@ int AsyncTCPSocketBase::FlushOutBuffer() {
     ASSERT(false);
     return -1;
   }
-  if (outpos_ > 0) {
-    memmove(outbuf_, outbuf_ + res, outpos_);
-  }
+  outstart_ = (outpos_ > 0) ? (outstart_ + res) % outsize_ : 0;
   return res;
 }
 
 void AsyncTCPSocketBase::AppendToOutBuffer(const void* pv, size_t cb) {
-  ASSERT(outpos_ + cb < outsize_);
-  memcpy(outbuf_ + outpos_, pv, cb);
+  ASSERT(outpos_ + cb <= outsize_);
+  const char* data = static_cast<const char*>(pv);
+  size_t end = (outstart_ + outpos_) % outsize_;
+  size_t first = _min(cb, outsize_ - end);
+  memcpy(outbuf_ + end, data, first);
+  memcpy(outbuf_, data + first, cb - first);
   outpos_ += cb;
 }
 
@@ -271,14 +299,16 @@ int AsyncTCPSocket::Send(const void *pv, size_t cb) {
   if (!IsOutBufferEmpty())
     return static_cast<int>(cb);
 
+  // Write the length prefix and the payload together without joining them.
   PacketLength pkt_len = HostToNetwork16(static_cast<PacketLength>(cb));
-  AppendToOutBuffer(&pkt_len, kPacketLenSize);
-  AppendToOutBuffer(pv, cb);
-
-  int res = FlushOutBuffer();
+  SocketIoVec buffers[2];
+  buffers[0].data = &pkt_len;
+  buffers[0].size = kPacketLenSize;
+  buffers[1].data = pv;
+  buffers[1].size = cb;
+  int res = SendDirect(buffers, ARRAY_SIZE(buffers));
   if (res <= 0) {
     // drop packet if we made no progress
-    ClearOutBuffer();
     return res;
   }
 
@@ -289,20 +319,21 @@ int AsyncTCPSocket::Send(const void *pv, size_t cb) {
 void AsyncTCPSocket::ProcessInput(char * data, size_t* len) {
   SocketAddress remote_addr(GetRemoteAddress());
 
-  while (true) {
-    if (*len < kPacketLenSize)
-      return;
+  // Deliver every complete packet before moving what is left, so a read
+  // full of small packets costs one memmove rather than one per packet.
+  size_t pos = 0;
+  while (*len - pos >= kPacketLenSize) {
+    PacketLength pkt_len = talk_base::GetBE16(data + pos);
+    if (*len - pos < kPacketLenSize + pkt_len)
+      break;
 
-    PacketLength pkt_len = talk_base::GetBE16(data);
-    if (*len < kPacketLenSize + pkt_len)
-      return;
-
-    SignalReadPacket(this, data + kPacketLenSize, pkt_len, remote_addr);
+    SignalReadPacket(this, data + pos + kPacketLenSize, pkt_len, remote_addr);
+    pos += kPacketLenSize + pkt_len;
+  }
 
-    *len -= kPacketLenSize + pkt_len;
-    if (*len > 0) {
-      memmove(data, data + kPacketLenSize + pkt_len, *len);
-    }
+  *len -= pos;
+  if (pos > 0 && *len > 0) {
+    memmove(data, data + pos, *len);
   }
 }
 
@@ -67,13 +67,16 @@ class AsyncTCPSocketBase : public AsyncPacketSocket {
                                     const SocketAddress& bind_address,
                                     const SocketAddress& remote_address);
   virtual int SendRaw(const void* pv, size_t cb);
+  // Sends the concatenation of |buffers| with one gathered write while
+  // |outbuf_| is empty, and only queues what the socket doesn't take.
+  int SendDirect(const SocketIoVec* buffers, size_t count);
   int FlushOutBuffer();
   // Add data to |outbuf_|.
   void AppendToOutBuffer(const void* pv, size_t cb);
 
   // Helper methods for |outpos_|.
   bool IsOutBufferEmpty() const { return outpos_ == 0; }
-  void ClearOutBuffer() { outpos_ = 0; }
+  void ClearOutBuffer() { outstart_ = outpos_ = 0; }
 
  private:
   // Called by the underlying socket
@@ -86,6 +89,9 @@ class AsyncTCPSocketBase : public AsyncPacketSocket {
   bool listen_;
   char* inbuf_, * outbuf_;
   size_t insize_, inpos_, outsize_, outpos_;
+  // |outbuf_| is a ring holding |outpos_| bytes from |outstart_|, so a
+  // partial send never moves the unsent bytes.
+  size_t outstart_;
 
   DISALLOW_EVIL_CONSTRUCTORS(AsyncTCPSocketBase);
 };
@@ -25,12 +25,17 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "talk/base/asynctcpsocket.h"
 #include "talk/base/gunit.h"
+#include "talk/base/logging.h"
 #include "talk/base/physicalsocketserver.h"
 #include "talk/base/scoped_ptr.h"
+#include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 #include "talk/base/virtualsocketserver.h"
 
 namespace talk_base {
@@ -67,4 +72,173 @@ TEST_F(AsyncTCPSocketTest, OnWriteEvent) {
   EXPECT_TRUE(ready_to_send_);
 }
 
+// A stream socket that takes at most |send_budget| bytes per send and hands
+// out |incoming| at most |recv_budget| bytes per receive.
+class BudgetSocket : public AsyncSocketAdapter {
+ public:
+  explicit BudgetSocket(AsyncSocket* socket)
+      : AsyncSocketAdapter(socket), send_budget(0), recv_budget(0) {
+  }
+
+  virtual int Send(const void* pv, size_t cb) {
+    size_t n = std::min(cb, send_budget);
+    if (n == 0) {
+      SetError(EWOULDBLOCK);
+      return -1;
+    }
+    sent.append(static_cast<const char*>(pv), n);
+    send_budget -= n;
+    return static_cast<int>(n);
+  }
+  virtual int Recv(void* pv, size_t cb) {
+    size_t n = std::min(std::min(cb, recv_budget), incoming.size());
+    if (n == 0) {
+      SetError(EWOULDBLOCK);
+      return -1;
+    }
+    incoming.copy(static_cast<char*>(pv), n);
+    incoming.erase(0, n);
+    return static_cast<int>(n);
+  }
+
+  size_t send_budget;
+  size_t recv_budget;
+  std::string sent;
+  std::string incoming;
+};
+
+class PacketCollector : public sigslot::has_slots<> {
+ public:
+  void OnReadPacket(AsyncPacketSocket* socket, const char* data, size_t size,
+                    const SocketAddress& remote_addr) {
+    packets.push_back(std::string(data, size));
+  }
+  void OnReadyToSend(AsyncPacketSocket* socket) {
+    ready_to_send = true;
+  }
+
+  std::vector<std::string> packets;
+  bool ready_to_send;
+};
+
+// Sends framed packets through a socket that only takes a few bytes at a
+// time, then reads the stream back in uneven pieces, and checks that every
+// packet comes out whole and in order.
+TEST_F(AsyncTCPSocketTest, PartialSendsAndReadsKeepFraming) {
+  BudgetSocket* sender_socket =
+      new BudgetSocket(vss_->CreateAsyncSocket(SOCK_STREAM));
+  AsyncTCPSocket sender(sender_socket, false);
+  PacketCollector collector;
+  sender.SignalReadyToSend.connect(&collector,
+                                   &PacketCollector::OnReadyToSend);
+
+  std::vector<std::string> packets;
+  for (size_t i = 0; i < 200; ++i) {
+    std::string packet(1 + (i * 37) % 300, static_cast<char>('a' + i % 26));
+    size_t budget = (i * 53) % 97;
+    sender_socket->send_budget = budget;
+    int res = sender.Send(packet.data(), packet.size());
+    if (budget == 0) {
+      // No progress at all, so the packet is dropped.
+      EXPECT_EQ(-1, res);
+      continue;
+    }
+    EXPECT_EQ(static_cast<int>(packet.size()), res);
+    packets.push_back(packet);
+    collector.ready_to_send = false;
+    while (!collector.ready_to_send) {
+      sender_socket->send_budget = 1 + (i * 11) % 29;
+      sender_socket->SignalWriteEvent(sender_socket);
+    }
+  }
+
+  BudgetSocket* receiver_socket =
+      new BudgetSocket(vss_->CreateAsyncSocket(SOCK_STREAM));
+  AsyncTCPSocket receiver(receiver_socket, false);
+  receiver.SignalReadPacket.connect(&collector,
+                                    &PacketCollector::OnReadPacket);
+  receiver_socket->incoming = sender_socket->sent;
+  for (size_t i = 0; !receiver_socket->incoming.empty(); ++i) {
+    receiver_socket->recv_budget = 1 + (i * 7919) % 1500;
+    receiver_socket->SignalReadEvent(receiver_socket);
+  }
+
+  ASSERT_EQ(packets.size(), collector.packets.size());
+  for (size_t i = 0; i < packets.size(); ++i) {
+    EXPECT_EQ(packets[i], collector.packets[i]);
+  }
+}
+
+class TcpLoopbackReceiver : public sigslot::has_slots<> {
+ public:
+  TcpLoopbackReceiver() : packets(0), bytes(0) {}
+
+  void OnNewConnection(AsyncPacketSocket* server, AsyncPacketSocket* socket) {
+    socket->SignalReadPacket.connect(this, &TcpLoopbackReceiver::OnReadPacket);
+    accepted.reset(socket);
+  }
+  void OnReadPacket(AsyncPacketSocket* socket, const char* data, size_t size,
+                    const SocketAddress& remote_addr) {
+    ++packets;
+    bytes += size;
+  }
+
+  scoped_ptr<AsyncPacketSocket> accepted;
+  size_t packets;
+  size_t bytes;
+};
+
+// Pushes framed packets of a few sizes over a real loopback TCP connection,
+// keeping a window of bytes in flight that the kernel buffers can absorb so
+// nothing is dropped, and logs the throughput.  Each read then carries many
+// small packets.
+TEST(AsyncTCPSocketPerfTest, FramedLoopbackThroughputPerf) {
+  const size_t kPacketSizes[] = { 64, 200, 1200 };
+  const size_t kPackets = 50000;
+  const size_t kWindowBytes = 32 * 1024;
+  const int kTimeoutMs = 10000;
+
+  PhysicalSocketServer pss;
+  SocketServerScope scope(&pss);
+  AsyncSocket* listen_socket = pss.CreateAsyncSocket(SOCK_STREAM);
+  ASSERT_EQ(0, listen_socket->Bind(SocketAddress("127.0.0.1", 0)));
+  AsyncTCPSocket server(listen_socket, true);
+  TcpLoopbackReceiver receiver;
+  server.SignalNewConnection.connect(&receiver,
+                                     &TcpLoopbackReceiver::OnNewConnection);
+  scoped_ptr<AsyncTCPSocket> client(AsyncTCPSocket::Create(
+      pss.CreateAsyncSocket(SOCK_STREAM), SocketAddress("127.0.0.1", 0),
+      listen_socket->GetLocalAddress()));
+  ASSERT_TRUE(client.get() != NULL);
+  // Don't let Nagle hold back the tail of each window.
+  client->SetOption(Socket::OPT_NODELAY, 1);
+  EXPECT_TRUE_WAIT(receiver.accepted.get() != NULL, kTimeoutMs);
+  ASSERT_TRUE(receiver.accepted.get() != NULL);
+
+  std::string payload(kPacketSizes[ARRAY_SIZE(kPacketSizes) - 1], 'x');
+  for (int i = 0; i < ARRAY_SIZE(kPacketSizes); ++i) {
+    size_t size = kPacketSizes[i];
+    size_t window = kWindowBytes / (size + 2);
+    receiver.packets = 0;
+    receiver.bytes = 0;
+    uint32 start = Time();
+    for (size_t sent = 0; sent < kPackets; ) {
+      for (size_t j = 0; j < window && sent < kPackets; ++j, ++sent) {
+        client->Send(payload.data(), size);
+      }
+      uint32 deadline = Time() + kTimeoutMs;
+      while (receiver.packets < sent && TimeIsLater(Time(), deadline)) {
+        pss.Wait(0, true);
+      }
+      ASSERT_EQ(sent, receiver.packets);
+    }
+    uint32 elapsed = std::max<uint32>(TimeSince(start), 1);
+    EXPECT_EQ(kPackets * size, receiver.bytes);
+    LOG(LS_INFO) << kPackets << " framed packets of " << size << " bytes: "
+                 << elapsed << " ms, " << kPackets * 1000 / elapsed
+                 << " packets/s, " << receiver.bytes / 1000 / elapsed
+                 << " MB/s";
+  }
+}
+
 }  // namespace talk_base
@@ -26,12 +26,23 @@
  */
 
 #include "talk/base/asyncudpsocket.h"
+
+#include <string.h>
+
 #include "talk/base/logging.h"
+#include "talk/base/thread.h"
 
 namespace talk_base {
 
 static const int BUF_SIZE = 64 * 1024;
 
+enum {
+  MSG_FLUSH_SEND_BATCH = 1,
+};
+
+const size_t AsyncUDPSocket::kMaxBatchedPacketSize;
+const int AsyncUDPSocket::kRecvBatchResumeCount;
+
 AsyncUDPSocket* AsyncUDPSocket::Create(
     AsyncSocket* socket,
     const SocketAddress& bind_address) {
@@ -53,7 +64,12 @@ AsyncUDPSocket* AsyncUDPSocket::Create(SocketFactory* factory,
 }
 
 AsyncUDPSocket::AsyncUDPSocket(AsyncSocket* socket)
-    : socket_(socket) {
+    : socket_(socket),
+      recv_batch_suspended_(false),
+      recv_fit_count_(0),
+      send_count_(0),
+      flush_posted_(false),
+      destroyed_(NULL) {
   ASSERT(socket_);
   size_ = BUF_SIZE;
   buf_ = new char[size_];
@@ -64,6 +80,9 @@ AsyncUDPSocket::AsyncUDPSocket(AsyncSocket* socket)
 }
 
 AsyncUDPSocket::~AsyncUDPSocket() {
+  FlushSendBatch();
+  if (destroyed_)
+    *destroyed_ = true;
   delete [] buf_;
 }
 
@@ -76,15 +95,61 @@ SocketAddress AsyncUDPSocket::GetRemoteAddress() const {
 }
 
 int AsyncUDPSocket::Send(const void *pv, size_t cb) {
+  // Keep packets in order with any held by SendTo().
+  FlushSendBatch();
   return socket_->Send(pv, cb);
 }
 
 int AsyncUDPSocket::SendTo(
     const void *pv, size_t cb, const SocketAddress& addr) {
-  return socket_->SendTo(pv, cb, addr);
+  if (send_batch_.empty() || cb > kMaxBatchedPacketSize || !ScheduleFlush()) {
+    FlushSendBatch();
+    return socket_->SendTo(pv, cb, addr);
+  }
+
+  SocketDatagram& datagram = send_batch_[send_count_++];
+  memcpy(datagram.data, pv, cb);
+  datagram.size = cb;
+  datagram.addr = addr;
+  if (send_count_ == send_batch_.size())
+    FlushSendBatch();
+  return static_cast<int>(cb);
+}
+
+int AsyncUDPSocket::SendBufferTo(PacketBuffer* packet,
+                                 const SocketAddress& addr) {
+  if (send_batch_.empty() || !ScheduleFlush()) {
+    FlushSendBatch();
+    return socket_->SendTo(packet->data(), packet->length(), addr);
+  }
+
+  // Hold a reference rather than a copy.
+  send_packets_[send_count_] = packet;
+  SocketDatagram& datagram = send_batch_[send_count_++];
+  datagram.data = packet->data();
+  datagram.size = packet->length();
+  datagram.addr = addr;
+  int sent = static_cast<int>(packet->length());
+  if (send_count_ == send_batch_.size())
+    FlushSendBatch();
+  return sent;
+}
+
+bool AsyncUDPSocket::ScheduleFlush() {
+  if (!flush_posted_) {
+    Thread* thread = Thread::Current();
+    if (!thread) {
+      // Nothing would flush the batch later, so don't hold the packet.
+      return false;
+    }
+    thread->Post(this, MSG_FLUSH_SEND_BATCH);
+    flush_posted_ = true;
+  }
+  return true;
 }
 
 int AsyncUDPSocket::Close() {
+  FlushSendBatch();
   return socket_->Close();
 }
 
@@ -108,9 +173,80 @@ void AsyncUDPSocket::SetError(int error) {
   return socket_->SetError(error);
 }
 
+void AsyncUDPSocket::SetRecvBatchSize(size_t count) {
+  recv_batch_.clear();
+  recv_buf_.reset();
+  recv_batch_suspended_ = false;
+  if (count <= 1)
+    return;
+  recv_batch_.resize(count);
+  recv_buf_.reset(new char[count * kMaxBatchedPacketSize]);
+  for (size_t i = 0; i < count; ++i) {
+    recv_batch_[i].data = recv_buf_.get() + i * kMaxBatchedPacketSize;
+  }
+}
+
+void AsyncUDPSocket::SetSendBatchSize(size_t count) {
+  FlushSendBatch();
+  send_batch_.clear();
+  send_buf_.reset();
+  send_packets_.clear();
+  if (count <= 1)
+    return;
+  send_batch_.resize(count);
+  send_packets_.resize(count);
+  send_buf_.reset(new char[count * kMaxBatchedPacketSize]);
+  for (size_t i = 0; i < count; ++i) {
+    send_batch_[i].data = send_buf_.get() + i * kMaxBatchedPacketSize;
+  }
+}
+
+int AsyncUDPSocket::FlushSendBatch() {
+  size_t sent = 0;
+  size_t dropped = 0;
+  while (sent + dropped < send_count_) {
+    int result = socket_->SendToBatch(&send_batch_[sent + dropped],
+                                      send_count_ - sent - dropped);
+    if (result > 0) {
+      sent += result;
+    } else if (socket_->IsBlocking()) {
+      // The socket will signal SignalReadyToSend; drop what is left, as an
+      // unbatched send would have.
+      dropped = send_count_ - sent;
+    } else {
+      // Errors such as an ICMP unreachable only concern one packet.
+      ++dropped;
+    }
+  }
+  if (dropped > 0) {
+    LOG(LS_INFO) << "AsyncUDPSocket[" << GetLocalAddress().ToSensitiveString()
+                 << "] dropped " << dropped << " of " << send_count_
+                 << " batched packets, error " << socket_->GetError();
+  }
+  for (size_t i = 0; i < send_count_; ++i) {
+    if (send_packets_[i]) {
+      send_packets_[i] = NULL;
+      send_batch_[i].data = send_buf_.get() + i * kMaxBatchedPacketSize;
+    }
+  }
+  send_count_ = 0;
+  return static_cast<int>(sent);
+}
+
+void AsyncUDPSocket::OnMessage(Message* msg) {
+  ASSERT(msg->message_id == MSG_FLUSH_SEND_BATCH);
+  flush_posted_ = false;
+  FlushSendBatch();
+}
+
 void AsyncUDPSocket::OnReadEvent(AsyncSocket* socket) {
   ASSERT(socket_.get() == socket);
 
+  if (!recv_batch_.empty() && !recv_batch_suspended_) {
+    ReadBatch();
+    return;
+  }
+
   SocketAddress remote_addr;
   int len = socket_->RecvFrom(buf_, size_, &remote_addr);
   if (len < 0) {
@@ -124,11 +260,64 @@ void AsyncUDPSocket::OnReadEvent(AsyncSocket* socket) {
     return;
   }
 
+  if (recv_batch_suspended_) {
+    if (static_cast<size_t>(len) > kMaxBatchedPacketSize) {
+      recv_fit_count_ = 0;
+    } else if (++recv_fit_count_ >= kRecvBatchResumeCount) {
+      LOG(LS_INFO) << "AsyncUDPSocket[" << GetLocalAddress().ToSensitiveString()
+                   << "] batching receives again";
+      recv_batch_suspended_ = false;
+    }
+  }
+
   // TODO: Make sure that we got all of the packet.
   // If we did not, then we should resize our buffer to be large enough.
   SignalReadPacket(this, buf_, (size_t)len, remote_addr);
 }
 
+void AsyncUDPSocket::ReadBatch() {
+  for (size_t i = 0; i < recv_batch_.size(); ++i) {
+    recv_batch_[i].size = kMaxBatchedPacketSize;
+  }
+  int count = socket_->RecvFromBatch(&recv_batch_[0], recv_batch_.size());
+  if (count < 0) {
+    if (!socket_->IsBlocking()) {
+      // See OnReadEvent() for why this is not treated as fatal.
+      SocketAddress local_addr = socket_->GetLocalAddress();
+      LOG(LS_INFO) << "AsyncUDPSocket[" << local_addr.ToSensitiveString()
+                   << "] receive failed with error " << socket_->GetError();
+    }
+    return;
+  }
+
+  // A handler may delete us while the batch is delivered.
+  bool destroyed = false;
+  bool truncated = false;
+  destroyed_ = &destroyed;
+  for (int i = 0; i < count && !destroyed; ++i) {
+    const SocketDatagram& datagram = recv_batch_[i];
+    if (datagram.size > kMaxBatchedPacketSize) {
+      LOG(LS_WARNING) << "Dropping truncated " << datagram.size
+                      << " byte packet from "
+                      << datagram.addr.ToSensitiveString();
+      truncated = true;
+      continue;
+    }
+    SignalReadPacket(this, datagram.data, datagram.size, datagram.addr);
+  }
+  if (destroyed)
+    return;
+  destroyed_ = NULL;
+  // A peer sends packets too large for the batch slots, so read one at a time
+  // into the full-sized buffer until small packets are the norm again.
+  if (truncated) {
+    LOG(LS_INFO) << "AsyncUDPSocket[" << GetLocalAddress().ToSensitiveString()
+                 << "] suspending batched receives";
+    recv_batch_suspended_ = true;
+    recv_fit_count_ = 0;
+  }
+}
+
 void AsyncUDPSocket::OnWriteEvent(AsyncSocket* socket) {
   SignalReadyToSend(this);
 }
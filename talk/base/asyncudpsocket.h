@@ -28,15 +28,19 @@
 #ifndef TALK_BASE_ASYNCUDPSOCKET_H_
 #define TALK_BASE_ASYNCUDPSOCKET_H_
 
+#include <vector>
+
 #include "talk/base/asyncpacketsocket.h"
+#include "talk/base/messagehandler.h"
 #include "talk/base/scoped_ptr.h"
+#include "talk/base/scoped_ref_ptr.h"
 #include "talk/base/socketfactory.h"
 
 namespace talk_base {
 
 // Provides the ability to receive packets asynchronously.  Sends are not
 // buffered since it is acceptable to drop packets under high load.
-class AsyncUDPSocket : public AsyncPacketSocket {
+class AsyncUDPSocket : public AsyncPacketSocket, public MessageHandler {
  public:
   // Binds |socket| and creates AsyncUDPSocket for it. Takes ownership
   // of |socket|. Returns NULL if bind() fails (|socket| is destroyed
@@ -54,6 +58,7 @@ class AsyncUDPSocket : public AsyncPacketSocket {
   virtual SocketAddress GetRemoteAddress() const;
   virtual int Send(const void *pv, size_t cb);
   virtual int SendTo(const void *pv, size_t cb, const SocketAddress& addr);
+  virtual int SendBufferTo(PacketBuffer* packet, const SocketAddress& addr);
   virtual int Close();
 
   virtual State GetState() const;
@@ -62,15 +67,52 @@ class AsyncUDPSocket : public AsyncPacketSocket {
   virtual int GetError() const;
   virtual void SetError(int error);
 
+  // Batched packets are limited to kMaxBatchedPacketSize bytes. Larger ones
+  // are sent on their own. A larger one that arrives in a receive batch is
+  // dropped, and the socket reads one packet at a time into a full-sized
+  // buffer until kRecvBatchResumeCount packets in a row have fit a batch
+  // slot again.
+  virtual void SetRecvBatchSize(size_t count);
+  virtual void SetSendBatchSize(size_t count);
+  virtual int FlushSendBatch();
+
+  // MessageHandler:
+  virtual void OnMessage(Message* msg);
+
+  static const size_t kMaxBatchedPacketSize = 2048;
+  static const int kRecvBatchResumeCount = 64;
+
  private:
   // Called when the underlying socket is ready to be read from.
   void OnReadEvent(AsyncSocket* socket);
+  void ReadBatch();
+  // Makes sure held packets are flushed from the message loop. Returns false
+  // if there is no message loop to do it.
+  bool ScheduleFlush();
   // Called when the underlying socket is ready to send.
   void OnWriteEvent(AsyncSocket* socket);
 
   scoped_ptr<AsyncSocket> socket_;
   char* buf_;
   size_t size_;
+
+  // Receive slots, each kMaxBatchedPacketSize bytes of |recv_buf_|.
+  std::vector<SocketDatagram> recv_batch_;
+  scoped_array<char> recv_buf_;
+  // Set while receives are unbatched because of a large packet, with the
+  // number of packets since then that would have fit a slot.
+  bool recv_batch_suspended_;
+  int recv_fit_count_;
+  // Packets held by SendTo(), each kMaxBatchedPacketSize bytes of
+  // |send_buf_|; the first |send_count_| are in use. Packets held by
+  // SendBufferTo() are referenced from |send_packets_| instead of copied.
+  std::vector<SocketDatagram> send_batch_;
+  scoped_array<char> send_buf_;
+  std::vector<scoped_refptr<PacketBuffer> > send_packets_;
+  size_t send_count_;
+  bool flush_posted_;
+  // Set while a receive batch is delivered, to notice deletion by a handler.
+  bool* destroyed_;
 };
 
 }  // namespace talk_base
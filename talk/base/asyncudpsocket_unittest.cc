@@ -26,11 +26,14 @@
  */
 
 #include <string>
+#include <vector>
 
 #include "talk/base/asyncudpsocket.h"
 #include "talk/base/gunit.h"
 #include "talk/base/physicalsocketserver.h"
 #include "talk/base/scoped_ptr.h"
+#include "talk/base/stringencode.h"
+#include "talk/base/thread.h"
 #include "talk/base/virtualsocketserver.h"
 
 namespace talk_base {
@@ -67,4 +70,112 @@ TEST_F(AsyncUdpSocketTest, OnWriteEvent) {
   EXPECT_TRUE(ready_to_send_);
 }
 
+// Records the packets read from an AsyncPacketSocket.
+class PacketRecorder : public sigslot::has_slots<> {
+ public:
+  void OnReadPacket(AsyncPacketSocket* socket, const char* data, size_t size,
+                    const SocketAddress& remote_addr) {
+    packets_.push_back(std::string(data, size));
+  }
+
+  std::vector<std::string> packets_;
+};
+
+// Sends numbered packets through batched sockets on the real network stack
+// and checks that all of them arrive in order.
+TEST(AsyncUdpSocketBatchTest, BatchedSendAndReceive) {
+  const int kNumPackets = 20;
+  SocketServer* ss = Thread::Current()->socketserver();
+  SocketAddress loopback(IPAddress(INADDR_LOOPBACK), 0);
+  scoped_ptr<AsyncUDPSocket> sender(AsyncUDPSocket::Create(ss, loopback));
+  scoped_ptr<AsyncUDPSocket> receiver(AsyncUDPSocket::Create(ss, loopback));
+  ASSERT_TRUE(sender.get() != NULL);
+  ASSERT_TRUE(receiver.get() != NULL);
+  sender->SetSendBatchSize(8);
+  receiver->SetRecvBatchSize(8);
+  PacketRecorder recorder;
+  receiver->SignalReadPacket.connect(&recorder, &PacketRecorder::OnReadPacket);
+
+  for (int i = 0; i < kNumPackets; ++i) {
+    std::string packet = "packet" + ToString(i);
+    EXPECT_EQ(static_cast<int>(packet.size()),
+              sender->SendTo(packet.data(), packet.size(),
+                             receiver->GetLocalAddress()));
+  }
+  // Two full batches have gone out; the rest waits for the message loop.
+  EXPECT_EQ_WAIT(kNumPackets, static_cast<int>(recorder.packets_.size()),
+                 1000);
+  for (int i = 0; i < kNumPackets; ++i) {
+    EXPECT_EQ("packet" + ToString(i), recorder.packets_[i]);
+  }
+}
+
+// Checks that held packets go out when flushed explicitly, and that packets
+// too large to batch keep their place in the sequence.
+TEST(AsyncUdpSocketBatchTest, FlushAndOversizedPackets) {
+  SocketServer* ss = Thread::Current()->socketserver();
+  SocketAddress loopback(IPAddress(INADDR_LOOPBACK), 0);
+  scoped_ptr<AsyncUDPSocket> sender(AsyncUDPSocket::Create(ss, loopback));
+  scoped_ptr<AsyncUDPSocket> receiver(AsyncUDPSocket::Create(ss, loopback));
+  ASSERT_TRUE(sender.get() != NULL);
+  ASSERT_TRUE(receiver.get() != NULL);
+  sender->SetSendBatchSize(4);
+  PacketRecorder recorder;
+  receiver->SignalReadPacket.connect(&recorder, &PacketRecorder::OnReadPacket);
+
+  std::string large(AsyncUDPSocket::kMaxBatchedPacketSize + 1, 'x');
+  sender->SendTo("a", 1, receiver->GetLocalAddress());
+  sender->SendTo(large.data(), large.size(), receiver->GetLocalAddress());
+  sender->SendTo("b", 1, receiver->GetLocalAddress());
+  EXPECT_EQ(1, sender->FlushSendBatch());
+  EXPECT_EQ(0, sender->FlushSendBatch());
+
+  EXPECT_EQ_WAIT(3U, recorder.packets_.size(), 1000);
+  ASSERT_EQ(3U, recorder.packets_.size());
+  EXPECT_EQ("a", recorder.packets_[0]);
+  EXPECT_EQ(large, recorder.packets_[1]);
+  EXPECT_EQ("b", recorder.packets_[2]);
+}
+
+// Checks that a receiver drops a packet too large for its batch slots, reads
+// the next large packet whole, and batches again once small packets return.
+TEST(AsyncUdpSocketBatchTest, OversizedPacketSuspendsReceiveBatching) {
+  SocketServer* ss = Thread::Current()->socketserver();
+  SocketAddress loopback(IPAddress(INADDR_LOOPBACK), 0);
+  scoped_ptr<AsyncUDPSocket> sender(AsyncUDPSocket::Create(ss, loopback));
+  scoped_ptr<AsyncUDPSocket> receiver(AsyncUDPSocket::Create(ss, loopback));
+  ASSERT_TRUE(sender.get() != NULL);
+  ASSERT_TRUE(receiver.get() != NULL);
+  receiver->SetRecvBatchSize(8);
+  PacketRecorder recorder;
+  receiver->SignalReadPacket.connect(&recorder, &PacketRecorder::OnReadPacket);
+
+  std::string large(AsyncUDPSocket::kMaxBatchedPacketSize + 1, 'x');
+  sender->SendTo("a", 1, receiver->GetLocalAddress());
+  sender->SendTo(large.data(), large.size(), receiver->GetLocalAddress());
+  EXPECT_EQ_WAIT(1U, recorder.packets_.size(), 1000);
+  Thread::Current()->ProcessMessages(100);
+  ASSERT_EQ(1U, recorder.packets_.size());
+  EXPECT_EQ("a", recorder.packets_[0]);
+
+  sender->SendTo(large.data(), large.size(), receiver->GetLocalAddress());
+  EXPECT_EQ_WAIT(2U, recorder.packets_.size(), 1000);
+  ASSERT_EQ(2U, recorder.packets_.size());
+  EXPECT_EQ(large, recorder.packets_[1]);
+
+  // Enough small packets turn batching back on, after which a large packet
+  // is dropped again.
+  const size_t kSmallPackets = AsyncUDPSocket::kRecvBatchResumeCount;
+  for (size_t i = 0; i < kSmallPackets; ++i) {
+    sender->SendTo("b", 1, receiver->GetLocalAddress());
+    EXPECT_EQ_WAIT(3U + i, recorder.packets_.size(), 1000);
+  }
+  sender->SendTo(large.data(), large.size(), receiver->GetLocalAddress());
+  sender->SendTo("c", 1, receiver->GetLocalAddress());
+  EXPECT_EQ_WAIT(3U + kSmallPackets, recorder.packets_.size(), 1000);
+  Thread::Current()->ProcessMessages(100);
+  ASSERT_EQ(3U + kSmallPackets, recorder.packets_.size());
+  EXPECT_EQ("c", recorder.packets_.back());
+}
+
 }  // namespace talk_base
@@ -58,6 +58,16 @@ ByteBuffer::ByteBuffer(const char* bytes) {
   Construct(bytes, strlen(bytes), ORDER_NETWORK);
 }
 
+ByteBuffer::ByteBuffer(ByteOrder byte_order, char* storage, size_t capacity) {
+  version_ = 0;
+  start_ = 0;
+  end_ = 0;
+  size_ = capacity;
+  byte_order_ = byte_order;
+  bytes_ = storage;
+  owned_ = false;
+}
+
 void ByteBuffer::Construct(const char* bytes, size_t len,
                            ByteOrder byte_order) {
   version_ = 0;
@@ -65,6 +75,7 @@ void ByteBuffer::Construct(const char* bytes, size_t len,
   size_ = len;
   byte_order_ = byte_order;
   bytes_ = new char[size_];
+  owned_ = true;
 
   if (bytes) {
     end_ = len;
@@ -75,7 +86,8 @@ void ByteBuffer::Construct(const char* bytes, size_t len,
 }
 
 ByteBuffer::~ByteBuffer() {
-  delete[] bytes_;
+  if (owned_)
+    delete[] bytes_;
 }
 
 bool ByteBuffer::ReadUInt8(uint8* val) {
@@ -195,6 +207,15 @@ void ByteBuffer::WriteBytes(const char* val, size_t len) {
   memcpy(ReserveWriteBuffer(len), val, len);
 }
 
+bool ByteBuffer::WriteUInt16At(size_t pos, uint16 val) {
+  if (pos + 2 > Length())
+    return false;
+
+  uint16 v = (byte_order_ == ORDER_NETWORK) ? HostToNetwork16(val) : val;
+  memcpy(bytes_ + start_ + pos, &v, 2);
+  return true;
+}
+
 char* ByteBuffer::ReserveWriteBuffer(size_t len) {
   if (Length() + len > Capacity())
     Resize(Length() + len);
@@ -214,8 +235,10 @@ void ByteBuffer::Resize(size_t size) {
     size_ = _max(size, 3 * size_ / 2);
     char* new_bytes = new char[size_];
     memcpy(new_bytes, bytes_ + start_, len);
-    delete [] bytes_;
+    if (owned_)
+      delete [] bytes_;
     bytes_ = new_bytes;
+    owned_ = true;
   }
   start_ = 0;
   end_ = len;
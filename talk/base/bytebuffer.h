@@ -52,6 +52,11 @@ class ByteBuffer {
   // Initializes buffer from a zero-terminated string.
   explicit ByteBuffer(const char* bytes);
 
+  // Writes into |storage| in place instead of allocating. The caller owns
+  // |storage|, which must outlive the buffer. A write that would not fit in
+  // |capacity| bytes moves the contents to the heap as usual.
+  ByteBuffer(ByteOrder byte_order, char* storage, size_t capacity);
+
   ~ByteBuffer();
 
   const char* Data() const { return bytes_ + start_; }
@@ -82,6 +87,11 @@ class ByteBuffer {
   void WriteString(const std::string& val);
   void WriteBytes(const char* val, size_t len);
 
+  // Overwrites two bytes that were already written, |pos| bytes past Data().
+  // Useful for patching a length field once the rest is known. Returns false
+  // if the bytes are not in the buffer.
+  bool WriteUInt16At(size_t pos, uint16 val);
+
   // Reserves the given number of bytes and returns a char* that can be written
   // into. Useful for functions that require a char* buffer and not a
   // ByteBuffer.
@@ -120,6 +130,7 @@ class ByteBuffer {
   void Construct(const char* bytes, size_t size, ByteOrder byte_order);
 
   char* bytes_;
+  bool owned_;
   size_t size_;
   size_t start_;
   size_t end_;
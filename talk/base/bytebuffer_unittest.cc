@@ -225,4 +225,51 @@ TEST(ByteBufferTest, TestReadWriteBuffer) {
   }
 }
 
+TEST(ByteBufferTest, TestWriteIntoStorage) {
+  char storage[8];
+  ByteBuffer buffer(ByteBuffer::ORDER_NETWORK, storage, sizeof(storage));
+  EXPECT_EQ(0U, buffer.Length());
+  EXPECT_EQ(sizeof(storage), buffer.Capacity());
+
+  buffer.WriteUInt16(0x0102);
+  buffer.WriteUInt32(0x03040506);
+  EXPECT_EQ(storage, buffer.Data());
+  EXPECT_EQ(6U, buffer.Length());
+  EXPECT_EQ(0x0102, GetBE16(storage));
+  EXPECT_EQ(0x03040506U, GetBE32(storage + 2));
+
+  // Consumed bytes are moved out of the way before falling back to the heap.
+  uint16 val;
+  EXPECT_TRUE(buffer.ReadUInt16(&val));
+  buffer.WriteUInt32(0x0708090a);
+  EXPECT_EQ(storage, buffer.Data());
+  EXPECT_EQ(8U, buffer.Length());
+
+  // Writing past the end of the storage moves everything to the heap.
+  buffer.WriteUInt8(0x0b);
+  EXPECT_NE(storage, buffer.Data());
+  EXPECT_EQ(9U, buffer.Length());
+  EXPECT_EQ(0x03040506U, GetBE32(buffer.Data()));
+  EXPECT_EQ(0x0708090aU, GetBE32(buffer.Data() + 4));
+  EXPECT_EQ(0x0b, buffer.Data()[8]);
+}
+
+TEST(ByteBufferTest, TestWriteUInt16At) {
+  ByteBuffer::ByteOrder orders[2] = { ByteBuffer::ORDER_HOST,
+                                      ByteBuffer::ORDER_NETWORK };
+  for (size_t i = 0; i < ARRAY_SIZE(orders); i++) {
+    ByteBuffer buffer(orders[i]);
+    buffer.WriteUInt16(1);
+    buffer.WriteUInt16(2);
+    EXPECT_TRUE(buffer.WriteUInt16At(2, 0x0304));
+    EXPECT_FALSE(buffer.WriteUInt16At(3, 5));
+    uint16 val;
+    EXPECT_TRUE(buffer.ReadUInt16(&val));
+    EXPECT_EQ(1, val);
+    EXPECT_TRUE(buffer.ReadUInt16(&val));
+    EXPECT_EQ(0x0304, val);
+    EXPECT_FALSE(buffer.WriteUInt16At(0, 5));
+  }
+}
+
 }  // namespace talk_base
@@ -36,8 +36,16 @@ namespace talk_base {
 
 // Updates a CRC32 checksum with |len| bytes from |buf|. |initial| holds the
 // checksum result from the previous update; for the first call, it should be 0.
+// Uses carry-less multiplication (PCLMULQDQ) for long inputs, if the CPU has
+// it, and otherwise a table-driven loop that handles 8 bytes per step.
 uint32 UpdateCrc32(uint32 initial, const void* buf, size_t len);
 
+// The implementations UpdateCrc32 chooses from, exposed for testing.
+// UpdateCrc32Clmul may only be called if HasCrc32Clmul returns true.
+bool HasCrc32Clmul();
+uint32 UpdateCrc32SliceBy8(uint32 initial, const void* buf, size_t len);
+uint32 UpdateCrc32Clmul(uint32 initial, const void* buf, size_t len);
+
 // Computes a CRC32 checksum using |len| bytes from |buf|.
 inline uint32 ComputeCrc32(const void* buf, size_t len) {
   return UpdateCrc32(0, buf, len);
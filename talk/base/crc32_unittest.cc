@@ -27,8 +27,12 @@
 
 #include "talk/base/crc32.h"
 #include "talk/base/gunit.h"
+#include "talk/base/logging.h"
+#include "talk/base/stringencode.h"
+#include "talk/base/timeutils.h"
 
 #include <string>
+#include <vector>
 
 namespace talk_base {
 
@@ -49,4 +53,72 @@ TEST(Crc32Test, TestMultipleUpdates) {
   EXPECT_EQ(0x171A3F5FU, c);
 }
 
+// Bit-at-a-time CRC32, to check the faster implementations against.
+static uint32 ReferenceCrc32(uint32 start, const uint8* buf, size_t len) {
+  uint32 c = start ^ 0xFFFFFFFF;
+  for (size_t i = 0; i < len; ++i) {
+    c ^= buf[i];
+    for (int j = 0; j < 8; ++j) {
+      c = (c >> 1) ^ (0xEDB88320 & (0 - (c & 1)));
+    }
+  }
+  return c ^ 0xFFFFFFFF;
+}
+
+// Checks every length up to a few folding blocks, at several alignments.
+TEST(Crc32Test, TestImplementationsAgree) {
+  std::vector<uint8> data(1024);
+  uint32 seed = 1;
+  for (size_t i = 0; i < data.size(); ++i) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = static_cast<uint8>(seed >> 16);
+  }
+  for (size_t offset = 0; offset < 4; ++offset) {
+    for (size_t len = 0; len <= 300; ++len) {
+      const uint8* buf = &data[offset];
+      uint32 expected = ReferenceCrc32(0x12345678, buf, len);
+      EXPECT_EQ(expected, UpdateCrc32(0x12345678, buf, len)) << len;
+      EXPECT_EQ(expected, UpdateCrc32SliceBy8(0x12345678, buf, len)) << len;
+      if (HasCrc32Clmul()) {
+        EXPECT_EQ(expected, UpdateCrc32Clmul(0x12345678, buf, len)) << len;
+      }
+    }
+  }
+  EXPECT_EQ(ReferenceCrc32(0, &data[0], data.size()),
+            ComputeCrc32(&data[0], data.size()));
+}
+
+// Reports the throughput of each implementation for a STUN-sized message, a
+// full-sized packet, and a large buffer.
+TEST(Crc32Test, ThroughputPerf) {
+  static const size_t kSizes[] = { 100, 1200, 65536 };
+  static const size_t kTotalBytes = 64 * 1024 * 1024;
+  std::vector<uint8> data(kSizes[ARRAY_SIZE(kSizes) - 1], 0x5A);
+  for (size_t i = 0; i < ARRAY_SIZE(kSizes); ++i) {
+    size_t size = kSizes[i];
+    size_t iterations = kTotalBytes / size;
+    uint32 c = 0;
+    uint32 start = Time();
+    for (size_t j = 0; j < iterations; ++j) {
+      c = UpdateCrc32SliceBy8(c, &data[0], size);
+    }
+    uint32 slice_ms = TimeSince(start);
+    uint32 clmul_ms = 0;
+    if (HasCrc32Clmul()) {
+      start = Time();
+      for (size_t j = 0; j < iterations; ++j) {
+        c = UpdateCrc32Clmul(c, &data[0], size);
+      }
+      clmul_ms = TimeSince(start);
+    }
+    std::string clmul_time = "n/a";
+    if (HasCrc32Clmul()) {
+      clmul_time = ToString(clmul_ms) + " ms";
+    }
+    LOG(LS_INFO) << "CRC32 of " << size << " bytes, " << iterations
+                 << " times: slicing-by-8 " << slice_ms << " ms, clmul "
+                 << clmul_time << " (crc " << c << ")";
+  }
+}
+
 }  // namespace talk_base
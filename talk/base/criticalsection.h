@@ -181,6 +181,29 @@ class AtomicOps {
   static int Decrement(int* i) {
     return ::InterlockedDecrement(reinterpret_cast<LONG*>(i));
   }
+  // Stores |new_value| in |*ptr| if it currently holds |old_value|. Returns
+  // the previous value of |*ptr|; the swap happened if that is |old_value|.
+  // Acts as a full memory barrier.
+  template <class T>
+  static T* CompareAndSwapPtr(T* volatile* ptr, T* old_value, T* new_value) {
+    return static_cast<T*>(::InterlockedCompareExchangePointer(
+        reinterpret_cast<PVOID volatile*>(ptr), new_value, old_value));
+  }
+  static int CompareAndSwap(volatile int* i, int old_value, int new_value) {
+    return ::InterlockedCompareExchange(reinterpret_cast<volatile LONG*>(i),
+                                        new_value, old_value);
+  }
+  // Loads and stores that order the memory accesses around them, for
+  // handing data from one thread to another through an index.
+  static int AcquireLoad(volatile const int* i) {
+    int value = *i;
+    ::MemoryBarrier();
+    return value;
+  }
+  static void ReleaseStore(volatile int* i, int value) {
+    ::MemoryBarrier();
+    *i = value;
+  }
 #else
   static int Increment(int* i) {
     return __sync_add_and_fetch(i, 1);
@@ -188,6 +211,22 @@ class AtomicOps {
   static int Decrement(int* i) {
     return __sync_sub_and_fetch(i, 1);
   }
+  template <class T>
+  static T* CompareAndSwapPtr(T* volatile* ptr, T* old_value, T* new_value) {
+    return __sync_val_compare_and_swap(ptr, old_value, new_value);
+  }
+  static int CompareAndSwap(volatile int* i, int old_value, int new_value) {
+    return __sync_val_compare_and_swap(i, old_value, new_value);
+  }
+  static int AcquireLoad(volatile const int* i) {
+    int value = *i;
+    __sync_synchronize();
+    return value;
+  }
+  static void ReleaseStore(volatile int* i, int value) {
+    __sync_synchronize();
+    *i = value;
+  }
 #endif
 };
 
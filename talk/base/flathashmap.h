@@ -0,0 +1,243 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef TALK_BASE_FLATHASHMAP_H_
+#define TALK_BASE_FLATHASHMAP_H_
+
+#include <vector>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/common.h"
+
+namespace talk_base {
+
+// Default hasher for FlatHashMap; works for integers and pointers.  Other key
+// types supply a functor returning a size_t, e.g. one that forwards to
+// SocketAddress::Hash() or HashIP().  The hash does not need to be well
+// mixed, FlatHashMap scrambles it before use.
+template <class K>
+struct FlatHash {
+  size_t operator()(const K& key) const { return static_cast<size_t>(key); }
+};
+
+template <class K>
+struct FlatHash<K*> {
+  size_t operator()(K* key) const { return reinterpret_cast<size_t>(key); }
+};
+
+// A hash table for small, copyable keys and values (ints, addresses,
+// pointers) on hot paths that currently walk a std::list or std::map.
+// Entries live in a single array with open addressing and linear probing, so
+// a lookup is usually one cache line and inserting or erasing does not touch
+// the heap unless the table grows.  Erase shifts the following entries back
+// instead of leaving tombstones, so lookups do not degrade over time.
+//
+// K and V must be default constructible and assignable.  Find() returns a
+// pointer into the table which is invalidated by the next Insert or Erase;
+// likewise iterators are invalidated by any modification.
+template <class K, class V, class Hasher = FlatHash<K> >
+class FlatHashMap {
+ private:
+  struct Slot {
+    Slot() : key(), value(), used(false) {}
+    K key;
+    V value;
+    bool used;
+  };
+
+ public:
+  class iterator {
+   public:
+    iterator() : map_(NULL), index_(0) {}
+    const K& key() const { return map_->slots_[index_].key; }
+    V& value() const { return map_->slots_[index_].value; }
+    iterator& operator++() {
+      index_ = map_->NextUsed(index_ + 1);
+      return *this;
+    }
+    bool operator==(const iterator& o) const { return index_ == o.index_; }
+    bool operator!=(const iterator& o) const { return index_ != o.index_; }
+
+   private:
+    friend class FlatHashMap;
+    iterator(FlatHashMap* map, size_t index) : map_(map), index_(index) {}
+    FlatHashMap* map_;
+    size_t index_;
+  };
+
+  class const_iterator {
+   public:
+    const_iterator() : map_(NULL), index_(0) {}
+    const K& key() const { return map_->slots_[index_].key; }
+    const V& value() const { return map_->slots_[index_].value; }
+    const_iterator& operator++() {
+      index_ = map_->NextUsed(index_ + 1);
+      return *this;
+    }
+    bool operator==(const const_iterator& o) const {
+      return index_ == o.index_;
+    }
+    bool operator!=(const const_iterator& o) const {
+      return index_ != o.index_;
+    }
+
+   private:
+    friend class FlatHashMap;
+    const_iterator(const FlatHashMap* map, size_t index)
+        : map_(map), index_(index) {}
+    const FlatHashMap* map_;
+    size_t index_;
+  };
+
+  explicit FlatHashMap(const Hasher& hasher = Hasher())
+      : hasher_(hasher), size_(0), shift_(0) {
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  iterator begin() { return iterator(this, NextUsed(0)); }
+  iterator end() { return iterator(this, slots_.size()); }
+  const_iterator begin() const { return const_iterator(this, NextUsed(0)); }
+  const_iterator end() const { return const_iterator(this, slots_.size()); }
+
+  // Returns the value stored for |key|, or NULL.
+  V* Find(const K& key) {
+    size_t i;
+    return Lookup(key, &i) ? &slots_[i].value : NULL;
+  }
+  const V* Find(const K& key) const {
+    size_t i;
+    return Lookup(key, &i) ? &slots_[i].value : NULL;
+  }
+
+  // Adds |key| -> |value|.  Returns false and leaves the table unchanged if
+  // |key| is already present.
+  bool Insert(const K& key, const V& value) {
+    size_t i;
+    if (Lookup(key, &i))
+      return false;
+    if ((size_ + 1) * 2 > slots_.size()) {
+      Grow();
+      Lookup(key, &i);
+    }
+    slots_[i].key = key;
+    slots_[i].value = value;
+    slots_[i].used = true;
+    ++size_;
+    return true;
+  }
+
+  // Removes |key|.  Returns false if it was not present.
+  bool Erase(const K& key) {
+    size_t i;
+    if (!Lookup(key, &i))
+      return false;
+    const size_t mask = slots_.size() - 1;
+    // Shift back every following entry of the probe run that would still be
+    // reachable from its home slot once it sits in the hole.
+    for (size_t j = (i + 1) & mask; slots_[j].used; j = (j + 1) & mask) {
+      size_t home = Home(slots_[j].key);
+      if (((j - home) & mask) >= ((j - i) & mask)) {
+        slots_[i] = slots_[j];
+        i = j;
+      }
+    }
+    slots_[i] = Slot();
+    --size_;
+    return true;
+  }
+
+  void Clear() {
+    slots_.clear();
+    size_ = 0;
+    shift_ = 0;
+  }
+
+ private:
+  static const size_t kMinCapacity = 8;
+
+  size_t Home(const K& key) const {
+    // Fibonacci hashing: the top bits of the product depend on every bit of
+    // the hash, which keeps sequential keys (channel numbers) spread out.
+    uint64 h = static_cast<uint64>(hasher_(key)) * UINT64_C(0x9E3779B97F4A7C15);
+    return static_cast<size_t>(h >> shift_);
+  }
+
+  // Finds |key|, setting |index| to its slot; otherwise sets |index| to the
+  // empty slot where it would go.  The table must not be full.
+  bool Lookup(const K& key, size_t* index) const {
+    if (slots_.empty()) {
+      *index = 0;
+      return false;
+    }
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = Home(key); ; i = (i + 1) & mask) {
+      if (!slots_[i].used) {
+        *index = i;
+        return false;
+      }
+      if (slots_[i].key == key) {
+        *index = i;
+        return true;
+      }
+    }
+  }
+
+  size_t NextUsed(size_t i) const {
+    while (i < slots_.size() && !slots_[i].used)
+      ++i;
+    return i;
+  }
+
+  void Grow() {
+    size_t capacity = kMinCapacity;
+    if (!slots_.empty())
+      capacity = slots_.size() * 2;
+    int bits = 0;
+    while ((static_cast<size_t>(1) << bits) < capacity)
+      ++bits;
+    std::vector<Slot> old(capacity);
+    old.swap(slots_);
+    shift_ = 64 - bits;
+    size_ = 0;
+    for (size_t i = 0; i < old.size(); ++i) {
+      if (old[i].used)
+        Insert(old[i].key, old[i].value);
+    }
+  }
+
+  Hasher hasher_;
+  std::vector<Slot> slots_;
+  size_t size_;
+  int shift_;
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_FLATHASHMAP_H_
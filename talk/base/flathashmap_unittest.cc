@@ -0,0 +1,165 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <map>
+
+#include "talk/base/flathashmap.h"
+#include "talk/base/gunit.h"
+#include "talk/base/socketaddress.h"
+
+namespace talk_base {
+
+namespace {
+
+// Puts every key in the same probe run, so Erase has to shift entries back.
+struct CollidingHash {
+  size_t operator()(int key) const { return 0; }
+};
+
+// Minimal linear congruential generator so the test is deterministic.
+class Lcg {
+ public:
+  Lcg() : state_(12345) {}
+  uint32 Next() {
+    state_ = state_ * 1103515245 + 12345;
+    return state_ >> 8;
+  }
+
+ private:
+  uint32 state_;
+};
+
+}  // namespace
+
+TEST(FlatHashMapTest, InsertFindErase) {
+  FlatHashMap<int, int> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.Find(1) == NULL);
+  EXPECT_FALSE(map.Erase(1));
+
+  EXPECT_TRUE(map.Insert(1, 10));
+  EXPECT_TRUE(map.Insert(2, 20));
+  EXPECT_FALSE(map.Insert(1, 11));
+  EXPECT_EQ(2U, map.size());
+  ASSERT_TRUE(map.Find(1) != NULL);
+  EXPECT_EQ(10, *map.Find(1));
+  *map.Find(2) = 21;
+  EXPECT_EQ(21, *map.Find(2));
+
+  EXPECT_TRUE(map.Erase(1));
+  EXPECT_FALSE(map.Erase(1));
+  EXPECT_TRUE(map.Find(1) == NULL);
+  EXPECT_EQ(1U, map.size());
+
+  map.Clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.Find(2) == NULL);
+  EXPECT_TRUE(map.begin() == map.end());
+}
+
+TEST(FlatHashMapTest, Iterate) {
+  FlatHashMap<int, int> map;
+  for (int i = 0; i < 100; ++i)
+    map.Insert(i, i * 2);
+  int count = 0;
+  int key_sum = 0;
+  for (FlatHashMap<int, int>::iterator it = map.begin(); it != map.end();
+       ++it) {
+    EXPECT_EQ(it.key() * 2, it.value());
+    key_sum += it.key();
+    ++count;
+  }
+  EXPECT_EQ(100, count);
+  EXPECT_EQ(99 * 100 / 2, key_sum);
+
+  const FlatHashMap<int, int>& const_map = map;
+  count = 0;
+  for (FlatHashMap<int, int>::const_iterator it = const_map.begin();
+       it != const_map.end(); ++it) {
+    EXPECT_EQ(it.key() * 2, it.value());
+    ++count;
+  }
+  EXPECT_EQ(100, count);
+}
+
+TEST(FlatHashMapTest, EraseWithinProbeRun) {
+  FlatHashMap<int, int, CollidingHash> map;
+  for (int i = 0; i < 20; ++i)
+    EXPECT_TRUE(map.Insert(i, i));
+  for (int i = 0; i < 20; i += 2)
+    EXPECT_TRUE(map.Erase(i));
+  for (int i = 0; i < 20; ++i) {
+    if (i % 2) {
+      EXPECT_TRUE(map.Find(i) != NULL) << i;
+    } else {
+      EXPECT_TRUE(map.Find(i) == NULL) << i;
+    }
+  }
+  EXPECT_EQ(10U, map.size());
+}
+
+TEST(FlatHashMapTest, MatchesStdMap) {
+  FlatHashMap<uint32, uint32> map;
+  std::map<uint32, uint32> reference;
+  Lcg lcg;
+  for (int i = 0; i < 20000; ++i) {
+    uint32 key = lcg.Next() % 512;
+    switch (lcg.Next() % 3) {
+      case 0:
+        EXPECT_EQ(reference.insert(std::make_pair(key, i)).second,
+                  map.Insert(key, i));
+        break;
+      case 1:
+        EXPECT_EQ(reference.erase(key) != 0, map.Erase(key));
+        break;
+      default: {
+        std::map<uint32, uint32>::iterator it = reference.find(key);
+        const uint32* value = map.Find(key);
+        ASSERT_EQ(it != reference.end(), value != NULL);
+        if (value) {
+          EXPECT_EQ(it->second, *value);
+        }
+      }
+    }
+    ASSERT_EQ(reference.size(), map.size());
+  }
+}
+
+TEST(FlatHashMapTest, SocketAddressKeys) {
+  FlatHashMap<SocketAddress, int, SocketAddressHash> map;
+  for (int port = 1000; port < 1100; ++port)
+    EXPECT_TRUE(map.Insert(SocketAddress("192.168.1.1", port), port));
+  EXPECT_TRUE(map.Insert(SocketAddress("::1", 1000), -1));
+  EXPECT_EQ(101U, map.size());
+  ASSERT_TRUE(map.Find(SocketAddress("192.168.1.1", 1050)) != NULL);
+  EXPECT_EQ(1050, *map.Find(SocketAddress("192.168.1.1", 1050)));
+  EXPECT_TRUE(map.Find(SocketAddress("192.168.1.2", 1050)) == NULL);
+  EXPECT_EQ(-1, *map.Find(SocketAddress("::1", 1000)));
+}
+
+}  // namespace talk_base
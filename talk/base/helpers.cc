@@ -261,6 +261,16 @@ bool CreateRandomString(size_t len, const std::string& table,
                             static_cast<int>(table.size()), str);
 }
 
+bool CreateRandomData(size_t len, std::string* data) {
+  data->resize(len);
+  if (len && !Rng().Generate(&(*data)[0], len)) {
+    LOG(LS_ERROR) << "Failed to generate random data!";
+    data->clear();
+    return false;
+  }
+  return true;
+}
+
 uint32 CreateRandomId() {
   uint32 id;
   if (!Rng().Generate(&id, sizeof(id))) {
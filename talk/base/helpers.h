@@ -56,6 +56,10 @@ bool CreateRandomString(size_t length, std::string* str);
 bool CreateRandomString(size_t length, const std::string& table,
                         std::string* str);
 
+// Generates (cryptographically) random bytes, e.g. for key material.
+// Return false if the random number generator failed.
+bool CreateRandomData(size_t length, std::string* data);
+
 // Generates a random id.
 uint32 CreateRandomId();
 
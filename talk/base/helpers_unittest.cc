@@ -57,6 +57,15 @@ TEST(RandomTest, TestCreateRandomString) {
   EXPECT_EQ(256U, random2.size());
 }
 
+TEST(RandomTest, TestCreateRandomData) {
+  std::string random;
+  EXPECT_TRUE(CreateRandomData(44, &random));
+  EXPECT_EQ(44U, random.size());
+  std::string random2;
+  EXPECT_TRUE(CreateRandomData(44, &random2));
+  EXPECT_NE(random, random2);
+}
+
 TEST(RandomTest, TestCreateRandomForTest) {
   // Make sure we get the output we expect.
   SetRandomTestMode(true);
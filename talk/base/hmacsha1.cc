@@ -0,0 +1,102 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/base/hmacsha1.h"
+
+#include <string.h>
+
+namespace talk_base {
+
+static const size_t kBlockSize = 64;
+
+HmacSha1::HmacSha1() {
+  SetKey("", 0);
+}
+
+HmacSha1::HmacSha1(const void* key, size_t key_len) {
+  SetKey(key, key_len);
+}
+
+void HmacSha1::SetKey(const void* key, size_t key_len) {
+  key_.assign(static_cast<const char*>(key), key_len);
+  // If the key is longer than a block, hash it and use the result instead.
+  uint8 block[kBlockSize] = { 0 };
+  if (key_len > kBlockSize) {
+    SHA1Init(&ctx_);
+    SHA1Update(&ctx_, static_cast<const uint8*>(key), key_len);
+    SHA1Final(&ctx_, block);
+  } else if (key_len > 0) {
+    memcpy(block, key, key_len);
+  }
+  uint8 pad[kBlockSize];
+  for (size_t i = 0; i < kBlockSize; ++i) {
+    pad[i] = 0x36 ^ block[i];
+  }
+  SHA1Init(&inner_);
+  SHA1Update(&inner_, pad, kBlockSize);
+  for (size_t i = 0; i < kBlockSize; ++i) {
+    pad[i] = 0x5c ^ block[i];
+  }
+  SHA1Init(&outer_);
+  SHA1Update(&outer_, pad, kBlockSize);
+  ctx_ = inner_;
+}
+
+void HmacSha1::SetKey(const std::string& key) {
+  if (key != key_) {
+    SetKey(key.data(), key.size());
+  }
+}
+
+void HmacSha1::Update(const void* buf, size_t len) {
+  SHA1Update(&ctx_, static_cast<const uint8*>(buf), len);
+}
+
+size_t HmacSha1::Finish(void* buf, size_t len) {
+  if (len < kSize) {
+    return 0;
+  }
+  uint8 inner[kSize];
+  SHA1Final(&ctx_, inner);
+  ctx_ = outer_;
+  SHA1Update(&ctx_, inner, kSize);
+  SHA1Final(&ctx_, static_cast<uint8*>(buf));
+  ctx_ = inner_;  // Reset for next use.
+  return kSize;
+}
+
+size_t HmacSha1::Compute(const void* input, size_t in_len,
+                         void* output, size_t out_len) {
+  if (out_len < kSize) {
+    return 0;
+  }
+  ctx_ = inner_;
+  Update(input, in_len);
+  return Finish(output, out_len);
+}
+
+}  // namespace talk_base
@@ -0,0 +1,78 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_BASE_HMACSHA1_H_
+#define TALK_BASE_HMACSHA1_H_
+
+#include <string>
+
+#include "talk/base/messagedigest.h"
+#include "talk/base/sha1.h"
+
+namespace talk_base {
+
+// Computes RFC 2104 HMAC-SHA1s with a fixed key. The key is padded and hashed
+// into the inner and outer SHA-1 states once, in SetKey, so each HMAC then
+// costs only the hashing of the input, without any allocation. Keep one per
+// key that is used repeatedly, such as an ICE password.
+// As a MessageDigest, Update adds input and Finish outputs the HMAC, and then
+// resets for the next HMAC with the same key.
+class HmacSha1 : public MessageDigest {
+ public:
+  enum { kSize = SHA1_DIGEST_SIZE };
+
+  // Starts with an empty key.
+  HmacSha1();
+  HmacSha1(const void* key, size_t key_len);
+
+  void SetKey(const void* key, size_t key_len);
+  // Does nothing if |key| is already the key, so this can be called before
+  // every use with a key that rarely changes.
+  void SetKey(const std::string& key);
+  const std::string& key() const { return key_; }
+
+  virtual size_t Size() const {
+    return kSize;
+  }
+  virtual void Update(const void* buf, size_t len);
+  virtual size_t Finish(void* buf, size_t len);
+
+  // Computes the HMAC of |in_len| bytes of |input| into |output|. Returns the
+  // number of bytes written, or 0 if |out_len| is too small.
+  size_t Compute(const void* input, size_t in_len,
+                 void* output, size_t out_len);
+
+ private:
+  std::string key_;
+  SHA1_CTX inner_;  // After hashing the key XOR ipad.
+  SHA1_CTX outer_;  // After hashing the key XOR opad.
+  SHA1_CTX ctx_;    // The HMAC in progress.
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_HMACSHA1_H_
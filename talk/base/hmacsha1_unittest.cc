@@ -0,0 +1,127 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string>
+
+#include "talk/base/gunit.h"
+#include "talk/base/hmacsha1.h"
+#include "talk/base/logging.h"
+#include "talk/base/stringencode.h"
+#include "talk/base/timeutils.h"
+
+namespace talk_base {
+
+static std::string HexHmac(HmacSha1* hmac, const std::string& input) {
+  char output[HmacSha1::kSize];
+  EXPECT_EQ(sizeof(output), hmac->Compute(input.data(), input.size(),
+                                          output, sizeof(output)));
+  return hex_encode(output, sizeof(output));
+}
+
+static std::string HexHmac(const std::string& key, const std::string& input) {
+  HmacSha1 hmac(key.data(), key.size());
+  return HexHmac(&hmac, input);
+}
+
+// Test vectors from RFC 2202.
+TEST(HmacSha1Test, TestVectors) {
+  EXPECT_EQ("b617318655057264e28bc0b6fb378c8ef146be00",
+      HexHmac(std::string(20, '\x0b'), "Hi There"));
+  EXPECT_EQ("effcdf6ae5eb2fa2d27416d5f184df9c259a7c79",
+      HexHmac("Jefe", "what do ya want for nothing?"));
+  EXPECT_EQ("125d7342b9ac11cd91a39af48aa17b4f63f175d3",
+      HexHmac(std::string(20, '\xaa'), std::string(50, '\xdd')));
+  EXPECT_EQ("4c9007f4026250c6bc8414f9bf50c86c2d7235da",
+      HexHmac("\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+              "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19",
+              std::string(50, '\xcd')));
+  EXPECT_EQ("4c1a03424b55e07fe7f27be1d58bb9324a9a5a04",
+      HexHmac(std::string(20, '\x0c'), "Test With Truncation"));
+  EXPECT_EQ("aa4ae5e15272d00e95705637ce8a3b55ed402112",
+      HexHmac(std::string(80, '\xaa'),
+          "Test Using Larger Than Block-Size Key - Hash Key First"));
+  EXPECT_EQ("e8e99d0f45237d786d6bbaa7965c7808bbff1a91",
+      HexHmac(std::string(80, '\xaa'),
+          "Test Using Larger Than Block-Size Key and Larger "
+          "Than One Block-Size Data"));
+}
+
+// Checks that the context can be reused, fed piecewise, and rekeyed.
+TEST(HmacSha1Test, TestReuse) {
+  HmacSha1 hmac;
+  EXPECT_EQ("", hmac.key());
+  hmac.SetKey(std::string("Jefe"));
+  EXPECT_EQ("Jefe", hmac.key());
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ("effcdf6ae5eb2fa2d27416d5f184df9c259a7c79",
+        HexHmac(&hmac, "what do ya want for nothing?"));
+  }
+
+  char output[HmacSha1::kSize];
+  hmac.Update("what do ya ", 11);
+  hmac.Update("want for nothing?", 17);
+  EXPECT_EQ(0U, hmac.Finish(output, sizeof(output) - 1));
+  EXPECT_EQ(sizeof(output), hmac.Finish(output, sizeof(output)));
+  EXPECT_EQ("effcdf6ae5eb2fa2d27416d5f184df9c259a7c79",
+      hex_encode(output, sizeof(output)));
+
+  hmac.SetKey(std::string(20, '\x0b'));
+  EXPECT_EQ("b617318655057264e28bc0b6fb378c8ef146be00",
+      HexHmac(&hmac, "Hi There"));
+  EXPECT_EQ(HexHmac(&hmac, "abc"),
+      ComputeHmac(DIGEST_SHA_1, std::string(20, '\x0b'), "abc"));
+}
+
+// Compares a cached context with ComputeHmac, which sets up the key pads for
+// every call, on a message the size of an ICE connectivity check.
+TEST(HmacSha1Test, CachedKeyPerf) {
+  static const int kIterations = 100000;
+  const std::string key("4nVwOJ6xQZmXbAxXEmcdtGUu");  // An ICE password.
+  const std::string input(84, 'x');
+  char output[HmacSha1::kSize];
+
+  uint32 start = Time();
+  for (int i = 0; i < kIterations; ++i) {
+    ComputeHmac(DIGEST_SHA_1, key.data(), key.size(),
+                input.data(), input.size(), output, sizeof(output));
+  }
+  uint32 compute_ms = TimeSince(start);
+
+  HmacSha1 hmac;
+  start = Time();
+  for (int i = 0; i < kIterations; ++i) {
+    hmac.SetKey(key);
+    hmac.Compute(input.data(), input.size(), output, sizeof(output));
+  }
+  uint32 cached_ms = TimeSince(start);
+
+  LOG(LS_INFO) << kIterations << " HMAC-SHA1s of " << input.size()
+               << " bytes: ComputeHmac " << compute_ms << " ms, HmacSha1 "
+               << cached_ms << " ms";
+}
+
+}  // namespace talk_base
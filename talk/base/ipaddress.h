@@ -133,6 +133,11 @@ bool IPIsPrivate(const IPAddress& ip);
 bool IPIsUnspec(const IPAddress& ip);
 size_t HashIP(const IPAddress& ip);
 
+// Hash functor for keying hash tables (e.g. FlatHashMap) by IPAddress.
+struct IPAddressHash {
+  size_t operator()(const IPAddress& ip) const { return HashIP(ip); }
+};
+
 // These are only really applicable for IPv6 addresses.
 bool IPIs6Bone(const IPAddress& ip);
 bool IPIs6To4(const IPAddress& ip);
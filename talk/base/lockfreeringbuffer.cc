@@ -0,0 +1,119 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/base/lockfreeringbuffer.h"
+
+#include <string.h>
+
+#include "talk/base/common.h"
+#include "talk/base/criticalsection.h"
+
+namespace talk_base {
+
+LockFreeRingBuffer::LockFreeRingBuffer(size_t capacity)
+    : buffer_(new char[capacity]), capacity_(capacity), write_(0), read_(0) {
+  ASSERT(capacity > 0 && (capacity & (capacity - 1)) == 0);
+}
+
+LockFreeRingBuffer::~LockFreeRingBuffer() {
+}
+
+size_t LockFreeRingBuffer::ReadAvailable() const {
+  uint32 write = static_cast<uint32>(AtomicOps::AcquireLoad(&write_));
+  uint32 read = static_cast<uint32>(AtomicOps::AcquireLoad(&read_));
+  return write - read;
+}
+
+size_t LockFreeRingBuffer::WriteRemaining() const {
+  return capacity_ - ReadAvailable();
+}
+
+size_t LockFreeRingBuffer::Write(const void* data, size_t len) {
+  const char* src = static_cast<const char*>(data);
+  size_t written = 0;
+  while (written < len) {
+    size_t space;
+    char* dst = static_cast<char*>(GetWriteBuffer(&space));
+    if (space == 0) {
+      break;
+    }
+    size_t chunk = _min(space, len - written);
+    memcpy(dst, src + written, chunk);
+    ConsumeWriteBuffer(chunk);
+    written += chunk;
+  }
+  return written;
+}
+
+void* LockFreeRingBuffer::GetWriteBuffer(size_t* len) {
+  uint32 write = static_cast<uint32>(write_);
+  uint32 read = static_cast<uint32>(AtomicOps::AcquireLoad(&read_));
+  size_t offset = write & (capacity_ - 1);
+  *len = _min(capacity_ - (write - read), capacity_ - offset);
+  return buffer_.get() + offset;
+}
+
+void LockFreeRingBuffer::ConsumeWriteBuffer(size_t len) {
+  uint32 write = static_cast<uint32>(write_);
+  ASSERT(len <= WriteRemaining());
+  // Publishes the bytes written before this call to the consumer.
+  AtomicOps::ReleaseStore(&write_, static_cast<int>(write + len));
+}
+
+size_t LockFreeRingBuffer::Read(void* buffer, size_t len) {
+  char* dst = static_cast<char*>(buffer);
+  size_t read = 0;
+  while (read < len) {
+    size_t available;
+    const char* src = static_cast<const char*>(GetReadData(&available));
+    if (available == 0) {
+      break;
+    }
+    size_t chunk = _min(available, len - read);
+    memcpy(dst + read, src, chunk);
+    ConsumeReadData(chunk);
+    read += chunk;
+  }
+  return read;
+}
+
+const void* LockFreeRingBuffer::GetReadData(size_t* len) {
+  uint32 read = static_cast<uint32>(read_);
+  uint32 write = static_cast<uint32>(AtomicOps::AcquireLoad(&write_));
+  size_t offset = read & (capacity_ - 1);
+  *len = _min<size_t>(write - read, capacity_ - offset);
+  return buffer_.get() + offset;
+}
+
+void LockFreeRingBuffer::ConsumeReadData(size_t len) {
+  uint32 read = static_cast<uint32>(read_);
+  ASSERT(len <= ReadAvailable());
+  // Hands the space back only once the bytes have been copied out.
+  AtomicOps::ReleaseStore(&read_, static_cast<int>(read + len));
+}
+
+}  // namespace talk_base
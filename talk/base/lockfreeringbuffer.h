@@ -0,0 +1,104 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_BASE_LOCKFREERINGBUFFER_H_
+#define TALK_BASE_LOCKFREERINGBUFFER_H_
+
+#include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+#include "talk/base/criticalsection.h"
+#include "talk/base/scoped_ptr.h"
+
+namespace talk_base {
+
+// A fixed-size byte ring for handing a stream from one thread to another
+// without a lock.  One thread may call the producer methods (Write,
+// GetWriteBuffer, ConsumeWriteBuffer) while another calls the consumer
+// methods (Read, GetReadData, ConsumeReadData); the available/remaining
+// counts may be read from either side.  The positions only ever grow and are
+// reduced modulo the capacity, which must be a power of two.
+class LockFreeRingBuffer {
+ public:
+  explicit LockFreeRingBuffer(size_t capacity);
+  ~LockFreeRingBuffer();
+
+  size_t capacity() const { return capacity_; }
+  // Bytes waiting to be read.
+  size_t ReadAvailable() const;
+  // Bytes that can be written before the ring is full.
+  size_t WriteRemaining() const;
+
+  // Producer side.  Write copies up to |len| bytes in and returns how many
+  // fit.  GetWriteBuffer returns the contiguous free space, up to the end of
+  // the storage, for the caller to fill before ConsumeWriteBuffer.
+  size_t Write(const void* data, size_t len);
+  void* GetWriteBuffer(size_t* len);
+  void ConsumeWriteBuffer(size_t len);
+
+  // Consumer side.  Read copies up to |len| bytes out and returns how many
+  // there were.  GetReadData returns the contiguous readable bytes, up to the
+  // end of the storage, which stay valid until ConsumeReadData.
+  size_t Read(void* buffer, size_t len);
+  const void* GetReadData(size_t* len);
+  void ConsumeReadData(size_t len);
+
+ private:
+  scoped_array<char> buffer_;
+  size_t capacity_;
+  // Written only by the producer and the consumer respectively.
+  volatile int write_;
+  volatile int read_;
+
+  DISALLOW_COPY_AND_ASSIGN(LockFreeRingBuffer);
+};
+
+// Lets the producer of a queue such as LockFreeRingBuffer wake its consumer
+// with one posted message per batch, rather than one per item.  After
+// queueing, the producer calls Request and posts only if it returns true.
+// The consumer calls Clear when the message arrives, before it reads the
+// queue: whatever was queued before that is read now, and whatever is queued
+// after it posts a new message, so nothing is left waiting without one.
+class PostOnce {
+ public:
+  PostOnce() : pending_(0) {}
+
+  // Returns true if no message was pending, in which case the caller must
+  // post one.
+  bool Request() { return AtomicOps::CompareAndSwap(&pending_, 0, 1) == 0; }
+  // Called by the consumer before it reads the queue, or by a producer that
+  // got true from Request but could not post after all.
+  void Clear() { AtomicOps::ReleaseStore(&pending_, 0); }
+
+ private:
+  volatile int pending_;
+
+  DISALLOW_COPY_AND_ASSIGN(PostOnce);
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_LOCKFREERINGBUFFER_H_
@@ -0,0 +1,150 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/base/gunit.h"
+#include "talk/base/lockfreeringbuffer.h"
+#include "talk/base/thread.h"
+
+namespace talk_base {
+
+TEST(LockFreeRingBufferTest, WriteAndRead) {
+  LockFreeRingBuffer ring(16);
+  char out[16];
+  EXPECT_EQ(16U, ring.capacity());
+  EXPECT_EQ(0U, ring.ReadAvailable());
+  EXPECT_EQ(16U, ring.WriteRemaining());
+  EXPECT_EQ(0U, ring.Read(out, sizeof(out)));
+
+  EXPECT_EQ(10U, ring.Write("0123456789", 10));
+  EXPECT_EQ(10U, ring.ReadAvailable());
+  EXPECT_EQ(6U, ring.WriteRemaining());
+  EXPECT_EQ(6U, ring.Write("abcdefghij", 10));
+  EXPECT_EQ(0U, ring.WriteRemaining());
+  EXPECT_EQ(0U, ring.Write("x", 1));
+
+  EXPECT_EQ(8U, ring.Read(out, 8));
+  EXPECT_EQ(0, memcmp(out, "01234567", 8));
+  // This write wraps around the end of the storage.
+  EXPECT_EQ(8U, ring.Write("ABCDEFGH", 8));
+  EXPECT_EQ(16U, ring.Read(out, sizeof(out)));
+  EXPECT_EQ(0, memcmp(out, "89abcdefABCDEFGH", 16));
+  EXPECT_EQ(0U, ring.ReadAvailable());
+}
+
+TEST(LockFreeRingBufferTest, ZeroCopyAccess) {
+  LockFreeRingBuffer ring(16);
+  size_t len;
+  char* dst = static_cast<char*>(ring.GetWriteBuffer(&len));
+  EXPECT_EQ(16U, len);
+  memcpy(dst, "0123456789ab", 12);
+  ring.ConsumeWriteBuffer(12);
+
+  const char* src = static_cast<const char*>(ring.GetReadData(&len));
+  EXPECT_EQ(12U, len);
+  EXPECT_EQ(0, memcmp(src, "0123456789ab", 12));
+  ring.ConsumeReadData(10);
+
+  // The free space wraps, so only the part before the end is contiguous.
+  ring.GetWriteBuffer(&len);
+  EXPECT_EQ(4U, len);
+  EXPECT_EQ(14U, ring.WriteRemaining());
+  EXPECT_EQ(6U, ring.Write("cdefgh", 6));
+  src = static_cast<const char*>(ring.GetReadData(&len));
+  EXPECT_EQ(6U, len);
+  EXPECT_EQ(0, memcmp(src, "abcdef", 6));
+  ring.ConsumeReadData(len);
+  src = static_cast<const char*>(ring.GetReadData(&len));
+  EXPECT_EQ(2U, len);
+  EXPECT_EQ(0, memcmp(src, "gh", 2));
+}
+
+// Writes a counting pattern into the ring from its own thread.
+class RingProducer : public Runnable {
+ public:
+  RingProducer(LockFreeRingBuffer* ring, size_t size)
+      : ring_(ring), size_(size) {}
+  virtual void Run(Thread* thread) {
+    char block[1000];
+    size_t sent = 0;
+    while (sent < size_) {
+      size_t len = _min(sizeof(block), size_ - sent);
+      for (size_t i = 0; i < len; ++i) {
+        block[i] = static_cast<char>(sent + i);
+      }
+      size_t written = 0;
+      while (written < len) {
+        size_t n = ring_->Write(block + written, len - written);
+        if (n == 0) {
+          Thread::SleepMs(0);  // Let the consumer run.
+        }
+        written += n;
+      }
+      sent += len;
+    }
+  }
+
+ private:
+  LockFreeRingBuffer* ring_;
+  size_t size_;
+};
+
+TEST(LockFreeRingBufferTest, TwoThreads) {
+  const size_t kSize = 1024 * 1024;
+  LockFreeRingBuffer ring(4096);
+  RingProducer producer(&ring, kSize);
+  Thread thread;
+  thread.Start(&producer);
+
+  char block[777];
+  size_t received = 0;
+  bool intact = true;
+  while (received < kSize && intact) {
+    size_t len = ring.Read(block, sizeof(block));
+    if (len == 0) {
+      Thread::SleepMs(0);  // Let the producer run.
+    }
+    for (size_t i = 0; i < len; ++i) {
+      intact &= (block[i] == static_cast<char>(received + i));
+    }
+    received += len;
+  }
+  thread.Stop();
+  EXPECT_TRUE(intact);
+  EXPECT_EQ(kSize, received);
+  EXPECT_EQ(0U, ring.ReadAvailable());
+}
+
+TEST(PostOnceTest, RequestUntilCleared) {
+  PostOnce post;
+  EXPECT_TRUE(post.Request());
+  EXPECT_FALSE(post.Request());
+  EXPECT_FALSE(post.Request());
+  post.Clear();
+  EXPECT_TRUE(post.Request());
+}
+
+}  // namespace talk_base
@@ -44,6 +44,9 @@ static const int kMaxLogLineSize = 1024 - 60;
 #endif  // OSX || ANDROID
 
 #include <time.h>
+#ifdef POSIX
+#include <pthread.h>
+#endif  // POSIX
 
 #include <ostream>
 #include <iomanip>
@@ -51,9 +54,12 @@ static const int kMaxLogLineSize = 1024 - 60;
 #include <vector>
 
 #include "talk/base/logging.h"
+#include "talk/base/event.h"
+#include "talk/base/lockfreeringbuffer.h"
 #include "talk/base/stream.h"
 #include "talk/base/stringencode.h"
 #include "talk/base/stringutils.h"
+#include "talk/base/thread.h"
 #include "talk/base/timeutils.h"
 
 namespace talk_base {
@@ -119,6 +125,158 @@ bool LogMessage::thread_, LogMessage::timestamp_;
 // If we're in diagnostic mode, we'll be explicitly set that way; default=false.
 bool LogMessage::is_diagnostic_mode_ = false;
 
+bool LogMessage::async_ = false;
+
+/////////////////////////////////////////////////////////////////////////////
+// Async logging
+/////////////////////////////////////////////////////////////////////////////
+
+// How long the writer thread waits to be woken before it drains the rings
+// anyway.
+static const int kLogWriterBackstopMs = 1000;
+
+struct LogRecordHeader {
+  uint32 size;
+  int severity;
+};
+
+// A single-producer, single-consumer queue of log records. The thread that
+// owns it pushes formatted messages, and whoever holds the drain lock pops
+// them. Each record is a LogRecordHeader followed by its text, and is written
+// to the byte ring in one piece so the consumer never sees half of one.
+class LogRing {
+ public:
+  static const uint32 kSize = 64 * 1024;
+
+  LogRing()
+      : next(NULL), in_use(1), reported_drops(0), ring_(kSize), drops_(0) {
+  }
+
+  bool Push(const std::string& msg, LoggingSeverity severity) {
+    LogRecordHeader header;
+    header.size = static_cast<uint32>(msg.size());
+    header.severity = severity;
+    size_t needed = sizeof(header) + header.size;
+    if (needed > ring_.WriteRemaining()) {
+      AtomicOps::Increment(&drops_);
+      return false;
+    }
+    record_.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    record_.append(msg);
+    ring_.Write(record_.data(), record_.size());
+    return true;
+  }
+
+  bool Pop(std::string* msg, LoggingSeverity* severity) {
+    if (ring_.ReadAvailable() == 0) {
+      return false;
+    }
+    LogRecordHeader header;
+    ring_.Read(&header, sizeof(header));
+    msg->resize(header.size);
+    if (header.size > 0) {
+      ring_.Read(&(*msg)[0], header.size);
+    }
+    *severity = static_cast<LoggingSeverity>(header.severity);
+    return true;
+  }
+
+  int drops() const { return AtomicOps::AcquireLoad(&drops_); }
+
+  // Rings are never freed; each is linked once onto the global list.
+  LogRing* next;
+  // Cleared when the owning thread exits, so another thread can take over.
+  int in_use;
+  // How many of |drops_| the drain side has reported.
+  int reported_drops;
+  // Wakes the writer thread for the first message after each drain.
+  PostOnce wakeup;
+
+ private:
+  LockFreeRingBuffer ring_;
+  // Producer-side scratch for assembling a record, kept to reuse its memory.
+  std::string record_;
+  int drops_;
+};
+
+// Drains the rings in the background while async logging is on.
+class LogWriter : public Runnable {
+ public:
+  virtual void Run(Thread* thread);
+};
+
+struct AsyncLogState {
+  AsyncLogState() : rings(NULL), wakeup_event(false, false),
+                    key_created(false) {}
+
+  // Lock-free list of every ring ever created; producers push at the head.
+  LogRing* volatile rings;
+  // Serializes the drain side, and turning async logging on and off.
+  CriticalSection drain_crit;
+  // Set when a ring asks for the writer thread.
+  Event wakeup_event;
+  scoped_ptr<Thread> writer_thread;
+  LogWriter writer;
+#ifdef WIN32
+  DWORD key;
+#else
+  pthread_key_t key;
+#endif
+  bool key_created;
+};
+
+static AsyncLogState& GetAsyncLogState() {
+  LIBJINGLE_DEFINE_STATIC_LOCAL(AsyncLogState, state, ());
+  return state;
+}
+
+void LogWriter::Run(Thread* thread) {
+  AsyncLogState& state = GetAsyncLogState();
+  while (!thread->IsQuitting()) {
+    LogMessage::FlushAsyncLogs();
+    state.wakeup_event.Wait(kLogWriterBackstopMs);
+  }
+}
+
+#ifdef POSIX
+static void ReleaseLogRing(void* ring) {
+  AtomicOps::ReleaseStore(&static_cast<LogRing*>(ring)->in_use, 0);
+}
+#endif
+
+// Returns the calling thread's ring, taking over one left by an exited
+// thread or creating a new one the first time the thread logs.
+static LogRing* CurrentLogRing() {
+  AsyncLogState& state = GetAsyncLogState();
+#ifdef WIN32
+  LogRing* ring = static_cast<LogRing*>(TlsGetValue(state.key));
+#else
+  LogRing* ring = static_cast<LogRing*>(pthread_getspecific(state.key));
+#endif
+  if (ring) {
+    return ring;
+  }
+  for (ring = state.rings; ring; ring = ring->next) {
+    if (AtomicOps::CompareAndSwap(&ring->in_use, 0, 1) == 0) {
+      break;
+    }
+  }
+  if (!ring) {
+    ring = new LogRing;
+    LogRing* head;
+    do {
+      head = state.rings;
+      ring->next = head;
+    } while (AtomicOps::CompareAndSwapPtr(&state.rings, head, ring) != head);
+  }
+#ifdef WIN32
+  TlsSetValue(state.key, ring);
+#else
+  pthread_setspecific(state.key, ring);
+#endif
+  return ring;
+}
+
 LogMessage::LogMessage(const char* file, int line, LoggingSeverity sev,
                        LogErrorContext err_ctx, int err, const char* module)
     : severity_(sev),
@@ -197,6 +355,14 @@ LogMessage::~LogMessage() {
   print_stream_ << std::endl;
 
   const std::string& str = print_stream_.str();
+  if (async_) {
+    LogRing* ring = CurrentLogRing();
+    if (ring->Push(str, severity_) && ring->wakeup.Request()) {
+      GetAsyncLogState().wakeup_event.Set();
+    }
+    return;
+  }
+
   if (severity_ >= dbg_sev_) {
     OutputToDebug(str, severity_);
   }
@@ -290,6 +456,68 @@ void LogMessage::RemoveLogToStream(StreamInterface* stream) {
   UpdateMinLogSeverity();
 }
 
+void LogMessage::SetAsyncLogging(bool enable) {
+  AsyncLogState& state = GetAsyncLogState();
+  scoped_ptr<Thread> writer_thread;
+  {
+    CritScope cs(&state.drain_crit);
+    if (enable == async_) {
+      return;
+    }
+    if (enable) {
+      if (!state.key_created) {
+#ifdef WIN32
+        state.key = TlsAlloc();
+#else
+        pthread_key_create(&state.key, &ReleaseLogRing);
+#endif
+        state.key_created = true;
+      }
+      state.writer_thread.reset(new Thread());
+      state.writer_thread->Start(&state.writer);
+      async_ = true;
+      return;
+    }
+    async_ = false;
+    writer_thread.reset(state.writer_thread.release());
+  }
+  // Stop the writer outside the lock, since it takes the lock to drain.
+  writer_thread->Quit();
+  state.wakeup_event.Set();
+  writer_thread.reset();
+  FlushAsyncLogs();
+}
+
+void LogMessage::FlushAsyncLogs() {
+  AsyncLogState& state = GetAsyncLogState();
+  CritScope cs(&state.drain_crit);
+  std::string msg;
+  LoggingSeverity severity;
+  for (LogRing* ring = state.rings; ring; ring = ring->next) {
+    // Cleared first, so messages pushed from here on wake the writer again.
+    ring->wakeup.Clear();
+    while (ring->Pop(&msg, &severity)) {
+      OutputQueuedMessage(msg, severity);
+    }
+    int drops = ring->drops();
+    if (drops != ring->reported_drops) {
+      std::ostringstream notice;
+      notice << "[" << (drops - ring->reported_drops)
+             << " log messages dropped]" << std::endl;
+      OutputQueuedMessage(notice.str(), LS_WARNING);
+      ring->reported_drops = drops;
+    }
+  }
+}
+
+size_t LogMessage::GetAsyncDropCount() {
+  size_t drops = 0;
+  for (LogRing* ring = GetAsyncLogState().rings; ring; ring = ring->next) {
+    drops += ring->drops();
+  }
+  return drops;
+}
+
 void LogMessage::ConfigureLogging(const char* params, const char* filename) {
   int current_level = LS_VERBOSE;
   int debug_level = GetLogToDebug();
@@ -509,6 +737,19 @@ void LogMessage::OutputToStream(StreamInterface* stream,
   stream->WriteAll(str.data(), str.size(), NULL, NULL);
 }
 
+void LogMessage::OutputQueuedMessage(const std::string& str,
+                                     LoggingSeverity severity) {
+  if (severity >= dbg_sev_) {
+    OutputToDebug(str, severity);
+  }
+  CritScope cs(&crit_);
+  for (StreamList::iterator it = streams_.begin(); it != streams_.end(); ++it) {
+    if (severity >= it->second) {
+      OutputToStream(it->first, str);
+    }
+  }
+}
+
 //////////////////////////////////////////////////////////////////////
 // Logging Helpers
 //////////////////////////////////////////////////////////////////////
@@ -178,6 +178,21 @@ class LogMessage {
   static void AddLogToStream(StreamInterface* stream, int min_sev);
   static void RemoveLogToStream(StreamInterface* stream);
 
+  //  Async: When enabled, each message is queued on a lock-free ring owned by
+  //   the thread that logged it, and a background thread writes it to the
+  //   debug output and the streams above, so a slow sink never stalls the
+  //   caller.  The first message queued after each pass wakes that thread,
+  //   which also passes over the rings once a second regardless.  Streams
+  //   are registered the same way either way.  A message that doesn't fit
+  //   in its thread's ring is dropped; GetAsyncDropCount reports how many
+  //   were, and the writer notes each gap in the log.
+  //   FlushAsyncLogs writes out everything queued so far, and turning async
+  //   logging off flushes as well.
+  static void SetAsyncLogging(bool enable);
+  static bool IsAsyncLogging() { return async_; }
+  static void FlushAsyncLogs();
+  static size_t GetAsyncDropCount();
+
   // Testing against MinLogSeverity allows code to avoid potentially expensive
   // logging operations by pre-checking the logging level.
   static int GetMinLogSeverity() { return min_sev_; }
@@ -206,6 +221,9 @@ class LogMessage {
   // These write out the actual log messages.
   static void OutputToDebug(const std::string& msg, LoggingSeverity severity_);
   static void OutputToStream(StreamInterface* stream, const std::string& msg);
+  // Writes a message taken off an async ring to the debug output and streams.
+  static void OutputQueuedMessage(const std::string& msg,
+                                  LoggingSeverity severity);
 
   // The ostream that buffers the formatted message before output
   std::ostringstream print_stream_;
@@ -240,6 +258,9 @@ class LogMessage {
   // are we in diagnostic mode (as defined by the app)?
   static bool is_diagnostic_mode_;
 
+  // Whether messages go through the async rings.
+  static bool async_;
+
   DISALLOW_EVIL_CONSTRUCTORS(LogMessage);
 };
 
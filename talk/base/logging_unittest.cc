@@ -25,6 +25,10 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <sstream>
+#include <vector>
+
+#include "talk/base/event.h"
 #include "talk/base/fileutils.h"
 #include "talk/base/gunit.h"
 #include "talk/base/logging.h"
@@ -115,6 +119,150 @@ TEST(LogTest, MultipleThreads) {
 }
 
 
+// Same as SingleStream, but through the async writer.
+TEST(LogTest, AsyncSingleStream) {
+  int sev = LogMessage::GetLogToStream(NULL);
+
+  std::string str;
+  StringStream stream(str);
+  LogMessage::SetAsyncLogging(true);
+  LogMessage::AddLogToStream(&stream, LS_INFO);
+
+  LOG(LS_INFO) << "INFO";
+  LOG(LS_VERBOSE) << "VERBOSE";
+  LogMessage::FlushAsyncLogs();
+  EXPECT_NE(std::string::npos, str.find("INFO"));
+  EXPECT_EQ(std::string::npos, str.find("VERBOSE"));
+
+  LogMessage::RemoveLogToStream(&stream);
+  LogMessage::SetAsyncLogging(false);
+  EXPECT_FALSE(LogMessage::IsAsyncLogging());
+  EXPECT_EQ(sev, LogMessage::GetLogToStream(NULL));
+}
+
+static const int kAsyncLogMessages = 500;
+
+class AsyncLogThread : public Thread {
+ public:
+  explicit AsyncLogThread(int id) : id_(id) {}
+  virtual ~AsyncLogThread() { Stop(); }
+
+  virtual void Run() {
+    for (int i = 0; i < kAsyncLogMessages; ++i) {
+      LOG(LS_SENSITIVE) << "async " << id_ << " " << i;
+    }
+  }
+
+ private:
+  int id_;
+};
+
+// Messages from several threads all come out, each thread's in order.
+TEST(LogTest, AsyncMultipleThreads) {
+  const int kThreads = 4;
+  std::string str;
+  StringStream stream(str);
+  size_t drops = LogMessage::GetAsyncDropCount();
+  LogMessage::SetAsyncLogging(true);
+  LogMessage::AddLogToStream(&stream, LS_SENSITIVE);
+
+  std::vector<AsyncLogThread*> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.push_back(new AsyncLogThread(i));
+    threads.back()->Start();
+  }
+  for (int i = 0; i < kThreads; ++i) {
+    delete threads[i];
+  }
+  LogMessage::SetAsyncLogging(false);
+  LogMessage::RemoveLogToStream(&stream);
+  EXPECT_EQ(drops, LogMessage::GetAsyncDropCount());
+
+  std::vector<int> next(kThreads, 0);
+  std::istringstream lines(str);
+  std::string line;
+  while (std::getline(lines, line)) {
+    size_t pos = line.find("async ");
+    if (pos == std::string::npos)
+      continue;
+    int id, i;
+    std::istringstream fields(line.substr(pos + 6));
+    fields >> id >> i;
+    ASSERT_TRUE(id >= 0 && id < kThreads);
+    EXPECT_EQ(next[id], i);
+    next[id] = i + 1;
+  }
+  for (int i = 0; i < kThreads; ++i) {
+    EXPECT_EQ(kAsyncLogMessages, next[i]);
+  }
+}
+
+// A stream whose first write blocks until released.
+class BlockingStream : public StringStream {
+ public:
+  explicit BlockingStream(std::string& str)
+      : StringStream(str), entered_(false, false), release_(false, false),
+        blocked_(false) {
+  }
+
+  virtual StreamResult Write(const void* data, size_t data_len,
+                             size_t* written, int* error) {
+    if (!blocked_) {
+      blocked_ = true;
+      entered_.Set();
+      release_.Wait(kForever);
+    }
+    return StringStream::Write(data, data_len, written, error);
+  }
+
+  Event entered_;
+  Event release_;
+
+ private:
+  bool blocked_;
+};
+
+// While the writer is stuck in a slow stream, the logging thread keeps going
+// and drops what doesn't fit in its ring, and the gap shows up in the log.
+TEST(LogTest, AsyncOverflowIsCounted) {
+  std::string str;
+  BlockingStream stream(str);
+  size_t drops = LogMessage::GetAsyncDropCount();
+  LogMessage::SetAsyncLogging(true);
+  LogMessage::AddLogToStream(&stream, LS_SENSITIVE);
+
+  LOG(LS_SENSITIVE) << "first";
+  EXPECT_TRUE(stream.entered_.Wait(10000));
+  std::string message(200, 'X');
+  for (int i = 0; i < 1000; ++i) {
+    LOG(LS_SENSITIVE) << message;
+  }
+  EXPECT_LT(drops, LogMessage::GetAsyncDropCount());
+  stream.release_.Set();
+
+  LogMessage::SetAsyncLogging(false);
+  LogMessage::RemoveLogToStream(&stream);
+  EXPECT_NE(std::string::npos, str.find("log messages dropped]"));
+}
+
+// A message logged while the writer is idle wakes it, well before its
+// once-a-second pass.
+TEST(LogTest, AsyncMessageWakesWriter) {
+  std::string str;
+  BlockingStream stream(str);
+  stream.release_.Set();
+  LogMessage::SetAsyncLogging(true);
+  LogMessage::AddLogToStream(&stream, LS_SENSITIVE);
+  Thread::SleepMs(50);  // Let the writer find the rings empty.
+
+  LOG(LS_SENSITIVE) << "wake";
+  EXPECT_TRUE(stream.entered_.Wait(500));
+
+  LogMessage::SetAsyncLogging(false);
+  LogMessage::RemoveLogToStream(&stream);
+  EXPECT_NE(std::string::npos, str.find("wake"));
+}
+
 TEST(LogTest, WallClockStartTime) {
   uint32 time = LogMessage::WallClockStartTime();
   // Expect the time to be in a sensible range, e.g. > 2012-01-01.
@@ -146,4 +294,48 @@ TEST(LogTest, Perf) {
   LOG(LS_INFO) << "Average log time: " << TimeDiff(finish, start) << " us";
 }
 
+// Writes batches of 80-character logs to an unbuffered file, first directly
+// and then through the async writer, and compares the time spent on the
+// logging thread. Each async batch fits in the ring and is flushed before
+// the next, so nothing is dropped.
+static uint64 TimeLogBatches(bool async) {
+  const int kBatches = 20;
+  const int kBatchSize = 500;
+  Pathname path;
+  EXPECT_TRUE(Filesystem::GetTemporaryFolder(path, true, NULL));
+  path.SetPathname(Filesystem::TempFilename(path, "ut"));
+
+  FileStream stream;
+  EXPECT_TRUE(stream.Open(path.pathname(), "wb", NULL));
+  stream.DisableBuffering();
+  LogMessage::SetAsyncLogging(async);
+  LogMessage::AddLogToStream(&stream, LS_SENSITIVE);
+
+  std::string message(80, 'X');
+  uint64 logging_ns = 0;
+  for (int i = 0; i < kBatches; ++i) {
+    uint64 start = TimeNanos();
+    for (int j = 0; j < kBatchSize; ++j) {
+      LOG(LS_SENSITIVE) << message;
+    }
+    logging_ns += TimeNanos() - start;
+    LogMessage::FlushAsyncLogs();
+  }
+
+  LogMessage::SetAsyncLogging(false);
+  LogMessage::RemoveLogToStream(&stream);
+  stream.Close();
+  Filesystem::DeleteFile(path);
+  return logging_ns / (kBatches * kBatchSize);
+}
+
+TEST(LogTest, AsyncPerf) {
+  size_t drops = LogMessage::GetAsyncDropCount();
+  uint64 sync_ns = TimeLogBatches(false);
+  uint64 async_ns = TimeLogBatches(true);
+  EXPECT_EQ(drops, LogMessage::GetAsyncDropCount());
+  LOG(LS_INFO) << "Average time on the logging thread: " << sync_ns
+               << " ns writing directly, " << async_ns << " ns queued";
+}
+
 }  // namespace talk_base
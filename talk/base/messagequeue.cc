@@ -38,6 +38,10 @@
 namespace talk_base {
 
 const uint32 kMaxMsgLatency = 150;  // 150 ms
+// Retired nodes are returned to the free pool in batches of this size, and
+// the pool holds at most kMaxFreeNodes.
+const size_t kRecycleBatch = 16;
+const size_t kMaxFreeNodes = 256;
 
 //------------------------------------------------------------------
 // MessageQueueManager
@@ -98,12 +102,268 @@ void MessageQueueManager::Clear(MessageHandler *handler) {
     (*iter)->Clear(handler);
 }
 
+//------------------------------------------------------------------
+// TimingWheel
+
+// Level 0 has 1 ms slots; each slot of level N covers a whole turn of level
+// N - 1.  The lists are level 0's slots, then the other levels' slots, then
+// the list of due messages.
+static const int kLevel0Bits = 8;
+static const int kLevelBits = 6;
+static const int kLevels = 5;
+static const uint32 kLevel0Mask = (1 << kLevel0Bits) - 1;
+static const uint32 kLevelMask = (1 << kLevelBits) - 1;
+static const int kLevel0Slots = 1 << kLevel0Bits;
+static const int kDueList = kLevel0Slots + (kLevels - 1) * (1 << kLevelBits);
+
+static int LevelShift(int level) {
+  return kLevel0Bits + (level - 1) * kLevelBits;
+}
+
+static int LevelList(int level, uint32 slot) {
+  return kLevel0Slots + (level - 1) * (1 << kLevelBits) + slot;
+}
+
+TimingWheel::TimingWheel(uint32 now)
+    : free_(-1), now_(now), next_num_(1), level0_count_(0), wheel_count_(0),
+      due_count_(0) {
+  ASSERT(kLists == kDueList + 1);
+  for (int i = 0; i < kLists; ++i) {
+    heads_[i] = tails_[i] = -1;
+  }
+}
+
+TimerHandle TimingWheel::Insert(int cmsDelay, uint32 trigger,
+                                const Message& msg) {
+  // If the wheel inserts 1 message every millisecond for 50 days, we will
+  // wrap this number.  Even then, only messages with identical times will be
+  // misordered, and then only briefly.  This is probably ok.
+  uint32 num = next_num_++;
+  if (next_num_ == 0)
+    next_num_ = 1;
+  int index;
+  if (free_ >= 0) {
+    index = free_;
+    free_ = entries_[index].next;
+    entries_[index] = Entry(cmsDelay, trigger, num, msg);
+  } else {
+    index = static_cast<int>(entries_.size());
+    entries_.push_back(Entry(cmsDelay, trigger, num, msg));
+  }
+  Link(index);
+  return TimerHandle(index, num);
+}
+
+bool TimingWheel::Cancel(const TimerHandle& handle, Message* msg) {
+  if (handle.IsNull() || handle.index_ >= entries_.size())
+    return false;
+  int index = static_cast<int>(handle.index_);
+  if (entries_[index].dmsg.num_ != handle.serial_)
+    return false;
+  *msg = entries_[index].dmsg.msg_;
+  Unlink(index);
+  Release(index);
+  return true;
+}
+
+void TimingWheel::Advance(uint32 now) {
+  while (TimeIsLaterOrEqual(now_, now)) {
+    if (wheel_count_ == 0) {
+      now_ = now + 1;
+      break;
+    }
+    uint32 slot = now_ & kLevel0Mask;
+    if (slot == 0)
+      Cascade();
+    if (level0_count_ == 0) {
+      // Nothing can trigger before the next cascade.
+      uint32 next = (now_ | kLevel0Mask) + 1;
+      if (TimeIsLater(now, next)) {
+        now_ = now + 1;
+        break;
+      }
+      now_ = next;
+      continue;
+    }
+    // Everything in a level 0 slot triggers at now_, in FIFO order.  Once
+    // now_ has moved on, relinking puts it on the due list.
+    int index = heads_[slot];
+    ++now_;
+    while (index >= 0) {
+      int next = entries_[index].next;
+      Unlink(index);
+      Link(index);
+      index = next;
+    }
+  }
+}
+
+bool TimingWheel::PopDue(Message* msg, uint32* serial) {
+  int index = heads_[kDueList];
+  if (index < 0)
+    return false;
+  *msg = entries_[index].dmsg.msg_;
+  *serial = entries_[index].dmsg.num_;
+  Unlink(index);
+  Release(index);
+  return true;
+}
+
+int TimingWheel::GetDelay(uint32 now) const {
+  if (due_count_ > 0)
+    return 0;
+  uint32 trigger;
+  if (!FindNext(&trigger))
+    return kForever;
+  return _max(0, TimeDiff(trigger, now));
+}
+
+void TimingWheel::Clear(MessageHandler* phandler, uint32 id,
+                        MessageList* removed) {
+  for (int list = 0; list < kLists; ++list) {
+    int index = heads_[list];
+    while (index >= 0) {
+      int next = entries_[index].next;
+      const Message& msg = entries_[index].dmsg.msg_;
+      if (msg.Match(phandler, id)) {
+        if (removed) {
+          removed->push_back(msg);
+        } else {
+          delete msg.pdata;
+        }
+        Unlink(index);
+        Release(index);
+      }
+      index = next;
+    }
+  }
+}
+
+int TimingWheel::ListFor(uint32 trigger) const {
+  int32 delta = TimeDiff(trigger, now_);
+  if (delta < 0)
+    return kDueList;
+  if (delta < kLevel0Slots)
+    return trigger & kLevel0Mask;
+  for (int level = 1; level < kLevels - 1; ++level) {
+    if (delta < (1 << (LevelShift(level) + kLevelBits)))
+      return LevelList(level, (trigger >> LevelShift(level)) & kLevelMask);
+  }
+  return LevelList(kLevels - 1,
+                   (trigger >> LevelShift(kLevels - 1)) & kLevelMask);
+}
+
+void TimingWheel::Link(int index) {
+  Entry& entry = entries_[index];
+  entry.list = ListFor(entry.dmsg.msTrigger_);
+  if (entry.list == kDueList) {
+    ++due_count_;
+  } else {
+    ++wheel_count_;
+    if (entry.list < kLevel0Slots)
+      ++level0_count_;
+  }
+
+  // Level 0 slots and the due list are kept in trigger time, then FIFO
+  // order.  New messages and cascaded ones almost always go at the end.
+  int prev = tails_[entry.list];
+  if (entry.list < kLevel0Slots || entry.list == kDueList) {
+    while (prev >= 0) {
+      const DelayedMessage& other = entries_[prev].dmsg;
+      int32 diff = TimeDiff(entry.dmsg.msTrigger_, other.msTrigger_);
+      if (diff > 0 || (diff == 0 && entry.dmsg.num_ > other.num_))
+        break;
+      prev = entries_[prev].prev;
+    }
+  }
+  entry.prev = prev;
+  entry.next = (prev >= 0) ? entries_[prev].next : heads_[entry.list];
+  if (prev >= 0) {
+    entries_[prev].next = index;
+  } else {
+    heads_[entry.list] = index;
+  }
+  if (entry.next >= 0) {
+    entries_[entry.next].prev = index;
+  } else {
+    tails_[entry.list] = index;
+  }
+}
+
+void TimingWheel::Unlink(int index) {
+  Entry& entry = entries_[index];
+  if (entry.prev >= 0) {
+    entries_[entry.prev].next = entry.next;
+  } else {
+    heads_[entry.list] = entry.next;
+  }
+  if (entry.next >= 0) {
+    entries_[entry.next].prev = entry.prev;
+  } else {
+    tails_[entry.list] = entry.prev;
+  }
+  if (entry.list == kDueList) {
+    --due_count_;
+  } else {
+    --wheel_count_;
+    if (entry.list < kLevel0Slots)
+      --level0_count_;
+  }
+  entry.prev = entry.next = entry.list = -1;
+}
+
+void TimingWheel::Release(int index) {
+  entries_[index].dmsg.num_ = 0;
+  entries_[index].dmsg.msg_ = Message();
+  entries_[index].next = free_;
+  free_ = index;
+}
+
+void TimingWheel::Cascade() {
+  for (int level = 1; level < kLevels; ++level) {
+    uint32 slot = (now_ >> LevelShift(level)) & kLevelMask;
+    int list = LevelList(level, slot);
+    int index = heads_[list];
+    while (index >= 0) {
+      int next = entries_[index].next;
+      Unlink(index);
+      Link(index);
+      index = next;
+    }
+    if (slot != 0)
+      break;
+  }
+}
+
+bool TimingWheel::FindNext(uint32* trigger) const {
+  bool found = false;
+  if (level0_count_ > 0) {
+    uint32 tick = now_;
+    while (heads_[tick & kLevel0Mask] < 0)
+      ++tick;
+    *trigger = tick;
+    found = true;
+  }
+  if (wheel_count_ > level0_count_) {
+    // Higher levels aren't sorted; use the next cascade as a lower bound.
+    uint32 cascade = ((now_ & kLevel0Mask) == 0) ? now_
+                                                 : (now_ | kLevel0Mask) + 1;
+    if (!found || TimeIsLater(cascade, *trigger)) {
+      *trigger = cascade;
+      found = true;
+    }
+  }
+  return found;
+}
+
 //------------------------------------------------------------------
 // MessageQueue
 
 MessageQueue::MessageQueue(SocketServer* ss)
     : ss_(ss), fStop_(false), fPeekKeep_(false), active_(false),
-      dmsgq_next_num_(0) {
+      inbox_(NULL), msgq_head_(NULL), msgq_tail_(NULL), msgq_size_(0),
+      retired_head_(NULL), retired_tail_(NULL), retired_count_(0),
+      free_nodes_(NULL), free_count_(0), dmsgq_(Time()) {
   if (!ss_) {
     // Currently, MessageQueue holds a socket server, and is the base class for
     // Thread.  It seems like it makes more sense for Thread to hold the socket
@@ -128,6 +388,8 @@ MessageQueue::~MessageQueue() {
   if (ss_) {
     ss_->SetMessageQueue(NULL);
   }
+  DeleteNodes(retired_head_);
+  DeleteNodes(free_nodes_);
 }
 
 void MessageQueue::set_socketserver(SocketServer* ss) {
@@ -192,22 +454,27 @@ bool MessageQueue::Get(Message *pmsg, int cmsWait, bool process_io) {
         // triggered and calculate the next trigger time.
         if (first_pass) {
           first_pass = false;
-          while (!dmsgq_.empty()) {
-            if (TimeIsLater(msCurrent, dmsgq_.top().msTrigger_)) {
-              cmsDelayNext = TimeDiff(dmsgq_.top().msTrigger_, msCurrent);
-              break;
-            }
-            msgq_.push_back(dmsgq_.top().msg_);
-            dmsgq_.pop();
+          // Messages posted so far are ordered before the triggered ones.
+          DrainInbox();
+          dmsgq_.Advance(msCurrent);
+          Message msg;
+          uint32 timer;
+          while (dmsgq_.PopDue(&msg, &timer)) {
+            MessageNode* node = NewNode();
+            node->msg = msg;
+            node->timer = timer;
+            AppendNode(node);
           }
+          cmsDelayNext = dmsgq_.GetDelay(msCurrent);
         }
         // Pull a message off the message queue, if available.
-        if (msgq_.empty()) {
+        MessageNode* node = PopNode();
+        if (!node) {
+          RecycleNodes();
           break;
-        } else {
-          *pmsg = msgq_.front();
-          msgq_.pop_front();
         }
+        *pmsg = node->msg;
+        RetireNode(node);
       }  // crit_ is released here.
 
       // Log a warning for time-sensitive messages that we're late to deliver.
@@ -262,66 +529,93 @@ void MessageQueue::ReceiveSends() {
 
 void MessageQueue::Post(MessageHandler *phandler, uint32 id,
     MessageData *pdata, bool time_sensitive) {
-  // Keep thread safe
-  CritScope cs(&crit_);
   if (fStop_)
     return;
-  if (id == MQID_QUIT)
-    fStop_ = true;
-
-  // Add the message to the end of the queue
-  // Signal for the multiplexer to return
-  EnsureActive();
-  Message msg;
-  msg.phandler = phandler;
-  msg.message_id = id;
-  msg.pdata = pdata;
-  if (time_sensitive) {
-    msg.ts_sensitive = Time() + kMaxMsgLatency;
+  // Stopping and activating the queue happen once; serialize them.
+  if (id == MQID_QUIT || !active_) {
+    CritScope cs(&crit_);
+    if (fStop_)
+      return;
+    if (id == MQID_QUIT)
+      fStop_ = true;
+    EnsureActive();
   }
-  msgq_.push_back(msg);
-  ss_->WakeUp();
+
+  // Add the message to the inbox. Only the post that finds the inbox empty
+  // signals the multiplexer; later posts are picked up by the same drain.
+  MessageNode* node = NewNode();
+  node->msg.phandler = phandler;
+  node->msg.message_id = id;
+  node->msg.pdata = pdata;
+  node->msg.ts_sensitive = time_sensitive ? Time() + kMaxMsgLatency : 0;
+  node->timer = 0;
+  if (PushInbox(node))
+    ss_->WakeUp();
 }
 
-void MessageQueue::DoDelayPost(int cmsDelay, uint32 tstamp,
+TimerHandle MessageQueue::DoDelayPost(int cmsDelay, uint32 tstamp,
     MessageHandler *phandler, uint32 id, MessageData* pdata) {
   // Keep thread safe
   CritScope cs(&crit_);
   if (fStop_)
-    return;
+    return TimerHandle();
   if (id == MQID_QUIT)
     fStop_ = true;
 
-  // Add to the priority queue. Gets sorted soonest first.
+  // Add to the timing wheel. Gets sorted soonest first.
   // Signal for the multiplexer to return.
   EnsureActive();
   Message msg;
   msg.phandler = phandler;
   msg.message_id = id;
   msg.pdata = pdata;
-  DelayedMessage dmsg(cmsDelay, tstamp, dmsgq_next_num_, msg);
-  dmsgq_.push(dmsg);
-  // If this message queue processes 1 message every millisecond for 50 days,
-  // we will wrap this number.  Even then, only messages with identical times
-  // will be misordered, and then only briefly.  This is probably ok.
-  VERIFY(0 != ++dmsgq_next_num_);
+  TimerHandle handle = dmsgq_.Insert(cmsDelay, tstamp, msg);
   ss_->WakeUp();
+  return handle;
+}
+
+bool MessageQueue::CancelDelayed(const TimerHandle& handle,
+                                 Message* removed) {
+  if (handle.IsNull())
+    return false;
+  CritScope cs(&crit_);
+  Message msg;
+  if (!dmsgq_.Cancel(handle, &msg)) {
+    // It may have triggered and be waiting in the ordered message queue.
+    MessageNode* prev = NULL;
+    MessageNode* node = msgq_head_;
+    while (node && node->timer != handle.serial_) {
+      prev = node;
+      node = node->next;
+    }
+    if (!node)
+      return false;
+    if (prev) {
+      prev->next = node->next;
+    } else {
+      msgq_head_ = node->next;
+    }
+    if (msgq_tail_ == node)
+      msgq_tail_ = prev;
+    --msgq_size_;
+    msg = node->msg;
+    RetireNode(node);
+  }
+  if (removed) {
+    *removed = msg;
+  } else {
+    delete msg.pdata;
+  }
+  return true;
 }
 
 int MessageQueue::GetDelay() {
   CritScope cs(&crit_);
 
-  if (!msgq_.empty())
+  if (msgq_head_ || inbox_)
     return 0;
 
-  if (!dmsgq_.empty()) {
-    int delay = TimeUntil(dmsgq_.top().msTrigger_);
-    if (delay < 0)
-      delay = 0;
-    return delay;
-  }
-
-  return kForever;
+  return dmsgq_.GetDelay(Time());
 }
 
 void MessageQueue::Clear(MessageHandler *phandler, uint32 id,
@@ -339,38 +633,31 @@ void MessageQueue::Clear(MessageHandler *phandler, uint32 id,
     fPeekKeep_ = false;
   }
 
-  // Remove from ordered message queue
+  // Remove from ordered message queue, including anything still in the inbox
 
-  for (MessageList::iterator it = msgq_.begin(); it != msgq_.end();) {
-    if (it->Match(phandler, id)) {
+  DrainInbox();
+  MessageNode** link = &msgq_head_;
+  msgq_tail_ = NULL;
+  while (*link) {
+    MessageNode* node = *link;
+    if (node->msg.Match(phandler, id)) {
       if (removed) {
-        removed->push_back(*it);
+        removed->push_back(node->msg);
       } else {
-        delete it->pdata;
+        delete node->msg.pdata;
       }
-      it = msgq_.erase(it);
+      *link = node->next;
+      --msgq_size_;
+      RetireNode(node);
     } else {
-      ++it;
+      msgq_tail_ = node;
+      link = &node->next;
     }
   }
 
-  // Remove from priority queue. Not directly iterable, so use this approach
+  // Remove from the timing wheel
 
-  PriorityQueue::container_type::iterator new_end = dmsgq_.container().begin();
-  for (PriorityQueue::container_type::iterator it = new_end;
-       it != dmsgq_.container().end(); ++it) {
-    if (it->msg_.Match(phandler, id)) {
-      if (removed) {
-        removed->push_back(it->msg_);
-      } else {
-        delete it->msg_.pdata;
-      }
-    } else {
-      *new_end++ = *it;
-    }
-  }
-  dmsgq_.container().erase(new_end, dmsgq_.container().end());
-  dmsgq_.reheap();
+  dmsgq_.Clear(phandler, id, removed);
 }
 
 void MessageQueue::Dispatch(Message *pmsg) {
@@ -385,4 +672,138 @@ void MessageQueue::EnsureActive() {
   }
 }
 
+size_t MessageQueue::size() const {
+  CritScope cs(&crit_);
+  size_t count = msgq_size_ + dmsgq_.size() + (fPeekKeep_ ? 1u : 0u);
+  // Nodes in the inbox can't be taken out of it without crit_.
+  for (MessageNode* node = inbox_; node; node = node->next)
+    ++count;
+  return count;
+}
+
+MessageQueue::MessageNode* MessageQueue::NewNode() {
+  {
+    TryCritScope cs(&pool_crit_);
+    if (cs.locked() && free_nodes_) {
+      MessageNode* node = free_nodes_;
+      free_nodes_ = node->next;
+      --free_count_;
+      return node;
+    }
+  }
+  return new MessageNode;
+}
+
+bool MessageQueue::PushInbox(MessageNode* node) {
+  MessageNode* head = inbox_;
+  while (true) {
+    node->next = head;
+    MessageNode* prev = AtomicOps::CompareAndSwapPtr(&inbox_, head, node);
+    if (prev == head)
+      return head == NULL;
+    head = prev;
+  }
+}
+
+void MessageQueue::DrainInbox() {
+  ASSERT(crit_.CurrentThreadIsOwner());
+  MessageNode* const empty = NULL;
+  MessageNode* head = inbox_;
+  while (head) {
+    MessageNode* prev = AtomicOps::CompareAndSwapPtr(&inbox_, head, empty);
+    if (prev == head)
+      break;
+    head = prev;
+  }
+  if (!head)
+    return;
+
+  // The inbox is newest first; reverse it before appending.
+  MessageNode* tail = head;
+  MessageNode* batch = NULL;
+  size_t count = 0;
+  while (head) {
+    MessageNode* next = head->next;
+    head->next = batch;
+    batch = head;
+    head = next;
+    ++count;
+  }
+  if (msgq_tail_) {
+    msgq_tail_->next = batch;
+  } else {
+    msgq_head_ = batch;
+  }
+  msgq_tail_ = tail;
+  msgq_size_ += count;
+}
+
+void MessageQueue::AppendNode(MessageNode* node) {
+  ASSERT(crit_.CurrentThreadIsOwner());
+  node->next = NULL;
+  if (msgq_tail_) {
+    msgq_tail_->next = node;
+  } else {
+    msgq_head_ = node;
+  }
+  msgq_tail_ = node;
+  ++msgq_size_;
+}
+
+MessageQueue::MessageNode* MessageQueue::PopNode() {
+  ASSERT(crit_.CurrentThreadIsOwner());
+  if (!msgq_head_)
+    DrainInbox();
+  MessageNode* node = msgq_head_;
+  if (node) {
+    msgq_head_ = node->next;
+    if (!msgq_head_)
+      msgq_tail_ = NULL;
+    --msgq_size_;
+  }
+  return node;
+}
+
+void MessageQueue::RetireNode(MessageNode* node) {
+  ASSERT(crit_.CurrentThreadIsOwner());
+  node->next = NULL;
+  if (retired_tail_) {
+    retired_tail_->next = node;
+  } else {
+    retired_head_ = node;
+  }
+  retired_tail_ = node;
+  if (++retired_count_ >= kRecycleBatch)
+    RecycleNodes();
+}
+
+void MessageQueue::RecycleNodes() {
+  ASSERT(crit_.CurrentThreadIsOwner());
+  if (!retired_head_)
+    return;
+  MessageNode* excess = retired_head_;
+  {
+    TryCritScope cs(&pool_crit_);
+    if (!cs.locked())
+      return;  // A poster has the pool; try again with the next batch.
+    if (free_count_ + retired_count_ <= kMaxFreeNodes) {
+      retired_tail_->next = free_nodes_;
+      free_nodes_ = retired_head_;
+      free_count_ += retired_count_;
+      excess = NULL;
+    }
+  }
+  retired_head_ = retired_tail_ = NULL;
+  retired_count_ = 0;
+  DeleteNodes(excess);
+}
+
+void MessageQueue::DeleteNodes(MessageNode* node) {
+  while (node) {
+    MessageNode* next = node->next;
+    delete node;
+    node = next;
+  }
+}
+
 }  // namespace talk_base
@@ -31,7 +31,6 @@
 #include <algorithm>
 #include <cstring>
 #include <list>
-#include <queue>
 #include <vector>
 
 #include "talk/base/basictypes.h"
@@ -151,7 +150,7 @@ struct Message {
 
 typedef std::list<Message> MessageList;
 
-// DelayedMessage goes into a priority queue, sorted by trigger time.  Messages
+// DelayedMessage goes into a TimingWheel, sorted by trigger time.  Messages
 // with the same trigger time are processed in num_ (FIFO) order.
 
 class DelayedMessage {
@@ -159,17 +158,84 @@ class DelayedMessage {
   DelayedMessage(int delay, uint32 trigger, uint32 num, const Message& msg)
   : cmsDelay_(delay), msTrigger_(trigger), num_(num), msg_(msg) { }
 
-  bool operator< (const DelayedMessage& dmsg) const {
-    return (dmsg.msTrigger_ < msTrigger_)
-           || ((dmsg.msTrigger_ == msTrigger_) && (dmsg.num_ < num_));
-  }
-
   int cmsDelay_;  // for debugging
   uint32 msTrigger_;
   uint32 num_;
   Message msg_;
 };
 
+// Refers to a delayed message posted with MessageQueue::PostDelayedTimer or
+// PostAtTimer.  A handle may be kept after its message has been delivered or
+// cancelled; it then matches nothing.  A default constructed handle is null.
+
+class TimerHandle {
+ public:
+  TimerHandle() : index_(0), serial_(0) { }
+  bool IsNull() const { return serial_ == 0; }
+
+ private:
+  friend class MessageQueue;
+  friend class TimingWheel;
+  TimerHandle(uint32 index, uint32 serial) : index_(index), serial_(serial) { }
+
+  uint32 index_;
+  uint32 serial_;
+};
+
+// TimingWheel holds DelayedMessages in a hierarchical timing wheel with 1 ms
+// ticks: a 256 slot level covering the next 256 ms, and four 64 slot levels
+// above it whose slots are cascaded into the level below as time advances.
+// Insert and Cancel are O(1); Advance costs O(1) per triggered message plus
+// one step per tick (or per 256 ticks while nothing is about to trigger).
+// Not thread safe; MessageQueue guards it with its lock.
+
+class TimingWheel {
+ public:
+  explicit TimingWheel(uint32 now);
+
+  TimerHandle Insert(int cmsDelay, uint32 trigger, const Message& msg);
+  // Removes the message if it is still in the wheel, storing it in |msg|.
+  bool Cancel(const TimerHandle& handle, Message* msg);
+  // Makes every message that triggers at or before |now| due.
+  void Advance(uint32 now);
+  // Removes the next due message, in trigger time then FIFO order.
+  bool PopDue(Message* msg, uint32* serial);
+  // Time until the next message may trigger: 0 if one is due, kForever if
+  // the wheel is empty.  Can be early, never late.
+  int GetDelay(uint32 now) const;
+  void Clear(MessageHandler* phandler, uint32 id, MessageList* removed);
+  size_t size() const { return wheel_count_ + due_count_; }
+
+ private:
+  struct Entry {
+    Entry(int delay, uint32 trigger, uint32 num, const Message& msg)
+        : dmsg(delay, trigger, num, msg), prev(-1), next(-1), list(-1) { }
+    DelayedMessage dmsg;
+    int prev;
+    int next;
+    int list;
+  };
+
+  int ListFor(uint32 trigger) const;
+  void Link(int index);
+  void Unlink(int index);
+  void Release(int index);
+  void Cascade();
+  bool FindNext(uint32* trigger) const;
+
+  static const int kLists = 256 + 4 * 64 + 1;
+  std::vector<Entry> entries_;
+  int free_;
+  int heads_[kLists];
+  int tails_[kLists];
+  // The next tick to process.
+  uint32 now_;
+  uint32 next_num_;
+  size_t level0_count_;
+  size_t wheel_count_;
+  size_t due_count_;
+};
+
 class MessageQueue {
  public:
   explicit MessageQueue(SocketServer* ss = NULL);
@@ -199,12 +265,27 @@ class MessageQueue {
                     MessageData *pdata = NULL, bool time_sensitive = false);
   virtual void PostDelayed(int cmsDelay, MessageHandler *phandler,
                            uint32 id = 0, MessageData *pdata = NULL) {
-    return DoDelayPost(cmsDelay, TimeAfter(cmsDelay), phandler, id, pdata);
+    DoDelayPost(cmsDelay, TimeAfter(cmsDelay), phandler, id, pdata);
   }
   virtual void PostAt(uint32 tstamp, MessageHandler *phandler,
                       uint32 id = 0, MessageData *pdata = NULL) {
+    DoDelayPost(TimeUntil(tstamp), tstamp, phandler, id, pdata);
+  }
+  // Like PostDelayed and PostAt, but return a handle for CancelDelayed.
+  TimerHandle PostDelayedTimer(int cmsDelay, MessageHandler *phandler,
+                               uint32 id = 0, MessageData *pdata = NULL) {
+    return DoDelayPost(cmsDelay, TimeAfter(cmsDelay), phandler, id, pdata);
+  }
+  TimerHandle PostAtTimer(uint32 tstamp, MessageHandler *phandler,
+                          uint32 id = 0, MessageData *pdata = NULL) {
     return DoDelayPost(TimeUntil(tstamp), tstamp, phandler, id, pdata);
   }
+  // Removes a message posted with PostDelayedTimer or PostAtTimer that has
+  // not been delivered yet, without the scan Clear does.  The message is
+  // returned in |removed| if given, otherwise its data is deleted.  Returns
+  // false if there was no such message.  |handle| must come from this queue.
+  virtual bool CancelDelayed(const TimerHandle& handle,
+                             Message* removed = NULL);
   virtual void Clear(MessageHandler *phandler, uint32 id = MQID_ANY,
                      MessageList* removed = NULL);
   virtual void Dispatch(Message *pmsg);
@@ -214,10 +295,7 @@ class MessageQueue {
   virtual int GetDelay();
 
   bool empty() const { return size() == 0u; }
-  size_t size() const {
-    CritScope cs(&crit_);  // msgq_.size() is not thread safe.
-    return msgq_.size() + dmsgq_.size() + (fPeekKeep_ ? 1u : 0u);
-  }
+  size_t size() const;
 
   // Internally posts a message which causes the doomed object to be deleted
   template<class T> void Dispose(T* doomed) {
@@ -231,15 +309,35 @@ class MessageQueue {
   sigslot::signal0<> SignalQueueDestroyed;
 
  protected:
-  class PriorityQueue : public std::priority_queue<DelayedMessage> {
-   public:
-    container_type& container() { return c; }
-    void reheap() { make_heap(c.begin(), c.end(), comp); }
+  // Ready messages are kept in intrusive lists of pooled nodes.  |timer| is
+  // the serial of the TimerHandle a triggered delayed message was posted
+  // with, or 0.
+  struct MessageNode {
+    Message msg;
+    uint32 timer;
+    MessageNode* next;
   };
 
   void EnsureActive();
-  void DoDelayPost(int cmsDelay, uint32 tstamp, MessageHandler *phandler,
-                   uint32 id, MessageData* pdata);
+  TimerHandle DoDelayPost(int cmsDelay, uint32 tstamp,
+                          MessageHandler *phandler, uint32 id,
+                          MessageData* pdata);
+
+  // Takes a node from the free pool, or from the heap if the pool is empty
+  // or busy. Never blocks.
+  MessageNode* NewNode();
+  // Pushes |node| onto |inbox_|. Returns true if the inbox was empty.
+  bool PushInbox(MessageNode* node);
+  // The following require |crit_|.
+  // Moves everything posted so far from |inbox_| to the tail of msgq_.
+  void DrainInbox();
+  void AppendNode(MessageNode* node);
+  MessageNode* PopNode();
+  void RetireNode(MessageNode* node);
+  // Hands retired nodes back to the free pool, if it can be done without
+  // waiting.
+  void RecycleNodes();
+  static void DeleteNodes(MessageNode* node);
 
   // The SocketServer is not owned by MessageQueue.
   SocketServer* ss_;
@@ -251,9 +349,23 @@ class MessageQueue {
   // A message queue is active if it has ever had a message posted to it.
   // This also corresponds to being in MessageQueueManager's global list.
   bool active_;
-  MessageList msgq_;
-  PriorityQueue dmsgq_;
-  uint32 dmsgq_next_num_;
+  // Post() pushes onto |inbox_| (newest first) with a compare-and-swap and
+  // does not take |crit_|. Whoever holds |crit_| takes the whole inbox in one
+  // step and appends it, oldest first, to the msgq_ list, so the owning
+  // thread pays for one atomic operation per batch rather than per message.
+  MessageNode* volatile inbox_;
+  MessageNode* msgq_head_;
+  MessageNode* msgq_tail_;
+  size_t msgq_size_;
+  // Nodes released under |crit_|, waiting to go back to |free_nodes_|.
+  MessageNode* retired_head_;
+  MessageNode* retired_tail_;
+  size_t retired_count_;
+  // Free nodes for posters. |pool_crit_| is only ever tried, never waited on.
+  MessageNode* free_nodes_;
+  size_t free_count_;
+  CriticalSection pool_crit_;
+  TimingWheel dmsgq_;
   mutable CriticalSection crit_;
 
  private:
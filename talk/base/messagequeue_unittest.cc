@@ -27,9 +27,13 @@
 
 #include "talk/base/messagequeue.h"
 
+#include <vector>
+
 #include "talk/base/bind.h"
+#include "talk/base/common.h"
 #include "talk/base/gunit.h"
 #include "talk/base/logging.h"
+#include "talk/base/physicalsocketserver.h"
 #include "talk/base/thread.h"
 #include "talk/base/timeutils.h"
 #include "talk/base/nullsocketserver.h"
@@ -130,3 +134,272 @@ TEST_F(MessageQueueTest, DiposeHandlerWithPostedMessagePending) {
   EXPECT_TRUE(deleted);
 }
 
+
+TEST_F(MessageQueueTest, ClearRemovesPostedMessages) {
+  Post(NULL, 1);
+  Post(NULL, 2);
+  Post(NULL, 1);
+  PostDelayed(1000, NULL, 1);
+  EXPECT_EQ(4u, size());
+  MessageList removed;
+  Clear(NULL, 1, &removed);
+  EXPECT_EQ(3u, removed.size());
+  EXPECT_EQ(1u, size());
+  Post(NULL, 3);
+  Message msg;
+  EXPECT_TRUE(Get(&msg, 0));
+  EXPECT_EQ(2u, msg.message_id);
+  EXPECT_TRUE(Get(&msg, 0));
+  EXPECT_EQ(3u, msg.message_id);
+  EXPECT_FALSE(Get(&msg, 0));
+}
+
+// The queue as it was before Post() went lock-free: a single lock shared by
+// every poster and the consumer, and a wakeup per post.
+class LockedMessageList {
+ public:
+  LockedMessageList() { }
+  void Post(MessageHandler* phandler, uint32 id) {
+    CritScope cs(&crit_);
+    Message msg;
+    msg.phandler = phandler;
+    msg.message_id = id;
+    msgq_.push_back(msg);
+    ss_.WakeUp();
+  }
+  bool Get(Message* pmsg, int cms_wait) {
+    {
+      CritScope cs(&crit_);
+      if (!msgq_.empty()) {
+        *pmsg = msgq_.front();
+        msgq_.pop_front();
+        return true;
+      }
+    }
+    ss_.Wait(cms_wait, true);
+    return false;
+  }
+
+ private:
+  CriticalSection crit_;
+  MessageList msgq_;
+  PhysicalSocketServer ss_;
+  DISALLOW_COPY_AND_ASSIGN(LockedMessageList);
+};
+
+// Posts |count| messages, numbered in order and tagged with |tag|.
+template <class Queue>
+class PostingRunnable : public Runnable {
+ public:
+  PostingRunnable(Queue* queue, uint32 tag, uint32 count)
+      : queue_(queue), tag_(tag), count_(count) { }
+  virtual void Run(Thread* thread) {
+    for (uint32 i = 0; i < count_; ++i) {
+      queue_->Post(NULL, (tag_ << 24) | i);
+    }
+  }
+
+ private:
+  Queue* queue_;
+  uint32 tag_;
+  uint32 count_;
+};
+
+// Starts |producers| threads posting |posts| messages each to |queue| and
+// receives them all on this thread. Returns the elapsed time in ms.
+template <class Queue>
+static uint32 ReceiveFromProducers(Queue* queue, uint32 producers,
+                                   uint32 posts) {
+  std::vector<PostingRunnable<Queue>*> runnables;
+  std::vector<Thread*> threads;
+  std::vector<uint32> received(producers, 0);
+  uint32 start = Time();
+  for (uint32 i = 0; i < producers; ++i) {
+    runnables.push_back(new PostingRunnable<Queue>(queue, i, posts));
+    threads.push_back(new Thread());
+    threads.back()->Start(runnables.back());
+  }
+  uint32 total = 0;
+  Message msg;
+  while (total < producers * posts) {
+    if (!queue->Get(&msg, 100)) {
+      continue;
+    }
+    uint32 tag = msg.message_id >> 24;
+    // Messages from one poster arrive in the order they were posted.
+    EXPECT_EQ(received[tag], msg.message_id & 0xffffff);
+    received[tag] = (msg.message_id & 0xffffff) + 1;
+    ++total;
+  }
+  uint32 elapsed = TimeSince(start);
+  for (uint32 i = 0; i < producers; ++i) {
+    threads[i]->Stop();
+    delete threads[i];
+    delete runnables[i];
+  }
+  return elapsed;
+}
+
+TEST(MessageQueuePostTest, PostsFromManyThreadsKeepPerThreadOrder) {
+  MessageQueue queue;
+  ReceiveFromProducers(&queue, 4, 10000);
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(MessageQueuePostTest, ContendedPostPerf) {
+  const uint32 kPosts = 100000;
+  const uint32 kProducers[] = { 1, 2, 4, 8 };
+  for (int i = 0; i < ARRAY_SIZE(kProducers); ++i) {
+    LockedMessageList locked;
+    uint32 locked_ms = ReceiveFromProducers(&locked, kProducers[i], kPosts);
+    MessageQueue queue;
+    uint32 queue_ms = ReceiveFromProducers(&queue, kProducers[i], kPosts);
+    LOG(LS_INFO) << kProducers[i] << " posters x " << kPosts
+                 << " messages: locked list " << locked_ms
+                 << " ms, MessageQueue " << queue_ms << " ms";
+  }
+}
+
+// Inserts messages with pseudo-random delays, then advances in uneven steps
+// and checks each comes out on time, in trigger then insertion order.
+static void CheckTimingWheelOrder(uint32 start, uint32 max_delay) {
+  TimingWheel wheel(start);
+  std::vector<uint32> triggers;
+  uint32 seed = 1;
+  for (uint32 i = 0; i < 2000; ++i) {
+    seed = seed * 1103515245 + 12345;
+    uint32 trigger = start + (seed >> 8) % max_delay;
+    Message msg;
+    msg.message_id = i;
+    wheel.Insert(0, trigger, msg);
+    triggers.push_back(trigger);
+  }
+  EXPECT_EQ(2000u, wheel.size());
+
+  uint32 now = start;
+  uint32 last_trigger = start;
+  uint32 last_id = 0;
+  size_t popped = 0;
+  while (popped < triggers.size()) {
+    now += 1 + (now % 997);
+    wheel.Advance(now);
+    Message msg;
+    uint32 serial;
+    while (wheel.PopDue(&msg, &serial)) {
+      uint32 trigger = triggers[msg.message_id];
+      EXPECT_TRUE(TimeIsLaterOrEqual(trigger, now));
+      EXPECT_TRUE(TimeIsLaterOrEqual(last_trigger, trigger));
+      if (popped > 0 && trigger == last_trigger) {
+        EXPECT_LT(last_id, msg.message_id);
+      }
+      last_trigger = trigger;
+      last_id = msg.message_id;
+      ++popped;
+    }
+    int delay = wheel.GetDelay(now);
+    if (popped < triggers.size()) {
+      ASSERT_NE(kForever, delay);
+      // The wheel may wake up early, never late.
+      for (size_t i = 0; i < triggers.size(); ++i) {
+        EXPECT_TRUE(TimeIsLaterOrEqual(triggers[i], now) ||
+                    TimeDiff(triggers[i], now) >= delay);
+      }
+    }
+  }
+  EXPECT_EQ(0u, wheel.size());
+  EXPECT_EQ(kForever, wheel.GetDelay(now));
+}
+
+TEST(TimingWheelTest, TriggersInOrderAcrossLevels) {
+  CheckTimingWheelOrder(1000, 200);
+  CheckTimingWheelOrder(1000, 100000);
+  CheckTimingWheelOrder(12345, 5000000);
+}
+
+TEST(TimingWheelTest, TriggersInOrderAcrossTimeWrap) {
+  CheckTimingWheelOrder(0xFFFFFF00, 1000);
+  CheckTimingWheelOrder(0xFFFF0000, 1000000);
+}
+
+TEST(TimingWheelTest, CancelAndStaleHandles) {
+  TimingWheel wheel(0);
+  Message msg;
+  msg.message_id = 1;
+  TimerHandle first = wheel.Insert(0, 10, msg);
+  msg.message_id = 2;
+  TimerHandle second = wheel.Insert(0, 70000, msg);
+  EXPECT_FALSE(first.IsNull());
+  EXPECT_TRUE(TimerHandle().IsNull());
+
+  Message removed;
+  EXPECT_TRUE(wheel.Cancel(second, &removed));
+  EXPECT_EQ(2u, removed.message_id);
+  EXPECT_FALSE(wheel.Cancel(second, &removed));
+  // The freed entry is reused, but the old handle doesn't match it.
+  msg.message_id = 3;
+  TimerHandle third = wheel.Insert(0, 20, msg);
+  EXPECT_FALSE(wheel.Cancel(second, &removed));
+  EXPECT_EQ(2u, wheel.size());
+
+  wheel.Advance(15);
+  uint32 serial;
+  EXPECT_TRUE(wheel.PopDue(&msg, &serial));
+  EXPECT_EQ(1u, msg.message_id);
+  EXPECT_FALSE(wheel.PopDue(&msg, &serial));
+  EXPECT_FALSE(wheel.Cancel(first, &removed));
+  EXPECT_EQ(5, wheel.GetDelay(15));
+  EXPECT_TRUE(wheel.Cancel(third, &removed));
+  EXPECT_EQ(0u, wheel.size());
+}
+
+TEST_F(MessageQueueTest, CancelDelayed) {
+  TimerHandle pending = PostDelayedTimer(10000, NULL, 1);
+  TimerHandle triggered = PostAtTimer(Time() - 1, NULL, 2);
+  TimerHandle delivered = PostAtTimer(Time() - 2, NULL, 3);
+  EXPECT_EQ(3u, size());
+
+  Message msg;
+  EXPECT_TRUE(Peek(&msg, 0));
+  EXPECT_EQ(3u, msg.message_id);
+  EXPECT_TRUE(Get(&msg, 0));
+  EXPECT_FALSE(CancelDelayed(delivered));
+
+  // Id 2 has triggered and waits in the ordered message queue.
+  EXPECT_TRUE(CancelDelayed(triggered, &msg));
+  EXPECT_EQ(2u, msg.message_id);
+  EXPECT_FALSE(CancelDelayed(triggered));
+  EXPECT_TRUE(CancelDelayed(pending));
+  EXPECT_FALSE(CancelDelayed(TimerHandle()));
+  EXPECT_EQ(0u, size());
+  EXPECT_FALSE(Get(&msg, 0));
+}
+
+TEST(TimingWheelTest, InsertAndCancelPerf) {
+  const int kTimers = 100000;
+  std::vector<TimerHandle> handles(kTimers);
+  TimingWheel wheel(0);
+  Message msg;
+  uint32 start = Time();
+  for (int i = 0; i < kTimers; ++i) {
+    handles[i] = wheel.Insert(0, 50 + (i * 7919) % 30000, msg);
+  }
+  uint32 insert_ms = TimeSince(start);
+  start = Time();
+  for (int i = 0; i < kTimers; i += 2) {
+    wheel.Cancel(handles[i], &msg);
+  }
+  uint32 cancel_ms = TimeSince(start);
+  start = Time();
+  uint32 serial;
+  for (uint32 now = 0; now <= 30050; now += 10) {
+    wheel.Advance(now);
+    while (wheel.PopDue(&msg, &serial)) {
+    }
+  }
+  uint32 expire_ms = TimeSince(start);
+  LOG(LS_INFO) << kTimers << " timers: insert " << insert_ms
+               << " ms, cancel half " << cancel_ms
+               << " ms, expire the rest over 30 s of ticks " << expire_ms
+               << " ms";
+  EXPECT_EQ(0u, wheel.size());
+}
@@ -0,0 +1,177 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "talk/base/packetbuffer.h"
+
+#include "talk/base/common.h"
+#include "talk/base/criticalsection.h"
+
+namespace talk_base {
+
+// Pooled packets all have this much storage, which covers a full MTU plus
+// the default headroom and tailroom.
+static const size_t kPooledStorageSize = 2048;
+// The most free packets kept around by the pool.
+static const size_t kMaxPooledPackets = 256;
+
+const size_t PacketBuffer::kDefaultHeadroom;
+const size_t PacketBuffer::kDefaultTailroom;
+
+// Free list of pooled packets.  Packets are usually created on one thread
+// (an encoder) and released on another (the worker), so it's locked.
+class PacketBufferPool {
+ public:
+  static PacketBufferPool* Instance() {
+    LIBJINGLE_DEFINE_STATIC_LOCAL(PacketBufferPool, pool, ());
+    return &pool;
+  }
+
+  PacketBufferPool() : free_(NULL), free_count_(0) {}
+
+  PacketBuffer* Get() {
+    {
+      CritScope cs(&crit_);
+      if (free_) {
+        PacketBuffer* packet = free_;
+        free_ = packet->next_free_;
+        --free_count_;
+        return packet;
+      }
+    }
+    return new PacketBuffer(new char[kPooledStorageSize], kPooledStorageSize,
+                            true);
+  }
+
+  void Put(PacketBuffer* packet) {
+    {
+      CritScope cs(&crit_);
+      if (free_count_ < kMaxPooledPackets) {
+        packet->next_free_ = free_;
+        free_ = packet;
+        ++free_count_;
+        return;
+      }
+    }
+    delete packet;
+  }
+
+ private:
+  CriticalSection crit_;
+  PacketBuffer* free_;
+  size_t free_count_;
+};
+
+PacketBuffer* PacketBuffer::Create(size_t length, size_t headroom,
+                                   size_t tailroom) {
+  PacketBuffer* packet;
+  if (headroom + length + tailroom <= kPooledStorageSize) {
+    packet = PacketBufferPool::Instance()->Get();
+  } else {
+    size_t capacity = headroom + length + tailroom;
+    packet = new PacketBuffer(new char[capacity], capacity, false);
+  }
+  packet->data_ = packet->storage_ + headroom;
+  packet->length_ = length;
+  return packet;
+}
+
+PacketBuffer* PacketBuffer::Create(const void* data, size_t length) {
+  PacketBuffer* packet = Create(length);
+  memcpy(packet->data_, data, length);
+  return packet;
+}
+
+PacketBuffer* PacketBuffer::Adopt(Buffer* buffer) {
+  PacketBuffer* packet = new PacketBuffer(NULL, 0, false);
+  buffer->TransferTo(&packet->adopted_);
+  packet->storage_ = packet->data_ = packet->adopted_.data();
+  packet->capacity_ = packet->adopted_.capacity();
+  packet->length_ = packet->adopted_.length();
+  return packet;
+}
+
+PacketBuffer::PacketBuffer(char* storage, size_t capacity, bool pooled)
+    : storage_(storage), capacity_(capacity), data_(storage), length_(0),
+      ref_count_(0), pooled_(pooled), next_free_(NULL) {
+}
+
+PacketBuffer::~PacketBuffer() {
+  if (storage_ != adopted_.data()) {
+    delete [] storage_;
+  }
+}
+
+int PacketBuffer::AddRef() {
+  return AtomicOps::Increment(&ref_count_);
+}
+
+int PacketBuffer::Release() {
+  int count = AtomicOps::Decrement(&ref_count_);
+  if (!count) {
+    if (pooled_) {
+      PacketBufferPool::Instance()->Put(this);
+    } else {
+      delete this;
+    }
+  }
+  return count;
+}
+
+char* PacketBuffer::Prepend(size_t size) {
+  if (size > headroom()) {
+    return NULL;
+  }
+  data_ -= size;
+  length_ += size;
+  return data_;
+}
+
+void PacketBuffer::Consume(size_t size) {
+  ASSERT(size <= length_);
+  data_ += size;
+  length_ -= size;
+}
+
+char* PacketBuffer::Append(size_t size) {
+  if (size > tailroom()) {
+    return NULL;
+  }
+  char* tail = data_ + length_;
+  length_ += size;
+  return tail;
+}
+
+bool PacketBuffer::SetLength(size_t length) {
+  if (length > length_ + tailroom()) {
+    return false;
+  }
+  length_ = length;
+  return true;
+}
+
+}  // namespace talk_base
@@ -0,0 +1,110 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef TALK_BASE_PACKETBUFFER_H_
+#define TALK_BASE_PACKETBUFFER_H_
+
+#include "talk/base/basictypes.h"
+#include "talk/base/buffer.h"
+#include "talk/base/constructormagic.h"
+
+namespace talk_base {
+
+// A reference counted packet that is written once and then handed, without
+// copying, down the send path and across threads.  The packet sits in the
+// middle of its storage: lower layers can prepend their headers (TURN
+// ChannelData, TCP framing) into the headroom and append trailers (SRTP
+// authentication tags) into the tailroom in place.
+//
+// Small packets come from a process wide pool, so steady state sending does
+// no heap allocation.  Use with scoped_refptr; the reference count starts at
+// zero as with RefCountedObject.
+class PacketBuffer {
+ public:
+  // Enough for a TURN Send indication with an IPv6 peer address, TURN
+  // ChannelData over TCP, or TCP framing.
+  static const size_t kDefaultHeadroom = 64;
+  // Enough for the largest SRTP/SRTCP authentication tag and SRTCP index,
+  // plus STUN attribute padding.
+  static const size_t kDefaultTailroom = 32;
+
+  // Creates a packet of |length| bytes with at least the given headroom and
+  // tailroom.  The contents are uninitialized.
+  static PacketBuffer* Create(size_t length,
+                              size_t headroom = kDefaultHeadroom,
+                              size_t tailroom = kDefaultTailroom);
+  // Creates a packet holding a copy of |data|.
+  static PacketBuffer* Create(const void* data, size_t length);
+  // Creates a packet that takes over the storage of |buffer|, leaving it
+  // empty.  The packet has no headroom, and the buffer's spare capacity as
+  // tailroom.
+  static PacketBuffer* Adopt(Buffer* buffer);
+
+  int AddRef();
+  int Release();
+
+  const char* data() const { return data_; }
+  char* data() { return data_; }
+  size_t length() const { return length_; }
+  size_t headroom() const { return data_ - storage_; }
+  size_t tailroom() const { return capacity_ - headroom() - length_; }
+
+  // Moves the start of the packet |size| bytes into the headroom and returns
+  // the new start, or NULL if there isn't enough headroom.
+  char* Prepend(size_t size);
+  // Drops |size| bytes from the start of the packet, e.g. to undo Prepend.
+  void Consume(size_t size);
+  // Grows the packet |size| bytes into the tailroom and returns a pointer to
+  // the added bytes, or NULL if there isn't enough tailroom.
+  char* Append(size_t size);
+  // Sets the length of the packet, keeping its start.  Returns false if it
+  // doesn't fit in the tailroom.
+  bool SetLength(size_t length);
+
+ private:
+  PacketBuffer(char* storage, size_t capacity, bool pooled);
+  ~PacketBuffer();
+
+  char* storage_;
+  size_t capacity_;
+  char* data_;
+  size_t length_;
+  int ref_count_;
+  bool pooled_;
+  // Storage taken over from a Buffer by Adopt.
+  Buffer adopted_;
+  // Link in the pool's free list.
+  PacketBuffer* next_free_;
+
+  friend class PacketBufferPool;
+  DISALLOW_COPY_AND_ASSIGN(PacketBuffer);
+};
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_PACKETBUFFER_H_
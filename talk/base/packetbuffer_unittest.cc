@@ -0,0 +1,91 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "talk/base/gunit.h"
+#include "talk/base/packetbuffer.h"
+#include "talk/base/scoped_ref_ptr.h"
+
+namespace talk_base {
+
+static const char kTestData[] = "abcdefghijklmnopqrstuvwxyz";
+
+TEST(PacketBufferTest, HeadroomAndTailroom) {
+  scoped_refptr<PacketBuffer> packet(
+      PacketBuffer::Create(kTestData, sizeof(kTestData)));
+  EXPECT_EQ(sizeof(kTestData), packet->length());
+  EXPECT_EQ(0, memcmp(packet->data(), kTestData, sizeof(kTestData)));
+  EXPECT_LE(PacketBuffer::kDefaultHeadroom, packet->headroom());
+  EXPECT_LE(PacketBuffer::kDefaultTailroom, packet->tailroom());
+
+  size_t headroom = packet->headroom();
+  char* header = packet->Prepend(4);
+  ASSERT_TRUE(header != NULL);
+  EXPECT_EQ(packet->data(), header);
+  EXPECT_EQ(headroom - 4, packet->headroom());
+  EXPECT_EQ(sizeof(kTestData) + 4, packet->length());
+  EXPECT_TRUE(packet->Prepend(headroom) == NULL);
+  packet->Consume(4);
+  EXPECT_EQ(0, memcmp(packet->data(), kTestData, sizeof(kTestData)));
+
+  size_t tailroom = packet->tailroom();
+  char* tail = packet->Append(10);
+  ASSERT_TRUE(tail != NULL);
+  EXPECT_EQ(packet->data() + sizeof(kTestData), tail);
+  EXPECT_EQ(tailroom - 10, packet->tailroom());
+  EXPECT_TRUE(packet->Append(tailroom) == NULL);
+  EXPECT_TRUE(packet->SetLength(sizeof(kTestData)));
+  EXPECT_FALSE(packet->SetLength(sizeof(kTestData) + tailroom + 1));
+}
+
+TEST(PacketBufferTest, PooledPacketsAreReused) {
+  PacketBuffer* first = PacketBuffer::Create(100);
+  first->AddRef();
+  EXPECT_EQ(0, first->Release());
+  scoped_refptr<PacketBuffer> second(PacketBuffer::Create(200));
+  EXPECT_EQ(first, second.get());
+
+  // Packets too large for the pool come from the heap.
+  scoped_refptr<PacketBuffer> large(PacketBuffer::Create(64 * 1024, 8, 8));
+  EXPECT_EQ(64u * 1024u, large->length());
+  EXPECT_EQ(8u, large->headroom());
+  EXPECT_EQ(8u, large->tailroom());
+}
+
+TEST(PacketBufferTest, AdoptTakesBufferStorage) {
+  Buffer buffer(kTestData, sizeof(kTestData), 100);
+  const char* storage = buffer.data();
+  scoped_refptr<PacketBuffer> packet(PacketBuffer::Adopt(&buffer));
+  EXPECT_EQ(0u, buffer.length());
+  EXPECT_EQ(storage, packet->data());
+  EXPECT_EQ(sizeof(kTestData), packet->length());
+  EXPECT_EQ(0u, packet->headroom());
+  EXPECT_EQ(100u - sizeof(kTestData), packet->tailroom());
+  EXPECT_TRUE(packet->Prepend(1) == NULL);
+}
+
+}  // namespace talk_base
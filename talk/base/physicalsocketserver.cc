@@ -40,6 +40,10 @@
 #include <signal.h>
 #endif
 
+#ifdef LINUX
+#include <sys/epoll.h>
+#endif
+
 #ifdef WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -106,6 +110,16 @@ static const int IPV6_HEADER_SIZE = 40u;
 static const int ICMP_HEADER_SIZE = 8u;
 static const int ICMP_PING_TIMEOUT_MILLIS = 10000u;
 
+#if defined(LINUX) && !defined(ANDROID)
+// Maximum number of datagrams moved by one recvmmsg() or sendmmsg() call.
+static const size_t kMaxDatagramBatch = 64;
+#endif
+
+#ifdef POSIX
+// Maximum number of buffers gathered by one sendmsg() call.
+static const size_t kMaxSendVBuffers = 16;
+#endif
+
 class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
  public:
   PhysicalSocket(PhysicalSocketServer* ss, SOCKET s = INVALID_SOCKET)
@@ -224,12 +238,12 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
       state_ = CS_CONNECTED;
     } else if (IsBlockingError(error_)) {
       state_ = CS_CONNECTING;
-      enabled_events_ |= DE_CONNECT;
+      EnableEvents(DE_CONNECT);
     } else {
       return SOCKET_ERROR;
     }
 
-    enabled_events_ |= DE_READ | DE_WRITE;
+    EnableEvents(DE_READ | DE_WRITE);
     return 0;
   }
 
@@ -291,10 +305,39 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     // We have seen minidumps where this may be false.
     ASSERT(sent <= static_cast<int>(cb));
     if ((sent < 0) && IsBlockingError(error_)) {
-      enabled_events_ |= DE_WRITE;
+      EnableEvents(DE_WRITE);
+    }
+    return sent;
+  }
+
+#ifdef POSIX
+  virtual int SendV(const SocketIoVec* buffers, size_t count) {
+    count = _min(count, kMaxSendVBuffers);
+    iovec iovs[kMaxSendVBuffers];
+    for (size_t i = 0; i < count; ++i) {
+      iovs[i].iov_base = const_cast<void*>(buffers[i].data);
+      iovs[i].iov_len = buffers[i].size;
+    }
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iovs;
+    msg.msg_iovlen = count;
+    // Suppress SIGPIPE. See Send() for explanation.
+    int sent = ::sendmsg(s_, &msg,
+#ifdef LINUX
+        MSG_NOSIGNAL
+#else
+        0
+#endif
+        );
+    UpdateLastError();
+    MaybeRemapSendError();
+    if ((sent < 0) && IsBlockingError(error_)) {
+      EnableEvents(DE_WRITE);
     }
     return sent;
   }
+#endif  // POSIX
 
   int SendTo(const void* buffer, size_t length, const SocketAddress& addr) {
     sockaddr_storage saddr;
@@ -313,7 +356,7 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     // We have seen minidumps where this may be false.
     ASSERT(sent <= static_cast<int>(length));
     if ((sent < 0) && IsBlockingError(error_)) {
-      enabled_events_ |= DE_WRITE;
+      EnableEvents(DE_WRITE);
     }
     return sent;
   }
@@ -328,14 +371,14 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
       LOG(LS_WARNING) << "EOF from socket; deferring close event";
       // Must turn this back on so that the select() loop will notice the close
       // event.
-      enabled_events_ |= DE_READ;
+      EnableEvents(DE_READ);
       error_ = EWOULDBLOCK;
       return SOCKET_ERROR;
     }
     UpdateLastError();
     bool success = (received >= 0) || IsBlockingError(error_);
     if (udp_ || success) {
-      enabled_events_ |= DE_READ;
+      EnableEvents(DE_READ);
     }
     if (!success) {
       LOG_F(LS_VERBOSE) << "Error = " << error_;
@@ -354,7 +397,43 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
       SocketAddressFromSockAddrStorage(addr_storage, out_addr);
     bool success = (received >= 0) || IsBlockingError(error_);
     if (udp_ || success) {
-      enabled_events_ |= DE_READ;
+      EnableEvents(DE_READ);
+    }
+    if (!success) {
+      LOG_F(LS_VERBOSE) << "Error = " << error_;
+    }
+    return received;
+  }
+
+#if defined(LINUX) && !defined(ANDROID)
+  // recvmmsg() and sendmmsg() are missing from older Android NDKs, which
+  // use the one-datagram-per-call fallbacks in Socket instead.
+  virtual int RecvFromBatch(SocketDatagram* datagrams, size_t count) {
+    count = _min(count, kMaxDatagramBatch);
+    mmsghdr msgs[kMaxDatagramBatch];
+    iovec iovs[kMaxDatagramBatch];
+    sockaddr_storage addrs[kMaxDatagramBatch];
+    memset(msgs, 0, count * sizeof(msgs[0]));
+    for (size_t i = 0; i < count; ++i) {
+      iovs[i].iov_base = datagrams[i].data;
+      iovs[i].iov_len = datagrams[i].size;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+    }
+    // MSG_TRUNC makes the kernel report the real length of a datagram that
+    // did not fit, so callers can tell it was cut short.
+    int received = ::recvmmsg(s_, msgs, static_cast<unsigned int>(count),
+                              MSG_TRUNC, NULL);
+    UpdateLastError();
+    for (int i = 0; i < received; ++i) {
+      datagrams[i].size = msgs[i].msg_len;
+      SocketAddressFromSockAddrStorage(addrs[i], &datagrams[i].addr);
+    }
+    bool success = (received >= 0) || IsBlockingError(error_);
+    if (udp_ || success) {
+      EnableEvents(DE_READ);
     }
     if (!success) {
       LOG_F(LS_VERBOSE) << "Error = " << error_;
@@ -362,12 +441,39 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     return received;
   }
 
+  virtual int SendToBatch(const SocketDatagram* datagrams, size_t count) {
+    count = _min(count, kMaxDatagramBatch);
+    mmsghdr msgs[kMaxDatagramBatch];
+    iovec iovs[kMaxDatagramBatch];
+    sockaddr_storage addrs[kMaxDatagramBatch];
+    memset(msgs, 0, count * sizeof(msgs[0]));
+    for (size_t i = 0; i < count; ++i) {
+      iovs[i].iov_base = datagrams[i].data;
+      iovs[i].iov_len = datagrams[i].size;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen =
+          datagrams[i].addr.ToSockAddrStorage(&addrs[i]);
+    }
+    // Suppress SIGPIPE. See Send() for explanation.
+    int sent = ::sendmmsg(s_, msgs, static_cast<unsigned int>(count),
+                          MSG_NOSIGNAL);
+    UpdateLastError();
+    MaybeRemapSendError();
+    if ((sent < 0) && IsBlockingError(error_)) {
+      EnableEvents(DE_WRITE);
+    }
+    return sent;
+  }
+#endif  // LINUX && !ANDROID
+
   int Listen(int backlog) {
     int err = ::listen(s_, backlog);
     UpdateLastError();
     if (err == 0) {
       state_ = CS_CONNECTING;
-      enabled_events_ |= DE_ACCEPT;
+      EnableEvents(DE_ACCEPT);
 #ifdef _DEBUG
       dbg_addr_ = "Listening @ ";
       dbg_addr_.append(GetLocalAddress().ToString());
@@ -384,7 +490,7 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
     UpdateLastError();
     if (s == INVALID_SOCKET)
       return NULL;
-    enabled_events_ |= DE_ACCEPT;
+    EnableEvents(DE_ACCEPT);
     if (out_addr != NULL)
       SocketAddressFromSockAddrStorage(addr_storage, out_addr);
     return ss_->WrapSocket(s);
@@ -468,6 +574,12 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
   SocketServer* socketserver() { return ss_; }
 
  protected:
+  // Turns on notifications for |events|. Overridden by SocketDispatcher so
+  // the socket server can start watching for events that were off.
+  virtual void EnableEvents(uint8 events) {
+    enabled_events_ |= events;
+  }
+
   void OnResolveResult(SignalThread* thread) {
     if (thread != resolver_) {
       return;
@@ -530,6 +642,15 @@ class PhysicalSocket : public AsyncSocket, public sigslot::has_slots<> {
         *slevel = IPPROTO_TCP;
         *sopt = TCP_NODELAY;
         break;
+      case OPT_REUSEPORT:
+#if defined(SO_REUSEPORT)
+        *slevel = SOL_SOCKET;
+        *sopt = SO_REUSEPORT;
+        break;
+#else
+        LOG(LS_WARNING) << "Socket::OPT_REUSEPORT not supported.";
+        return -1;
+#endif
       default:
         ASSERT(false);
         return -1;
@@ -870,6 +991,13 @@ class SocketDispatcher : public Dispatcher, public PhysicalSocket {
     return enabled_events_;
   }
 
+  virtual void EnableEvents(uint8 events) {
+    uint8 old_events = enabled_events_;
+    PhysicalSocket::EnableEvents(events);
+    if (enabled_events_ != old_events)
+      ss_->Update(this);
+  }
+
   virtual void OnPreEvent(uint32 ff) {
     if ((ff & DE_CONNECT) != 0)
       state_ = CS_CONNECTED;
@@ -958,6 +1086,8 @@ class FileDispatcher: public Dispatcher, public AsyncFile {
 
   virtual void set_readable(bool value) {
     flags_ = value ? (flags_ | DE_READ) : (flags_ & ~DE_READ);
+    if (value)
+      ss_->Update(this);
   }
 
   virtual bool writable() {
@@ -966,6 +1096,8 @@ class FileDispatcher: public Dispatcher, public AsyncFile {
 
   virtual void set_writable(bool value) {
     flags_ = value ? (flags_ | DE_WRITE) : (flags_ & ~DE_WRITE);
+    if (value)
+      ss_->Update(this);
   }
 
  private:
@@ -1186,10 +1318,52 @@ class Signaler : public EventDispatcher {
   bool *pf_;
 };
 
+#ifdef LINUX
+// Maximum number of ready descriptors returned by a single epoll_wait().
+static const int kMaxEpollEvents = 128;
+
+static uint32 GetEpollEvents(uint32 ff) {
+  uint32 events = 0;
+  if (ff & (DE_READ | DE_ACCEPT))
+    events |= EPOLLIN;
+  if (ff & (DE_WRITE | DE_CONNECT))
+    events |= EPOLLOUT;
+  return events;
+}
+#endif  // LINUX
+
 PhysicalSocketServer::PhysicalSocketServer()
     : fWait_(false),
       last_tick_tracked_(0),
       last_tick_dispatch_count_(0) {
+  Construct(WAIT_EPOLL_LEVEL);
+}
+
+PhysicalSocketServer::PhysicalSocketServer(WaitMode mode)
+    : fWait_(false),
+      last_tick_tracked_(0),
+      last_tick_dispatch_count_(0) {
+  Construct(mode);
+}
+
+void PhysicalSocketServer::Construct(WaitMode mode) {
+  wait_mode_ = WAIT_SELECT;
+#ifdef LINUX
+  epoll_fd_ = INVALID_SOCKET;
+  epoll_event_count_ = 0;
+  if (mode != WAIT_SELECT) {
+    // The size argument is only a hint, but must be positive.
+    epoll_fd_ = epoll_create(kMaxEpollEvents);
+    if (epoll_fd_ != INVALID_SOCKET) {
+      epoll_events_.reset(new epoll_event[kMaxEpollEvents]);
+      wait_mode_ = mode;
+    } else {
+      LOG_ERR(LS_WARNING) << "epoll_create failed, falling back to select";
+    }
+  }
+#endif
+  // The wakeup signaler is added to the dispatcher list, so it must be
+  // created after the epoll descriptor.
   signal_wakeup_ = new Signaler(this, &fWait_);
 #ifdef WIN32
   socket_ev_ = WSACreateEvent();
@@ -1205,6 +1379,10 @@ PhysicalSocketServer::~PhysicalSocketServer() {
 #endif
   delete signal_wakeup_;
   ASSERT(dispatchers_.empty());
+#ifdef LINUX
+  if (epoll_fd_ != INVALID_SOCKET)
+    close(epoll_fd_);
+#endif
 }
 
 void PhysicalSocketServer::WakeUp() {
@@ -1258,6 +1436,14 @@ void PhysicalSocketServer::Add(Dispatcher *pdispatcher) {
   if (pos != dispatchers_.end())
     return;
   dispatchers_.push_back(pdispatcher);
+#ifdef LINUX
+  if (epoll_fd_ != INVALID_SOCKET) {
+    uint32* mask = &epoll_masks_[pdispatcher];
+    *mask = 0;
+    SetEpollMask(pdispatcher, mask,
+                 GetEpollEvents(pdispatcher->GetRequestedEvents()));
+  }
+#endif
 }
 
 void PhysicalSocketServer::Remove(Dispatcher *pdispatcher) {
@@ -1274,10 +1460,201 @@ void PhysicalSocketServer::Remove(Dispatcher *pdispatcher) {
       --**it;
     }
   }
+#ifdef LINUX
+  if (epoll_fd_ != INVALID_SOCKET) {
+    EpollMaskMap::iterator it = epoll_masks_.find(pdispatcher);
+    ASSERT(it != epoll_masks_.end());
+    if (it != epoll_masks_.end()) {
+      SetEpollMask(pdispatcher, &it->second, 0);
+      epoll_masks_.erase(it);
+    }
+    // Don't deliver the rest of the current batch to a dead dispatcher.
+    for (int i = 0; i < epoll_event_count_; ++i) {
+      if (epoll_events_[i].data.ptr == pdispatcher)
+        epoll_events_[i].data.ptr = NULL;
+    }
+  }
+#endif
+}
+
+void PhysicalSocketServer::Update(Dispatcher *pdispatcher) {
+#ifdef LINUX
+  if (epoll_fd_ == INVALID_SOCKET)
+    return;
+  CritScope cs(&crit_);
+  EpollMaskMap::iterator it = epoll_masks_.find(pdispatcher);
+  if (it == epoll_masks_.end())
+    return;
+  uint32 events = GetEpollEvents(pdispatcher->GetRequestedEvents());
+  // In level-triggered mode stale events are dropped lazily by WaitEpoll(),
+  // so a registration only has to change when it needs to grow. In
+  // edge-triggered mode every update re-arms the descriptor, which makes the
+  // kernel report it again if it is still ready.
+  if (wait_mode_ == WAIT_EPOLL_LEVEL && (events & ~it->second) == 0)
+    return;
+  if (events != 0)
+    SetEpollMask(pdispatcher, &it->second, events);
+#endif
+}
+
+#ifdef LINUX
+void PhysicalSocketServer::SetEpollMask(Dispatcher* pdispatcher, uint32* mask,
+                                        uint32 new_mask) {
+  int op;
+  if (*mask == 0) {
+    if (new_mask == 0)
+      return;
+    op = EPOLL_CTL_ADD;
+  } else if (new_mask == 0) {
+    // Removing the descriptor altogether keeps EPOLLHUP, which is always
+    // reported, from spinning a level-triggered wait.
+    op = EPOLL_CTL_DEL;
+  } else {
+    op = EPOLL_CTL_MOD;
+  }
+  epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = new_mask;
+  if (wait_mode_ == WAIT_EPOLL_EDGE)
+    event.events |= EPOLLET;
+  event.data.ptr = pdispatcher;
+  if (epoll_ctl(epoll_fd_, op, pdispatcher->GetDescriptor(), &event) != 0) {
+    // A descriptor that was closed before its dispatcher was removed has
+    // already left the epoll set.
+    if (op != EPOLL_CTL_DEL || (errno != EBADF && errno != ENOENT)) {
+      LOG_E(LS_ERROR, EN, errno) << "epoll_ctl " << op << " failed for fd "
+                                 << pdispatcher->GetDescriptor();
+    }
+    if (op != EPOLL_CTL_DEL)
+      return;
+  }
+  *mask = new_mask;
 }
+#endif  // LINUX
 
 #ifdef POSIX
+// Translates select/epoll readiness of a dispatcher's descriptor into
+// dispatcher events and delivers them.
+static void ProcessEvents(Dispatcher* pdispatcher, bool readable,
+                          bool writable) {
+  int fd = pdispatcher->GetDescriptor();
+  uint32 ff = 0;
+  int errcode = 0;
+
+  // Reap any error code, which can be signaled through reads or writes.
+  // TODO: Should we set errcode if getsockopt fails?
+  if (readable || writable) {
+    socklen_t len = sizeof(errcode);
+    ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &errcode, &len);
+  }
+
+  // Check readable descriptors. If we're waiting on an accept, signal
+  // that. Otherwise we're waiting for data, check to see if we're
+  // readable or really closed.
+  // TODO: Only peek at TCP descriptors.
+  if (readable) {
+    if (pdispatcher->GetRequestedEvents() & DE_ACCEPT) {
+      ff |= DE_ACCEPT;
+    } else if (errcode || pdispatcher->IsDescriptorClosed()) {
+      ff |= DE_CLOSE;
+    } else {
+      ff |= DE_READ;
+    }
+  }
+
+  // Check writable descriptors. If we're waiting on a connect, detect
+  // success versus failure by the reaped error code.
+  if (writable) {
+    if (pdispatcher->GetRequestedEvents() & DE_CONNECT) {
+      if (!errcode) {
+        ff |= DE_CONNECT;
+      } else {
+        ff |= DE_CLOSE;
+      }
+    } else {
+      ff |= DE_WRITE;
+    }
+  }
+
+  // Tell the descriptor about the event.
+  if (ff != 0) {
+    pdispatcher->OnPreEvent(ff);
+    pdispatcher->OnEvent(ff, errcode);
+  }
+}
+
 bool PhysicalSocketServer::Wait(int cmsWait, bool process_io) {
+#ifdef LINUX
+  // A wait that only services the wakeup signaler is cheap with select().
+  if (epoll_fd_ != INVALID_SOCKET && process_io)
+    return WaitEpoll(cmsWait);
+#endif
+  return WaitSelect(cmsWait, process_io);
+}
+
+#ifdef LINUX
+bool PhysicalSocketServer::WaitEpoll(int cmsWait) {
+  uint32 msStop = 0;
+  if (cmsWait != kForever)
+    msStop = TimeAfter(cmsWait);
+
+  fWait_ = true;
+
+  while (fWait_) {
+    int n = epoll_wait(epoll_fd_, epoll_events_.get(), kMaxEpollEvents,
+                       cmsWait);
+
+    if (n < 0) {
+      if (errno != EINTR) {
+        LOG_E(LS_ERROR, EN, errno) << "epoll_wait";
+        return false;
+      }
+      // Else ignore the error and keep going, as in WaitSelect().
+    } else if (n == 0) {
+      // If timeout, return success
+      return true;
+    } else {
+      CritScope cr(&crit_);
+      epoll_event_count_ = n;
+      for (int i = 0; i < n; ++i) {
+        Dispatcher* pdispatcher =
+            static_cast<Dispatcher*>(epoll_events_[i].data.ptr);
+        // Cleared by Remove() while handling an earlier entry.
+        if (!pdispatcher)
+          continue;
+
+        uint32 ready = epoll_events_[i].events;
+        uint32 requested = GetEpollEvents(pdispatcher->GetRequestedEvents());
+        if (wait_mode_ == WAIT_EPOLL_LEVEL && (ready & ~requested) != 0) {
+          // The dispatcher turned these events off since it was registered;
+          // stop the kernel from reporting them over and over.
+          EpollMaskMap::iterator it = epoll_masks_.find(pdispatcher);
+          if (it != epoll_masks_.end() && it->second != requested)
+            SetEpollMask(pdispatcher, &it->second, requested);
+        }
+
+        // Errors and hangups are reported as readiness in both directions,
+        // just as select() does.
+        bool error = (ready & (EPOLLERR | EPOLLHUP)) != 0;
+        bool readable = (requested & EPOLLIN) &&
+            (error || (ready & EPOLLIN) != 0);
+        bool writable = (requested & EPOLLOUT) &&
+            (error || (ready & EPOLLOUT) != 0);
+        ProcessEvents(pdispatcher, readable, writable);
+      }
+      epoll_event_count_ = 0;
+    }
+
+    // Recalc the time remaining to wait.
+    if (cmsWait != kForever)
+      cmsWait = _max(TimeUntil(msStop), 0);
+  }
+
+  return true;
+}
+#endif  // LINUX
+
+bool PhysicalSocketServer::WaitSelect(int cmsWait, bool process_io) {
   // Calculate timing information
 
   struct timeval *ptvWait = NULL;
@@ -1356,51 +1733,13 @@ bool PhysicalSocketServer::Wait(int cmsWait, bool process_io) {
       for (size_t i = 0; i < dispatchers_.size(); ++i) {
         Dispatcher *pdispatcher = dispatchers_[i];
         int fd = pdispatcher->GetDescriptor();
-        uint32 ff = 0;
-        int errcode = 0;
-
-        // Reap any error code, which can be signaled through reads or writes.
-        // TODO: Should we set errcode if getsockopt fails?
-        if (FD_ISSET(fd, &fdsRead) || FD_ISSET(fd, &fdsWrite)) {
-          socklen_t len = sizeof(errcode);
-          ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &errcode, &len);
-        }
-
-        // Check readable descriptors. If we're waiting on an accept, signal
-        // that. Otherwise we're waiting for data, check to see if we're
-        // readable or really closed.
-        // TODO: Only peek at TCP descriptors.
-        if (FD_ISSET(fd, &fdsRead)) {
+        bool readable = FD_ISSET(fd, &fdsRead);
+        bool writable = FD_ISSET(fd, &fdsWrite);
+        if (readable)
           FD_CLR(fd, &fdsRead);
-          if (pdispatcher->GetRequestedEvents() & DE_ACCEPT) {
-            ff |= DE_ACCEPT;
-          } else if (errcode || pdispatcher->IsDescriptorClosed()) {
-            ff |= DE_CLOSE;
-          } else {
-            ff |= DE_READ;
-          }
-        }
-
-        // Check writable descriptors. If we're waiting on a connect, detect
-        // success versus failure by the reaped error code.
-        if (FD_ISSET(fd, &fdsWrite)) {
+        if (writable)
           FD_CLR(fd, &fdsWrite);
-          if (pdispatcher->GetRequestedEvents() & DE_CONNECT) {
-            if (!errcode) {
-              ff |= DE_CONNECT;
-            } else {
-              ff |= DE_CLOSE;
-            }
-          } else {
-            ff |= DE_WRITE;
-          }
-        }
-
-        // Tell the descriptor about the event.
-        if (ff != 0) {
-          pdispatcher->OnPreEvent(ff);
-          pdispatcher->OnEvent(ff, errcode);
-        }
+        ProcessEvents(pdispatcher, readable, writable);
       }
     }
 
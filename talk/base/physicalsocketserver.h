@@ -28,6 +28,7 @@
 #ifndef TALK_BASE_PHYSICALSOCKETSERVER_H__
 #define TALK_BASE_PHYSICALSOCKETSERVER_H__
 
+#include <map>
 #include <vector>
 
 #include "talk/base/asyncfile.h"
@@ -39,6 +40,10 @@
 typedef int SOCKET;
 #endif // POSIX
 
+#ifdef LINUX
+struct epoll_event;
+#endif // LINUX
+
 namespace talk_base {
 
 // Event constants for the Dispatcher class.
@@ -74,9 +79,28 @@ class Dispatcher {
 // A socket server that provides the real sockets of the underlying OS.
 class PhysicalSocketServer : public SocketServer {
  public:
+  // The readiness notification mechanism behind Wait().
+  enum WaitMode {
+    // select() over every dispatcher on each pass. Available everywhere, but
+    // O(n) per wakeup and limited to descriptors below FD_SETSIZE.
+    WAIT_SELECT,
+    // Level-triggered epoll (Linux only). Dispatchers are registered once and
+    // only ready descriptors are visited.
+    WAIT_EPOLL_LEVEL,
+    // Edge-triggered epoll (Linux only). A descriptor is re-armed every time
+    // its dispatcher re-enables an event, so dispatchers that do not drain
+    // their descriptor must report re-enabled events through Update().
+    WAIT_EPOLL_EDGE,
+  };
+
+  // Uses level-triggered epoll where available and select() elsewhere.
   PhysicalSocketServer();
+  // Falls back to WAIT_SELECT if |mode| is not supported on this platform.
+  explicit PhysicalSocketServer(WaitMode mode);
   virtual ~PhysicalSocketServer();
 
+  WaitMode wait_mode() const { return wait_mode_; }
+
   // SocketFactory:
   virtual Socket* CreateSocket(int type);
   virtual Socket* CreateSocket(int family, int type);
@@ -93,6 +117,9 @@ class PhysicalSocketServer : public SocketServer {
 
   void Add(Dispatcher* dispatcher);
   void Remove(Dispatcher* dispatcher);
+  // Must be called when a dispatcher enables events it was not requesting
+  // when it was added, so an epoll backend can watch for them.
+  void Update(Dispatcher* dispatcher);
 
 #ifdef POSIX
   AsyncFile* CreateFile(int fd);
@@ -117,11 +144,30 @@ class PhysicalSocketServer : public SocketServer {
   typedef std::vector<Dispatcher*> DispatcherList;
   typedef std::vector<size_t*> IteratorList;
 
+  void Construct(WaitMode mode);
+
 #ifdef POSIX
   static bool InstallSignal(int signum, void (*handler)(int));
 
+  bool WaitSelect(int cms, bool process_io);
+
   scoped_ptr<PosixSignalDispatcher> signal_dispatcher_;
 #endif
+#ifdef LINUX
+  typedef std::map<Dispatcher*, uint32> EpollMaskMap;
+
+  bool WaitEpoll(int cms);
+  void SetEpollMask(Dispatcher* dispatcher, uint32* mask, uint32 new_mask);
+
+  int epoll_fd_;
+  // The epoll events each dispatcher is currently registered for.
+  EpollMaskMap epoll_masks_;
+  // The batch returned by the last epoll_wait(). Entries for dispatchers
+  // removed while the batch is dispatched are cleared.
+  scoped_array< ::epoll_event> epoll_events_;
+  int epoll_event_count_;
+#endif
+  WaitMode wait_mode_;
   DispatcherList dispatchers_;
   IteratorList iterators_;
   Signaler* signal_wakeup_;
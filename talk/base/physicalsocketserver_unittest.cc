@@ -34,6 +34,7 @@
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/socket_unittest.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 
 namespace talk_base {
 
@@ -172,6 +173,158 @@ TEST_F(PhysicalSocketTest, TestGetSetOptionsIPv6) {
   SocketTest::TestGetSetOptionsIPv6();
 }
 
+#ifdef LINUX
+
+// Runs the generic socket tests against the wait modes that are not the
+// default on this platform.
+class PhysicalSocketSelectTest : public SocketTest {
+ protected:
+  PhysicalSocketSelectTest()
+      : server_(PhysicalSocketServer::WAIT_SELECT), scope_(&server_) {}
+
+  PhysicalSocketServer server_;
+  SocketServerScope scope_;
+};
+
+class PhysicalSocketEdgeTriggeredTest : public SocketTest {
+ protected:
+  PhysicalSocketEdgeTriggeredTest()
+      : server_(PhysicalSocketServer::WAIT_EPOLL_EDGE), scope_(&server_) {}
+
+  PhysicalSocketServer server_;
+  SocketServerScope scope_;
+};
+
+TEST_F(PhysicalSocketTest, TestDefaultWaitModeIsEpoll) {
+  PhysicalSocketServer server;
+  EXPECT_EQ(PhysicalSocketServer::WAIT_EPOLL_LEVEL, server.wait_mode());
+}
+
+TEST_F(PhysicalSocketSelectTest, TestConnectIPv4) {
+  EXPECT_EQ(PhysicalSocketServer::WAIT_SELECT, server_.wait_mode());
+  SocketTest::TestConnectIPv4();
+}
+
+TEST_F(PhysicalSocketSelectTest, TestServerCloseIPv4) {
+  SocketTest::TestServerCloseIPv4();
+}
+
+TEST_F(PhysicalSocketSelectTest, TestCloseInClosedCallbackIPv4) {
+  SocketTest::TestCloseInClosedCallbackIPv4();
+}
+
+TEST_F(PhysicalSocketSelectTest, TestSocketServerWaitIPv4) {
+  SocketTest::TestSocketServerWaitIPv4();
+}
+
+TEST_F(PhysicalSocketSelectTest, TestTcpIPv4) {
+  SocketTest::TestTcpIPv4();
+}
+
+TEST_F(PhysicalSocketSelectTest, TestUdpIPv4) {
+  SocketTest::TestUdpIPv4();
+}
+
+TEST_F(PhysicalSocketSelectTest, TestUdpReadyToSendIPv4) {
+  SocketTest::TestUdpReadyToSendIPv4();
+}
+
+TEST_F(PhysicalSocketEdgeTriggeredTest, TestConnectIPv4) {
+  EXPECT_EQ(PhysicalSocketServer::WAIT_EPOLL_EDGE, server_.wait_mode());
+  SocketTest::TestConnectIPv4();
+}
+
+TEST_F(PhysicalSocketEdgeTriggeredTest, TestServerCloseIPv4) {
+  SocketTest::TestServerCloseIPv4();
+}
+
+TEST_F(PhysicalSocketEdgeTriggeredTest, TestCloseInClosedCallbackIPv4) {
+  SocketTest::TestCloseInClosedCallbackIPv4();
+}
+
+TEST_F(PhysicalSocketEdgeTriggeredTest, TestSocketServerWaitIPv4) {
+  SocketTest::TestSocketServerWaitIPv4();
+}
+
+TEST_F(PhysicalSocketEdgeTriggeredTest, TestTcpIPv4) {
+  SocketTest::TestTcpIPv4();
+}
+
+TEST_F(PhysicalSocketEdgeTriggeredTest, TestUdpIPv4) {
+  SocketTest::TestUdpIPv4();
+}
+
+TEST_F(PhysicalSocketEdgeTriggeredTest, TestUdpReadyToSendIPv4) {
+  SocketTest::TestUdpReadyToSendIPv4();
+}
+
+// Reads every datagram that arrives on the sockets it is connected to.
+class DatagramSink : public sigslot::has_slots<> {
+ public:
+  DatagramSink() : count_(0) {}
+
+  void OnReadEvent(AsyncSocket* socket) {
+    char buf[64];
+    while (socket->Recv(buf, sizeof(buf)) >= 0) {
+      ++count_;
+    }
+  }
+
+  int count() const { return count_; }
+
+ private:
+  int count_;
+};
+
+// Measures the cost of a Wait() pass that finds a single ready socket among
+// |num_sockets| idle ones.
+static void MeasureWait(PhysicalSocketServer::WaitMode mode, int num_sockets) {
+  const int kIterations = 1000;
+  PhysicalSocketServer server(mode);
+  DatagramSink sink;
+  std::vector<AsyncSocket*> sockets;
+  for (int i = 0; i < num_sockets; ++i) {
+    AsyncSocket* socket = server.CreateAsyncSocket(AF_INET, SOCK_DGRAM);
+    ASSERT_TRUE(socket != NULL);
+    EXPECT_EQ(0, socket->Bind(SocketAddress(IPAddress(INADDR_LOOPBACK), 0)));
+    socket->SignalReadEvent.connect(&sink, &DatagramSink::OnReadEvent);
+    sockets.push_back(socket);
+  }
+  // Let every socket report its initial writability.
+  server.Wait(0, true);
+
+  scoped_ptr<AsyncSocket> sender(
+      server.CreateAsyncSocket(AF_INET, SOCK_DGRAM));
+  SocketAddress target = sockets.back()->GetLocalAddress();
+  uint32 start = Time();
+  for (int i = 0; i < kIterations; ++i) {
+    sender->SendTo("x", 1, target);
+    server.Wait(0, true);
+  }
+  uint32 elapsed = TimeSince(start);
+  EXPECT_EQ(kIterations, sink.count());
+
+  LOG(LS_INFO) << "Wait mode " << mode << ", " << num_sockets
+               << " sockets: " << elapsed * 1000 / kIterations
+               << " us per wakeup";
+  for (size_t i = 0; i < sockets.size(); ++i) {
+    delete sockets[i];
+  }
+}
+
+// Compares how the cost of a wakeup scales with the number of sockets. The
+// socket count stays below FD_SETSIZE so that select() can take part.
+TEST(PhysicalSocketServerTest, WaitScalingPerf) {
+  const int kSocketCounts[] = { 16, 128, 512, 768 };
+  for (size_t i = 0; i < ARRAY_SIZE(kSocketCounts); ++i) {
+    MeasureWait(PhysicalSocketServer::WAIT_SELECT, kSocketCounts[i]);
+    MeasureWait(PhysicalSocketServer::WAIT_EPOLL_LEVEL, kSocketCounts[i]);
+    MeasureWait(PhysicalSocketServer::WAIT_EPOLL_EDGE, kSocketCounts[i]);
+  }
+}
+
+#endif  // LINUX
+
 #ifdef POSIX
 
 class PosixSignalDeliveryTest : public testing::Test {
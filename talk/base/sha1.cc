@@ -155,9 +155,10 @@ void SHA1Transform(uint32 state[5], const uint8 buffer[64]) {
     uint32 l[16];
   };
 #ifdef SHA1HANDSOFF
-  static uint8 workspace[64];
-  memcpy(workspace, buffer, 64);
-  CHAR64LONG16* block = reinterpret_cast<CHAR64LONG16*>(workspace);
+  // On the stack, so that contexts can be used on several threads at once.
+  CHAR64LONG16 workspace;
+  memcpy(workspace.c, buffer, 64);
+  CHAR64LONG16* block = &workspace;
 #else
   // Note(fbarchard): This option does modify the user's data buffer.
   CHAR64LONG16* block = const_cast<CHAR64LONG16*>(
@@ -275,8 +276,4 @@ void SHA1Final(SHA1_CTX* context, uint8 digest[SHA1_DIGEST_SIZE]) {
   memset(context->state, 0, 20);
   memset(context->count, 0, 8);
   memset(finalcount, 0, 8);   // SWR
-
-#ifdef SHA1HANDSOFF  // Make SHA1Transform overwrite its own static vars.
-  SHA1Transform(context->state, context->buffer);
-#endif
 }
@@ -69,6 +69,9 @@
 //										  absolutely essential. However, on some platforms, creating a lot of
 //										  mutexes can slow down the whole OS, so use this option with care.
 //
+//			thread_confined				- (libjingle) The signal is only emitted on one thread. No locking is
+//										  done; debug builds assert if a second thread emits it.
+//
 //		USING THE LIBRARY
 //
 //			See the full documentation at http://sigslot.sourceforge.net/
@@ -87,6 +90,7 @@
 #ifndef TALK_BASE_SIGSLOT_H__
 #define TALK_BASE_SIGSLOT_H__
 
+#include <assert.h>
 #include <list>
 #include <set>
 #include <stdlib.h>
@@ -292,6 +296,78 @@ namespace sigslot {
 	};
 #endif // _SIGSLOT_HAS_POSIX_THREADS
 
+	// For signals that are only ever emitted on the thread that owns them,
+	// such as the per-packet signals on the network thread. Nothing is
+	// locked, and unlike single_threaded no virtual lock()/unlock() calls are
+	// made either. In debug builds the first emitting thread is remembered
+	// and emitting from any other thread asserts. Connecting and
+	// disconnecting carry the same caveats as single_threaded.
+	class thread_confined
+	{
+	public:
+		thread_confined()
+#ifdef _DEBUG
+			: m_bound(false)
+#endif
+		{
+			;
+		}
+
+		thread_confined(const thread_confined&)
+#ifdef _DEBUG
+			: m_bound(false)
+#endif
+		{
+			;
+		}
+
+		virtual ~thread_confined()
+		{
+			;
+		}
+
+		virtual void lock()
+		{
+			;
+		}
+
+		virtual void unlock()
+		{
+			;
+		}
+
+#ifdef _DEBUG
+		void check_emit_thread()
+		{
+#if defined(_SIGSLOT_HAS_WIN32_THREADS)
+			DWORD current = GetCurrentThreadId();
+			if(!m_bound)
+			{
+				m_owner = current;
+				m_bound = true;
+			}
+			assert(m_owner == current);
+#elif defined(_SIGSLOT_HAS_POSIX_THREADS)
+			pthread_t current = pthread_self();
+			if(!m_bound)
+			{
+				m_owner = current;
+				m_bound = true;
+			}
+			assert(pthread_equal(m_owner, current));
+#endif
+		}
+
+	private:
+		bool m_bound;
+#if defined(_SIGSLOT_HAS_WIN32_THREADS)
+		DWORD m_owner;
+#elif defined(_SIGSLOT_HAS_POSIX_THREADS)
+		pthread_t m_owner;
+#endif
+#endif // _DEBUG
+	};
+
 	template<class mt_policy>
 	class lock_block
 	{
@@ -310,6 +386,41 @@ namespace sigslot {
 		}
 	};
 
+	template<>
+	class lock_block<thread_confined>
+	{
+	public:
+		lock_block(thread_confined *)
+		{
+			;
+		}
+	};
+
+	// Taken around the slot calls in emit(). The same as lock_block except
+	// for thread_confined signals, where it checks the emitting thread.
+	template<class mt_policy>
+	class emit_block : public lock_block<mt_policy>
+	{
+	public:
+		emit_block(mt_policy *mtx)
+			: lock_block<mt_policy>(mtx)
+		{
+			;
+		}
+	};
+
+	template<>
+	class emit_block<thread_confined>
+	{
+	public:
+		emit_block(thread_confined *confined)
+		{
+#ifdef _DEBUG
+			confined->check_emit_thread();
+#endif
+		}
+	};
+
 	class has_slots_interface;
 
 	template<class mt_policy>
@@ -2253,7 +2364,7 @@ namespace sigslot {
 
 		void emit()
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2270,7 +2381,7 @@ namespace sigslot {
 
 		void operator()()
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2317,7 +2428,7 @@ namespace sigslot {
 
 		void emit(arg1_type a1)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2334,7 +2445,7 @@ namespace sigslot {
 
 		void operator()(arg1_type a1)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2382,7 +2493,7 @@ namespace sigslot {
 
 		void emit(arg1_type a1, arg2_type a2)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2399,7 +2510,7 @@ namespace sigslot {
 
 		void operator()(arg1_type a1, arg2_type a2)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2448,7 +2559,7 @@ namespace sigslot {
 
 		void emit(arg1_type a1, arg2_type a2, arg3_type a3)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2465,7 +2576,7 @@ namespace sigslot {
 
 		void operator()(arg1_type a1, arg2_type a2, arg3_type a3)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2515,7 +2626,7 @@ namespace sigslot {
 
 		void emit(arg1_type a1, arg2_type a2, arg3_type a3, arg4_type a4)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2532,7 +2643,7 @@ namespace sigslot {
 
 		void operator()(arg1_type a1, arg2_type a2, arg3_type a3, arg4_type a4)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2586,7 +2697,7 @@ namespace sigslot {
 		void emit(arg1_type a1, arg2_type a2, arg3_type a3, arg4_type a4,
 			arg5_type a5)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2604,7 +2715,7 @@ namespace sigslot {
 		void operator()(arg1_type a1, arg2_type a2, arg3_type a3, arg4_type a4,
 			arg5_type a5)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2660,7 +2771,7 @@ namespace sigslot {
 		void emit(arg1_type a1, arg2_type a2, arg3_type a3, arg4_type a4,
 			arg5_type a5, arg6_type a6)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2678,7 +2789,7 @@ namespace sigslot {
 		void operator()(arg1_type a1, arg2_type a2, arg3_type a3, arg4_type a4,
 			arg5_type a5, arg6_type a6)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2735,7 +2846,7 @@ namespace sigslot {
 		void emit(arg1_type a1, arg2_type a2, arg3_type a3, arg4_type a4,
 			arg5_type a5, arg6_type a6, arg7_type a7)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2753,7 +2864,7 @@ namespace sigslot {
 		void operator()(arg1_type a1, arg2_type a2, arg3_type a3, arg4_type a4,
 			arg5_type a5, arg6_type a6, arg7_type a7)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2811,7 +2922,7 @@ namespace sigslot {
 		void emit(arg1_type a1, arg2_type a2, arg3_type a3, arg4_type a4,
 			arg5_type a5, arg6_type a6, arg7_type a7, arg8_type a8)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -2829,7 +2940,7 @@ namespace sigslot {
 		void operator()(arg1_type a1, arg2_type a2, arg3_type a3, arg4_type a4,
 			arg5_type a5, arg6_type a6, arg7_type a7, arg8_type a8)
 		{
-			lock_block<mt_policy> lock(this);
+			emit_block<mt_policy> lock(this);
 			typename connections_list::const_iterator itNext, it = m_connected_slots.begin();
 			typename connections_list::const_iterator itEnd = m_connected_slots.end();
 
@@ -140,6 +140,25 @@ inline bool IsBlockingError(int e) {
   return (e == EWOULDBLOCK) || (e == EAGAIN) || (e == EINPROGRESS);
 }
 
+// One datagram for the batched receive and send calls of Socket.
+struct SocketDatagram {
+  SocketDatagram() : data(NULL), size(0) {}
+
+  // Buffer to receive into, or the payload to send.
+  char* data;
+  // For receives, the capacity of |data| on input and the length of the
+  // datagram on output. For sends, the length of the payload.
+  size_t size;
+  // Where a received datagram came from, or where to send one.
+  SocketAddress addr;
+};
+
+// One piece of the data for a gathered Socket::SendV call.
+struct SocketIoVec {
+  const void* data;
+  size_t size;
+};
+
 // General interface for the socket implementations of various networks.  The
 // methods match those of normal UNIX sockets very closely.
 class Socket {
@@ -162,6 +181,50 @@ class Socket {
   virtual int RecvFrom(void *pv, size_t cb, SocketAddress *paddr) = 0;
   virtual int Listen(int backlog) = 0;
   virtual Socket *Accept(SocketAddress *paddr) = 0;
+
+  // Receives up to |count| datagrams in one call where the platform allows
+  // it. Returns the number of datagrams received, or SOCKET_ERROR if none
+  // could be read.
+  virtual int RecvFromBatch(SocketDatagram* datagrams, size_t count) {
+    size_t i = 0;
+    for (; i < count; ++i) {
+      int len = RecvFrom(datagrams[i].data, datagrams[i].size,
+                         &datagrams[i].addr);
+      if (len < 0)
+        return (i == 0) ? len : static_cast<int>(i);
+      datagrams[i].size = static_cast<size_t>(len);
+    }
+    return static_cast<int>(i);
+  }
+  // Sends up to |count| datagrams in one call where the platform allows it.
+  // Returns the number of datagrams sent, which may be less than |count|, or
+  // SOCKET_ERROR if none could be sent.
+  virtual int SendToBatch(const SocketDatagram* datagrams, size_t count) {
+    size_t i = 0;
+    for (; i < count; ++i) {
+      int sent = SendTo(datagrams[i].data, datagrams[i].size,
+                        datagrams[i].addr);
+      if (sent < 0)
+        return (i == 0) ? sent : static_cast<int>(i);
+    }
+    return static_cast<int>(i);
+  }
+  // Sends the concatenation of |count| buffers in one call where the
+  // platform allows it, like writev(). Returns the number of bytes sent,
+  // which may be less than the total, or SOCKET_ERROR if none could be sent.
+  virtual int SendV(const SocketIoVec* buffers, size_t count) {
+    int total = 0;
+    for (size_t i = 0; i < count; ++i) {
+      int sent = Send(buffers[i].data, buffers[i].size);
+      if (sent < 0)
+        return (total == 0) ? sent : total;
+      total += sent;
+      if (static_cast<size_t>(sent) < buffers[i].size)
+        break;
+    }
+    return total;
+  }
+
   virtual int Close() = 0;
   virtual int GetError() const = 0;
   virtual void SetError(int error) = 0;
@@ -184,7 +247,9 @@ class Socket {
     OPT_RCVBUF,      // receive buffer size
     OPT_SNDBUF,      // send buffer size
     OPT_NODELAY,     // whether Nagle algorithm is enabled
-    OPT_IPV6_V6ONLY  // Whether the socket is IPv6 only.
+    OPT_IPV6_V6ONLY, // Whether the socket is IPv6 only.
+    OPT_REUSEPORT    // Whether other sockets may bind the same address and
+                     // port (SO_REUSEPORT). Must be set before Bind.
   };
   virtual int GetOption(Option opt, int* value) = 0;
   virtual int SetOption(Option opt, int value) = 0;
@@ -226,6 +226,11 @@ bool SocketAddressFromSockAddrStorage(const sockaddr_storage& saddr,
                                       SocketAddress* out);
 SocketAddress EmptySocketAddressWithFamily(int family);
 
+// Hash functor for keying hash tables (e.g. FlatHashMap) by SocketAddress.
+struct SocketAddressHash {
+  size_t operator()(const SocketAddress& addr) const { return addr.Hash(); }
+};
+
 }  // namespace talk_base
 
 #endif  // TALK_BASE_SOCKETADDRESS_H_
@@ -843,7 +843,9 @@ bool FifoBuffer::SetCapacity(size_t size) {
 
   if (size != buffer_length_) {
     char* buffer = new char[size];
-    const size_t copy = data_length_;
+    // When growing, copy the whole ring so that bytes written ahead of the
+    // readable data by WriteOffset() survive.
+    const size_t copy = (size > buffer_length_) ? buffer_length_ : data_length_;
     const size_t tail_copy = _min(copy, buffer_length_ - read_position_);
     memcpy(buffer, &buffer_[read_position_], tail_copy);
     memcpy(buffer + tail_copy, &buffer_[0], copy - tail_copy);
@@ -929,6 +931,17 @@ const void* FifoBuffer::GetReadData(size_t* size) {
   return &buffer_[read_position_];
 }
 
+const void* FifoBuffer::GetReadDataAt(size_t offset, size_t* size) {
+  CritScope cs(&crit_);
+  if (offset >= data_length_) {
+    *size = 0;
+    return NULL;
+  }
+  const size_t read_position = (read_position_ + offset) % buffer_length_;
+  *size = _min(data_length_ - offset, buffer_length_ - read_position);
+  return &buffer_[read_position];
+}
+
 void FifoBuffer::ConsumeReadData(size_t size) {
   CritScope cs(&crit_);
   ASSERT(size <= data_length_);
@@ -621,8 +621,14 @@ class FifoBuffer : public StreamInterface {
   // Gets the amount of data currently readable from the buffer.
   bool GetBuffered(size_t* data_len) const;
   // Resizes the buffer to the specified capacity. Fails if data_length_ > size
+  // When growing, data written with WriteOffset() but not yet consumed is
+  // kept as well.
   bool SetCapacity(size_t length);
 
+  // Like GetReadData(), but starts |offset| bytes past the current read
+  // position. Returns NULL if there is no readable data at |offset|.
+  const void* GetReadDataAt(size_t offset, size_t* data_len);
+
   // Read into |buffer| with an offset from the current read position, offset
   // is specified in number of bytes.
   // This method doesn't adjust read position nor the number of available
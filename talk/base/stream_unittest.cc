@@ -451,6 +451,54 @@ TEST(FifoBufferTest, WriteOffsetAndReadOffset) {
   EXPECT_EQ(SR_BLOCK, buf.ReadOffset(out, 10, 16, NULL));
 }
 
+TEST(FifoBufferTest, GetReadDataAt) {
+  const size_t kSize = 16;
+  const char in[kSize + 1] = "0123456789ABCDEF";
+  FifoBuffer buf(kSize);
+
+  // Leave 10 readable bytes that wrap around the end of the buffer.
+  EXPECT_EQ(SR_SUCCESS, buf.Write(in, 12, NULL, NULL));
+  buf.ConsumeReadData(8);
+  EXPECT_EQ(SR_SUCCESS, buf.Write(in + 12, 4, NULL, NULL));
+  EXPECT_EQ(SR_SUCCESS, buf.Write(in, 2, NULL, NULL));
+
+  size_t len;
+  const char* data = static_cast<const char*>(buf.GetReadDataAt(0, &len));
+  ASSERT_TRUE(data != NULL);
+  EXPECT_EQ(8u, len);
+  EXPECT_EQ(0, memcmp(data, in + 8, 8));
+  data = static_cast<const char*>(buf.GetReadDataAt(3, &len));
+  ASSERT_TRUE(data != NULL);
+  EXPECT_EQ(5u, len);
+  EXPECT_EQ(0, memcmp(data, in + 11, 5));
+  data = static_cast<const char*>(buf.GetReadDataAt(8, &len));
+  ASSERT_TRUE(data != NULL);
+  EXPECT_EQ(2u, len);
+  EXPECT_EQ(0, memcmp(data, in, 2));
+  EXPECT_TRUE(buf.GetReadDataAt(10, &len) == NULL);
+  EXPECT_EQ(0u, len);
+}
+
+TEST(FifoBufferTest, SetCapacityKeepsDataWrittenAtOffset) {
+  const size_t kSize = 16;
+  const char in[kSize + 1] = "0123456789ABCDEF";
+  char out[kSize];
+  FifoBuffer buf(kSize);
+
+  // Readable data that wraps, and a block written ahead of it.
+  EXPECT_EQ(SR_SUCCESS, buf.Write(in, 12, NULL, NULL));
+  buf.ConsumeReadData(10);
+  EXPECT_EQ(SR_SUCCESS, buf.WriteOffset(in, 4, 4, NULL));
+
+  EXPECT_TRUE(buf.SetCapacity(2 * kSize));
+  buf.ConsumeWriteBuffer(8);
+  size_t read;
+  EXPECT_EQ(SR_SUCCESS, buf.Read(out, sizeof(out), &read, NULL));
+  EXPECT_EQ(10u, read);
+  EXPECT_EQ(0, memcmp(out, in + 10, 2));
+  EXPECT_EQ(0, memcmp(out + 6, in, 4));
+}
+
 TEST(AsyncWriteTest, TestWrite) {
   FifoBuffer* buf = new FifoBuffer(100);
   AsyncWriteStream stream(buf, Thread::Current());
@@ -212,9 +212,12 @@
         'base/firewallsocketserver.h',
         'base/flags.cc',
         'base/flags.h',
+        'base/flathashmap.h',
         'base/gunit_prod.h',
         'base/helpers.cc',
         'base/helpers.h',
+        'base/hmacsha1.cc',
+        'base/hmacsha1.h',
         'base/host.cc',
         'base/host.h',
         'base/httpbase.cc',
@@ -236,6 +239,8 @@
         'base/json.h',
         'base/linked_ptr.h',
         'base/linuxfdwalk.h',
+        'base/lockfreeringbuffer.cc',
+        'base/lockfreeringbuffer.h',
         'base/logging.cc',
         'base/logging.h',
         'base/maccocoasocketserver.h',
@@ -269,6 +274,8 @@
         'base/nullsocketserver.h',
         'base/optionsfile.cc',
         'base/optionsfile.h',
+        'base/packetbuffer.cc',
+        'base/packetbuffer.h',
         'base/pathutils.cc',
         'base/pathutils.h',
         'base/physicalsocketserver.cc',
@@ -843,6 +850,8 @@
         'p2p/base/constants.h',
         'p2p/base/dtlstransportchannel.cc',
         'p2p/base/dtlstransportchannel.h',
+        'p2p/base/icecheckscheduler.cc',
+        'p2p/base/icecheckscheduler.h',
         'p2p/base/p2ptransport.cc',
         'p2p/base/p2ptransport.h',
         'p2p/base/p2ptransportchannel.cc',
@@ -861,6 +870,8 @@
         'p2p/base/portproxy.h',
         'p2p/base/pseudotcp.cc',
         'p2p/base/pseudotcp.h',
+        'p2p/base/pseudotcpcongestion.cc',
+        'p2p/base/pseudotcpcongestion.h',
         'p2p/base/rawtransport.cc',
         'p2p/base/rawtransport.h',
         'p2p/base/rawtransportchannel.cc',
@@ -879,6 +890,8 @@
         'p2p/base/sessionmanager.h',
         'p2p/base/sessionmessages.cc',
         'p2p/base/sessionmessages.h',
+        'p2p/base/shardedturnserver.cc',
+        'p2p/base/shardedturnserver.h',
         'p2p/base/stun.cc',
         'p2p/base/stun.h',
         'p2p/base/stunport.cc',
@@ -905,6 +918,8 @@
         'p2p/base/turnserver.cc',
         'p2p/base/turnserver.h',
         'p2p/base/udpport.h',
+        'p2p/base/udpportmux.cc',
+        'p2p/base/udpportmux.h',
         'p2p/client/autoportallocator.h',
         'p2p/client/basicportallocator.cc',
         'p2p/client/basicportallocator.h',
@@ -949,12 +964,21 @@
         'session/media/soundclip.h',
         'session/media/srtpfilter.cc',
         'session/media/srtpfilter.h',
+        'session/media/ssrcdemuxer.cc',
+        'session/media/ssrcdemuxer.h',
         'session/media/ssrcmuxfilter.cc',
         'session/media/ssrcmuxfilter.h',
         'session/media/typingmonitor.cc',
         'session/media/typingmonitor.h',
         'session/media/voicechannel.h',
       ],
+      'conditions': [
+        ['libsrtp_has_user_data==1', {
+          'defines': [
+            'SRTP_HAVE_USER_DATA',
+          ],
+        }],
+      ],
     },  # target libjingle_p2p
     {
       'target_name': 'libjingle_peerconnection',
@@ -106,6 +106,7 @@
       ],
       'sources': [
         'base/asynchttprequest_unittest.cc',
+        'base/asyncudpsocket_unittest.cc',
         'base/atomicops_unittest.cc',
         'base/autodetectproxy_unittest.cc',
         'base/bandwidthsmoother_unittest.cc',
@@ -120,12 +121,15 @@
         'base/event_unittest.cc',
         'base/filelock_unittest.cc',
         'base/fileutils_unittest.cc',
+        'base/flathashmap_unittest.cc',
         'base/helpers_unittest.cc',
+        'base/hmacsha1_unittest.cc',
         'base/host_unittest.cc',
         'base/httpbase_unittest.cc',
         'base/httpcommon_unittest.cc',
         'base/httpserver_unittest.cc',
         'base/ipaddress_unittest.cc',
+        'base/lockfreeringbuffer_unittest.cc',
         'base/logging_unittest.cc',
         'base/md5digest_unittest.cc',
         'base/messagedigest_unittest.cc',
@@ -135,6 +139,7 @@
         'base/network_unittest.cc',
         'base/nullsocketserver_unittest.cc',
         'base/optionsfile_unittest.cc',
+        'base/packetbuffer_unittest.cc',
         'base/pathutils_unittest.cc',
         'base/physicalsocketserver_unittest.cc',
         'base/proxy_unittest.cc',
@@ -324,13 +329,16 @@
         # webrtc issue #1541.
         # 'p2p/base/dtlstransportchannel_unittest.cc',
         'p2p/base/fakesession.h',
+        'p2p/base/icecheckscheduler_unittest.cc',
         'p2p/base/p2ptransportchannel_unittest.cc',
         'p2p/base/port_unittest.cc',
         'p2p/base/portallocatorsessionproxy_unittest.cc',
         'p2p/base/pseudotcp_unittest.cc',
+        'p2p/base/pseudotcpcongestion_unittest.cc',
         'p2p/base/relayport_unittest.cc',
         'p2p/base/relayserver_unittest.cc',
         'p2p/base/session_unittest.cc',
+        'p2p/base/shardedturnserver_unittest.cc',
         'p2p/base/stun_unittest.cc',
         'p2p/base/stunport_unittest.cc',
         'p2p/base/stunrequest_unittest.cc',
@@ -352,6 +360,7 @@
         'session/media/mediasessionclient_unittest.cc',
         'session/media/rtcpmuxfilter_unittest.cc',
         'session/media/srtpfilter_unittest.cc',
+        'session/media/ssrcdemuxer_unittest.cc',
         'session/media/ssrcmuxfilter_unittest.cc',
       ],
       'conditions': [
@@ -85,4 +85,17 @@ bool IsCoreIOrBetter() {
   return false;
 }
 
+bool HasAesNiAndClmul() {
+#if !defined(DISABLE_YUV) && (defined(__i386__) || defined(__x86_64__) || \
+    defined(_M_IX86) || defined(_M_X64))
+  int cpu_info[4];
+  libyuv::CpuId(cpu_info, 1);  // Function 1: Feature flags in ECX.
+  const int kCpuIdEcxPclmulqdq = 1 << 1;
+  const int kCpuIdEcxAes = 1 << 25;
+  return (cpu_info[2] & kCpuIdEcxPclmulqdq) && (cpu_info[2] & kCpuIdEcxAes);
+#else
+  return false;
+#endif
+}
+
 }  // namespace cricket
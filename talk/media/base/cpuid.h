@@ -71,6 +71,10 @@ class CpuInfo {
 // Detect an Intel Core I5 or better such as 4th generation Macbook Air.
 bool IsCoreIOrBetter();
 
+// Detect the AES-NI and carry-less multiply (PCLMULQDQ) instructions, which
+// together make AES-GCM about as cheap as AES-CM with HMAC-SHA1.
+bool HasAesNiAndClmul();
+
 }  // namespace cricket
 
 #endif  // TALK_MEDIA_BASE_CPUID_H_
@@ -72,3 +72,15 @@ TEST(CpuInfoTest, IsCoreIOrBetter) {
   }
 }
 
+
+TEST(CpuInfoTest, HasAesNiAndClmul) {
+  bool aes_clmul = cricket::HasAesNiAndClmul();
+  // Tests the function is callable.  Run on known hardware to confirm.
+  LOG(LS_INFO) << "HasAesNiAndClmul: " << aes_clmul;
+
+  // AES-NI first shipped after SSE 4.1, and only on x86.
+  if (aes_clmul) {
+    EXPECT_TRUE(cricket::CpuInfo::TestCpuFlag(cricket::CpuInfo::kCpuHasX86));
+    EXPECT_TRUE(cricket::CpuInfo::TestCpuFlag(cricket::CpuInfo::kCpuHasSSE41));
+  }
+}
@@ -34,6 +34,7 @@
 #include "talk/base/basictypes.h"
 #include "talk/base/buffer.h"
 #include "talk/base/logging.h"
+#include "talk/base/packetbuffer.h"
 #include "talk/base/sigslot.h"
 #include "talk/base/socket.h"
 #include "talk/base/window.h"
@@ -402,6 +403,18 @@ class MediaChannel : public sigslot::has_slots<> {
     enum SocketType { ST_RTP, ST_RTCP };
     virtual bool SendPacket(talk_base::Buffer* packet) = 0;
     virtual bool SendRtcp(talk_base::Buffer* packet) = 0;
+    // Ref-counted variants that let the packet travel down to the socket
+    // without being copied.  The defaults copy into a Buffer.
+    virtual bool SendPacketBuffer(talk_base::PacketBuffer* packet) {
+      talk_base::Buffer buffer(packet->data(), packet->length(),
+                               packet->length() + packet->tailroom());
+      return SendPacket(&buffer);
+    }
+    virtual bool SendRtcpBuffer(talk_base::PacketBuffer* packet) {
+      talk_base::Buffer buffer(packet->data(), packet->length(),
+                               packet->length() + packet->tailroom());
+      return SendRtcp(&buffer);
+    }
     virtual int SetOption(SocketType type, talk_base::Socket::Option opt,
                           int option) = 0;
     virtual ~NetworkInterface() {}
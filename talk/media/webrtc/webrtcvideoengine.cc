@@ -41,6 +41,8 @@
 #include "talk/base/common.h"
 #include "talk/base/cpumonitor.h"
 #include "talk/base/logging.h"
+#include "talk/base/packetbuffer.h"
+#include "talk/base/scoped_ref_ptr.h"
 #include "talk/base/stringutils.h"
 #include "talk/base/thread.h"
 #include "talk/base/timeutils.h"
@@ -3526,8 +3528,9 @@ int WebRtcVideoMediaChannel::SendPacket(int channel, const void* data,
   if (!network_interface_) {
     return -1;
   }
-  talk_base::Buffer packet(data, len, kMaxRtpPacketLen);
-  return network_interface_->SendPacket(&packet) ? len : -1;
+  talk_base::scoped_refptr<talk_base::PacketBuffer> packet(
+      talk_base::PacketBuffer::Create(data, len));
+  return network_interface_->SendPacketBuffer(packet) ? len : -1;
 }
 
 int WebRtcVideoMediaChannel::SendRTCPPacket(int channel,
@@ -3536,8 +3539,9 @@ int WebRtcVideoMediaChannel::SendRTCPPacket(int channel,
   if (!network_interface_) {
     return -1;
   }
-  talk_base::Buffer packet(data, len, kMaxRtpPacketLen);
-  return network_interface_->SendRtcp(&packet) ? len : -1;
+  talk_base::scoped_refptr<talk_base::PacketBuffer> packet(
+      talk_base::PacketBuffer::Create(data, len));
+  return network_interface_->SendRtcpBuffer(packet) ? len : -1;
 }
 
 void WebRtcVideoMediaChannel::QueueBlackFrame(uint32 ssrc, int64 timestamp,
@@ -36,6 +36,8 @@
 #include "talk/base/buffer.h"
 #include "talk/base/byteorder.h"
 #include "talk/base/logging.h"
+#include "talk/base/packetbuffer.h"
+#include "talk/base/scoped_ref_ptr.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/stream.h"
 #include "talk/media/base/rtputils.h"
@@ -343,16 +345,18 @@ class WebRtcMediaChannel : public T, public webrtc::Transport {
     }
     sequence_number_ = seq_num;
 
-    talk_base::Buffer packet(data, len, kMaxRtpPacketLen);
-    return T::network_interface_->SendPacket(&packet) ? len : -1;
+    talk_base::scoped_refptr<talk_base::PacketBuffer> packet(
+        talk_base::PacketBuffer::Create(data, len));
+    return T::network_interface_->SendPacketBuffer(packet) ? len : -1;
   }
   virtual int SendRTCPPacket(int channel, const void *data, int len) {
     if (!T::network_interface_) {
       return -1;
     }
 
-    talk_base::Buffer packet(data, len, kMaxRtpPacketLen);
-    return T::network_interface_->SendRtcp(&packet) ? len : -1;
+    talk_base::scoped_refptr<talk_base::PacketBuffer> packet(
+        talk_base::PacketBuffer::Create(data, len));
+    return T::network_interface_->SendRtcpBuffer(packet) ? len : -1;
   }
   int sequence_number() const {
     return sequence_number_;
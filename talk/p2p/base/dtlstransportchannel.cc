@@ -323,6 +323,21 @@ int DtlsTransportChannelWrapper::SendPacket(const char* data, size_t size,
   return result;
 }
 
+int DtlsTransportChannelWrapper::SendBuffer(talk_base::PacketBuffer* packet,
+                                            int flags) {
+  if (dtls_state_ == STATE_NONE) {
+    return channel_->SendBuffer(packet, 0);
+  }
+  if (dtls_state_ == STATE_OPEN && (flags & PF_SRTP_BYPASS)) {
+    ASSERT(!srtp_ciphers_.empty());
+    if (!IsRtpPacket(packet->data(), packet->length())) {
+      return -1;
+    }
+    return channel_->SendBuffer(packet, 0);
+  }
+  return SendPacket(packet->data(), packet->length(), flags);
+}
+
 // The state transition logic here is as follows:
 // (1) If we're not doing DTLS-SRTP, then the state is just the
 //     state of the underlying impl()
@@ -135,6 +135,9 @@ class DtlsTransportChannelWrapper : public TransportChannelImpl {
 
   // Called to send a packet (via DTLS, if turned on).
   virtual int SendPacket(const char* data, size_t size, int flags);
+  // SRTP-protected and non-DTLS packets go down without a copy; anything
+  // that has to be DTLS-encrypted takes the SendPacket path.
+  virtual int SendBuffer(talk_base::PacketBuffer* packet, int flags);
 
   // TransportChannel calls that we forward to the wrapped transport.
   virtual int SetOption(talk_base::Socket::Option opt, int value) {
@@ -31,6 +31,7 @@
 #include "talk/base/common.h"
 #include "talk/base/gunit.h"
 #include "talk/base/helpers.h"
+#include "talk/base/packetbuffer.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/stringutils.h"
 #include "talk/base/thread.h"
@@ -217,6 +218,11 @@ class DtlsTestClient : public sigslot::has_slots<> {
     } while (sent < count);
   }
 
+  int SendBuffer(size_t channel, talk_base::PacketBuffer* packet, int flags) {
+    ASSERT(channel < channels_.size());
+    return channels_[channel]->SendBuffer(packet, flags);
+  }
+
   void ExpectPackets(size_t channel, size_t size) {
     packet_size_ = size;
     received_.clear();
@@ -562,3 +568,16 @@ TEST_F(DtlsTransportChannelTest, TestTransferDtlsSrtpDemux) {
   TestTransfer(0, 1000, 100, false);
   TestTransfer(0, 1000, 100, true);
 }
+
+// Check that SendBuffer reports an error, rather than 0 bytes sent, for a
+// non-RTP packet with the bypass flag.
+TEST_F(DtlsTransportChannelTest, TestSendBufferBypassNonRtp) {
+  MAYBE_SKIP_TEST(HaveDtlsSrtp);
+  PrepareDtls(true, true);
+  PrepareDtlsSrtp(true, true);
+  ASSERT_TRUE(Connect());
+  char data[100] = { 0 };
+  talk_base::scoped_refptr<talk_base::PacketBuffer> packet(
+      talk_base::PacketBuffer::Create(data, sizeof(data)));
+  EXPECT_EQ(-1, client1_.SendBuffer(0, packet, cricket::PF_SRTP_BYPASS));
+}
@@ -0,0 +1,284 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/p2p/base/icecheckscheduler.h"
+
+#include <algorithm>
+
+#include "talk/base/common.h"
+#include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
+
+namespace {
+
+enum {
+  MSG_CHECK = 1,
+};
+
+// The lists are asked for checks at least this often, in milliseconds.
+const uint32 kMaxTickInterval = 1000;
+
+}  // namespace
+
+namespace cricket {
+
+const int IceCheckScheduler::kDefaultTa;
+const int IceCheckScheduler::kMaxFrozenTime;
+
+IceCheckScheduler::IceCheckScheduler(talk_base::Thread* thread)
+    : thread_(thread),
+      ta_(kDefaultTa),
+      freezing_(true),
+      next_entry_(0),
+      has_sent_(false),
+      last_check_time_(0),
+      timer_time_(0) {
+}
+
+IceCheckScheduler::~IceCheckScheduler() {
+  thread_->CancelDelayed(timer_);
+}
+
+void IceCheckScheduler::set_ta(int ta) {
+  ASSERT(ta > 0);
+  ta_ = ta;
+}
+
+void IceCheckScheduler::AddCheckList(IceCheckList* list) {
+  if (FindEntry(list))
+    return;
+
+  // Only freeze the new list if there is another one that is not frozen to
+  // wait for.
+  bool frozen = false;
+  if (freezing_) {
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      if (!entries_[i].frozen) {
+        frozen = true;
+        break;
+      }
+    }
+  }
+  Entry entry = { list, frozen, talk_base::TimeAfter(kMaxFrozenTime), false,
+                  0, -1 };
+  entries_.push_back(entry);
+  ScheduleCheck();
+}
+
+void IceCheckScheduler::RemoveCheckList(IceCheckList* list) {
+  for (EntryList::iterator it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it->list == list) {
+      entries_.erase(it);
+      break;
+    }
+  }
+  TriggeredCheckList::iterator it = triggered_checks_.begin();
+  while (it != triggered_checks_.end()) {
+    if (it->list == list) {
+      it = triggered_checks_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  if (next_entry_ >= entries_.size())
+    next_entry_ = 0;
+
+  if (entries_.empty()) {
+    thread_->CancelDelayed(timer_);
+    timer_ = talk_base::TimerHandle();
+  }
+}
+
+void IceCheckScheduler::ScheduleCheck() {
+  if (!entries_.empty())
+    ScheduleTick(EarliestCheckTime(talk_base::Time()));
+}
+
+void IceCheckScheduler::AddTriggeredCheck(IceCheckList* list,
+                                          Connection* conn) {
+  Entry* entry = FindEntry(list);
+  if (!entry)
+    return;
+  for (TriggeredCheckList::iterator it = triggered_checks_.begin();
+       it != triggered_checks_.end(); ++it) {
+    if (it->connection == conn)
+      return;
+  }
+
+  // A check from the peer means it has started on this list, so we should
+  // too (RFC 5245 section 7.2.1.4).
+  entry->frozen = false;
+  TriggeredCheck check = { list, conn };
+  triggered_checks_.push_back(check);
+  ScheduleCheck();
+}
+
+void IceCheckScheduler::CancelTriggeredCheck(Connection* conn) {
+  for (TriggeredCheckList::iterator it = triggered_checks_.begin();
+       it != triggered_checks_.end(); ++it) {
+    if (it->connection == conn) {
+      triggered_checks_.erase(it);
+      return;
+    }
+  }
+}
+
+void IceCheckScheduler::OnCheckListConnected(IceCheckList* list) {
+  Entry* entry = FindEntry(list);
+  if (!entry || entry->connect_time >= 0)
+    return;
+
+  entry->connect_time = entry->checked ?
+      std::max(talk_base::TimeSince(entry->first_check_time), 0) : 0;
+  ++stats_.lists_connected;
+  stats_.max_connect_time = std::max(stats_.max_connect_time,
+                                     entry->connect_time);
+
+  // The other components are now likely to work the same way, so start on
+  // them (RFC 5245 section 7.1.3.2.3).
+  bool thawed = false;
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    if (entries_[i].frozen) {
+      entries_[i].frozen = false;
+      thawed = true;
+    }
+  }
+  if (thawed)
+    ScheduleCheck();
+}
+
+int IceCheckScheduler::GetConnectTime(IceCheckList* list) const {
+  const Entry* entry = FindEntry(list);
+  return entry ? entry->connect_time : -1;
+}
+
+bool IceCheckScheduler::IsFrozen(IceCheckList* list) const {
+  const Entry* entry = FindEntry(list);
+  return entry && entry->frozen;
+}
+
+IceCheckScheduler::Entry* IceCheckScheduler::FindEntry(IceCheckList* list) {
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    if (entries_[i].list == list)
+      return &entries_[i];
+  }
+  return NULL;
+}
+
+const IceCheckScheduler::Entry* IceCheckScheduler::FindEntry(
+    IceCheckList* list) const {
+  return const_cast<IceCheckScheduler*>(this)->FindEntry(list);
+}
+
+bool IceCheckScheduler::SendTriggeredCheck(uint32 now) {
+  if (triggered_checks_.empty())
+    return false;
+
+  TriggeredCheck check = triggered_checks_.front();
+  triggered_checks_.pop_front();
+  Entry* entry = FindEntry(check.list);
+  ASSERT(entry != NULL);
+  ++stats_.triggered_checks_sent;
+  SendCheck(entry, check.connection, now);
+  return true;
+}
+
+// Gives the check to the first list, after the one that had the last check,
+// that has one due.  Otherwise sets |next_time| to when one may be.
+bool IceCheckScheduler::SendOrderedCheck(uint32 now, uint32* next_time) {
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    size_t index = (next_entry_ + i) % entries_.size();
+    Entry* entry = &entries_[index];
+    if (entry->frozen) {
+      if (talk_base::TimeIsLater(now, entry->thaw_time)) {
+        *next_time = talk_base::TimeMin(*next_time, entry->thaw_time);
+        continue;
+      }
+      entry->frozen = false;
+    }
+
+    uint32 list_time = *next_time;
+    Connection* conn = entry->list->GetNextCheck(now, &list_time);
+    if (conn) {
+      next_entry_ = (index + 1) % entries_.size();
+      SendCheck(entry, conn, now);
+      return true;
+    }
+    *next_time = talk_base::TimeMin(*next_time, list_time);
+  }
+  return false;
+}
+
+void IceCheckScheduler::SendCheck(Entry* entry, Connection* conn,
+                                  uint32 now) {
+  if (!entry->checked) {
+    entry->checked = true;
+    entry->first_check_time = now;
+  }
+  ++stats_.checks_sent;
+  has_sent_ = true;
+  last_check_time_ = now;
+  // This goes last; the list may call back into us.
+  entry->list->SendCheck(conn);
+}
+
+// Returns the earliest time the pacing allows the next check at.
+uint32 IceCheckScheduler::EarliestCheckTime(uint32 now) const {
+  if (!has_sent_)
+    return now;
+  return talk_base::TimeMax(now, last_check_time_ + ta_);
+}
+
+void IceCheckScheduler::ScheduleTick(uint32 time) {
+  if (!timer_.IsNull()) {
+    // A tick that is already coming soon enough will do.
+    if (talk_base::TimeIsLaterOrEqual(timer_time_, time))
+      return;
+    thread_->CancelDelayed(timer_);
+  }
+  timer_time_ = time;
+  timer_ = thread_->PostAtTimer(time, this, MSG_CHECK);
+}
+
+void IceCheckScheduler::OnMessage(talk_base::Message* msg) {
+  ASSERT(msg->message_id == MSG_CHECK);
+  timer_ = talk_base::TimerHandle();
+  if (entries_.empty())
+    return;
+
+  uint32 now = talk_base::Time();
+  uint32 next_time = now + kMaxTickInterval;
+  if (SendTriggeredCheck(now) || SendOrderedCheck(now, &next_time)) {
+    // There may well be more to check.
+    next_time = now;
+  }
+  // Even lists with nothing to check are asked again no sooner than Ta.
+  if (!entries_.empty())
+    ScheduleTick(talk_base::TimeMax(next_time, now + ta_));
+}
+
+}  // namespace cricket
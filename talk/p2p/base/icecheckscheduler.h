@@ -0,0 +1,165 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_P2P_BASE_ICECHECKSCHEDULER_H_
+#define TALK_P2P_BASE_ICECHECKSCHEDULER_H_
+
+#include <deque>
+#include <vector>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+#include "talk/base/messagehandler.h"
+#include "talk/base/messagequeue.h"
+
+namespace talk_base {
+class Thread;
+}
+
+namespace cricket {
+
+class Connection;
+
+// The candidate pairs of one component, which an IceCheckScheduler sends
+// connectivity checks for.  P2PTransportChannel is one.
+class IceCheckList {
+ public:
+  virtual ~IceCheckList() {}
+
+  // Returns the connection to check next, or NULL if no check is due at
+  // |now|, in which case |next_time| is set to when to ask again.
+  virtual Connection* GetNextCheck(uint32 now, uint32* next_time) = 0;
+  // Sends a connectivity check on |conn|.
+  virtual void SendCheck(Connection* conn) = 0;
+};
+
+// Schedules the connectivity checks of all the check lists of an ICE agent,
+// which for us is all the channels of a Transport (RFC 5245 section 5.8).
+// A single check goes out every Ta milliseconds, whatever the number of
+// components and candidate pairs, and the lists take turns.  Triggered
+// checks, for pairs the peer has just checked, are sent before any ordinary
+// check.  Lists added after the first start out frozen, and are thawed when
+// a list connects or when the peer checks one of their pairs.
+class IceCheckScheduler : public talk_base::MessageHandler {
+ public:
+  // RFC 5245 section 16 recommends at least 20 ms for RTP media.
+  static const int kDefaultTa = 20;
+  // How long a list stays frozen at most, in case the list it waits on never
+  // connects.
+  static const int kMaxFrozenTime = 1000;
+
+  struct Stats {
+    Stats() : checks_sent(0), triggered_checks_sent(0), lists_connected(0),
+              max_connect_time(0) {}
+
+    int checks_sent;  // Including the triggered ones.
+    int triggered_checks_sent;
+    int lists_connected;
+    // The longest time from a list's first check to it becoming writable, in
+    // milliseconds; the time it took the whole transport to connect.
+    int max_connect_time;
+  };
+
+  explicit IceCheckScheduler(talk_base::Thread* thread);
+  virtual ~IceCheckScheduler();
+
+  // The pacing interval, in milliseconds.
+  int ta() const { return ta_; }
+  void set_ta(int ta);
+
+  // Whether lists after the first start out frozen.  Affects lists added
+  // afterwards.  A frozen list thaws by itself after kMaxFrozenTime.
+  bool freezing() const { return freezing_; }
+  void set_freezing(bool freezing) { freezing_ = freezing; }
+
+  // Starts and stops sending checks for |list|.  The scheduler does not take
+  // ownership.
+  void AddCheckList(IceCheckList* list);
+  void RemoveCheckList(IceCheckList* list);
+
+  // Asks for the next check as soon as the pacing allows, because a list may
+  // have something new to check.
+  void ScheduleCheck();
+  // Queues a check of |conn|, which goes ahead of the ordinary checks and
+  // thaws |list|.  A connection is queued at most once.
+  void AddTriggeredCheck(IceCheckList* list, Connection* conn);
+  // Forgets any triggered check of |conn|, which is going away.
+  void CancelTriggeredCheck(Connection* conn);
+
+  // Called when |list| gets its first writable connection.  This records its
+  // connect time and thaws the other lists.
+  void OnCheckListConnected(IceCheckList* list);
+
+  const Stats& stats() const { return stats_; }
+  // Returns the milliseconds |list| took to connect, or -1 if it has not yet.
+  int GetConnectTime(IceCheckList* list) const;
+  bool IsFrozen(IceCheckList* list) const;
+
+ private:
+  struct Entry {
+    IceCheckList* list;
+    bool frozen;
+    uint32 thaw_time;
+    bool checked;
+    uint32 first_check_time;
+    int connect_time;
+  };
+  struct TriggeredCheck {
+    IceCheckList* list;
+    Connection* connection;
+  };
+  typedef std::vector<Entry> EntryList;
+  typedef std::deque<TriggeredCheck> TriggeredCheckList;
+
+  Entry* FindEntry(IceCheckList* list);
+  const Entry* FindEntry(IceCheckList* list) const;
+  bool SendTriggeredCheck(uint32 now);
+  bool SendOrderedCheck(uint32 now, uint32* next_time);
+  void SendCheck(Entry* entry, Connection* conn, uint32 now);
+  uint32 EarliestCheckTime(uint32 now) const;
+  void ScheduleTick(uint32 time);
+  virtual void OnMessage(talk_base::Message* msg);
+
+  talk_base::Thread* thread_;
+  int ta_;
+  bool freezing_;
+  EntryList entries_;
+  // The entry to give the next ordinary check to.
+  size_t next_entry_;
+  TriggeredCheckList triggered_checks_;
+  bool has_sent_;
+  uint32 last_check_time_;
+  talk_base::TimerHandle timer_;
+  uint32 timer_time_;
+  Stats stats_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(IceCheckScheduler);
+};
+
+}  // namespace cricket
+
+#endif  // TALK_P2P_BASE_ICECHECKSCHEDULER_H_
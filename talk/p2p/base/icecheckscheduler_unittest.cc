@@ -0,0 +1,171 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <vector>
+
+#include "talk/base/gunit.h"
+#include "talk/base/thread.h"
+#include "talk/p2p/base/icecheckscheduler.h"
+
+using cricket::Connection;
+using cricket::IceCheckList;
+using cricket::IceCheckScheduler;
+
+static const int kTa = 20;
+
+// A check list that has a check due whenever it is asked, unless it is idle,
+// and remembers the checks it is given.  Its connections are only compared,
+// never used.
+class FakeCheckList : public IceCheckList {
+ public:
+  FakeCheckList() : idle_(false) {}
+
+  virtual Connection* GetNextCheck(uint32 now, uint32* next_time) {
+    if (idle_) {
+      *next_time = now + 10 * kTa;
+      return NULL;
+    }
+    return connection(0);
+  }
+  virtual void SendCheck(Connection* conn) {
+    checks_.push_back(conn);
+  }
+
+  Connection* connection(int i) {
+    return reinterpret_cast<Connection*>(&slots_[i]);
+  }
+  void set_idle(bool idle) { idle_ = idle; }
+  const std::vector<Connection*>& checks() const { return checks_; }
+
+ private:
+  bool idle_;
+  char slots_[4];
+  std::vector<Connection*> checks_;
+};
+
+class IceCheckSchedulerTest : public testing::Test {
+ public:
+  IceCheckSchedulerTest() : scheduler_(talk_base::Thread::Current()) {
+    scheduler_.set_ta(kTa);
+  }
+
+  void Run(int ms) {
+    talk_base::Thread::Current()->ProcessMessages(ms);
+  }
+
+ protected:
+  IceCheckScheduler scheduler_;
+  FakeCheckList list1_;
+  FakeCheckList list2_;
+};
+
+// Checks go out once per Ta however many lists there are, and the lists take
+// turns.
+TEST_F(IceCheckSchedulerTest, TestPacing) {
+  scheduler_.set_freezing(false);
+  scheduler_.AddCheckList(&list1_);
+  scheduler_.AddCheckList(&list2_);
+  Run(10 * kTa);
+
+  int checks = scheduler_.stats().checks_sent;
+  EXPECT_LE(checks, 11);
+  EXPECT_GE(checks, 5);
+  EXPECT_EQ(checks, static_cast<int>(list1_.checks().size() +
+                                     list2_.checks().size()));
+  EXPECT_LE(abs(static_cast<int>(list1_.checks().size()) -
+                static_cast<int>(list2_.checks().size())), 1);
+}
+
+// A list added after another waits for it to connect.
+TEST_F(IceCheckSchedulerTest, TestFreezing) {
+  scheduler_.AddCheckList(&list1_);
+  scheduler_.AddCheckList(&list2_);
+  EXPECT_FALSE(scheduler_.IsFrozen(&list1_));
+  EXPECT_TRUE(scheduler_.IsFrozen(&list2_));
+  Run(5 * kTa);
+  EXPECT_FALSE(list1_.checks().empty());
+  EXPECT_TRUE(list2_.checks().empty());
+
+  scheduler_.OnCheckListConnected(&list1_);
+  EXPECT_FALSE(scheduler_.IsFrozen(&list2_));
+  EXPECT_EQ(1, scheduler_.stats().lists_connected);
+  EXPECT_GE(scheduler_.GetConnectTime(&list1_), 0);
+  EXPECT_EQ(-1, scheduler_.GetConnectTime(&list2_));
+  Run(5 * kTa);
+  EXPECT_FALSE(list2_.checks().empty());
+}
+
+// A frozen list does not wait forever on one that does not connect.
+TEST_F(IceCheckSchedulerTest, TestFrozenListThaws) {
+  list1_.set_idle(true);
+  scheduler_.AddCheckList(&list1_);
+  scheduler_.AddCheckList(&list2_);
+  Run(IceCheckScheduler::kMaxFrozenTime / 2);
+  EXPECT_TRUE(list2_.checks().empty());
+  EXPECT_TRUE_WAIT(!list2_.checks().empty(),
+                   IceCheckScheduler::kMaxFrozenTime);
+  EXPECT_FALSE(scheduler_.IsFrozen(&list2_));
+}
+
+// Triggered checks go first, thaw their list and are only sent once.
+TEST_F(IceCheckSchedulerTest, TestTriggeredCheck) {
+  scheduler_.AddCheckList(&list1_);
+  scheduler_.AddCheckList(&list2_);
+  list2_.set_idle(true);
+  scheduler_.AddTriggeredCheck(&list2_, list2_.connection(1));
+  scheduler_.AddTriggeredCheck(&list2_, list2_.connection(1));
+  EXPECT_FALSE(scheduler_.IsFrozen(&list2_));
+  Run(5 * kTa);
+  ASSERT_EQ(1U, list2_.checks().size());
+  EXPECT_EQ(list2_.connection(1), list2_.checks()[0]);
+  EXPECT_EQ(1, scheduler_.stats().triggered_checks_sent);
+  EXPECT_GT(scheduler_.stats().checks_sent, 1);
+}
+
+TEST_F(IceCheckSchedulerTest, TestCancelTriggeredCheck) {
+  list1_.set_idle(true);
+  scheduler_.AddCheckList(&list1_);
+  scheduler_.AddTriggeredCheck(&list1_, list1_.connection(1));
+  scheduler_.CancelTriggeredCheck(list1_.connection(1));
+  Run(5 * kTa);
+  EXPECT_TRUE(list1_.checks().empty());
+  EXPECT_EQ(0, scheduler_.stats().checks_sent);
+}
+
+// Lists that are removed get no more checks, and the others carry on.
+TEST_F(IceCheckSchedulerTest, TestRemoveCheckList) {
+  scheduler_.set_freezing(false);
+  scheduler_.AddCheckList(&list1_);
+  scheduler_.AddCheckList(&list2_);
+  Run(3 * kTa);
+  scheduler_.RemoveCheckList(&list1_);
+  size_t checks = list1_.checks().size();
+  Run(5 * kTa);
+  EXPECT_EQ(checks, list1_.checks().size());
+  EXPECT_GE(list2_.checks().size(), 3U);
+}
@@ -62,7 +62,8 @@ P2PTransport::P2PTransport(talk_base::Thread* signaling_thread,
                            const std::string& content_name,
                            PortAllocator* allocator)
     : Transport(signaling_thread, worker_thread,
-                content_name, NS_GINGLE_P2P, allocator) {
+                content_name, NS_GINGLE_P2P, allocator),
+      check_scheduler_(worker_thread) {
 }
 
 P2PTransport::~P2PTransport() {
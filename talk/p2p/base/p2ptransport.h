@@ -30,6 +30,7 @@
 
 #include <string>
 #include <vector>
+#include "talk/p2p/base/icecheckscheduler.h"
 #include "talk/p2p/base/transport.h"
 
 namespace cricket {
@@ -42,6 +43,9 @@ class P2PTransport : public Transport {
                PortAllocator* allocator);
   virtual ~P2PTransport();
 
+  // Paces the connectivity checks of all of our channels.
+  IceCheckScheduler* check_scheduler() { return &check_scheduler_; }
+
  protected:
   // Creates and destroys P2PTransportChannel.
   virtual TransportChannelImpl* CreateTransportChannel(int component);
@@ -49,6 +53,9 @@ class P2PTransport : public Transport {
 
   friend class P2PTransportChannel;
 
+ private:
+  IceCheckScheduler check_scheduler_;
+
   DISALLOW_EVIL_CONSTRUCTORS(P2PTransport);
 };
 
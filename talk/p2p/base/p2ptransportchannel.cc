@@ -27,11 +27,12 @@
 
 #include "talk/p2p/base/p2ptransportchannel.h"
 
-#include <set>
+#include <algorithm>
 #include "talk/base/common.h"
 #include "talk/base/crc32.h"
 #include "talk/base/logging.h"
 #include "talk/base/stringencode.h"
+#include "talk/base/timeutils.h"
 #include "talk/p2p/base/timeouts.h"
 #include "talk/p2p/base/common.h"
 #include "talk/p2p/base/relayport.h"  // For RELAY_PORT_TYPE.
@@ -43,7 +44,6 @@ namespace {
 // messages for queuing up work for ourselves
 enum {
   MSG_SORT = 1,
-  MSG_PING,
 };
 
 // See the enum definition to better understand these values
@@ -93,40 +93,6 @@ int CompareConnections(cricket::Connection *a, cricket::Connection *b) {
   return CompareConnectionCandidates(a, b);
 }
 
-// Wraps the comparison connection into a less than operator that puts higher
-// priority writable connections first.
-class ConnectionCompare {
- public:
-  bool operator()(const cricket::Connection *ca,
-                  const cricket::Connection *cb) {
-    cricket::Connection* a = const_cast<cricket::Connection*>(ca);
-    cricket::Connection* b = const_cast<cricket::Connection*>(cb);
-
-    ASSERT(a->port()->IceProtocol() == b->port()->IceProtocol());
-
-    // Compare first on writability and static preferences.
-    int cmp = CompareConnections(a, b);
-    if (cmp > 0)
-      return true;
-    if (cmp < 0)
-      return false;
-
-    // Otherwise, sort based on latency estimate.
-    return a->rtt() < b->rtt();
-
-    // Should we bother checking for the last connection that last received
-    // data? It would help rendezvous on the connection that is also receiving
-    // packets.
-    //
-    // TODO: Yes we should definitely do this.  The TCP protocol gains
-    // efficiency by being used bidirectionally, as opposed to two separate
-    // unidirectional streams.  This test should probably occur before
-    // comparison of local prefs (assuming combined prefs are the same).  We
-    // need to be careful though, not to bounce back and forth with both sides
-    // trying to rendevous with the other.
-  }
-};
-
 // Determines whether we should switch between two connections, based first on
 // static preferences and then (if those are equal) on latency estimates.
 bool ShouldSwitch(cricket::Connection* a_conn, cricket::Connection* b_conn) {
@@ -168,12 +134,20 @@ P2PTransportChannel::P2PTransportChannel(const std::string& content_name,
     remote_ice_mode_(ICEMODE_FULL),
     role_(ROLE_UNKNOWN),
     tiebreaker_(0),
-    remote_candidate_generation_(0) {
+    remote_candidate_generation_(0),
+    scheduler_(transport ? transport->check_scheduler() : NULL),
+    last_check_time_(0) {
+  if (!scheduler_) {
+    owned_scheduler_.reset(new IceCheckScheduler(worker_thread_));
+    scheduler_ = owned_scheduler_.get();
+  }
 }
 
 P2PTransportChannel::~P2PTransportChannel() {
   ASSERT(worker_thread_ == talk_base::Thread::Current());
 
+  scheduler_->RemoveCheckList(this);
+
   for (uint32 i = 0; i < allocator_sessions_.size(); ++i)
     delete allocator_sessions_[i];
 }
@@ -286,7 +260,7 @@ void P2PTransportChannel::Connect() {
   Allocate();
 
   // Start pinging as the ports come in.
-  thread()->Post(this, MSG_PING);
+  scheduler_->AddCheckList(this);
 }
 
 // Reset the socket, clear up any previous allocations and start over
@@ -317,9 +291,11 @@ void P2PTransportChannel::Reset() {
   if (transport_->connect_requested())
     Allocate();
 
-  // Start pinging as the ports come in.
+  // Start pinging as the ports come in, with our connect time measured
+  // afresh.
   thread()->Clear(this);
-  thread()->Post(this, MSG_PING);
+  scheduler_->RemoveCheckList(this);
+  scheduler_->AddCheckList(this);
 }
 
 // A new port is available, attempt to make connections for it
@@ -623,7 +599,7 @@ bool P2PTransportChannel::CreateConnection(PortInterface* port,
     if (!connection)
       return false;
 
-    connections_.push_back(connection);
+    AddRankedConnection(connection);
     connection->set_remote_ice_mode(remote_ice_mode_);
     connection->SignalReadPacket.connect(
         this, &P2PTransportChannel::OnReadPacket);
@@ -650,9 +626,11 @@ bool P2PTransportChannel::CreateConnection(PortInterface* port,
 
 bool P2PTransportChannel::FindConnection(
     cricket::Connection* connection) const {
-  std::vector<Connection*>::const_iterator citer =
-      std::find(connections_.begin(), connections_.end(), connection);
-  return citer != connections_.end();
+  for (size_t i = 0; i < connections_.size(); ++i) {
+    if (connections_[i].connection == connection)
+      return true;
+  }
+  return false;
 }
 
 uint32 P2PTransportChannel::GetRemoteCandidateGeneration(
@@ -741,14 +719,32 @@ int P2PTransportChannel::SendPacket(const char *data, size_t len, int flags) {
   return sent;
 }
 
+int P2PTransportChannel::SendBuffer(talk_base::PacketBuffer* packet,
+                                    int flags) {
+  ASSERT(worker_thread_ == talk_base::Thread::Current());
+  if (flags != 0) {
+    error_ = EINVAL;
+    return -1;
+  }
+  if (best_connection_ == NULL) {
+    error_ = EWOULDBLOCK;
+    return -1;
+  }
+  int sent = best_connection_->SendBuffer(packet);
+  if (sent <= 0) {
+    ASSERT(sent < 0);
+    error_ = best_connection_->GetError();
+  }
+  return sent;
+}
+
 bool P2PTransportChannel::GetStats(ConnectionInfos *infos) {
   ASSERT(worker_thread_ == talk_base::Thread::Current());
   // Gather connection infos.
   infos->clear();
 
-  std::vector<Connection *>::const_iterator it;
-  for (it = connections_.begin(); it != connections_.end(); ++it) {
-    Connection *connection = *it;
+  for (size_t i = 0; i < connections_.size(); ++i) {
+    Connection *connection = connections_[i].connection;
     ConnectionInfo info;
     info.best_connection = (best_connection_ == connection);
     info.readable =
@@ -788,7 +784,7 @@ void P2PTransportChannel::UpdateConnectionStates() {
   // We need to copy the list of connections since some may delete themselves
   // when we call UpdateState.
   for (uint32 i = 0; i < connections_.size(); ++i)
-    connections_[i]->UpdateState(now);
+    connections_[i].connection->UpdateState(now);
 }
 
 // Prepare for best candidate sorting.
@@ -811,26 +807,19 @@ void P2PTransportChannel::SortConnections() {
   // Any changes after this point will require a re-sort.
   sort_dirty_ = false;
 
-  // Get a list of the networks that we are using.
-  std::set<talk_base::Network*> networks;
-  for (uint32 i = 0; i < connections_.size(); ++i)
-    networks.insert(connections_[i]->port()->Network());
-
-  // Find the best alternative connection by sorting.  It is important to note
+  // Find the best alternative connection by ranking.  It is important to note
   // that amongst equal preference, writable connections, this will choose the
   // one whose estimated latency is lowest.  So it is the only one that we
   // need to consider switching to.
-
-  ConnectionCompare cmp;
-  std::stable_sort(connections_.begin(), connections_.end(), cmp);
+  RankConnections();
   LOG(LS_VERBOSE) << "Sorting available connections:";
   for (uint32 i = 0; i < connections_.size(); ++i) {
-    LOG(LS_VERBOSE) << connections_[i]->ToString();
+    LOG(LS_VERBOSE) << connections_[i].connection->ToString();
   }
 
   Connection* top_connection = NULL;
   if (connections_.size() > 0)
-    top_connection = connections_[0];
+    top_connection = connections_[0].connection;
 
   // We don't want to pick the best connections if channel is using RFC5245
   // and it's mode is CONTROLLED, as connections will be selected by the
@@ -842,23 +831,39 @@ void P2PTransportChannel::SortConnections() {
       SwitchBestConnectionTo(top_connection);
   }
 
+  // Find the premier connection on each network we are using: the best
+  // connection if it is on that network, and otherwise the top-ranked one.
+  // There are only ever a few networks.
+  std::vector<Connection*> premiers;
+  if (best_connection_)
+    premiers.push_back(best_connection_);
+  for (uint32 i = 0; i < connections_.size(); ++i) {
+    Connection* connection = connections_[i].connection;
+    talk_base::Network* network = connection->port()->Network();
+    size_t j = 0;
+    while (j < premiers.size() && premiers[j]->port()->Network() != network)
+      ++j;
+    if (j == premiers.size())
+      premiers.push_back(connection);
+  }
+
   // We can prune any connection for which there is a writable connection on
   // the same network with better or equal priority.  We leave those with
   // better priority just in case they become writable later (at which point,
   // we would prune out the current best connection).  We leave connections on
   // other networks because they may not be using the same resources and they
   // may represent very distinct paths over which we can switch.
-  std::set<talk_base::Network*>::iterator network;
-  for (network = networks.begin(); network != networks.end(); ++network) {
-    Connection* primier = GetBestConnectionOnNetwork(*network);
-    if (!primier || (primier->write_state() != Connection::STATE_WRITABLE))
+  for (size_t j = 0; j < premiers.size(); ++j) {
+    Connection* premier = premiers[j];
+    if (premier->write_state() != Connection::STATE_WRITABLE)
       continue;
 
     for (uint32 i = 0; i < connections_.size(); ++i) {
-      if ((connections_[i] != primier) &&
-          (connections_[i]->port()->Network() == *network) &&
-          (CompareConnectionCandidates(primier, connections_[i]) >= 0)) {
-        connections_[i]->Prune();
+      Connection* connection = connections_[i].connection;
+      if ((connection != premier) &&
+          (connection->port()->Network() == premier->port()->Network()) &&
+          (CompareConnectionCandidates(premier, connection) >= 0)) {
+        connection->Prune();
       }
     }
   }
@@ -866,7 +871,8 @@ void P2PTransportChannel::SortConnections() {
   // Check if all connections are timedout.
   bool all_connections_timedout = true;
   for (uint32 i = 0; i < connections_.size(); ++i) {
-    if (connections_[i]->write_state() != Connection::STATE_WRITE_TIMEOUT) {
+    if (connections_[i].connection->write_state() !=
+        Connection::STATE_WRITE_TIMEOUT) {
       all_connections_timedout = false;
       break;
     }
@@ -888,6 +894,105 @@ void P2PTransportChannel::SortConnections() {
 }
 
 
+// Refreshes the values |entry| is ranked by from its connection, and returns
+// whether any of them changed.
+bool P2PTransportChannel::UpdateRank(RankedConnection* entry) {
+  Connection* connection = entry->connection;
+  RankedConnection old = *entry;
+  entry->write_state = connection->write_state();
+  entry->priority = connection->priority();
+  entry->generation = connection->remote_candidate().generation() +
+      connection->port()->generation();
+  entry->rtt = connection->rtt();
+  return entry->write_state != old.write_state ||
+      entry->priority != old.priority ||
+      entry->generation != old.generation ||
+      entry->rtt != old.rtt;
+}
+
+// Puts higher priority writable connections first, in the same order as
+// CompareConnections, and then the ones with lower latency estimates.
+bool P2PTransportChannel::RanksBefore(const RankedConnection& a,
+                                      const RankedConnection& b) {
+  // Better write states have lower values.
+  if (a.write_state != b.write_state)
+    return a.write_state < b.write_state;
+  if (a.priority != b.priority)
+    return a.priority > b.priority;
+  // Prefer a younger generation.
+  int generation_cmp = a.generation - b.generation;
+  if (generation_cmp != 0)
+    return generation_cmp > 0;
+  return a.rtt < b.rtt;
+
+  // Should we bother checking for the last connection that last received
+  // data? It would help rendezvous on the connection that is also receiving
+  // packets.
+  //
+  // TODO: Yes we should definitely do this.  The TCP protocol gains
+  // efficiency by being used bidirectionally, as opposed to two separate
+  // unidirectional streams.  This test should probably occur before
+  // comparison of local prefs (assuming combined prefs are the same).  We
+  // need to be careful though, not to bounce back and forth with both sides
+  // trying to rendevous with the other.
+}
+
+// Adds a new connection after the ones that rank at least as well.
+void P2PTransportChannel::AddRankedConnection(Connection* connection) {
+  RankedConnection entry = { connection, 0, 0, 0, 0 };
+  UpdateRank(&entry);
+  connections_.insert(std::upper_bound(connections_.begin(),
+                                       connections_.end(), entry,
+                                       &P2PTransportChannel::RanksBefore),
+                      entry);
+}
+
+// Moves the connection at |index|, whose values have changed, to its new
+// place.  Amongst equally ranked connections it keeps its old relative order,
+// as a stable sort would.
+void P2PTransportChannel::RerankConnection(size_t index) {
+  RankedConnection entry = connections_[index];
+  connections_.erase(connections_.begin() + index);
+  UpdateRank(&entry);
+  std::pair<RankedConnections::iterator, RankedConnections::iterator> equal =
+      std::equal_range(connections_.begin(), connections_.end(), entry,
+                       &P2PTransportChannel::RanksBefore);
+  RankedConnections::iterator pos = connections_.begin() + index;
+  if (pos < equal.first) {
+    pos = equal.first;
+  } else if (pos > equal.second) {
+    pos = equal.second;
+  }
+  connections_.insert(pos, entry);
+}
+
+// Brings the ranking up to date.  Usually only a few connections have changed
+// since the last time, and only those are moved; if many have, they are all
+// sorted again.
+void P2PTransportChannel::RankConnections() {
+  std::vector<Connection*> changed;
+  for (size_t i = 0; i < connections_.size(); ++i) {
+    RankedConnection entry = connections_[i];
+    if (UpdateRank(&entry))
+      changed.push_back(entry.connection);
+  }
+
+  if (changed.size() * 4 > connections_.size()) {
+    for (size_t i = 0; i < connections_.size(); ++i)
+      UpdateRank(&connections_[i]);
+    std::stable_sort(connections_.begin(), connections_.end(),
+                     &P2PTransportChannel::RanksBefore);
+    return;
+  }
+
+  for (size_t i = 0; i < changed.size(); ++i) {
+    size_t index = 0;
+    while (connections_[index].connection != changed[i])
+      ++index;
+    RerankConnection(index);
+  }
+}
+
 // Track the best connection, and let listeners know
 void P2PTransportChannel::SwitchBestConnectionTo(Connection* conn) {
   // Note: if conn is NULL, the previous best_connection_ has been destroyed,
@@ -919,7 +1024,8 @@ void P2PTransportChannel::UpdateChannelState() {
 
   bool readable = false;
   for (uint32 i = 0; i < connections_.size(); ++i) {
-    if (connections_[i]->read_state() == Connection::STATE_READABLE)
+    if (connections_[i].connection->read_state() ==
+        Connection::STATE_READABLE)
       readable = true;
   }
   set_readable(readable);
@@ -939,6 +1045,7 @@ void P2PTransportChannel::HandleWritable() {
 
   was_writable_ = true;
   set_writable(true);
+  scheduler_->OnCheckListConnected(this);
 }
 
 // Notify upper layer about channel not writable state, if it was before.
@@ -955,32 +1062,12 @@ void P2PTransportChannel::HandleAllTimedOut() {
   HandleNotWritable();
 }
 
-// If we have a best connection, return it, otherwise return top one in the
-// list (later we will mark it best).
-Connection* P2PTransportChannel::GetBestConnectionOnNetwork(
-    talk_base::Network* network) {
-  // If the best connection is on this network, then it wins.
-  if (best_connection_ && (best_connection_->port()->Network() == network))
-    return best_connection_;
-
-  // Otherwise, we return the top-most in sorted order.
-  for (uint32 i = 0; i < connections_.size(); ++i) {
-    if (connections_[i]->port()->Network() == network)
-      return connections_[i];
-  }
-
-  return NULL;
-}
-
 // Handle any queued up requests
 void P2PTransportChannel::OnMessage(talk_base::Message *pmsg) {
   switch (pmsg->message_id) {
     case MSG_SORT:
       OnSort();
       break;
-    case MSG_PING:
-      OnPing();
-      break;
     default:
       ASSERT(false);
       break;
@@ -993,20 +1080,30 @@ void P2PTransportChannel::OnSort() {
   SortConnections();
 }
 
-// Handle queued up ping request
-void P2PTransportChannel::OnPing() {
+// Picks the connection to ping next, when our scheduler has a check to
+// give us.  While writable, we only ping to keep our connections alive.
+Connection* P2PTransportChannel::GetNextCheck(uint32 now, uint32* next_time) {
   // Make sure the states of the connections are up-to-date (since this affects
   // which ones are pingable).
   UpdateConnectionStates();
 
-  // Find the oldest pingable connection and have it do a ping.
+  if (writable() &&
+      talk_base::TimeIsLater(now, last_check_time_ + WRITABLE_DELAY)) {
+    *next_time = last_check_time_ + WRITABLE_DELAY;
+    return NULL;
+  }
+
+  // Find the oldest pingable connection and have it do a ping.  If there is
+  // none yet, we want to be asked again at the next opportunity.
   Connection* conn = FindNextPingableConnection();
-  if (conn)
-    PingConnection(conn);
+  if (!conn)
+    *next_time = writable() ? now + WRITABLE_DELAY : now;
+  return conn;
+}
 
-  // Post ourselves a message to perform the next ping.
-  uint32 delay = writable() ? WRITABLE_DELAY : UNWRITABLE_DELAY;
-  thread()->PostDelayed(delay, this, MSG_PING);
+void P2PTransportChannel::SendCheck(Connection* conn) {
+  last_check_time_ = talk_base::Time();
+  PingConnection(conn);
 }
 
 // Is the connection in a state for us to even consider pinging the other side?
@@ -1046,10 +1143,11 @@ Connection* P2PTransportChannel::FindNextPingableConnection() {
   Connection* oldest_conn = NULL;
   uint32 oldest_time = 0xFFFFFFFF;
   for (uint32 i = 0; i < connections_.size(); ++i) {
-    if (IsPingable(connections_[i])) {
-      if (connections_[i]->last_ping_sent() < oldest_time) {
-        oldest_time = connections_[i]->last_ping_sent();
-        oldest_conn = connections_[i];
+    Connection* conn = connections_[i].connection;
+    if (IsPingable(conn)) {
+      if (conn->last_ping_sent() < oldest_time) {
+        oldest_time = conn->last_ping_sent();
+        oldest_conn = conn;
       }
     }
   }
@@ -1098,6 +1196,20 @@ void P2PTransportChannel::OnConnectionStateChange(Connection* connection) {
     }
   }
 
+  // With ICE, the other side checking a connection we have not got through
+  // on yet means it is likely to work, so we check it right away (RFC 5245
+  // section 7.2.1.4).  Pruned connections are left alone, even if the check
+  // was asked for before they were pruned.
+  if (protocol_type_ == ICEPROTO_RFC5245 &&
+      connection->connected() &&
+      connection->read_state() == Connection::STATE_READABLE &&
+      (connection->write_state() == Connection::STATE_WRITE_INIT ||
+       connection->write_state() == Connection::STATE_WRITE_UNRELIABLE)) {
+    scheduler_->AddTriggeredCheck(this, connection);
+  } else {
+    scheduler_->CancelTriggeredCheck(connection);
+  }
+
   // We have to unroll the stack before doing this because we may be changing
   // the state of connections while sorting.
   RequestSort();
@@ -1112,10 +1224,12 @@ void P2PTransportChannel::OnConnectionDestroyed(Connection* connection) {
   // use it.
 
   // Remove this connection from the list.
-  std::vector<Connection*>::iterator iter =
-      std::find(connections_.begin(), connections_.end(), connection);
+  RankedConnections::iterator iter = connections_.begin();
+  while (iter != connections_.end() && iter->connection != connection)
+    ++iter;
   ASSERT(iter != connections_.end());
   connections_.erase(iter);
+  scheduler_->CancelTriggeredCheck(connection);
 
   LOG_J(LS_INFO, this) << "Removed connection ("
     << static_cast<int>(connections_.size()) << " remaining)";
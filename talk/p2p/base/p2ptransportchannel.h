@@ -40,8 +40,10 @@
 #include <map>
 #include <vector>
 #include <string>
+#include "talk/base/scoped_ptr.h"
 #include "talk/base/sigslot.h"
 #include "talk/p2p/base/candidate.h"
+#include "talk/p2p/base/icecheckscheduler.h"
 #include "talk/p2p/base/portinterface.h"
 #include "talk/p2p/base/portallocator.h"
 #include "talk/p2p/base/transport.h"
@@ -66,6 +68,7 @@ class RemoteCandidate : public Candidate {
 // P2PTransportChannel manages the candidates and connection process to keep
 // two P2P clients connected to each other.
 class P2PTransportChannel : public TransportChannelImpl,
+                            public IceCheckList,
                             public talk_base::MessageHandler {
  public:
   P2PTransportChannel(const std::string& content_name,
@@ -93,10 +96,15 @@ class P2PTransportChannel : public TransportChannelImpl,
 
   // From TransportChannel:
   virtual int SendPacket(const char *data, size_t len, int flags);
+  virtual int SendBuffer(talk_base::PacketBuffer* packet, int flags);
   virtual int SetOption(talk_base::Socket::Option opt, int value);
   virtual int GetError() { return error_; }
   virtual bool GetStats(std::vector<ConnectionInfo>* stats);
 
+  // From IceCheckList:
+  virtual Connection* GetNextCheck(uint32 now, uint32* next_time);
+  virtual void SendCheck(Connection* conn);
+
   const Connection* best_connection() const { return best_connection_; }
   void set_incoming_only(bool value) { incoming_only_ = value; }
 
@@ -106,7 +114,21 @@ class P2PTransportChannel : public TransportChannelImpl,
 
   IceMode remote_ice_mode() const { return remote_ice_mode_; }
 
+  // The scheduler our checks are sent by; the transport's, or our own if we
+  // have no transport.
+  IceCheckScheduler* check_scheduler() { return scheduler_; }
+
  private:
+  // A connection, with the values it was last ranked by.
+  struct RankedConnection {
+    Connection* connection;
+    int write_state;
+    uint64 priority;
+    uint32 generation;
+    uint32 rtt;
+  };
+  typedef std::vector<RankedConnection> RankedConnections;
+
   talk_base::Thread* thread() { return worker_thread_; }
   PortAllocatorSession* allocator_session() {
     return allocator_sessions_.back();
@@ -116,13 +138,18 @@ class P2PTransportChannel : public TransportChannelImpl,
   void UpdateConnectionStates();
   void RequestSort();
   void SortConnections();
+  static bool UpdateRank(RankedConnection* entry);
+  static bool RanksBefore(const RankedConnection& a,
+                          const RankedConnection& b);
+  void AddRankedConnection(Connection* connection);
+  void RerankConnection(size_t index);
+  void RankConnections();
   void SwitchBestConnectionTo(Connection* conn);
   void UpdateChannelState();
   void HandleWritable();
   void HandleNotWritable();
   void HandleAllTimedOut();
 
-  Connection* GetBestConnectionOnNetwork(talk_base::Network* network);
   bool CreateConnections(const Candidate &remote_candidate,
                          PortInterface* origin_port, bool readable);
   bool CreateConnection(PortInterface* port, const Candidate& remote_candidate,
@@ -159,7 +186,6 @@ class P2PTransportChannel : public TransportChannelImpl,
 
   virtual void OnMessage(talk_base::Message *pmsg);
   void OnSort();
-  void OnPing();
 
   P2PTransport* transport_;
   PortAllocator *allocator_;
@@ -169,7 +195,9 @@ class P2PTransportChannel : public TransportChannelImpl,
   int error_;
   std::vector<PortAllocatorSession*> allocator_sessions_;
   std::vector<PortInterface *> ports_;
-  std::vector<Connection *> connections_;
+  // Kept sorted, best first, by the values each connection was last ranked
+  // by, so that re-sorting only has to move the connections that changed.
+  RankedConnections connections_;
   Connection* best_connection_;
   // Connection selected by the controlling agent. This should be used only
   // at controlled side when protocol type is RFC5245.
@@ -188,6 +216,9 @@ class P2PTransportChannel : public TransportChannelImpl,
   TransportRole role_;
   uint64 tiebreaker_;
   uint32 remote_candidate_generation_;
+  talk_base::scoped_ptr<IceCheckScheduler> owned_scheduler_;
+  IceCheckScheduler* scheduler_;
+  uint32 last_check_time_;
 
   DISALLOW_EVIL_CONSTRUCTORS(P2PTransportChannel);
 };
@@ -36,11 +36,13 @@
 #include "talk/base/proxyserver.h"
 #include "talk/base/socketaddress.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 #include "talk/base/virtualsocketserver.h"
 #include "talk/p2p/base/p2ptransportchannel.h"
 #include "talk/p2p/base/testrelayserver.h"
 #include "talk/p2p/base/teststunserver.h"
 #include "talk/p2p/client/basicportallocator.h"
+#include "talk/p2p/client/fakeportallocator.h"
 
 using cricket::kDefaultPortAllocatorFlags;
 using cricket::kMinimumStepDelay;
@@ -1085,6 +1087,29 @@ TEST_F(P2PTransportChannelTest, GetStats) {
   DestroyChannels();
 }
 
+// Test that the check scheduler records how long the channel took to connect.
+TEST_F(P2PTransportChannelTest, ConnectTime) {
+  ConfigureEndpoints(OPEN, OPEN,
+                     kDefaultPortAllocatorFlags,
+                     kDefaultPortAllocatorFlags,
+                     kDefaultStepDelay, kDefaultStepDelay,
+                     cricket::ICEPROTO_RFC5245);
+  CreateChannels(1);
+  EXPECT_TRUE_WAIT_MARGIN(ep1_ch1()->readable() && ep1_ch1()->writable() &&
+                          ep2_ch1()->readable() && ep2_ch1()->writable(),
+                          1000, 1000);
+  const cricket::IceCheckScheduler* scheduler = ep1_ch1()->check_scheduler();
+  EXPECT_EQ(1, scheduler->stats().lists_connected);
+  EXPECT_GE(scheduler->GetConnectTime(ep1_ch1()), 0);
+  EXPECT_EQ(scheduler->GetConnectTime(ep1_ch1()),
+            scheduler->stats().max_connect_time);
+  EXPECT_GT(scheduler->stats().checks_sent, 0);
+  LOG(LS_INFO) << "Connected in " << scheduler->stats().max_connect_time
+               << " ms with " << scheduler->stats().checks_sent << " checks, "
+               << scheduler->stats().triggered_checks_sent << " triggered";
+  DestroyChannels();
+}
+
 // Test that we properly handle getting a STUN error due to slow signaling.
 TEST_F(P2PTransportChannelTest, SlowSignaling) {
   ConfigureEndpoints(OPEN, NAT_SYMMETRIC,
@@ -1407,3 +1432,66 @@ TEST_F(P2PTransportChannelTest, TestIceConfigWillPassDownToPort) {
 
   TestSendRecv(1);
 }
+
+// Measures how ranking the connections scales with the number of remote
+// candidates, as with full-mesh pairing on multihomed hosts.  Each new
+// candidate re-ranks the connections, and so does each state change.
+TEST(P2PTransportChannelPerfTest, ManyCandidatesPerf) {
+  static const int kCandidateCounts[] = { 50, 200, 800 };
+  static const int kStateChanges = 200;
+  talk_base::VirtualSocketServer vss(NULL);
+  talk_base::SocketServerScope scope(&vss);
+  cricket::FakePortAllocator allocator(talk_base::Thread::Current(), NULL);
+
+  for (size_t n = 0; n < ARRAY_SIZE(kCandidateCounts); ++n) {
+    const int count = kCandidateCounts[n];
+    cricket::P2PTransportChannel channel("perf", 1, NULL, &allocator);
+    channel.SetIceProtocolType(cricket::ICEPROTO_RFC5245);
+    channel.SetRole(cricket::ROLE_CONTROLLING);
+    channel.SetIceCredentials(kIceUfrag[0], kIcePwd[0]);
+    channel.SetRemoteIceCredentials(kIceUfrag[1], kIcePwd[1]);
+    channel.Connect();
+    channel.OnSignalingReady();
+    ASSERT_EQ_WAIT(1u, channel.ports().size(), kDefaultTimeout);
+
+    std::vector<cricket::Candidate> candidates;
+    uint32 best_priority = 0;
+    for (int i = 0; i < count; ++i) {
+      cricket::Candidate c;
+      c.set_component(1);
+      c.set_protocol(cricket::UDP_PROTOCOL_NAME);
+      c.set_address(SocketAddress("10.0.0.1", 1000 + i));
+      c.set_priority(1 + (i * 7919) % 100000);
+      c.set_username(kIceUfrag[1]);
+      c.set_password(kIcePwd[1]);
+      c.set_type(cricket::LOCAL_PORT_TYPE);
+      best_priority = talk_base::_max(best_priority, c.priority());
+      candidates.push_back(c);
+    }
+
+    uint32 start = talk_base::Time();
+    for (int i = 0; i < count; ++i) {
+      channel.OnCandidate(candidates[i]);
+    }
+    uint32 add_elapsed = talk_base::TimeSince(start);
+    ASSERT_TRUE(channel.best_connection() != NULL);
+    EXPECT_EQ(best_priority,
+              channel.best_connection()->remote_candidate().priority());
+
+    // Change one connection at a time, and have the channel re-rank them by
+    // repeating a candidate it already has.
+    std::vector<cricket::ConnectionInfo> infos;
+    ASSERT_TRUE(channel.GetStats(&infos));
+    ASSERT_EQ(static_cast<size_t>(count), infos.size());
+    start = talk_base::Time();
+    for (int i = 0; i < kStateChanges; ++i) {
+      static_cast<cricket::Connection*>(infos[i % count].key)->Prune();
+      channel.OnCandidate(candidates[0]);
+    }
+    uint32 change_elapsed = talk_base::TimeSince(start);
+
+    LOG(LS_INFO) << count << " candidates: adding them took " << add_elapsed
+                 << " ms, " << kStateChanges << " state changes took "
+                 << change_elapsed << " ms";
+  }
+}
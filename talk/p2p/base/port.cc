@@ -201,6 +201,7 @@ void Port::Construct() {
     ice_username_fragment_ = talk_base::CreateRandomString(ICE_UFRAG_LENGTH);
     password_ = talk_base::CreateRandomString(ICE_PWD_LENGTH);
   }
+  password_hmac_.SetKey(password_);
   LOG_J(LS_INFO, this) << "Port created";
 }
 
@@ -212,7 +213,7 @@ Port::~Port() {
 
   AddressMap::iterator iter = connections_.begin();
   while (iter != connections_.end()) {
-    list.push_back(iter->second);
+    list.push_back(iter.value());
     ++iter;
   }
 
@@ -221,11 +222,8 @@ Port::~Port() {
 }
 
 Connection* Port::GetConnection(const talk_base::SocketAddress& remote_addr) {
-  AddressMap::const_iterator iter = connections_.find(remote_addr);
-  if (iter != connections_.end())
-    return iter->second;
-  else
-    return NULL;
+  Connection* const* conn = connections_.Find(AddressKey(remote_addr));
+  return conn ? *conn : NULL;
 }
 
 // Foundation:  An arbitrary string that is the same for two candidates
@@ -271,7 +269,9 @@ void Port::AddAddress(const talk_base::SocketAddress& address,
 }
 
 void Port::AddConnection(Connection* conn) {
-  connections_[conn->remote_candidate().address()] = conn;
+  AddressKey key(conn->remote_candidate().address());
+  connections_.Erase(key);
+  connections_.Insert(key, conn);
   conn->SignalDestroyed.connect(this, &Port::OnConnectionDestroyed);
   SignalConnectionCreated(this, conn);
 }
@@ -319,20 +319,53 @@ void Port::OnReadPacket(
 void Port::OnReadyToSend() {
   AddressMap::iterator iter = connections_.begin();
   for (; iter != connections_.end(); ++iter) {
-    iter->second->OnReadyToSend();
+    iter.value()->OnReadyToSend();
   }
 }
 
+// Decodes a whole STUN message, which must fill |data|.
+static bool ReadStunMessage(const char* data, size_t size,
+                            talk_base::scoped_ptr<IceMessage>* msg) {
+  msg->reset(new IceMessage());
+  talk_base::ByteBuffer buf(data, size);
+  if (!(*msg)->Read(&buf) || (buf.Length() > 0)) {
+    msg->reset();
+    return false;
+  }
+  return true;
+}
+
 bool Port::GetStunMessage(const char* data, size_t size,
                           const talk_base::SocketAddress& addr,
                           IceMessage** out_msg, std::string* out_username) {
-  // NOTE: This could clearly be optimized to avoid allocating any memory.
-  //       However, at the data rates we'll be looking at on the client side,
-  //       this probably isn't worth worrying about.
+  StunMessageView view;
+  bool request = false;
+  if (!GetStunMessage(data, size, addr, &view, out_msg, out_username,
+                      &request)) {
+    return false;
+  }
+  if (request) {
+    talk_base::scoped_ptr<IceMessage> stun_msg;
+    if (!ReadStunMessage(data, size, &stun_msg)) {
+      out_username->clear();
+      return false;
+    }
+    *out_msg = stun_msg.release();
+  }
+  return true;
+}
+
+bool Port::GetStunMessage(const char* data, size_t size,
+                          const talk_base::SocketAddress& addr,
+                          StunMessageView* view, IceMessage** out_msg,
+                          std::string* out_username, bool* out_request) {
+  ASSERT(view != NULL);
   ASSERT(out_msg != NULL);
   ASSERT(out_username != NULL);
+  ASSERT(out_request != NULL);
   *out_msg = NULL;
   out_username->clear();
+  *out_request = false;
 
   // Don't bother parsing the packet if we can tell it's not STUN.
   // In ICE mode, all STUN packets will have a valid fingerprint.
@@ -341,20 +374,23 @@ bool Port::GetStunMessage(const char* data, size_t size,
     return false;
   }
 
-  // Parse the request message.  If the packet is not a complete and correct
-  // STUN message, then ignore it.
-  talk_base::scoped_ptr<IceMessage> stun_msg(new IceMessage());
-  talk_base::ByteBuffer buf(data, size);
-  if (!stun_msg->Read(&buf) || (buf.Length() > 0)) {
+  // Check the packet through a view, which allocates nothing; media packets,
+  // STUN packets that fail the checks below, and binding requests that pass
+  // them never get decoded.
+  if (!view->Parse(data, size)) {
     return false;
   }
 
-  if (stun_msg->type() == STUN_BINDING_REQUEST) {
+  talk_base::scoped_ptr<IceMessage> stun_msg;
+  if (view->type() == STUN_BINDING_REQUEST) {
     // Check for the presence of USERNAME and MESSAGE-INTEGRITY (if ICE) first.
     // If not present, fail with a 400 Bad Request.
-    if (!stun_msg->GetByteString(STUN_ATTR_USERNAME) ||
+    if (!view->HasAttribute(STUN_ATTR_USERNAME) ||
         (ice_protocol_ == ICEPROTO_RFC5245 &&
-            !stun_msg->GetByteString(STUN_ATTR_MESSAGE_INTEGRITY))) {
+            !view->HasAttribute(STUN_ATTR_MESSAGE_INTEGRITY))) {
+      if (!ReadStunMessage(data, size, &stun_msg)) {
+        return false;
+      }
       LOG_J(LS_ERROR, this) << "Received STUN request without username/M-I "
                             << "from " << addr.ToSensitiveString();
       SendBindingErrorResponse(stun_msg.get(), addr, STUN_ERROR_BAD_REQUEST,
@@ -363,10 +399,15 @@ bool Port::GetStunMessage(const char* data, size_t size,
     }
 
     // If the username is bad or unknown, fail with a 401 Unauthorized.
+    std::string username;
     std::string local_ufrag;
     std::string remote_ufrag;
-    if (!ParseStunUsername(stun_msg.get(), &local_ufrag, &remote_ufrag) ||
+    view->GetByteString(STUN_ATTR_USERNAME, &username);
+    if (!ParseStunUsername(username, &local_ufrag, &remote_ufrag) ||
         local_ufrag != username_fragment()) {
+      if (!ReadStunMessage(data, size, &stun_msg)) {
+        return false;
+      }
       LOG_J(LS_ERROR, this) << "Received STUN request with bad local username "
                             << local_ufrag << " from "
                             << addr.ToSensitiveString();
@@ -377,7 +418,10 @@ bool Port::GetStunMessage(const char* data, size_t size,
 
     // If ICE, and the MESSAGE-INTEGRITY is bad, fail with a 401 Unauthorized
     if (ice_protocol_ == ICEPROTO_RFC5245 &&
-        !stun_msg->ValidateMessageIntegrity(data, size, password_)) {
+        !view->ValidateMessageIntegrity(&password_hmac_)) {
+      if (!ReadStunMessage(data, size, &stun_msg)) {
+        return false;
+      }
       LOG_J(LS_ERROR, this) << "Received STUN request with bad M-I "
                             << "from " << addr.ToSensitiveString();
       SendBindingErrorResponse(stun_msg.get(), addr, STUN_ERROR_UNAUTHORIZED,
@@ -385,9 +429,14 @@ bool Port::GetStunMessage(const char* data, size_t size,
       return true;
     }
     out_username->assign(remote_ufrag);
-  } else if ((stun_msg->type() == STUN_BINDING_RESPONSE) ||
-             (stun_msg->type() == STUN_BINDING_ERROR_RESPONSE)) {
-    if (stun_msg->type() == STUN_BINDING_ERROR_RESPONSE) {
+    *out_request = true;
+    return true;
+  } else if ((view->type() == STUN_BINDING_RESPONSE) ||
+             (view->type() == STUN_BINDING_ERROR_RESPONSE)) {
+    if (view->type() == STUN_BINDING_ERROR_RESPONSE) {
+      if (!ReadStunMessage(data, size, &stun_msg)) {
+        return false;
+      }
       if (const StunErrorCodeAttribute* error_code = stun_msg->GetErrorCode()) {
         LOG_J(LS_ERROR, this) << "Received STUN binding error:"
                               << " class=" << error_code->eclass()
@@ -403,7 +452,7 @@ bool Port::GetStunMessage(const char* data, size_t size,
     }
     // NOTE: Username should not be used in verifying response messages.
     out_username->clear();
-  } else if (stun_msg->type() == STUN_BINDING_INDICATION) {
+  } else if (view->type() == STUN_BINDING_INDICATION) {
     LOG_J(LS_VERBOSE, this) << "Received STUN binding indication:"
                             << " from " << addr.ToSensitiveString();
     out_username->clear();
@@ -411,11 +460,17 @@ bool Port::GetStunMessage(const char* data, size_t size,
     // Returning from end of the this method.
   } else {
     LOG_J(LS_ERROR, this) << "Received STUN packet with invalid type ("
-                          << stun_msg->type() << ") from "
+                          << view->type() << ") from "
                           << addr.ToSensitiveString();
     return true;
   }
 
+  // Decode the message that passed the checks, unless already done.  If the
+  // packet is not a complete and correct STUN message, then ignore it.
+  if (!stun_msg && !ReadStunMessage(data, size, &stun_msg)) {
+    return false;
+  }
+
   // Return the STUN message found.
   *out_msg = stun_msg.release();
   return true;
@@ -447,7 +502,15 @@ bool Port::ParseStunUsername(const StunMessage* stun_msg,
   if (username_attr == NULL)
     return false;
 
-  const std::string username_attr_str = username_attr->GetString();
+  return ParseStunUsername(username_attr->GetString(), local_ufrag,
+                           remote_ufrag);
+}
+
+bool Port::ParseStunUsername(const std::string& username_attr_str,
+                             std::string* local_ufrag,
+                             std::string* remote_ufrag) const {
+  local_ufrag->clear();
+  remote_ufrag->clear();
   if (ice_protocol_ == ICEPROTO_RFC5245) {
     size_t colon_pos = username_attr_str.find(":");
     if (colon_pos != std::string::npos) {  // RFRAG:LFRAG
@@ -474,14 +537,52 @@ bool Port::MaybeIceRoleConflict(
     const talk_base::SocketAddress& addr, IceMessage* stun_msg,
     const std::string& remote_ufrag) {
   // Validate ICE_CONTROLLING or ICE_CONTROLLED attributes.
+  const StunUInt64Attribute* controlling =
+      stun_msg->GetUInt64(STUN_ATTR_ICE_CONTROLLING);
+  const StunUInt64Attribute* controlled =
+      stun_msg->GetUInt64(STUN_ATTR_ICE_CONTROLLED);
+  if (!CheckIceRole(controlling != NULL, controlling ? controlling->value() : 0,
+                    controlled != NULL, controlled ? controlled->value() : 0,
+                    remote_ufrag)) {
+    // Send Role Conflict (487) error response.
+    SendBindingErrorResponse(stun_msg, addr,
+        STUN_ERROR_ROLE_CONFLICT, STUN_ERROR_REASON_ROLE_CONFLICT);
+    return false;
+  }
+  return true;
+}
+
+bool Port::MaybeIceRoleConflict(
+    const talk_base::SocketAddress& addr, const StunMessageView& request,
+    const std::string& remote_ufrag) {
+  uint64 controlling_tiebreaker = 0;
+  uint64 controlled_tiebreaker = 0;
+  bool controlling = request.GetUInt64(STUN_ATTR_ICE_CONTROLLING,
+                                       &controlling_tiebreaker);
+  bool controlled = request.GetUInt64(STUN_ATTR_ICE_CONTROLLED,
+                                      &controlled_tiebreaker);
+  if (!CheckIceRole(controlling, controlling_tiebreaker,
+                    controlled, controlled_tiebreaker, remote_ufrag)) {
+    // Conflicts are rare, so only decode the request to answer one.
+    talk_base::scoped_ptr<IceMessage> stun_msg;
+    if (ReadStunMessage(request.data(), request.size(), &stun_msg)) {
+      SendBindingErrorResponse(stun_msg.get(), addr,
+          STUN_ERROR_ROLE_CONFLICT, STUN_ERROR_REASON_ROLE_CONFLICT);
+    }
+    return false;
+  }
+  return true;
+}
+
+bool Port::CheckIceRole(bool controlling, uint64 controlling_tiebreaker,
+                        bool controlled, uint64 controlled_tiebreaker,
+                        const std::string& remote_ufrag) {
   bool ret = true;
   TransportRole remote_ice_role = ROLE_UNKNOWN;
   uint64 remote_tiebreaker = 0;
-  const StunUInt64Attribute* stun_attr =
-      stun_msg->GetUInt64(STUN_ATTR_ICE_CONTROLLING);
-  if (stun_attr) {
+  if (controlling) {
     remote_ice_role = ROLE_CONTROLLING;
-    remote_tiebreaker = stun_attr->value();
+    remote_tiebreaker = controlling_tiebreaker;
   }
 
   // If |remote_ufrag| is same as port local username fragment and
@@ -494,10 +595,9 @@ bool Port::MaybeIceRoleConflict(
     return true;
   }
 
-  stun_attr = stun_msg->GetUInt64(STUN_ATTR_ICE_CONTROLLED);
-  if (stun_attr) {
+  if (controlled) {
     remote_ice_role = ROLE_CONTROLLED;
-    remote_tiebreaker = stun_attr->value();
+    remote_tiebreaker = controlled_tiebreaker;
   }
 
   switch (role_) {
@@ -506,9 +606,6 @@ bool Port::MaybeIceRoleConflict(
         if (remote_tiebreaker >= tiebreaker_) {
           SignalRoleConflict(this);
         } else {
-          // Send Role Conflict (487) error response.
-          SendBindingErrorResponse(stun_msg, addr,
-              STUN_ERROR_ROLE_CONFLICT, STUN_ERROR_REASON_ROLE_CONFLICT);
           ret = false;
         }
       }
@@ -518,9 +615,6 @@ bool Port::MaybeIceRoleConflict(
         if (remote_tiebreaker < tiebreaker_) {
           SignalRoleConflict(this);
         } else {
-          // Send Role Conflict (487) error response.
-          SendBindingErrorResponse(stun_msg, addr,
-              STUN_ERROR_ROLE_CONFLICT, STUN_ERROR_REASON_ROLE_CONFLICT);
           ret = false;
         }
       }
@@ -555,22 +649,55 @@ void Port::SendBindingResponse(StunMessage* request,
     return;
   }
 
+  const StunUInt32Attribute* retransmit_attr =
+      request->GetUInt32(STUN_ATTR_RETRANSMIT_COUNT);
+  uint32 retransmit_count = retransmit_attr ? retransmit_attr->value() : 0;
+  SendBindingResponse(request->transaction_id(),
+                      retransmit_attr ? &retransmit_count : NULL,
+                      username_attr->GetString(), addr);
+}
+
+void Port::SendBindingResponse(const StunMessageView& request,
+                               const talk_base::SocketAddress& addr) {
+  ASSERT(request.type() == STUN_BINDING_REQUEST);
+
+  ASSERT(request.HasAttribute(STUN_ATTR_USERNAME));
+  if (!request.HasAttribute(STUN_ATTR_USERNAME)) {
+    // No valid username, skip the response.
+    return;
+  }
+  // Only GICE echoes the username, so don't copy it out for ICE.
+  std::string username;
+  if (ice_protocol_ == ICEPROTO_GOOGLE) {
+    request.GetByteString(STUN_ATTR_USERNAME, &username);
+  }
+
+  uint32 retransmit_count;
+  bool has_retransmit_count =
+      request.GetUInt32(STUN_ATTR_RETRANSMIT_COUNT, &retransmit_count);
+  SendBindingResponse(request.transaction_id(),
+                      has_retransmit_count ? &retransmit_count : NULL,
+                      username, addr);
+}
+
+void Port::SendBindingResponse(const std::string& transaction_id,
+                               const uint32* retransmit_count,
+                               const std::string& username,
+                               const talk_base::SocketAddress& addr) {
   // Fill in the response message.
   StunMessage response;
   response.SetType(STUN_BINDING_RESPONSE);
-  response.SetTransactionID(request->transaction_id());
-  const StunUInt32Attribute* retransmit_attr =
-      request->GetUInt32(STUN_ATTR_RETRANSMIT_COUNT);
-  if (retransmit_attr) {
+  response.SetTransactionID(transaction_id);
+  if (retransmit_count) {
     // Inherit the incoming retransmit value in the response so the other side
     // can see our view of lost pings.
     response.AddAttribute(new StunUInt32Attribute(
-        STUN_ATTR_RETRANSMIT_COUNT, retransmit_attr->value()));
+        STUN_ATTR_RETRANSMIT_COUNT, *retransmit_count));
 
-    if (retransmit_attr->value() > CONNECTION_WRITE_CONNECT_FAILURES) {
+    if (*retransmit_count > CONNECTION_WRITE_CONNECT_FAILURES) {
       LOG_J(LS_INFO, this)
           << "Received a remote ping with high retransmit count: "
-          << retransmit_attr->value();
+          << *retransmit_count;
     }
   }
 
@@ -579,18 +706,22 @@ void Port::SendBindingResponse(StunMessage* request,
   if (ice_protocol_ == ICEPROTO_RFC5245) {
     response.AddAttribute(
         new StunXorAddressAttribute(STUN_ATTR_XOR_MAPPED_ADDRESS, addr));
-    response.AddMessageIntegrity(password_);
-    response.AddFingerprint();
   } else if (ice_protocol_ == ICEPROTO_GOOGLE) {
     response.AddAttribute(
         new StunAddressAttribute(STUN_ATTR_MAPPED_ADDRESS, addr));
     response.AddAttribute(new StunByteStringAttribute(
-        STUN_ATTR_USERNAME, username_attr->GetString()));
+        STUN_ATTR_USERNAME, username));
   }
 
   // Send the response message.
-  talk_base::ByteBuffer buf;
+  char storage[kStunMessageBufferSize];
+  talk_base::ByteBuffer buf(talk_base::ByteBuffer::ORDER_NETWORK,
+                            storage, sizeof(storage));
   response.Write(&buf);
+  if (ice_protocol_ == ICEPROTO_RFC5245) {
+    StunMessage::AppendMessageIntegrity(&buf, &password_hmac_);
+    StunMessage::AppendFingerprint(&buf);
+  }
   if (SendTo(buf.Data(), buf.Length(), addr, false) < 0) {
     LOG_J(LS_ERROR, this) << "Failed to send STUN ping response to "
                           << addr.ToSensitiveString();
@@ -626,14 +757,7 @@ void Port::SendBindingErrorResponse(StunMessage* request,
   error_attr->SetReason(reason);
   response.AddAttribute(error_attr);
 
-  if (ice_protocol_ == ICEPROTO_RFC5245) {
-    // Per Section 10.1.2, certain error cases don't get a MESSAGE-INTEGRITY,
-    // because we don't have enough information to determine the shared secret.
-    if (error_code != STUN_ERROR_BAD_REQUEST &&
-        error_code != STUN_ERROR_UNAUTHORIZED)
-      response.AddMessageIntegrity(password_);
-    response.AddFingerprint();
-  } else if (ice_protocol_ == ICEPROTO_GOOGLE) {
+  if (ice_protocol_ == ICEPROTO_GOOGLE) {
     // GICE responses include a username, if one exists.
     const StunByteStringAttribute* username_attr =
         request->GetByteString(STUN_ATTR_USERNAME);
@@ -643,8 +767,18 @@ void Port::SendBindingErrorResponse(StunMessage* request,
   }
 
   // Send the response message.
-  talk_base::ByteBuffer buf;
+  char storage[kStunMessageBufferSize];
+  talk_base::ByteBuffer buf(talk_base::ByteBuffer::ORDER_NETWORK,
+                            storage, sizeof(storage));
   response.Write(&buf);
+  if (ice_protocol_ == ICEPROTO_RFC5245) {
+    // Per Section 10.1.2, certain error cases don't get a MESSAGE-INTEGRITY,
+    // because we don't have enough information to determine the shared secret.
+    if (error_code != STUN_ERROR_BAD_REQUEST &&
+        error_code != STUN_ERROR_UNAUTHORIZED)
+      StunMessage::AppendMessageIntegrity(&buf, &password_hmac_);
+    StunMessage::AppendFingerprint(&buf);
+  }
   SendTo(buf.Data(), buf.Length(), addr, false);
   LOG_J(LS_INFO, this) << "Sending STUN binding error: reason=" << reason
                        << " to " << addr.ToSensitiveString();
@@ -681,10 +815,7 @@ void Port::Start() {
 }
 
 void Port::OnConnectionDestroyed(Connection* conn) {
-  AddressMap::iterator iter =
-      connections_.find(conn->remote_candidate().address());
-  ASSERT(iter != connections_.end());
-  connections_.erase(iter);
+  VERIFY(connections_.Erase(AddressKey(conn->remote_candidate().address())));
 
   CheckTimeout();
 }
@@ -779,7 +910,7 @@ class ConnectionRequest : public StunRequest {
           new StunUInt32Attribute(STUN_ATTR_PRIORITY, prflx_priority));
 
       // Adding Message Integrity attribute.
-      request->AddMessageIntegrity(connection_->remote_candidate().password());
+      request->AddMessageIntegrity(&connection_->remote_password_hmac_);
       // Adding Fingerprint.
       request->AddFingerprint();
     }
@@ -815,7 +946,10 @@ class ConnectionRequest : public StunRequest {
 Connection::Connection(Port* port, size_t index,
                        const Candidate& remote_candidate)
   : port_(port), local_candidate_index_(index),
-    remote_candidate_(remote_candidate), read_state_(STATE_READ_INIT),
+    remote_candidate_(remote_candidate),
+    remote_password_hmac_(remote_candidate.password().data(),
+                          remote_candidate.password().size()),
+    read_state_(STATE_READ_INIT),
     write_state_(STATE_WRITE_INIT), connected_(true), pruned_(false),
     use_candidate_attr_(false), remote_ice_mode_(ICEMODE_FULL),
     requests_(port->thread()), rtt_(DEFAULT_RTT), last_ping_sent_(0),
@@ -912,9 +1046,12 @@ void Connection::OnSendStunPacket(const void* data, size_t size,
 
 void Connection::OnReadPacket(const char* data, size_t size) {
   talk_base::scoped_ptr<IceMessage> msg;
+  StunMessageView view;
+  bool request = false;
   std::string remote_ufrag;
   const talk_base::SocketAddress& addr(remote_candidate_.address());
-  if (!port_->GetStunMessage(data, size, addr, msg.accept(), &remote_ufrag)) {
+  if (!port_->GetStunMessage(data, size, addr, &view, msg.accept(),
+                             &remote_ufrag, &request)) {
     // The packet did not parse as a valid STUN message
 
     // If this connection is readable, then pass along the packet.
@@ -939,19 +1076,20 @@ void Connection::OnReadPacket(const char* data, size_t size) {
       LOG_J(LS_WARNING, this)
         << "Received non-STUN packet from an unreadable connection.";
     }
-  } else if (!msg) {
+  } else if (!msg && !request) {
     // The packet was STUN, but failed a check and was handled internally.
   } else {
     // The packet is STUN and passed the Port checks.
     // Perform our own checks to ensure this packet is valid.
     // If this is a STUN request, then update the readable bit and respond.
     // If this is a STUN response, then update the writable bit.
-    switch (msg->type()) {
+    // Requests, the bulk of the STUN traffic, are answered from the view.
+    switch (view.type()) {
       case STUN_BINDING_REQUEST:
         if (remote_ufrag == remote_candidate_.username()) {
           // Check for role conflicts.
           if (port_->IceProtocol() == ICEPROTO_RFC5245 &&
-              !port_->MaybeIceRoleConflict(addr, msg.get(), remote_ufrag)) {
+              !port_->MaybeIceRoleConflict(addr, view, remote_ufrag)) {
             // Received conflicting role from the peer.
             LOG(LS_INFO) << "Received conflicting role from the peer.";
             return;
@@ -959,7 +1097,7 @@ void Connection::OnReadPacket(const char* data, size_t size) {
 
           // Incoming, validated stun request from remote peer.
           // This call will also set the connection readable.
-          port_->SendBindingResponse(msg.get(), addr);
+          port_->SendBindingResponse(view, addr);
 
           // If timed out sending writability checks, start up again
           if (!pruned_ && (write_state_ == STATE_WRITE_TIMEOUT))
@@ -967,9 +1105,7 @@ void Connection::OnReadPacket(const char* data, size_t size) {
 
           if ((port_->IceProtocol() == ICEPROTO_RFC5245) &&
               (port_->Role() == ROLE_CONTROLLED)) {
-            const StunByteStringAttribute* use_candidate_attr =
-                msg->GetByteString(STUN_ATTR_USE_CANDIDATE);
-            if (use_candidate_attr)
+            if (view.HasAttribute(STUN_ATTR_USE_CANDIDATE))
               SignalUseCandidate(this);
           }
         } else {
@@ -978,9 +1114,11 @@ void Connection::OnReadPacket(const char* data, size_t size) {
           LOG_J(LS_ERROR, this)
             << "Received STUN request with bad remote username "
             << remote_ufrag;
-          port_->SendBindingErrorResponse(msg.get(), addr,
-                                          STUN_ERROR_UNAUTHORIZED,
-                                          STUN_ERROR_REASON_UNAUTHORIZED);
+          if (ReadStunMessage(data, size, &msg)) {
+            port_->SendBindingErrorResponse(msg.get(), addr,
+                                            STUN_ERROR_UNAUTHORIZED,
+                                            STUN_ERROR_REASON_UNAUTHORIZED);
+          }
 
         }
         break;
@@ -991,8 +1129,8 @@ void Connection::OnReadPacket(const char* data, size_t size) {
       case STUN_BINDING_RESPONSE:
       case STUN_BINDING_ERROR_RESPONSE:
         if (port_->IceProtocol() == ICEPROTO_GOOGLE ||
-            msg->ValidateMessageIntegrity(
-                data, size, remote_candidate().password())) {
+            StunMessage::ValidateMessageIntegrity(
+                data, size, &remote_password_hmac_)) {
           requests_.CheckResponse(msg.get());
         }
         // Otherwise silently discard the response message.
@@ -1320,4 +1458,19 @@ int ProxyConnection::Send(const void* data, size_t size) {
   return sent;
 }
 
+int ProxyConnection::SendBuffer(talk_base::PacketBuffer* packet) {
+  if (write_state_ == STATE_WRITE_INIT || write_state_ == STATE_WRITE_TIMEOUT) {
+    error_ = EWOULDBLOCK;
+    return SOCKET_ERROR;
+  }
+  int sent = port_->SendBufferTo(packet, remote_candidate_.address(), true);
+  if (sent <= 0) {
+    ASSERT(sent < 0);
+    error_ = port_->GetError();
+  } else {
+    send_rate_tracker_.Update(sent);
+  }
+  return sent;
+}
+
 }  // namespace cricket
@@ -32,6 +32,8 @@
 #include <vector>
 #include <map>
 
+#include "talk/base/flathashmap.h"
+#include "talk/base/hmacsha1.h"
 #include "talk/base/network.h"
 #include "talk/base/proxyinfo.h"
 #include "talk/base/ratetracker.h"
@@ -63,6 +65,28 @@ extern const char UDP_PROTOCOL_NAME[];
 extern const char TCP_PROTOCOL_NAME[];
 extern const char SSLTCP_PROTOCOL_NAME[];
 
+// Identifies a remote address by IP and port only, for looking connections
+// up on every received packet.  Unlike SocketAddress it carries no hostname
+// to copy or compare; remote candidates are resolved before we connect.
+struct AddressKey {
+  AddressKey() : port(0) {}
+  explicit AddressKey(const talk_base::SocketAddress& addr)
+      : ip(addr.ipaddr()), port(addr.port()) {}
+
+  bool operator==(const AddressKey& key) const {
+    return port == key.port && ip == key.ip;
+  }
+
+  talk_base::IPAddress ip;
+  uint16 port;
+};
+
+struct AddressKeyHash {
+  size_t operator()(const AddressKey& key) const {
+    return talk_base::HashIP(key.ip) ^ (key.port | (key.port << 16));
+  }
+};
+
 // The length of time we wait before timing out readability on a connection.
 const uint32 CONNECTION_READ_TIMEOUT = cricket::kPortTimeoutConnectionReadable;
 
@@ -136,6 +160,7 @@ class Port : public PortInterface, public talk_base::MessageHandler,
   // as opposed to RFRAGLFRAG.
   virtual void SetIceProtocolType(IceProtocolType protocol) {
     ice_protocol_ = protocol;
+    SignalUfragChanged(this);
   }
   virtual IceProtocolType IceProtocol() const { return ice_protocol_; }
 
@@ -164,7 +189,10 @@ class Port : public PortInterface, public talk_base::MessageHandler,
   }
 
   int component() const { return component_; }
-  void set_component(int component) { component_ = component; }
+  void set_component(int component) {
+    component_ = component;
+    SignalUfragChanged(this);
+  }
 
   bool send_retransmit_count_attribute() const {
     return send_retransmit_count_attribute_;
@@ -200,6 +228,9 @@ class Port : public PortInterface, public talk_base::MessageHandler,
   // RTCP.
   const std::string username_fragment() const;
   const std::string& password() const { return password_; }
+  // Fired when username_fragment() may have changed, which is whenever the
+  // ICE protocol or the component is set.
+  sigslot::signal1<Port*> SignalUfragChanged;
 
   // Fired when candidates are discovered by the port. When all candidates
   // are discovered that belong to port SignalAddressReady is fired.
@@ -222,7 +253,8 @@ class Port : public PortInterface, public talk_base::MessageHandler,
 
   // Returns a map containing all of the connections of this port, keyed by the
   // remote address.
-  typedef std::map<talk_base::SocketAddress, Connection*> AddressMap;
+  typedef talk_base::FlatHashMap<AddressKey, Connection*, AddressKeyHash>
+      AddressMap;
   const AddressMap& connections() { return connections_; }
 
   // Returns the connection to the given address or NULL if none exists.
@@ -251,6 +283,10 @@ class Port : public PortInterface, public talk_base::MessageHandler,
   virtual void SendBindingErrorResponse(
       StunMessage* request, const talk_base::SocketAddress& addr,
       int error_code, const std::string& reason);
+  // Same as SendBindingResponse, for a request that was checked through a
+  // view by GetStunMessage and never decoded.
+  void SendBindingResponse(const StunMessageView& request,
+                           const talk_base::SocketAddress& addr);
 
   void set_proxy(const std::string& user_agent,
                  const talk_base::ProxyInfo& proxy) {
@@ -282,12 +318,19 @@ class Port : public PortInterface, public talk_base::MessageHandler,
   bool ParseStunUsername(const StunMessage* stun_msg,
                          std::string* local_username,
                          std::string* remote_username) const;
+  // Same, given the value of the username attribute.
+  bool ParseStunUsername(const std::string& username_attr_str,
+                         std::string* local_username,
+                         std::string* remote_username) const;
   void CreateStunUsername(const std::string& remote_username,
                           std::string* stun_username_attr_str) const;
 
   bool MaybeIceRoleConflict(const talk_base::SocketAddress& addr,
                             IceMessage* stun_msg,
                             const std::string& remote_ufrag);
+  bool MaybeIceRoleConflict(const talk_base::SocketAddress& addr,
+                            const StunMessageView& request,
+                            const std::string& remote_ufrag);
 
   // Called when the socket is currently able to send.
   void OnReadyToSend();
@@ -318,6 +361,13 @@ class Port : public PortInterface, public talk_base::MessageHandler,
   bool GetStunMessage(const char* data, size_t size,
                       const talk_base::SocketAddress& addr,
                       IceMessage** out_msg, std::string* out_username);
+  // Same, except that a binding request which passes the checks is not
+  // decoded: msg is left NULL, out_request is set, and the request can be
+  // looked at through |view|, which is always filled in for STUN packets.
+  bool GetStunMessage(const char* data, size_t size,
+                      const talk_base::SocketAddress& addr,
+                      StunMessageView* view, IceMessage** out_msg,
+                      std::string* out_username, bool* out_request);
 
   // Checks if the address in addr is compatible with the port's ip.
   bool IsCompatibleAddress(const talk_base::SocketAddress& addr);
@@ -330,6 +380,17 @@ class Port : public PortInterface, public talk_base::MessageHandler,
   // Checks if this port is useless, and hence, should be destroyed.
   void CheckTimeout();
 
+  // The parts of MaybeIceRoleConflict and SendBindingResponse that don't
+  // depend on how the request was read.  Returns false if the request must be
+  // answered with a role conflict error.
+  bool CheckIceRole(bool controlling, uint64 controlling_tiebreaker,
+                    bool controlled, uint64 controlled_tiebreaker,
+                    const std::string& remote_ufrag);
+  void SendBindingResponse(const std::string& transaction_id,
+                           const uint32* retransmit_count,
+                           const std::string& username,
+                           const talk_base::SocketAddress& addr);
+
   std::string ComputeFoundation(const std::string& type,
       const std::string& protocol,
       const talk_base::SocketAddress& base_address) const;
@@ -356,6 +417,8 @@ class Port : public PortInterface, public talk_base::MessageHandler,
   // username_fragment().
   std::string ice_username_fragment_;
   std::string password_;
+  // Keyed with |password_|, to check and sign our STUN messages.
+  talk_base::HmacSha1 password_hmac_;
   std::vector<Candidate> candidates_;
   AddressMap connections_;
   enum Lifetime { LT_PRESTART, LT_PRETIMEOUT, LT_POSTTIMEOUT } lifetime_;
@@ -427,6 +490,12 @@ class Connection : public talk_base::MessageHandler,
   // Estimate of the round-trip time over this connection.
   uint32 rtt() const { return rtt_; }
 
+  // Returns whether |id| is the transaction ID of one of our outstanding
+  // pings.
+  bool HasStunRequest(const std::string& id) const {
+    return requests_.HasRequest(id);
+  }
+
   size_t sent_total_bytes();
   size_t sent_bytes_second();
   size_t recv_total_bytes();
@@ -442,10 +511,17 @@ class Connection : public talk_base::MessageHandler,
   // covers.
   virtual int Send(const void* data, size_t size) = 0;
 
+  // Sends a ref-counted packet, letting the lower layers frame it in place
+  // and keep a reference rather than copying.  Returns the payload size sent.
+  virtual int SendBuffer(talk_base::PacketBuffer* packet) {
+    return Send(packet->data(), packet->length());
+  }
+
   // Error if Send() returns < 0
   virtual int GetError() = 0;
 
-  sigslot::signal3<Connection*, const char*, size_t> SignalReadPacket;
+  sigslot::signal3<Connection*, const char*, size_t,
+                   sigslot::thread_confined> SignalReadPacket;
 
   sigslot::signal1<Connection*> SignalReadyToSend;
 
@@ -531,6 +607,8 @@ class Connection : public talk_base::MessageHandler,
   Port* port_;
   size_t local_candidate_index_;
   Candidate remote_candidate_;
+  // Keyed with the remote candidate's password.
+  talk_base::HmacSha1 remote_password_hmac_;
   ReadState read_state_;
   WriteState write_state_;
   bool connected_;
@@ -568,6 +646,7 @@ class ProxyConnection : public Connection {
   virtual std::string GetClassname() const { return "ProxyConnection"; }
 
   virtual int Send(const void* data, size_t size);
+  virtual int SendBuffer(talk_base::PacketBuffer* packet);
   virtual int GetError() { return error_; }
 
  private:
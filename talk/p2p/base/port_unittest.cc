@@ -48,6 +48,7 @@
 #include "talk/p2p/base/testturnserver.h"
 #include "talk/p2p/base/transport.h"
 #include "talk/p2p/base/turnport.h"
+#include "talk/p2p/base/udpportmux.h"
 
 using talk_base::AsyncPacketSocket;
 using talk_base::ByteBuffer;
@@ -424,6 +425,18 @@ class PortTest : public testing::Test, public sigslot::has_slots<> {
     port->SetIceProtocolType(ice_protocol_);
     return port;
   }
+  UDPPortMux* CreateUdpPortMux(const SocketAddress& addr) {
+    return new UDPPortMux(
+        socket_factory_.CreateUdpSocket(SocketAddress(addr.ipaddr(), 0), 0, 0));
+  }
+  // Ports on the same mux need their own ufrags.
+  UDPPort* CreateMuxedUdpPort(UDPPortMux* mux) {
+    UDPPort* port = mux->CreatePort(
+        main_, &network_, talk_base::CreateRandomString(ICE_UFRAG_LENGTH),
+        password_);
+    port->SetIceProtocolType(ice_protocol_);
+    return port;
+  }
   TCPPort* CreateTcpPort(const SocketAddress& addr) {
     TCPPort* port = CreateTcpPort(addr, &socket_factory_);
     port->SetIceProtocolType(ice_protocol_);
@@ -1025,6 +1038,77 @@ TEST_F(PortTest, TestLocalToLocalAsIce) {
   TestConnectivity("udp", port1, "udp", port2, true, true, true, true);
 }
 
+// Test that a port sharing its socket with another through a UDPPortMux gets
+// the pings for it, and the responses to its own.
+TEST_F(PortTest, TestLocalToUdpPortMux) {
+  talk_base::scoped_ptr<UDPPortMux> mux(CreateUdpPortMux(kLocalAddr2));
+  talk_base::scoped_ptr<UDPPort> other_port(CreateMuxedUdpPort(mux.get()));
+  other_port->PrepareAddress();
+  UDPPort* port1 = CreateUdpPort(kLocalAddr1);
+  UDPPort* port2 = CreateMuxedUdpPort(mux.get());
+  EXPECT_EQ(2U, mux->port_count());
+  TestConnectivity("udp", port1, "udp", port2, true, true, true, true);
+  EXPECT_EQ(0U, other_port->connections().size());
+}
+
+TEST_F(PortTest, TestLocalToUdpPortMuxAsIce) {
+  SetIceProtocolType(cricket::ICEPROTO_RFC5245);
+  talk_base::scoped_ptr<UDPPortMux> mux(CreateUdpPortMux(kLocalAddr2));
+  talk_base::scoped_ptr<UDPPort> other_port(CreateMuxedUdpPort(mux.get()));
+  other_port->PrepareAddress();
+  UDPPort* port1 = CreateUdpPort(kLocalAddr1);
+  port1->SetRole(cricket::ROLE_CONTROLLING);
+  port1->SetTiebreaker(kTiebreaker1);
+  UDPPort* port2 = CreateMuxedUdpPort(mux.get());
+  port2->SetRole(cricket::ROLE_CONTROLLED);
+  port2->SetTiebreaker(kTiebreaker2);
+  TestConnectivity("udp", port1, "udp", port2, true, true, true, true);
+  EXPECT_EQ(0U, other_port->connections().size());
+  // The mux forgets the ports as they go.
+  other_port.reset();
+  EXPECT_EQ(0U, mux->port_count());
+}
+
+// Test that two ports on a mux that both ping the same remote address, here
+// that of another mux, each get the responses to their own pings.
+TEST_F(PortTest, TestUdpPortMuxToSharedRemoteAddress) {
+  talk_base::scoped_ptr<UDPPortMux> lmux(CreateUdpPortMux(kLocalAddr1));
+  talk_base::scoped_ptr<UDPPortMux> rmux(CreateUdpPortMux(kLocalAddr2));
+  talk_base::scoped_ptr<UDPPort> lports[2];
+  talk_base::scoped_ptr<UDPPort> rports[2];
+  for (int i = 0; i < 2; ++i) {
+    lports[i].reset(CreateMuxedUdpPort(lmux.get()));
+    rports[i].reset(CreateMuxedUdpPort(rmux.get()));
+    lports[i]->PrepareAddress();
+    rports[i]->PrepareAddress();
+    ASSERT_EQ(1U, lports[i]->Candidates().size());
+    ASSERT_EQ(1U, rports[i]->Candidates().size());
+  }
+  EXPECT_EQ(lports[0]->Candidates()[0].address(),
+            lports[1]->Candidates()[0].address());
+
+  Connection* lconns[2];
+  Connection* rconns[2];
+  for (int i = 0; i < 2; ++i) {
+    lconns[i] = lports[i]->CreateConnection(rports[i]->Candidates()[0],
+                                            Port::ORIGIN_MESSAGE);
+    rconns[i] = rports[i]->CreateConnection(lports[i]->Candidates()[0],
+                                            Port::ORIGIN_MESSAGE);
+    ASSERT_TRUE(lconns[i] != NULL);
+    ASSERT_TRUE(rconns[i] != NULL);
+  }
+  for (int i = 0; i < 2; ++i) {
+    rconns[i]->Ping(0);
+    lconns[i]->Ping(0);
+  }
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_TRUE_WAIT(lconns[i]->writable(), kTimeout);
+    EXPECT_TRUE_WAIT(rconns[i]->writable(), kTimeout);
+    EXPECT_TRUE(lconns[i]->readable());
+    EXPECT_TRUE(rconns[i]->readable());
+  }
+}
+
 // This test is trying to validate a successful and failure scenario in a
 // loopback test when protocol is RFC5245. For success tiebreaker, username
 // should remain equal to the request generated by the port and role of port
@@ -1121,6 +1205,57 @@ TEST_F(PortTest, TestIceRoleConflict) {
   EXPECT_TRUE(role_conflict());
 }
 
+// A connection answers a binding request without decoding it; check that the
+// response carries everything it did when it was built from the IceMessage.
+TEST_F(PortTest, TestConnectionAnswersBindingRequest) {
+  talk_base::scoped_ptr<TestPort> lport(
+      CreateTestPort(kLocalAddr1, "lfrag", "lpass"));
+  lport->SetIceProtocolType(ICEPROTO_RFC5245);
+  lport->SetRole(cricket::ROLE_CONTROLLING);
+  lport->SetTiebreaker(kTiebreaker1);
+  talk_base::scoped_ptr<TestPort> rport(
+      CreateTestPort(kLocalAddr2, "rfrag", "rpass"));
+  rport->SetIceProtocolType(ICEPROTO_RFC5245);
+  rport->SetRole(cricket::ROLE_CONTROLLED);
+  rport->SetTiebreaker(kTiebreaker2);
+  rport->set_send_retransmit_count_attribute(true);
+
+  lport->PrepareAddress();
+  rport->PrepareAddress();
+  ASSERT_FALSE(lport->Candidates().empty());
+  ASSERT_FALSE(rport->Candidates().empty());
+  Connection* lconn = lport->CreateConnection(rport->Candidates()[0],
+                                              Port::ORIGIN_MESSAGE);
+  Connection* rconn = rport->CreateConnection(lport->Candidates()[0],
+                                              Port::ORIGIN_MESSAGE);
+  rconn->Ping(0);
+  rconn->Ping(0);
+  ASSERT_TRUE_WAIT(rport->last_stun_msg() != NULL, 1000);
+  std::string transaction_id = rport->last_stun_msg()->transaction_id();
+
+  EXPECT_NE(Connection::STATE_READABLE, lconn->read_state());
+  lconn->OnReadPacket(rport->last_stun_buf()->Data(),
+                      rport->last_stun_buf()->Length());
+  EXPECT_EQ(Connection::STATE_READABLE, lconn->read_state());
+
+  ASSERT_TRUE_WAIT(lport->last_stun_msg() != NULL, 1000);
+  IceMessage* msg = lport->last_stun_msg();
+  EXPECT_EQ(STUN_BINDING_RESPONSE, msg->type());
+  EXPECT_EQ(transaction_id, msg->transaction_id());
+  const StunUInt32Attribute* retransmit_attr =
+      msg->GetUInt32(STUN_ATTR_RETRANSMIT_COUNT);
+  ASSERT_TRUE(retransmit_attr != NULL);
+  EXPECT_EQ(1U, retransmit_attr->value());
+  const StunAddressAttribute* addr_attr =
+      msg->GetAddress(STUN_ATTR_XOR_MAPPED_ADDRESS);
+  ASSERT_TRUE(addr_attr != NULL);
+  EXPECT_EQ(rport->Candidates()[0].address(), addr_attr->GetAddress());
+  EXPECT_TRUE(StunMessage::ValidateMessageIntegrity(
+      lport->last_stun_buf()->Data(), lport->last_stun_buf()->Length(),
+      "lpass"));
+  EXPECT_FALSE(role_conflict());
+}
+
 TEST_F(PortTest, TestTcpNoDelay) {
   TCPPort* port1 = CreateTcpPort(kLocalAddr1);
   int option_value = -1;
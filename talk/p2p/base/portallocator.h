@@ -55,6 +55,11 @@ const uint32 PORTALLOCATOR_ENABLE_SHARED_UFRAG = 0x80;
 const uint32 PORTALLOCATOR_ENABLE_SHARED_SOCKET = 0x100;
 const uint32 PORTALLOCATOR_ENABLE_STUN_RETRANSMIT_ATTRIBUTE = 0x200;
 const uint32 PORTALLOCATOR_USE_LARGE_SOCKET_SEND_BUFFERS = 0x400;
+// The local UDP ports of all sessions on a network share one socket, per
+// component.  Unlike PORTALLOCATOR_ENABLE_SHARED_SOCKET, which shares a
+// socket between the ports of one session, this needs each session to have
+// its own ICE ufrag.
+const uint32 PORTALLOCATOR_ENABLE_UDP_MUX = 0x800;
 
 enum {
   PORTALLOCATOR_FILTER_ALLOW_NONE = 0,
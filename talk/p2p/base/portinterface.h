@@ -30,6 +30,7 @@
 
 #include <string>
 
+#include "talk/base/packetbuffer.h"
 #include "talk/base/socketaddress.h"
 #include "talk/p2p/base/transport.h"
 
@@ -101,6 +102,15 @@ class PortInterface {
   virtual int SendTo(const void* data, size_t size,
                      const talk_base::SocketAddress& addr, bool payload) = 0;
 
+  // Like SendTo, but hands the port a ref-counted packet so that framing can
+  // be written into its headroom and the socket can hold on to it instead of
+  // copying.  The packet view is unchanged on return.
+  virtual int SendBufferTo(talk_base::PacketBuffer* packet,
+                           const talk_base::SocketAddress& addr,
+                           bool payload) {
+    return SendTo(packet->data(), packet->length(), addr, payload);
+  }
+
   // Indicates that we received a successful STUN binding request from an
   // address that doesn't correspond to any current connection.  To turn this
   // into a real connection, call CreateConnection.
@@ -130,7 +140,8 @@ class PortInterface {
   // through this port.
   virtual void EnablePortPackets() = 0;
   sigslot::signal4<PortInterface*, const char*, size_t,
-                   const talk_base::SocketAddress&> SignalReadPacket;
+                   const talk_base::SocketAddress&,
+                   sigslot::thread_confined> SignalReadPacket;
 
   virtual std::string ToString() const = 0;
 
@@ -102,6 +102,13 @@ int PortProxy::SendTo(const void* data,
   return impl_->SendTo(data, size, addr, payload);
 }
 
+int PortProxy::SendBufferTo(talk_base::PacketBuffer* packet,
+                            const talk_base::SocketAddress& addr,
+                            bool payload) {
+  ASSERT(impl_ != NULL);
+  return impl_->SendBufferTo(packet, addr, payload);
+}
+
 int PortProxy::SetOption(talk_base::Socket::Option opt,
                          int value) {
   ASSERT(impl_ != NULL);
@@ -69,6 +69,9 @@ class PortProxy : public PortInterface, public sigslot::has_slots<> {
 
   virtual int SendTo(const void* data, size_t size,
                      const talk_base::SocketAddress& addr, bool payload);
+  virtual int SendBufferTo(talk_base::PacketBuffer* packet,
+                           const talk_base::SocketAddress& addr,
+                           bool payload);
   virtual int SetOption(talk_base::Socket::Option opt, int value);
   virtual int GetOption(talk_base::Socket::Option opt, int* value);
   virtual int GetError();
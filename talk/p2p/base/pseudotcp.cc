@@ -29,6 +29,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <set>
 
 #include "talk/base/basictypes.h"
@@ -88,6 +89,8 @@ const uint32 JINGLE_HEADER_SIZE = 64; // when relay framing is in use
 // Default size for receive and send buffer.
 const uint32 DEFAULT_RCV_BUF_SIZE = 60 * 1024;
 const uint32 DEFAULT_SND_BUF_SIZE = 90 * 1024;
+// Default limit for auto-tuned buffers; enough for 100 Mbps at 300 ms RTT.
+const uint32 DEFAULT_AUTOTUNE_MAX = 4 * 1024 * 1024;
 
 //////////////////////////////////////////////////////////////////////
 // Global Constants and Functions
@@ -113,6 +116,11 @@ const uint32 DEFAULT_SND_BUF_SIZE = 90 * 1024;
 // 24 |                             data                              |
 //    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 //
+// If FLAG_SACK is set, the data is preceded by a one byte block count and
+// that many SACK blocks, each a 32-bit left edge followed by a 32-bit right
+// edge (RFC2018). SACK is only sent when both sides offered
+// TCP_OPT_SACK_PERMITTED in their connect messages.
+//
 //////////////////////////////////////////////////////////////////////
 
 #define PSEUDO_KEEPALIVE 0
@@ -128,6 +136,9 @@ const uint32 DEF_ACK_DELAY = 100; // 100 milliseconds
 
 const uint8 FLAG_CTL = 0x02;
 const uint8 FLAG_RST = 0x04;
+const uint8 FLAG_SACK = 0x08;
+
+const uint32 SACK_BLOCK_SIZE = 8;
 
 const uint8 CTL_CONNECT = 0;
 //const uint8 CTL_REDIRECT = 1;
@@ -138,6 +149,7 @@ const uint8 TCP_OPT_EOL = 0;  // End of list.
 const uint8 TCP_OPT_NOOP = 1;  // No-op.
 const uint8 TCP_OPT_MSS = 2;  // Maximum segment size.
 const uint8 TCP_OPT_WND_SCALE = 3;  // Window scale factor.
+const uint8 TCP_OPT_SACK_PERMITTED = 4;  // SACK blocks may be sent.
 
 /*
 const uint8 FLAG_FIN = 0x01;
@@ -218,10 +230,28 @@ void ReportStats() {
 
 #endif
 
+//////////////////////////////////////////////////////////////////////
+// IPseudoTcpNotify
+//////////////////////////////////////////////////////////////////////
+
+IPseudoTcpNotify::WriteResult IPseudoTcpNotify::TcpWritePacketV(
+    PseudoTcp* tcp, const PacketFragment* fragments, size_t count) {
+  char buffer[MAX_PACKET];
+  size_t len = 0;
+  for (size_t i = 0; i < count; ++i) {
+    ASSERT(len + fragments[i].len <= MAX_PACKET);
+    memcpy(buffer + len, fragments[i].data, fragments[i].len);
+    len += fragments[i].len;
+  }
+  return TcpWritePacket(tcp, buffer, len);
+}
+
 //////////////////////////////////////////////////////////////////////
 // PseudoTcp
 //////////////////////////////////////////////////////////////////////
 
+const uint32 PseudoTcp::MAX_SACK_BLOCKS;
+
 uint32 PseudoTcp::Now() {
 #if 0  // Use this to synchronize timers with logging timestamps (easier debug)
   return talk_base::TimeSince(StartTime());
@@ -247,6 +277,8 @@ PseudoTcp::PseudoTcp(IPseudoTcpNotify* notify, uint32 conv)
   m_state = TCP_LISTEN;
   m_conv = conv;
   m_rcv_wnd = m_rbuf_len;
+  m_rcv_recent = 0;
+  m_rcv_rtt = m_rcv_space_time = m_rcv_space_seq = 0;
   m_rwnd_scale = m_swnd_scale = 0;
   m_snd_nxt = 0;
   m_snd_wnd = 1;
@@ -270,6 +302,13 @@ PseudoTcp::PseudoTcp(IPseudoTcpNotify* notify, uint32 conv)
 
   m_dup_acks = 0;
   m_recover = 0;
+  m_cc.reset(PseudoTcpCongestionControl::Create(
+      PseudoTcpCongestionControl::RENO));
+
+  m_sack_enabled = false;
+  m_sack_high = m_sack_rexmit = 0;
+  m_rto_recovery = false;
+  m_rto_recover = 0;
 
   m_ts_recent = m_ts_lastack = 0;
 
@@ -279,6 +318,12 @@ PseudoTcp::PseudoTcp(IPseudoTcpNotify* notify, uint32 conv)
   m_use_nagling = true;
   m_ack_delay = DEF_ACK_DELAY;
   m_support_wnd_scale = true;
+  m_support_sack = true;
+
+  m_autotune_max = DEFAULT_AUTOTUNE_MAX;
+  m_rbuf_autotune = m_sbuf_autotune = true;
+  // Pick a window scale that leaves the receive buffer room to grow.
+  resizeReceiveBuffer(m_rbuf_len);
 }
 
 PseudoTcp::~PseudoTcp() {
@@ -328,11 +373,15 @@ void PseudoTcp::NotifyClock(uint32 now) {
         closedown(ECONNABORTED);
         return;
       }
+      m_sack_rexmit = m_slist.front().seq + m_slist.front().len;
+      m_rto_recovery = true;
+      m_rto_recover = m_snd_nxt;
 
       uint32 nInFlight = m_snd_nxt - m_snd_una;
-      m_ssthresh = talk_base::_max(nInFlight / 2, 2 * m_mss);
+      m_ssthresh = m_cc->OnLoss(now, nInFlight, m_mss);
       //LOG(LS_INFO) << "m_ssthresh: " << m_ssthresh << "  nInFlight: " << nInFlight << "  m_mss: " << m_mss;
       m_cwnd = m_mss;
+      m_cc->OnRestart();
 
       // Back off retransmit timer.  Note: the limit is lower when connecting.
       uint32 rto_limit = (m_state < TCP_ESTABLISHED) ? DEF_RTO : MAX_RTO;
@@ -397,6 +446,10 @@ void PseudoTcp::GetOption(Option opt, int* value) {
     *value = m_sbuf_len;
   } else if (opt == OPT_RCVBUF) {
     *value = m_rbuf_len;
+  } else if (opt == OPT_CONGESTION_CONTROL) {
+    *value = m_cc->type();
+  } else if (opt == OPT_AUTOTUNE_MAX) {
+    *value = m_autotune_max;
   } else {
     ASSERT(false);
   }
@@ -408,10 +461,24 @@ void PseudoTcp::SetOption(Option opt, int value) {
     m_ack_delay = value;
   } else if (opt == OPT_SNDBUF) {
     ASSERT(m_state == TCP_LISTEN);
+    m_sbuf_autotune = false;
     resizeSendBuffer(value);
   } else if (opt == OPT_RCVBUF) {
     ASSERT(m_state == TCP_LISTEN);
+    m_rbuf_autotune = false;
     resizeReceiveBuffer(value);
+  } else if (opt == OPT_AUTOTUNE_MAX) {
+    ASSERT(m_state == TCP_LISTEN);
+    m_autotune_max = value;
+    resizeReceiveBuffer(m_rbuf_len);
+  } else if (opt == OPT_CONGESTION_CONTROL) {
+    ASSERT(m_state == TCP_LISTEN);
+    PseudoTcpCongestionControl* cc = PseudoTcpCongestionControl::Create(
+        static_cast<PseudoTcpCongestionControl::Type>(value));
+    ASSERT(cc != NULL);
+    if (cc) {
+      m_cc.reset(cc);
+    }
   } else {
     ASSERT(false);
   }
@@ -456,20 +523,29 @@ int PseudoTcp::Recv(char* buffer, size_t len) {
   }
   ASSERT(result == talk_base::SR_SUCCESS);
 
-  size_t available_space = 0;
-  m_rbuf.GetWriteRemaining(&available_space);
+  openReceiveWindow();
+  return read;
+}
 
-  if (uint32(available_space) - m_rcv_wnd >=
-      talk_base::_min<uint32>(m_rbuf_len / 2, m_mss)) {
-    bool bWasClosed = (m_rcv_wnd == 0); // !?! Not sure about this was closed business
-    m_rcv_wnd = available_space;
+const char* PseudoTcp::PeekRecv(size_t* len) {
+  *len = 0;
+  if (m_state != TCP_ESTABLISHED) {
+    m_error = ENOTCONN;
+    return NULL;
+  }
 
-    if (bWasClosed) {
-      attemptSend(sfImmediateAck);
-    }
+  const char* data = static_cast<const char*>(m_rbuf.GetReadData(len));
+  if (*len == 0) {
+    m_bReadEnable = true;
+    m_error = EWOULDBLOCK;
+    return NULL;
   }
+  return data;
+}
 
-  return read;
+void PseudoTcp::ConsumeRecv(size_t len) {
+  m_rbuf.ConsumeReadData(len);
+  openReceiveWindow();
 }
 
 int PseudoTcp::Send(const char* buffer, size_t len) {
@@ -532,11 +608,21 @@ uint32 PseudoTcp::queue(const char* data, uint32 len, bool bCtrl) {
 
 IPseudoTcpNotify::WriteResult PseudoTcp::packet(uint32 seq, uint8 flags,
                                                 uint32 offset, uint32 len) {
-  ASSERT(HEADER_SIZE + len <= MAX_PACKET);
-
   uint32 now = Now();
 
-  uint8 buffer[MAX_PACKET];
+  // Only the header is built here; the payload is handed to the notify
+  // interface straight from |m_sbuf|.
+  uint8 buffer[HEADER_SIZE + 1 + MAX_SACK_BLOCKS * SACK_BLOCK_SIZE];
+  uint32 header_len = HEADER_SIZE;
+  if (m_sack_enabled) {
+    uint32 sack_len = writeSackBlocks(buffer + HEADER_SIZE);
+    if (sack_len) {
+      flags |= FLAG_SACK;
+      header_len += sack_len;
+    }
+  }
+  ASSERT(header_len + len <= MAX_PACKET);
+
   long_to_bytes(m_conv, buffer);
   long_to_bytes(seq, buffer + 4);
   long_to_bytes(m_rcv_nxt, buffer + 8);
@@ -549,15 +635,25 @@ IPseudoTcpNotify::WriteResult PseudoTcp::packet(uint32 seq, uint8 flags,
   long_to_bytes(m_ts_recent, buffer + 20);
   m_ts_lastack = m_rcv_nxt;
 
-  if (len) {
-    size_t bytes_read = 0;
-    talk_base::StreamResult result = m_sbuf.ReadOffset(buffer + HEADER_SIZE,
-                                                       len,
-                                                       offset,
-                                                       &bytes_read);
-    UNUSED(result);
-    ASSERT(result == talk_base::SR_SUCCESS);
-    ASSERT(static_cast<uint32>(bytes_read) == len);
+  // The payload may wrap around the end of |m_sbuf|, so it takes at most two
+  // fragments.
+  IPseudoTcpNotify::PacketFragment fragments[3];
+  size_t count = 0;
+  fragments[count].data = reinterpret_cast<char *>(buffer);
+  fragments[count++].len = header_len;
+  for (uint32 remaining = len; remaining > 0; ) {
+    size_t available = 0;
+    const void* data = m_sbuf.GetReadDataAt(offset, &available);
+    ASSERT(data != NULL);
+    ASSERT(count < static_cast<size_t>(ARRAY_SIZE(fragments)));
+    if (!data || count == static_cast<size_t>(ARRAY_SIZE(fragments))) {
+      break;
+    }
+    uint32 chunk = talk_base::_min(static_cast<uint32>(available), remaining);
+    fragments[count].data = static_cast<const char *>(data);
+    fragments[count++].len = chunk;
+    offset += chunk;
+    remaining -= chunk;
   }
 
 #if _DEBUGMSG >= _DBG_VERBOSE
@@ -571,7 +667,7 @@ IPseudoTcpNotify::WriteResult PseudoTcp::packet(uint32 seq, uint8 flags,
                << "><LEN=" << len << ">";
 #endif // _DEBUGMSG
 
-  IPseudoTcpNotify::WriteResult wres = m_notify->TcpWritePacket(this, reinterpret_cast<char *>(buffer), len + HEADER_SIZE);
+  IPseudoTcpNotify::WriteResult wres = m_notify->TcpWritePacketV(this, fragments, count);
   // Note: When len is 0, this is an ACK packet.  We don't read the return value for those,
   // and thus we won't retry.  So go ahead and treat the packet as a success (basically simulate
   // as if it were dropped), which will prevent our timers from being messed up.
@@ -605,6 +701,24 @@ bool PseudoTcp::parse(const uint8* buffer, uint32 size) {
   seg.data = reinterpret_cast<const char *>(buffer) + HEADER_SIZE;
   seg.len = size - HEADER_SIZE;
 
+  seg.nsack = 0;
+  if (seg.flags & FLAG_SACK) {
+    uint32 nsack = (seg.len > 0) ? buffer[HEADER_SIZE] : 0;
+    uint32 sack_len = 1 + nsack * SACK_BLOCK_SIZE;
+    if ((nsack == 0) || (nsack > MAX_SACK_BLOCKS) || (sack_len > seg.len)) {
+      LOG_F(LS_WARNING) << "invalid SACK blocks";
+      return false;
+    }
+    const uint8* block = buffer + HEADER_SIZE + 1;
+    for (uint32 i = 0; i < nsack; ++i, block += SACK_BLOCK_SIZE) {
+      seg.sack[i].left = bytes_to_long(block);
+      seg.sack[i].right = bytes_to_long(block + 4);
+    }
+    seg.nsack = nsack;
+    seg.data += sack_len;
+    seg.len -= sack_len;
+  }
+
 #if _DEBUGMSG >= _DBG_VERBOSE
   LOG(LS_INFO) << "--> <CONV=" << seg.conv
                << "><FLG=" << static_cast<unsigned>(seg.flags)
@@ -716,16 +830,23 @@ bool PseudoTcp::process(Segment& seg) {
     }
   }
 
-  // Update timestamp
-  if ((seg.seq <= m_ts_lastack) && (m_ts_lastack < seg.seq + seg.len)) {
+  // Update timestamp. Pure acks count too, so that a peer which is only
+  // receiving can time its round trip from the echo of its own timestamps.
+  if ((seg.seq <= m_ts_lastack) && ((m_ts_lastack < seg.seq + seg.len)
+      || ((seg.len == 0) && (seg.seq == m_ts_lastack)))) {
     m_ts_recent = seg.tsval;
   }
 
+  if (m_sack_enabled && seg.nsack) {
+    processSack(seg);
+  }
+
   // Check if this is a valuable ack
   if ((seg.ack > m_snd_una) && (seg.ack <= m_snd_nxt)) {
     // Calculate round-trip time
+    long rtt = -1;
     if (seg.tsecr) {
-      long rtt = talk_base::TimeDiff(now, seg.tsecr);
+      rtt = talk_base::TimeDiff(now, seg.tsecr);
       if (rtt >= 0) {
         if (m_rx_srtt == 0) {
           m_rx_srtt = rtt;
@@ -781,19 +902,38 @@ bool PseudoTcp::process(Segment& seg) {
 #if _DEBUGMSG >= _DBG_NORMAL
         LOG(LS_INFO) << "recovery retransmit";
 #endif // _DEBUGMSG
-        if (!transmit(m_slist.begin(), now)) {
-          closedown(ECONNABORTED);
-          return false;
+        if (m_sack_enabled && (m_slist.front().seq < m_sack_rexmit)) {
+          // The hole at the front was resent already; fill the next one.
+          if (!retransmitSackHole(now)) {
+            closedown(ECONNABORTED);
+            return false;
+          }
+        } else {
+          if (!transmit(m_slist.begin(), now)) {
+            closedown(ECONNABORTED);
+            return false;
+          }
+          m_sack_rexmit = m_slist.front().seq + m_slist.front().len;
         }
         m_cwnd += m_mss - talk_base::_min(nAcked, m_cwnd);
       }
     } else {
       m_dup_acks = 0;
       // Slow start, congestion avoidance
-      if (m_cwnd < m_ssthresh) {
-        m_cwnd += m_mss;
-      } else {
-        m_cwnd += talk_base::_max<uint32>(1, m_mss * m_mss / m_cwnd);
+      m_cc->OnAck(now, nAcked, rtt, m_mss, &m_cwnd, &m_ssthresh);
+      if (m_sbuf_autotune) {
+        autotuneSendBuffer();
+      }
+      // After a timeout the rest of the window is still outstanding; resend
+      // the holes the peer has told us about rather than wait for more
+      // timeouts. The cwnd was already collapsed by the timeout.
+      if (m_rto_recovery && (m_snd_una >= m_rto_recover)) {
+        m_rto_recovery = false;
+      }
+      if (m_rto_recovery && m_sack_enabled && (m_snd_una < m_sack_high)
+          && !retransmitSackHole(now)) {
+        closedown(ECONNABORTED);
+        return false;
       }
     }
   } else if (seg.ack == m_snd_una) {
@@ -814,13 +954,21 @@ bool PseudoTcp::process(Segment& seg) {
           closedown(ECONNABORTED);
           return false;
         }
+        m_sack_rexmit = m_slist.front().seq + m_slist.front().len;
         m_recover = m_snd_nxt;
         uint32 nInFlight = m_snd_nxt - m_snd_una;
-        m_ssthresh = talk_base::_max(nInFlight / 2, 2 * m_mss);
+        m_ssthresh = m_cc->OnLoss(now, nInFlight, m_mss);
         //LOG(LS_INFO) << "m_ssthresh: " << m_ssthresh << "  nInFlight: " << nInFlight << "  m_mss: " << m_mss;
         m_cwnd = m_ssthresh + 3 * m_mss;
       } else if (m_dup_acks > 3) {
         m_cwnd += m_mss;
+        // Each further dup ack means a segment has left the network, so
+        // with SACK we can spend it on the next hole rather than wait a
+        // round trip for the partial ack.
+        if (m_sack_enabled && !retransmitSackHole(now)) {
+          closedown(ECONNABORTED);
+          return false;
+        }
       }
     } else {
       m_dup_acks = 0;
@@ -924,6 +1072,17 @@ bool PseudoTcp::process(Segment& seg) {
         m_rcv_wnd -= seg.len;
         bNewData = true;
 
+        // The peer echoes the timestamp of our latest ack, so this is
+        // roughly one round trip plus however long the peer sat on it.
+        if (seg.tsecr) {
+          long rtt = talk_base::TimeDiff(now, seg.tsecr);
+          if (rtt >= 0) {
+            uint32 sample = talk_base::_max<uint32>(rtt, 1);
+            m_rcv_rtt = ((m_rcv_rtt == 0) || (sample < m_rcv_rtt)) ? sample :
+                (7 * m_rcv_rtt + sample) / 8;
+          }
+        }
+
         RList::iterator it = m_rlist.begin();
         while ((it != m_rlist.end()) && (it->seq <= m_rcv_nxt)) {
           if (it->seq + it->len > m_rcv_nxt) {
@@ -938,6 +1097,10 @@ bool PseudoTcp::process(Segment& seg) {
           }
           it = m_rlist.erase(it);
         }
+
+        if (m_rbuf_autotune) {
+          autotuneReceiveBuffer(now);
+        }
       } else {
 #if _DEBUGMSG >= _DBG_NORMAL
         LOG(LS_INFO) << "Saving " << seg.len << " bytes (" << seg.seq << " -> " << seg.seq + seg.len << ")";
@@ -945,6 +1108,7 @@ bool PseudoTcp::process(Segment& seg) {
         RSegment rseg;
         rseg.seq = seg.seq;
         rseg.len = seg.len;
+        m_rcv_recent = seg.seq;
         RList::iterator it = m_rlist.begin();
         while ((it != m_rlist.end()) && (it->seq < rseg.seq)) {
           ++it;
@@ -974,7 +1138,7 @@ bool PseudoTcp::transmit(const SList::iterator& seg, uint32 now) {
     return false;
   }
 
-  uint32 nTransmit = talk_base::_min(seg->len, m_mss);
+  uint32 nTransmit = talk_base::_min(seg->len, maxSegmentPayload());
 
   while (true) {
     uint32 seq = seg->seq;
@@ -1003,8 +1167,8 @@ bool PseudoTcp::transmit(const SList::iterator& seg, uint32 now) {
 
       m_mss = PACKET_MAXIMUMS[++m_msslevel] - PACKET_OVERHEAD;
       m_cwnd = 2 * m_mss; // I added this... haven't researched actual formula
-      if (m_mss < nTransmit) {
-        nTransmit = m_mss;
+      if (maxSegmentPayload() < nTransmit) {
+        nTransmit = maxSegmentPayload();
         break;
       }
     }
@@ -1042,6 +1206,7 @@ void PseudoTcp::attemptSend(SendFlags sflags) {
 
   if (talk_base::TimeDiff(now, m_lastsend) > static_cast<long>(m_rx_rto)) {
     m_cwnd = m_mss;
+    m_cc->OnRestart();
   }
 
 #if _DEBUGMSG
@@ -1060,8 +1225,8 @@ void PseudoTcp::attemptSend(SendFlags sflags) {
 
     size_t snd_buffered = 0;
     m_sbuf.GetBuffered(&snd_buffered);
-    uint32 nAvailable =
-        talk_base::_min(static_cast<uint32>(snd_buffered) - nInFlight, m_mss);
+    uint32 nAvailable = talk_base::_min(
+        static_cast<uint32>(snd_buffered) - nInFlight, maxSegmentPayload());
 
     if (nAvailable > nUseable) {
       if (nUseable * 4 < nWindow) {
@@ -1105,7 +1270,8 @@ void PseudoTcp::attemptSend(SendFlags sflags) {
     // If there is data already in-flight, and we haven't a full segment of
     // data ready to send then hold off until we get more to send, or the
     // in-flight data is acknowledged.
-    if (m_use_nagling && (m_snd_nxt > m_snd_una) && (nAvailable < m_mss))  {
+    if (m_use_nagling && (m_snd_nxt > m_snd_una) &&
+        (nAvailable < maxSegmentPayload()))  {
       return;
     }
 
@@ -1134,6 +1300,93 @@ void PseudoTcp::attemptSend(SendFlags sflags) {
   }
 }
 
+void PseudoTcp::processSack(const Segment& seg) {
+  for (uint32 i = 0; i < seg.nsack; ++i) {
+    const SackBlock& block = seg.sack[i];
+    // Ignore blocks that are stale or that cover data we never sent.
+    if ((block.left >= block.right) || (block.left < m_snd_una)
+        || (block.right > m_snd_nxt)) {
+      continue;
+    }
+    m_sack_high = talk_base::_max(m_sack_high, block.right);
+    for (SList::iterator it = m_slist.begin();
+         (it != m_slist.end()) && (it->seq < block.right); ++it) {
+      if ((it->seq >= block.left) && (it->seq + it->len <= block.right)) {
+        it->bSacked = true;
+      }
+    }
+  }
+}
+
+bool PseudoTcp::retransmitSackHole(uint32 now) {
+  // Only segments below the highest SACKed one are known to be missing.
+  for (SList::iterator it = m_slist.begin(); it != m_slist.end(); ++it) {
+    if ((it->xmit == 0) || (it->seq >= m_sack_high)) {
+      break;
+    }
+    if (!it->bSacked && (it->seq >= m_sack_rexmit)) {
+#if _DEBUGMSG >= _DBG_NORMAL
+      LOG(LS_INFO) << "SACK retransmit " << it->seq;
+#endif // _DEBUGMSG
+      if (!transmit(it, now)) {
+        return false;
+      }
+      m_sack_rexmit = it->seq + it->len;
+      break;
+    }
+  }
+  return true;
+}
+
+uint32 PseudoTcp::writeSackBlocks(uint8* buf) const {
+  SackBlock blocks[MAX_SACK_BLOCKS];
+  uint32 count = 0;
+
+  // |m_rlist| is sorted but its segments may touch or overlap, so merge them
+  // into ranges first.
+  RList::const_iterator it = m_rlist.begin();
+  while (it != m_rlist.end()) {
+    SackBlock block;
+    block.left = it->seq;
+    block.right = it->seq + it->len;
+    for (++it; (it != m_rlist.end()) && (it->seq <= block.right); ++it) {
+      block.right = talk_base::_max(block.right, it->seq + it->len);
+    }
+
+    if ((block.left <= m_rcv_recent) && (m_rcv_recent < block.right)) {
+      // The block holding the latest segment goes first (RFC2018 sec 4), so
+      // that the sender learns about it even if there isn't room for all.
+      if (count == MAX_SACK_BLOCKS) {
+        --count;
+      }
+      memmove(blocks + 1, blocks, count * sizeof(blocks[0]));
+      blocks[0] = block;
+      ++count;
+    } else if (count < MAX_SACK_BLOCKS) {
+      blocks[count++] = block;
+    }
+  }
+  if (count == 0) {
+    return 0;
+  }
+
+  buf[0] = static_cast<uint8>(count);
+  uint8* pos = buf + 1;
+  for (uint32 i = 0; i < count; ++i, pos += SACK_BLOCK_SIZE) {
+    long_to_bytes(blocks[i].left, pos);
+    long_to_bytes(blocks[i].right, pos + 4);
+  }
+  return 1 + count * SACK_BLOCK_SIZE;
+}
+
+uint32 PseudoTcp::maxSegmentPayload() const {
+  if (!m_sack_enabled)
+    return m_mss;
+  // Keep the segments a multiple of 4 bytes, like |m_mss|, or a scaled
+  // window may be left with a byte that can't be advertised.
+  return (m_mss - (1 + MAX_SACK_BLOCKS * SACK_BLOCK_SIZE)) & ~3;
+}
+
 void
 PseudoTcp::closedown(uint32 err) {
   LOG(LS_INFO) << "State: TCP_CLOSED";
@@ -1172,6 +1425,14 @@ PseudoTcp::isReceiveBufferFull() const {
 void
 PseudoTcp::disableWindowScale() {
   m_support_wnd_scale = false;
+  // Without scaling the buffer can't be advertised beyond 64K.
+  m_rbuf_autotune = false;
+  resizeReceiveBuffer(m_rbuf_len);
+}
+
+void
+PseudoTcp::disableSack() {
+  m_support_sack = false;
 }
 
 void
@@ -1184,6 +1445,10 @@ PseudoTcp::queueConnectMessage() {
     buf.WriteUInt8(1);
     buf.WriteUInt8(m_rwnd_scale);
   }
+  if (m_support_sack) {
+    buf.WriteUInt8(TCP_OPT_SACK_PERMITTED);
+    buf.WriteUInt8(0);
+  }
   m_snd_wnd = buf.Length();
   queue(buf.Data(), buf.Length(), true);
 }
@@ -1230,10 +1495,15 @@ PseudoTcp::parseOptions(const char* data, uint32 len) {
     if (m_rwnd_scale > 0) {
       // Peer doesn't support TCP options and window scaling.
       // Revert receive buffer size to default value.
+      m_rbuf_autotune = false;
       resizeReceiveBuffer(DEFAULT_RCV_BUF_SIZE);
       m_swnd_scale = 0;
     }
   }
+
+  m_sack_enabled = m_support_sack &&
+      (options_specified.find(TCP_OPT_SACK_PERMITTED) !=
+       options_specified.end());
 }
 
 void
@@ -1268,14 +1538,18 @@ PseudoTcp::resizeReceiveBuffer(uint32 new_size) {
   uint8 scale_factor = 0;
 
   // Determine the scale factor such that the scaled window size can fit
-  // in a 16-bit unsigned integer.
-  while (new_size > 0xFFFF) {
+  // in a 16-bit unsigned integer. The factor is fixed once connected, so an
+  // auto-tuned buffer needs one that covers the largest size it may reach.
+  uint32 max_size = new_size;
+  if (m_rbuf_autotune) {
+    max_size = talk_base::_max(new_size, m_autotune_max);
+  }
+  while ((max_size >> scale_factor) > 0xFFFF) {
     ++scale_factor;
-    new_size >>= 1;
   }
 
   // Determine the proper size of the buffer.
-  new_size <<= scale_factor;
+  new_size = (new_size >> scale_factor) << scale_factor;
   bool result = m_rbuf.SetCapacity(new_size);
 
   // Make sure the new buffer is large enough to contain data in the old
@@ -1286,11 +1560,92 @@ PseudoTcp::resizeReceiveBuffer(uint32 new_size) {
   UNUSED(result);
   m_rbuf_len = new_size;
   m_rwnd_scale = scale_factor;
-  m_ssthresh = new_size;
+  m_ssthresh = max_size;
 
   size_t available_space = 0;
   m_rbuf.GetWriteRemaining(&available_space);
   m_rcv_wnd = available_space;
 }
 
+void
+PseudoTcp::openReceiveWindow() {
+  size_t available_space = 0;
+  m_rbuf.GetWriteRemaining(&available_space);
+
+  if (uint32(available_space) - m_rcv_wnd >=
+      talk_base::_min<uint32>(m_rbuf_len / 2, m_mss)) {
+    bool bWasClosed = (m_rcv_wnd == 0); // !?! Not sure about this was closed business
+    m_rcv_wnd = available_space;
+
+    if (bWasClosed) {
+      attemptSend(sfImmediateAck);
+    }
+  }
+}
+
+void
+PseudoTcp::autotuneReceiveBuffer(uint32 now) {
+  if (m_rcv_rtt == 0) {
+    return;
+  }
+  if (m_rcv_space_time == 0) {
+    m_rcv_space_time = now ? now : 1;
+    m_rcv_space_seq = m_rcv_nxt;
+    return;
+  }
+  if (talk_base::TimeDiff(now, m_rcv_space_time) < static_cast<long>(m_rcv_rtt)) {
+    return;
+  }
+
+  // If the peer delivered more than half the buffer in one round trip, the
+  // window may be what is holding it back.
+  uint32 received = m_rcv_nxt - m_rcv_space_seq;
+  m_rcv_space_time = now ? now : 1;
+  m_rcv_space_seq = m_rcv_nxt;
+  uint32 limit = talk_base::_min(m_autotune_max,
+                                 static_cast<uint32>(0xFFFF) << m_rwnd_scale);
+  if ((received <= m_rbuf_len / 2) || (m_rbuf_len >= limit)) {
+    return;
+  }
+
+  uint32 new_size = talk_base::_min(limit, 2 * received);
+  new_size = (new_size >> m_rwnd_scale) << m_rwnd_scale;
+  if ((new_size <= m_rbuf_len) || !m_rbuf.SetCapacity(new_size)) {
+    return;
+  }
+#if _DEBUGMSG >= _DBG_NORMAL
+  LOG(LS_INFO) << "Growing receive buffer to " << new_size << " bytes";
+#endif // _DEBUGMSG
+  m_rcv_wnd += new_size - m_rbuf_len;
+  m_rbuf_len = new_size;
+}
+
+void
+PseudoTcp::autotuneSendBuffer() {
+  if (m_sbuf_len >= m_autotune_max) {
+    return;
+  }
+  uint32 target = talk_base::_min(m_autotune_max,
+                                  2 * talk_base::_min(m_cwnd, m_snd_wnd));
+  // Each resize copies the whole buffer, and the window grows by a segment
+  // per ack in slow start, so wait until the buffer is well short and then
+  // jump to the next power of two, or to the limit.
+  if ((target < m_autotune_max) && (target < m_sbuf_len + m_sbuf_len / 2)) {
+    return;
+  }
+  uint32 new_size = 1;
+  while ((new_size < target) && (new_size <= m_autotune_max / 2)) {
+    new_size <<= 1;
+  }
+  if (new_size < target) {
+    new_size = m_autotune_max;
+  }
+  if (new_size > m_sbuf_len) {
+#if _DEBUGMSG >= _DBG_NORMAL
+    LOG(LS_INFO) << "Growing send buffer to " << new_size << " bytes";
+#endif // _DEBUGMSG
+    resizeSendBuffer(new_size);
+  }
+}
+
 }  // namespace cricket
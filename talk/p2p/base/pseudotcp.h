@@ -31,7 +31,9 @@
 #include <list>
 
 #include "talk/base/basictypes.h"
+#include "talk/base/scoped_ptr.h"
 #include "talk/base/stream.h"
+#include "talk/p2p/base/pseudotcpcongestion.h"
 
 namespace cricket {
 
@@ -54,6 +56,18 @@ class IPseudoTcpNotify {
   virtual WriteResult TcpWritePacket(PseudoTcp* tcp,
                                      const char* buffer, size_t len) = 0;
 
+  // Write a packet given as a list of fragments onto the network. The
+  // payload fragments point straight into the send buffer, so a transport
+  // that can gather them avoids copying the data. The default implementation
+  // joins the fragments and calls TcpWritePacket().
+  struct PacketFragment {
+    const char* data;
+    size_t len;
+  };
+  virtual WriteResult TcpWritePacketV(PseudoTcp* tcp,
+                                      const PacketFragment* fragments,
+                                      size_t count);
+
  protected:
   virtual ~IPseudoTcpNotify() {}
 };
@@ -72,6 +86,13 @@ class PseudoTcp {
   int Connect();
   int Recv(char* buffer, size_t len);
   int Send(const char* buffer, size_t len);
+
+  // Zero-copy alternative to Recv(). Returns the next contiguous run of
+  // received data and sets |len| to its size. The data stays buffered until
+  // it is released with ConsumeRecv(). Returns NULL and sets the error as
+  // Recv() would if there is nothing to read.
+  const char* PeekRecv(size_t* len);
+  void ConsumeRecv(size_t len);
   void Close(bool force);
   int GetError();
 
@@ -99,13 +120,19 @@ class PseudoTcp {
   // instance's behaviour for the kind of data it will carry.
   // If an unrecognized option is set or got, an assertion will fire.
   //
-  // Setting options for OPT_RCVBUF or OPT_SNDBUF after Connect() is called
-  // will result in an assertion.
+  // Setting options for OPT_RCVBUF, OPT_SNDBUF, OPT_CONGESTION_CONTROL or
+  // OPT_AUTOTUNE_MAX after Connect() is called will result in an assertion.
+  //
+  // Unless OPT_RCVBUF or OPT_SNDBUF fix their size, both buffers start at
+  // their defaults and grow with the measured bandwidth-delay product, up to
+  // OPT_AUTOTUNE_MAX.
   enum Option {
     OPT_NODELAY,      // Whether to enable Nagle's algorithm (0 == off)
     OPT_ACKDELAY,     // The Delayed ACK timeout (0 == off).
     OPT_RCVBUF,       // Set the receive buffer size, in bytes.
     OPT_SNDBUF,       // Set the send buffer size, in bytes.
+    OPT_CONGESTION_CONTROL,  // A PseudoTcpCongestionControl::Type.
+    OPT_AUTOTUNE_MAX,  // Largest auto-tuned buffer size, in bytes (0 == off).
   };
   void GetOption(Option opt, int* value);
   void SetOption(Option opt, int value);
@@ -127,6 +154,14 @@ class PseudoTcp {
  protected:
   enum SendFlags { sfNone, sfDelayedAck, sfImmediateAck };
 
+  // Most SACK blocks carried by one packet.
+  static const uint32 MAX_SACK_BLOCKS = 4;
+
+  // A range of out-of-order data the receiver holds, [left, right).
+  struct SackBlock {
+    uint32 left, right;
+  };
+
   struct Segment {
     uint32 conv, seq, ack;
     uint8 flags;
@@ -134,16 +169,19 @@ class PseudoTcp {
     const char * data;
     uint32 len;
     uint32 tsval, tsecr;
+    uint32 nsack;
+    SackBlock sack[MAX_SACK_BLOCKS];
   };
 
   struct SSegment {
     SSegment(uint32 s, uint32 l, bool c)
-        : seq(s), len(l), /*tstamp(0),*/ xmit(0), bCtrl(c) {
+        : seq(s), len(l), /*tstamp(0),*/ xmit(0), bCtrl(c), bSacked(false) {
     }
     uint32 seq, len;
     //uint32 tstamp;
     uint8 xmit;
     bool bCtrl;
+    bool bSacked;  // The peer has reported holding this segment.
   };
   typedef std::list<SSegment> SList;
 
@@ -174,6 +212,22 @@ class PseudoTcp {
   bool process(Segment& seg);
   bool transmit(const SList::iterator& seg, uint32 now);
 
+  // Marks the segments covered by the SACK blocks in |seg|.
+  void processSack(const Segment& seg);
+
+  // Retransmits the first segment the peer is known to be missing that
+  // hasn't been retransmitted in the current recovery yet. Returns false if
+  // the retransmit failed.
+  bool retransmitSackHole(uint32 now);
+
+  // Writes SACK blocks describing |m_rlist| to |buf| and returns the number
+  // of bytes written, or 0 if there is nothing to report.
+  uint32 writeSackBlocks(uint8* buf) const;
+
+  // Largest payload to put in a segment, so that it still fits in |m_mss|
+  // when the packet also carries as many SACK blocks as it can.
+  uint32 maxSegmentPayload() const;
+
   void adjustMTU();
 
  protected:
@@ -184,6 +238,13 @@ class PseudoTcp {
   // support for testing backward compatibility.
   void disableWindowScale();
 
+  // This method is only used in tests, to disable SACK support for testing
+  // backward compatibility.
+  void disableSack();
+
+  // Whether both sides agreed to use SACK.
+  bool isSackEnabled() const { return m_sack_enabled; }
+
  private:
   // Queue the connect message with TCP options.
   void queueConnectMessage();
@@ -204,6 +265,15 @@ class PseudoTcp {
   // window scale factor |m_swnd_scale| accordingly.
   void resizeReceiveBuffer(uint32 new_size);
 
+  // Advertise the space freed by the application reading |m_rbuf|.
+  void openReceiveWindow();
+
+  // Grow the buffers towards twice the bandwidth-delay product. The receive
+  // side measures how much arrives per round trip; the send side follows the
+  // congestion and send windows.
+  void autotuneReceiveBuffer(uint32 now);
+  void autotuneSendBuffer();
+
   IPseudoTcpNotify* m_notify;
   enum Shutdown { SD_NONE, SD_GRACEFUL, SD_FORCEFUL } m_shutdown;
   int m_error;
@@ -220,6 +290,12 @@ class PseudoTcp {
   uint32 m_rbuf_len, m_rcv_nxt, m_rcv_wnd, m_lastrecv;
   uint8 m_rwnd_scale;  // Window scale factor.
   talk_base::FifoBuffer m_rbuf;
+  // Start of the most recently saved out-of-order segment; its SACK block
+  // is reported first.
+  uint32 m_rcv_recent;
+  // Receive buffer auto-tuning: the round trip as seen by the receiver, and
+  // where the current measurement started.
+  uint32 m_rcv_rtt, m_rcv_space_time, m_rcv_space_seq;
 
   // Outgoing data
   SList m_slist;
@@ -243,14 +319,29 @@ class PseudoTcp {
   uint8 m_dup_acks;
   uint32 m_recover;
   uint32 m_t_ack;
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> m_cc;
+
+  // Selective acknowledgements. |m_sack_high| is the highest sequence number
+  // the peer has SACKed, and holes below |m_sack_rexmit| have already been
+  // retransmitted during the current recovery. After a timeout,
+  // |m_rto_recovery| stays set until everything that was outstanding at the
+  // time, up to |m_rto_recover|, has been acknowledged.
+  bool m_sack_enabled;
+  uint32 m_sack_high, m_sack_rexmit;
+  bool m_rto_recovery;
+  uint32 m_rto_recover;
 
   // Configuration options
   bool m_use_nagling;
   uint32 m_ack_delay;
+  uint32 m_autotune_max;
+  bool m_rbuf_autotune, m_sbuf_autotune;
 
   // This is used by unit tests to test backward compatibility of
   // PseudoTcp implementations that don't support window scaling.
   bool m_support_wnd_scale;
+  // Likewise for implementations that don't support SACK.
+  bool m_support_sack;
 };
 
 }  // namespace cricket
@@ -36,6 +36,7 @@
 #include "talk/p2p/base/pseudotcp.h"
 
 using cricket::PseudoTcp;
+using cricket::PseudoTcpCongestionControl;
 
 static const int kConnectTimeoutMs = 10000;  // ~3 * default RTO of 3000ms
 static const int kTransferTimeoutMs = 15000;
@@ -54,6 +55,17 @@ class PseudoTcpForTest : public cricket::PseudoTcp {
   void disableWindowScale() {
     PseudoTcp::disableWindowScale();
   }
+
+  void disableSack() {
+    PseudoTcp::disableSack();
+  }
+
+  bool isSackEnabled() const {
+    return PseudoTcp::isSackEnabled();
+  }
+
+  // The most a packet's SACK option can take.
+  static const size_t kMaxSackSize = 1 + MAX_SACK_BLOCKS * 8;
 };
 
 class PseudoTcpTestBase : public testing::Test,
@@ -68,7 +80,11 @@ class PseudoTcpTestBase : public testing::Test,
         local_mtu_(65535),
         remote_mtu_(65535),
         delay_(0),
-        loss_(0) {
+        loss_(0),
+        split_packets_(0),
+        max_local_packet_(0),
+        local_sndbuf_(0),
+        local_sndbuf_resizes_(0) {
     // Set use of the test RNG to get predictable loss patterns.
     talk_base::SetRandomTestMode(true);
   }
@@ -114,6 +130,20 @@ class PseudoTcpTestBase : public testing::Test,
   void DisableLocalWindowScale() {
     local_.disableWindowScale();
   }
+  void DisableRemoteSack() {
+    remote_.disableSack();
+  }
+  void DisableLocalSack() {
+    local_.disableSack();
+  }
+  void SetOptCongestionControl(PseudoTcpCongestionControl::Type type) {
+    local_.SetOption(PseudoTcp::OPT_CONGESTION_CONTROL, type);
+    remote_.SetOption(PseudoTcp::OPT_CONGESTION_CONTROL, type);
+  }
+  void SetOptAutotuneMax(int size) {
+    local_.SetOption(PseudoTcp::OPT_AUTOTUNE_MAX, size);
+    remote_.SetOption(PseudoTcp::OPT_AUTOTUNE_MAX, size);
+  }
 
  protected:
   int Connect() {
@@ -155,6 +185,17 @@ class PseudoTcpTestBase : public testing::Test,
   }
   virtual WriteResult TcpWritePacket(PseudoTcp* tcp,
                                      const char* buffer, size_t len) {
+    if (tcp == &local_) {
+      max_local_packet_ = talk_base::_max(max_local_packet_, len);
+      int sndbuf;
+      local_.GetOption(PseudoTcp::OPT_SNDBUF, &sndbuf);
+      if (sndbuf != local_sndbuf_) {
+        if (local_sndbuf_ != 0) {
+          ++local_sndbuf_resizes_;
+        }
+        local_sndbuf_ = sndbuf;
+      }
+    }
     // Randomly drop the desired percentage of packets.
     // Also drop packets that are larger than the configured MTU.
     if (talk_base::CreateRandomId() % 100 < static_cast<uint32>(loss_)) {
@@ -170,6 +211,15 @@ class PseudoTcpTestBase : public testing::Test,
     }
     return WR_SUCCESS;
   }
+  virtual WriteResult TcpWritePacketV(PseudoTcp* tcp,
+                                      const PacketFragment* fragments,
+                                      size_t count) {
+    // A header plus a payload that wraps around the send buffer.
+    if (count > 2) {
+      ++split_packets_;
+    }
+    return IPseudoTcpNotify::TcpWritePacketV(tcp, fragments, count);
+  }
 
   void UpdateLocalClock() { UpdateClock(&local_, MSG_LCLOCK); }
   void UpdateRemoteClock() { UpdateClock(&remote_, MSG_RCLOCK); }
@@ -221,11 +271,20 @@ class PseudoTcpTestBase : public testing::Test,
   int remote_mtu_;
   int delay_;
   int loss_;
+  int split_packets_;
+  size_t max_local_packet_;
+  // The local send buffer size, and how often it changed, as seen between
+  // the packets the local side sends.
+  int local_sndbuf_;
+  int local_sndbuf_resizes_;
 };
 
 class PseudoTcpTest : public PseudoTcpTestBase {
  public:
-  void TestTransfer(int size) {
+  PseudoTcpTest() : use_peek_(false) {}
+
+  // Returns the time the transfer took, in ms.
+  uint32 TestTransfer(int size) {
     uint32 start, elapsed;
     size_t received;
     // Create some dummy data to send.
@@ -255,8 +314,36 @@ class PseudoTcpTest : public PseudoTcpTestBase {
                         recv_stream_.GetBuffer(), size));
     LOG(LS_INFO) << "Transferred " << received << " bytes in " << elapsed
                  << " ms (" << size * 8 / elapsed << " Kbps)";
+    return elapsed;
   }
 
+  // Measures goodput over a link with a 40 ms RTT and 5% random loss.
+  void TestLossyLinkGoodput(const char* label) {
+    const int kSize = 500000;
+    SetLocalMtu(1500);
+    SetRemoteMtu(1500);
+    SetDelay(20);
+    SetLoss(5);
+    uint32 elapsed = talk_base::_max<uint32>(TestTransfer(kSize), 1);
+    LOG(LS_INFO) << label << " goodput over lossy link: "
+                 << kSize * 8 / elapsed << " Kbps";
+  }
+
+  // Measures throughput over a link with a 100 ms RTT and no loss.
+  void TestHighBdpThroughput(const char* label) {
+    const int kSize = 1000000;
+    SetLocalMtu(1500);
+    SetRemoteMtu(1500);
+    SetDelay(50);
+    uint32 elapsed = talk_base::_max<uint32>(TestTransfer(kSize), 1);
+    LOG(LS_INFO) << label << " throughput over high-BDP link: "
+                 << kSize * 8 / elapsed << " Kbps";
+  }
+
+ protected:
+  // Whether the receiver reads through PeekRecv instead of Recv.
+  bool use_peek_;
+
  private:
   // IPseudoTcpNotify interface
 
@@ -289,6 +376,10 @@ class PseudoTcpTest : public PseudoTcpTestBase {
   }
 
   void ReadData() {
+    if (use_peek_) {
+      PeekData();
+      return;
+    }
     char block[kBlockSize];
     size_t position;
     int rcvd;
@@ -301,6 +392,13 @@ class PseudoTcpTest : public PseudoTcpTestBase {
       }
     } while (rcvd > 0);
   }
+  void PeekData() {
+    size_t len;
+    while (const char* data = remote_.PeekRecv(&len)) {
+      recv_stream_.Write(data, len, NULL, NULL);
+      remote_.ConsumeRecv(len);
+    }
+  }
   void WriteData(bool* done) {
     size_t position, tosend;
     int sent;
@@ -456,6 +554,11 @@ class PseudoTcpTestPingPong : public PseudoTcpTestBase {
 // contracts and enlarges correctly.
 class PseudoTcpTestReceiveWindow : public PseudoTcpTestBase {
  public:
+  PseudoTcpTestReceiveWindow() {
+    // These tests measure the configured windows, so keep them fixed.
+    SetOptAutotuneMax(0);
+  }
+
   // Not all the data are transfered, |size| just need to be big enough
   // to fill up the receiver window twice.
   void TestTransfer(int size) {
@@ -639,6 +742,55 @@ TEST_F(PseudoTcpTest, TestSendWithDelayAndLoss) {
   TestTransfer(100000);  // less data so test runs faster
 }
 
+// Test sending data with packet loss using the CUBIC congestion controller.
+TEST_F(PseudoTcpTest, TestSendWithLossCubic) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetLoss(10);
+  SetOptCongestionControl(PseudoTcpCongestionControl::CUBIC);
+  TestTransfer(100000);
+}
+
+// Test sending data with delay and packet loss using CUBIC.
+TEST_F(PseudoTcpTest, TestSendWithDelayAndLossCubic) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLoss(10);
+  SetOptCongestionControl(PseudoTcpCongestionControl::CUBIC);
+  TestTransfer(100000);
+}
+
+// Test sending data with packet loss using the delay-based controller.
+TEST_F(PseudoTcpTest, TestSendWithLossDelayBased) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetLoss(10);
+  SetOptCongestionControl(PseudoTcpCongestionControl::DELAY_BASED);
+  TestTransfer(100000);
+}
+
+// Test sending data with delay and packet loss using the delay-based
+// controller.
+TEST_F(PseudoTcpTest, TestSendWithDelayAndLossDelayBased) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLoss(10);
+  SetOptCongestionControl(PseudoTcpCongestionControl::DELAY_BASED);
+  TestTransfer(100000);
+}
+
+// Test that the congestion controller option can be read back.
+TEST_F(PseudoTcpTest, TestGetCongestionControl) {
+  int value = -1;
+  local_.GetOption(PseudoTcp::OPT_CONGESTION_CONTROL, &value);
+  EXPECT_EQ(PseudoTcpCongestionControl::RENO, value);
+  SetOptCongestionControl(PseudoTcpCongestionControl::CUBIC);
+  local_.GetOption(PseudoTcp::OPT_CONGESTION_CONTROL, &value);
+  EXPECT_EQ(PseudoTcpCongestionControl::CUBIC, value);
+}
+
 // Test sending data with 10% packet loss and Nagling disabled.  Transmission
 // should take about the same time as with Nagling enabled.
 TEST_F(PseudoTcpTest, TestSendWithLossAndOptNaglingOff) {
@@ -677,6 +829,128 @@ TEST_F(PseudoTcpTest, TestSendWithDelayAndOptAckDelayOff) {
   TestTransfer(100000);  // less data so test runs faster
 }
 
+// Test sending data with loss when both peers support SACK.
+TEST_F(PseudoTcpTest, TestSendWithLossBothUseSack) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLoss(10);
+  TestTransfer(100000);
+  EXPECT_TRUE(local_.isSackEnabled());
+  EXPECT_TRUE(remote_.isSackEnabled());
+}
+
+// Test that with SACK, full-sized segments leave room for a full SACK option,
+// so that they still fit in the MTU when they carry one.  The MTU covers the
+// IP, UDP and relay headers as well as the packet.
+TEST_F(PseudoTcpTest, TestSegmentsLeaveRoomForSack) {
+  static const size_t kLowerLayerHeaders = 20 + 8 + 64;
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  TestTransfer(100000);
+  ASSERT_TRUE(local_.isSackEnabled());
+  EXPECT_LE(max_local_packet_ + PseudoTcpForTest::kMaxSackSize,
+            1500 - kLowerLayerHeaders);
+  // But not much more room than that.
+  EXPECT_GT(max_local_packet_ + PseudoTcpForTest::kMaxSackSize + 4,
+            1500 - kLowerLayerHeaders);
+}
+
+// Test sending data with loss when the remote peer does not support SACK.
+TEST_F(PseudoTcpTest, TestSendWithLossRemoteNoSack) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLoss(10);
+  DisableRemoteSack();
+  TestTransfer(100000);
+  EXPECT_FALSE(local_.isSackEnabled());
+  EXPECT_FALSE(remote_.isSackEnabled());
+}
+
+// Test sending data with loss when the local peer does not support SACK.
+TEST_F(PseudoTcpTest, TestSendWithLossLocalNoSack) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetLoss(10);
+  DisableLocalSack();
+  TestTransfer(100000);
+  EXPECT_FALSE(local_.isSackEnabled());
+  EXPECT_FALSE(remote_.isSackEnabled());
+}
+
+// Test that the receive buffer grows when the window limits a long path.
+TEST_F(PseudoTcpTest, TestSendWithDelayAutotunesReceiveBuffer) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  int initial_size;
+  remote_.GetOption(PseudoTcp::OPT_RCVBUF, &initial_size);
+  TestTransfer(1000000);
+  int size;
+  remote_.GetOption(PseudoTcp::OPT_RCVBUF, &size);
+  EXPECT_GT(size, initial_size);
+  local_.GetOption(PseudoTcp::OPT_SNDBUF, &size);
+  EXPECT_GT(size, 90 * 1024);
+}
+
+// Test that the send buffer grows in a few large steps rather than a little
+// on every ack, since each step copies the whole buffer.
+TEST_F(PseudoTcpTest, TestSendWithDelayGrowsSendBufferInFewSteps) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  TestTransfer(1000000);
+  EXPECT_GT(local_sndbuf_resizes_, 0);
+  EXPECT_LE(local_sndbuf_resizes_, 6);
+}
+
+// Test that setting the buffer sizes explicitly turns auto-tuning off.
+TEST_F(PseudoTcpTest, TestSendWithDelayFixedBuffers) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetRemoteOptRcvBuf(100000);
+  SetOptSndBuf(150000);
+  TestTransfer(1000000);
+  int size;
+  remote_.GetOption(PseudoTcp::OPT_RCVBUF, &size);
+  EXPECT_EQ(100000, size);
+  local_.GetOption(PseudoTcp::OPT_SNDBUF, &size);
+  EXPECT_EQ(150000, size);
+}
+
+// Test that the auto-tuning limit caps both buffers.
+TEST_F(PseudoTcpTest, TestSendWithDelayAutotuneMax) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  SetDelay(50);
+  SetOptAutotuneMax(128 * 1024);
+  TestTransfer(1000000);
+  int size;
+  remote_.GetOption(PseudoTcp::OPT_RCVBUF, &size);
+  EXPECT_LE(size, 128 * 1024);
+  local_.GetOption(PseudoTcp::OPT_SNDBUF, &size);
+  EXPECT_LE(size, 128 * 1024);
+}
+
+// Test reading straight out of the receive buffer.
+TEST_F(PseudoTcpTest, TestSendWithPeekRecv) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  use_peek_ = true;
+  TestTransfer(1000000);
+}
+
+// Test segments whose payload wraps around the end of the send buffer.
+TEST_F(PseudoTcpTest, TestSendWithWrappedPayload) {
+  SetLocalMtu(1500);
+  SetRemoteMtu(1500);
+  TestTransfer(1000000);
+  EXPECT_GT(split_packets_, 0);
+}
+
 // Test a large receive buffer with a sender that doesn't support scaling.
 TEST_F(PseudoTcpTest, TestSendRemoteNoWindowScale) {
   SetLocalMtu(1500);
@@ -845,6 +1119,36 @@ TEST_F(PseudoTcpTestReceiveWindow, TestSetReceiveWindowSize) {
   EXPECT_EQ(100000u, EstimateReceiveWindowSize());
 }
 
+// Lossy link benchmarks; compare the goodput logged by each.
+TEST_F(PseudoTcpTest, LossyLinkGoodputRenoNoSackPerf) {
+  DisableLocalSack();
+  TestLossyLinkGoodput("Reno without SACK");
+}
+
+TEST_F(PseudoTcpTest, LossyLinkGoodputRenoPerf) {
+  TestLossyLinkGoodput("Reno");
+}
+
+TEST_F(PseudoTcpTest, LossyLinkGoodputCubicPerf) {
+  SetOptCongestionControl(PseudoTcpCongestionControl::CUBIC);
+  TestLossyLinkGoodput("CUBIC");
+}
+
+TEST_F(PseudoTcpTest, LossyLinkGoodputDelayBasedPerf) {
+  SetOptCongestionControl(PseudoTcpCongestionControl::DELAY_BASED);
+  TestLossyLinkGoodput("Delay-based");
+}
+
+// High bandwidth-delay product benchmarks; compare the throughput logged.
+TEST_F(PseudoTcpTest, HighBdpThroughputFixedBuffersPerf) {
+  SetOptAutotuneMax(0);
+  TestHighBdpThroughput("Fixed buffers");
+}
+
+TEST_F(PseudoTcpTest, HighBdpThroughputAutotunedPerf) {
+  TestHighBdpThroughput("Auto-tuned buffers");
+}
+
 /* Test sending data with mismatched MTUs. We should detect this and reduce
 // our packet size accordingly.
 // TODO: This doesn't actually work right now. The current code
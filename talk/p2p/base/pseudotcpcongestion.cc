@@ -0,0 +1,250 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/p2p/base/pseudotcpcongestion.h"
+
+#include <cmath>
+
+#include "talk/base/common.h"
+#include "talk/base/timeutils.h"
+
+namespace cricket {
+
+// CUBIC constants, from RFC8312 section 5.
+const double CUBIC_C = 0.4;
+const double CUBIC_BETA = 0.7;
+
+// Vegas thresholds, in segments queued at the bottleneck.
+const double DELAY_ALPHA = 2;
+const double DELAY_BETA = 4;
+const double DELAY_GAMMA = 1;
+
+//////////////////////////////////////////////////////////////////////
+// RenoCongestionControl
+//////////////////////////////////////////////////////////////////////
+
+class RenoCongestionControl : public PseudoTcpCongestionControl {
+ public:
+  virtual Type type() const { return RENO; }
+
+  virtual void OnAck(uint32 now, uint32 acked, long rtt, uint32 mss,
+                     uint32* cwnd, uint32* ssthresh) {
+    if (*cwnd < *ssthresh) {
+      *cwnd += mss;
+    } else {
+      *cwnd += talk_base::_max<uint32>(1, mss * mss / *cwnd);
+    }
+  }
+
+  virtual uint32 OnLoss(uint32 now, uint32 in_flight, uint32 mss) {
+    return talk_base::_max(in_flight / 2, 2 * mss);
+  }
+};
+
+//////////////////////////////////////////////////////////////////////
+// CubicCongestionControl
+//////////////////////////////////////////////////////////////////////
+
+// The window is tracked in segments here; the cubic function is defined in
+// segments and seconds.
+class CubicCongestionControl : public PseudoTcpCongestionControl {
+ public:
+  CubicCongestionControl()
+      : w_max_(0), w_est_(0), k_(0), origin_(0), epoch_start_(0),
+        min_rtt_(-1) {
+  }
+
+  virtual Type type() const { return CUBIC; }
+
+  virtual void OnAck(uint32 now, uint32 acked, long rtt, uint32 mss,
+                     uint32* cwnd, uint32* ssthresh) {
+    if (rtt >= 0 && (min_rtt_ < 0 || rtt < min_rtt_)) {
+      min_rtt_ = rtt;
+    }
+    if (*cwnd < *ssthresh) {
+      *cwnd += mss;
+      return;
+    }
+
+    double cwnd_seg = static_cast<double>(*cwnd) / mss;
+    if (epoch_start_ == 0) {
+      // Zero means "no epoch", so nudge a clock that happens to read zero.
+      epoch_start_ = now ? now : 1;
+      if (cwnd_seg < w_max_) {
+        k_ = pow((w_max_ - cwnd_seg) / CUBIC_C, 1.0 / 3);
+        origin_ = w_max_;
+      } else {
+        k_ = 0;
+        origin_ = cwnd_seg;
+      }
+      w_est_ = cwnd_seg;
+    }
+
+    // Aim for where the curve will be one rtt from now.
+    double t = (talk_base::TimeDiff(now, epoch_start_) +
+                talk_base::_max<long>(min_rtt_, 0)) / 1000.0;
+    double target = origin_ + CUBIC_C * (t - k_) * (t - k_) * (t - k_);
+
+    // Never be slower than Reno would be (the "TCP-friendly region").
+    w_est_ += 3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA) * acked / *cwnd;
+    if (target < w_est_) {
+      target = w_est_;
+    }
+    target = talk_base::_min(target, 1.5 * cwnd_seg);
+
+    uint32 increase = 0;
+    if (target > cwnd_seg) {
+      increase = static_cast<uint32>(mss * (target - cwnd_seg) / cwnd_seg);
+    } else {
+      increase = static_cast<uint32>(mss / (100 * cwnd_seg));
+    }
+    *cwnd += talk_base::_max<uint32>(1, increase);
+  }
+
+  virtual uint32 OnLoss(uint32 now, uint32 in_flight, uint32 mss) {
+    double w = static_cast<double>(in_flight) / mss;
+    // Fast convergence: release bandwidth sooner if the window is shrinking.
+    if (w < w_max_) {
+      w_max_ = w * (1 + CUBIC_BETA) / 2;
+    } else {
+      w_max_ = w;
+    }
+    epoch_start_ = 0;
+    return talk_base::_max(static_cast<uint32>(in_flight * CUBIC_BETA),
+                           2 * mss);
+  }
+
+  virtual void OnRestart() {
+    epoch_start_ = 0;
+  }
+
+ private:
+  double w_max_;    // Window before the last reduction.
+  double w_est_;    // Estimate of the window Reno would have.
+  double k_;        // Seconds until the curve reaches |origin_|.
+  double origin_;
+  uint32 epoch_start_;
+  long min_rtt_;
+};
+
+//////////////////////////////////////////////////////////////////////
+// DelayCongestionControl
+//////////////////////////////////////////////////////////////////////
+
+// Compares the smallest rtt seen in each round trip with the smallest rtt
+// ever seen, and uses the difference to estimate how many segments are
+// sitting in a queue. The window only grows while that queue is short, so
+// random loss on an otherwise idle path costs less than it does with Reno.
+class DelayCongestionControl : public PseudoTcpCongestionControl {
+ public:
+  DelayCongestionControl()
+      : base_rtt_(-1), round_min_rtt_(-1), round_start_(0) {
+  }
+
+  virtual Type type() const { return DELAY_BASED; }
+
+  virtual void OnAck(uint32 now, uint32 acked, long rtt, uint32 mss,
+                     uint32* cwnd, uint32* ssthresh) {
+    if (rtt >= 0) {
+      if (base_rtt_ < 0 || rtt < base_rtt_) {
+        base_rtt_ = rtt;
+      }
+      if (round_min_rtt_ < 0 || rtt < round_min_rtt_) {
+        round_min_rtt_ = rtt;
+      }
+    }
+    if (round_start_ == 0) {
+      round_start_ = now ? now : 1;
+    }
+    bool round_done = (round_min_rtt_ >= 0) &&
+        (talk_base::TimeDiff(now, round_start_) >=
+         talk_base::_max<long>(round_min_rtt_, 1));
+
+    if (*cwnd < *ssthresh) {
+      *cwnd += mss;
+      if (round_done && Queued(*cwnd, mss) > DELAY_GAMMA) {
+        // Queueing has started; leave slow start at the current window.
+        *ssthresh = talk_base::_max(*cwnd, 2 * mss);
+      }
+    } else if (round_done) {
+      double queued = Queued(*cwnd, mss);
+      if (queued < DELAY_ALPHA) {
+        *cwnd += mss;
+      } else if (queued > DELAY_BETA && *cwnd >= 3 * mss) {
+        // Lower the threshold too, or the next ack would slow start again.
+        *cwnd -= mss;
+        *ssthresh = *cwnd;
+      }
+    }
+
+    if (round_done) {
+      round_start_ = now ? now : 1;
+      round_min_rtt_ = -1;
+    }
+  }
+
+  virtual uint32 OnLoss(uint32 now, uint32 in_flight, uint32 mss) {
+    // Loss is a weaker congestion signal than delay here, so back off less.
+    return talk_base::_max(in_flight / 4 * 3, 2 * mss);
+  }
+
+  virtual void OnRestart() {
+    round_start_ = 0;
+    round_min_rtt_ = -1;
+  }
+
+ private:
+  double Queued(uint32 cwnd, uint32 mss) const {
+    if (round_min_rtt_ <= 0 || base_rtt_ < 0) {
+      return 0;
+    }
+    return static_cast<double>(cwnd) / mss *
+        (round_min_rtt_ - base_rtt_) / round_min_rtt_;
+  }
+
+  long base_rtt_;
+  long round_min_rtt_;
+  uint32 round_start_;
+};
+
+//////////////////////////////////////////////////////////////////////
+// PseudoTcpCongestionControl
+//////////////////////////////////////////////////////////////////////
+
+PseudoTcpCongestionControl* PseudoTcpCongestionControl::Create(Type type) {
+  switch (type) {
+    case RENO:
+      return new RenoCongestionControl();
+    case CUBIC:
+      return new CubicCongestionControl();
+    case DELAY_BASED:
+      return new DelayCongestionControl();
+  }
+  return NULL;
+}
+
+}  // namespace cricket
@@ -0,0 +1,72 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_P2P_BASE_PSEUDOTCPCONGESTION_H_
+#define TALK_P2P_BASE_PSEUDOTCPCONGESTION_H_
+
+#include "talk/base/basictypes.h"
+
+namespace cricket {
+
+// Decides how PseudoTcp grows its congestion window and how far it backs off
+// on loss. PseudoTcp keeps the window itself and still runs the loss recovery
+// mechanics (fast retransmit, window inflation, SACK retransmits); the
+// controller only sees acks, rtt samples and congestion events.
+class PseudoTcpCongestionControl {
+ public:
+  enum Type {
+    RENO,         // Slow start and AIMD congestion avoidance (RFC5681).
+    CUBIC,        // Cubic window growth (RFC8312).
+    DELAY_BASED,  // Vegas-style; holds the window when queueing delay builds.
+  };
+
+  // Returns a new controller of the given type, or NULL if unknown.
+  static PseudoTcpCongestionControl* Create(Type type);
+
+  virtual ~PseudoTcpCongestionControl() {}
+
+  virtual Type type() const = 0;
+
+  // Called for each ack that advances the send window outside of loss
+  // recovery. |acked| is the number of newly acknowledged bytes and |rtt| the
+  // round-trip sample it carried, or -1 if there wasn't one. May update both
+  // |cwnd| and |ssthresh|.
+  virtual void OnAck(uint32 now, uint32 acked, long rtt, uint32 mss,
+                     uint32* cwnd, uint32* ssthresh) = 0;
+
+  // Called when loss is detected, either by duplicate acks or by a
+  // retransmit timeout. Returns the new slow start threshold.
+  virtual uint32 OnLoss(uint32 now, uint32 in_flight, uint32 mss) = 0;
+
+  // Called when the window collapses to a single segment, after a retransmit
+  // timeout or an idle period.
+  virtual void OnRestart() {}
+};
+
+}  // namespace cricket
+
+#endif  // TALK_P2P_BASE_PSEUDOTCPCONGESTION_H_
@@ -0,0 +1,144 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/base/gunit.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/p2p/base/pseudotcpcongestion.h"
+
+using cricket::PseudoTcpCongestionControl;
+
+static const uint32 kMss = 1000;
+static const long kRttMs = 100;
+
+// Feeds one round trip's worth of acks, one per segment in the window.
+static void AckRound(PseudoTcpCongestionControl* cc, uint32 now, long rtt,
+                     uint32* cwnd, uint32* ssthresh) {
+  uint32 acks = *cwnd / kMss;
+  for (uint32 i = 0; i < acks; ++i) {
+    cc->OnAck(now, kMss, rtt, kMss, cwnd, ssthresh);
+  }
+}
+
+TEST(PseudoTcpCongestionControlTest, TestCreate) {
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> cc;
+  cc.reset(PseudoTcpCongestionControl::Create(PseudoTcpCongestionControl::RENO));
+  EXPECT_EQ(PseudoTcpCongestionControl::RENO, cc->type());
+  cc.reset(PseudoTcpCongestionControl::Create(
+      PseudoTcpCongestionControl::CUBIC));
+  EXPECT_EQ(PseudoTcpCongestionControl::CUBIC, cc->type());
+  cc.reset(PseudoTcpCongestionControl::Create(
+      PseudoTcpCongestionControl::DELAY_BASED));
+  EXPECT_EQ(PseudoTcpCongestionControl::DELAY_BASED, cc->type());
+}
+
+// Reno grows by a segment per ack in slow start, by about a segment per
+// round trip after that, and halves on loss.
+TEST(PseudoTcpCongestionControlTest, TestReno) {
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> cc(
+      PseudoTcpCongestionControl::Create(PseudoTcpCongestionControl::RENO));
+  uint32 cwnd = 2 * kMss;
+  uint32 ssthresh = 8 * kMss;
+  AckRound(cc.get(), 1000, kRttMs, &cwnd, &ssthresh);
+  EXPECT_EQ(4 * kMss, cwnd);
+  AckRound(cc.get(), 1100, kRttMs, &cwnd, &ssthresh);
+  EXPECT_EQ(8 * kMss, cwnd);
+  AckRound(cc.get(), 1200, kRttMs, &cwnd, &ssthresh);
+  EXPECT_LE(8 * kMss, cwnd);
+  EXPECT_GE(9 * kMss, cwnd);
+
+  EXPECT_EQ(50 * kMss, cc->OnLoss(1300, 100 * kMss, kMss));
+  EXPECT_EQ(2 * kMss, cc->OnLoss(1300, kMss, kMss));
+}
+
+// After a loss, CUBIC climbs quickly back towards the old window, levels off
+// near it, and then probes beyond it.
+TEST(PseudoTcpCongestionControlTest, TestCubic) {
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> cc(
+      PseudoTcpCongestionControl::Create(PseudoTcpCongestionControl::CUBIC));
+  uint32 ssthresh = cc->OnLoss(1000, 100 * kMss, kMss);
+  EXPECT_EQ(70 * kMss, ssthresh);
+  uint32 cwnd = ssthresh;
+
+  // K = cbrt((100 - 70) / 0.4), a little over 4 seconds.
+  uint32 now = 1000;
+  for (; now < 1000 + 2000; now += kRttMs) {
+    AckRound(cc.get(), now, kRttMs, &cwnd, &ssthresh);
+  }
+  uint32 cwnd_at_2s = cwnd;
+  EXPECT_LT(85 * kMss, cwnd_at_2s);
+  for (; now < 1000 + 4200; now += kRttMs) {
+    AckRound(cc.get(), now, kRttMs, &cwnd, &ssthresh);
+  }
+  EXPECT_LT(97 * kMss, cwnd);
+  EXPECT_GT(103 * kMss, cwnd);
+  // Growth on the plateau is slower than on the way up.
+  EXPECT_GT(cwnd_at_2s - 70 * kMss, cwnd - cwnd_at_2s);
+  for (; now < 1000 + 8000; now += kRttMs) {
+    AckRound(cc.get(), now, kRttMs, &cwnd, &ssthresh);
+  }
+  EXPECT_LT(115 * kMss, cwnd);
+
+  // Fast convergence: a loss below the old maximum backs off further.
+  EXPECT_EQ(56 * kMss, cc->OnLoss(now, 80 * kMss, kMss));
+}
+
+// The delay-based controller keeps growing while the rtt stays at its
+// minimum, and gives back window once a queue builds.
+TEST(PseudoTcpCongestionControlTest, TestDelayBased) {
+  talk_base::scoped_ptr<PseudoTcpCongestionControl> cc(
+      PseudoTcpCongestionControl::Create(
+          PseudoTcpCongestionControl::DELAY_BASED));
+  uint32 cwnd = 2 * kMss;
+  uint32 ssthresh = 1000 * kMss;
+  uint32 now = 1000;
+  for (int i = 0; i < 5; ++i, now += kRttMs) {
+    AckRound(cc.get(), now, kRttMs, &cwnd, &ssthresh);
+  }
+  EXPECT_LE(32 * kMss, cwnd);
+
+  // Double the rtt, as if a queue as large as the window had formed. Slow
+  // start ends once a round has seen it, and the window shrinks every round
+  // after that.
+  for (int i = 0; i < 2; ++i, now += 2 * kRttMs) {
+    AckRound(cc.get(), now, 2 * kRttMs, &cwnd, &ssthresh);
+  }
+  EXPECT_EQ(cwnd, ssthresh);
+  uint32 cwnd_queued = cwnd;
+  for (int i = 0; i < 5; ++i, now += 2 * kRttMs) {
+    AckRound(cc.get(), now, 2 * kRttMs, &cwnd, &ssthresh);
+  }
+  EXPECT_GT(cwnd_queued, cwnd);
+
+  // Once the queue drains the window grows again, a segment per round.
+  uint32 cwnd_drained = cwnd;
+  for (int i = 0; i < 5; ++i, now += kRttMs) {
+    AckRound(cc.get(), now, kRttMs, &cwnd, &ssthresh);
+  }
+  EXPECT_EQ(cwnd_drained + 5 * kMss, cwnd);
+
+  EXPECT_EQ(75 * kMss, cc->OnLoss(now, 100 * kMss, kMss));
+}
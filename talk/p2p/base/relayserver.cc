@@ -48,6 +48,9 @@ const uint32 USERNAME_LENGTH = 16;
 
 static const uint32 kMessageAcceptConnection = 1;
 
+// Number of UDP packets read, and held for sending, per system call.
+static const size_t kPacketBatchSize = 32;
+
 // Calls SendTo on the given socket and logs any bad results.
 void Send(talk_base::AsyncPacketSocket* socket, const char* bytes, size_t size,
           const talk_base::SocketAddress& addr) {
@@ -64,7 +67,9 @@ void Send(talk_base::AsyncPacketSocket* socket, const char* bytes, size_t size,
 void SendStun(const StunMessage& msg,
               talk_base::AsyncPacketSocket* socket,
               const talk_base::SocketAddress& addr) {
-  talk_base::ByteBuffer buf;
+  char storage[kStunMessageBufferSize];
+  talk_base::ByteBuffer buf(talk_base::ByteBuffer::ORDER_NETWORK,
+                            storage, sizeof(storage));
   msg.Write(&buf);
   Send(socket, buf.Data(), buf.Length(), addr);
 }
@@ -119,6 +124,8 @@ void RelayServer::AddInternalSocket(talk_base::AsyncPacketSocket* socket) {
   ASSERT(internal_sockets_.end() ==
       std::find(internal_sockets_.begin(), internal_sockets_.end(), socket));
   internal_sockets_.push_back(socket);
+  socket->SetRecvBatchSize(kPacketBatchSize);
+  socket->SetSendBatchSize(kPacketBatchSize);
   socket->SignalReadPacket.connect(this, &RelayServer::OnInternalPacket);
 }
 
@@ -134,6 +141,8 @@ void RelayServer::AddExternalSocket(talk_base::AsyncPacketSocket* socket) {
   ASSERT(external_sockets_.end() ==
       std::find(external_sockets_.begin(), external_sockets_.end(), socket));
   external_sockets_.push_back(socket);
+  socket->SetRecvBatchSize(kPacketBatchSize);
+  socket->SetSendBatchSize(kPacketBatchSize);
   socket->SignalReadPacket.connect(this, &RelayServer::OnExternalPacket);
 }
 
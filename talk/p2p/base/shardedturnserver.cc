@@ -0,0 +1,169 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "talk/p2p/base/shardedturnserver.h"
+
+#include "talk/base/asyncudpsocket.h"
+#include "talk/base/common.h"
+#include "talk/base/logging.h"
+#include "talk/base/thread.h"
+#include "talk/p2p/base/basicpacketsocketfactory.h"
+#include "talk/p2p/base/turnserver.h"
+
+namespace cricket {
+
+static const int kListenBacklog = 128;
+
+ShardedTurnServer::ShardedTurnServer(int num_shards)
+    : started_(false) {
+  ASSERT(num_shards > 0);
+  for (int i = 0; i < num_shards; ++i) {
+    talk_base::Thread* thread = new talk_base::Thread();
+    thread->SetName("TurnServerShard", this);
+    TurnServer* server = new TurnServer(thread);
+    if (!servers_.empty()) {
+      server->set_nonce_key(servers_[0]->nonce_key());
+    }
+    threads_.push_back(thread);
+    servers_.push_back(server);
+  }
+}
+
+ShardedTurnServer::~ShardedTurnServer() {
+  Stop();
+  // The servers own sockets that live in their threads' socket servers.
+  for (size_t i = 0; i < servers_.size(); ++i) {
+    delete servers_[i];
+  }
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    delete threads_[i];
+  }
+}
+
+void ShardedTurnServer::set_realm(const std::string& realm) {
+  ASSERT(!started_);
+  for (size_t i = 0; i < servers_.size(); ++i) {
+    servers_[i]->set_realm(realm);
+  }
+}
+
+void ShardedTurnServer::set_software(const std::string& software) {
+  ASSERT(!started_);
+  for (size_t i = 0; i < servers_.size(); ++i) {
+    servers_[i]->set_software(software);
+  }
+}
+
+void ShardedTurnServer::set_auth_hook(TurnAuthInterface* auth_hook) {
+  ASSERT(!started_);
+  for (size_t i = 0; i < servers_.size(); ++i) {
+    servers_[i]->set_auth_hook(auth_hook);
+  }
+}
+
+void ShardedTurnServer::set_enable_otu_nonce(bool enable) {
+  ASSERT(!started_);
+  for (size_t i = 0; i < servers_.size(); ++i) {
+    servers_[i]->set_enable_otu_nonce(enable);
+  }
+}
+
+bool ShardedTurnServer::AddInternalSocket(
+    const talk_base::SocketAddress& address, ProtocolType proto,
+    talk_base::SocketAddress* bound_address) {
+  ASSERT(!started_);
+  talk_base::SocketAddress bind_address(address);
+  for (size_t i = 0; i < servers_.size(); ++i) {
+    talk_base::AsyncSocket* socket =
+        threads_[i]->socketserver()->CreateAsyncSocket(
+            (proto == PROTO_UDP) ? SOCK_DGRAM : SOCK_STREAM);
+    if (!socket) {
+      LOG(LS_ERROR) << "Failed to create a socket for TURN shard " << i;
+      return false;
+    }
+    if (socket->SetOption(talk_base::Socket::OPT_REUSEPORT, 1) < 0 ||
+        socket->Bind(bind_address) < 0 ||
+        (proto != PROTO_UDP && socket->Listen(kListenBacklog) < 0)) {
+      LOG(LS_ERROR) << "Failed to bind TURN shard " << i << " to "
+                    << bind_address.ToString() << ", err="
+                    << socket->GetError();
+      delete socket;
+      return false;
+    }
+    bind_address = socket->GetLocalAddress();
+
+    if (proto == PROTO_UDP) {
+      servers_[i]->AddInternalSocket(new talk_base::AsyncUDPSocket(socket),
+                                     proto);
+    } else {
+      servers_[i]->AddInternalServerSocket(socket, proto);
+    }
+  }
+  if (bound_address) {
+    *bound_address = bind_address;
+  }
+  return true;
+}
+
+void ShardedTurnServer::SetExternalAddress(
+    const talk_base::SocketAddress& address) {
+  ASSERT(!started_);
+  for (size_t i = 0; i < servers_.size(); ++i) {
+    servers_[i]->SetExternalSocketFactory(
+        new talk_base::BasicPacketSocketFactory(threads_[i]), address);
+  }
+}
+
+bool ShardedTurnServer::Start() {
+  if (started_) {
+    return true;
+  }
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    if (!threads_[i]->Start()) {
+      LOG(LS_ERROR) << "Failed to start TURN shard " << i;
+      for (size_t j = 0; j < i; ++j) {
+        threads_[j]->Stop();
+      }
+      return false;
+    }
+  }
+  started_ = true;
+  return true;
+}
+
+void ShardedTurnServer::Stop() {
+  if (!started_) {
+    return;
+  }
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i]->Stop();
+  }
+  started_ = false;
+}
+
+}  // namespace cricket
@@ -0,0 +1,95 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef TALK_P2P_BASE_SHARDEDTURNSERVER_H_
+#define TALK_P2P_BASE_SHARDEDTURNSERVER_H_
+
+#include <string>
+#include <vector>
+
+#include "talk/base/constructormagic.h"
+#include "talk/base/socketaddress.h"
+#include "talk/p2p/base/portinterface.h"
+
+namespace talk_base {
+class Thread;
+}
+
+namespace cricket {
+
+class TurnAuthInterface;
+class TurnServer;
+
+// Runs several TurnServers, each on its own thread and with its own sockets,
+// behind the same internal addresses. The internal sockets are opened with
+// OPT_REUSEPORT, so the kernel spreads clients over the shards by 5-tuple and
+// each shard owns the allocations of the clients it is given. All shards sign
+// nonces with the same key, so a nonce from one shard is accepted by the
+// others. Configure everything before calling Start().
+class ShardedTurnServer {
+ public:
+  explicit ShardedTurnServer(int num_shards);
+  ~ShardedTurnServer();
+
+  int num_shards() const { return static_cast<int>(servers_.size()); }
+  TurnServer* shard(int index) { return servers_[index]; }
+  talk_base::Thread* shard_thread(int index) { return threads_[index]; }
+
+  void set_realm(const std::string& realm);
+  void set_software(const std::string& software);
+  // Sets the authentication callback; does not take ownership. The hook is
+  // called from every shard's thread, so it must be thread safe.
+  void set_auth_hook(TurnAuthInterface* auth_hook);
+  void set_enable_otu_nonce(bool enable);
+
+  // Binds a socket to |address| in every shard: a UDP socket for PROTO_UDP,
+  // or a listening socket for PROTO_TCP and PROTO_SSLTCP. If the port is 0,
+  // the port picked for the first shard is used for the rest. The address
+  // actually bound is returned in |bound_address|, which may be NULL.
+  // Returns false if a shard could not bind, e.g. without SO_REUSEPORT.
+  bool AddInternalSocket(const talk_base::SocketAddress& address,
+                         ProtocolType proto,
+                         talk_base::SocketAddress* bound_address);
+  // Relayed addresses are allocated on the IP of |address|.
+  void SetExternalAddress(const talk_base::SocketAddress& address);
+
+  // Starts or stops every shard's thread.
+  bool Start();
+  void Stop();
+
+ private:
+  std::vector<talk_base::Thread*> threads_;
+  std::vector<TurnServer*> servers_;
+  bool started_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShardedTurnServer);
+};
+
+}  // namespace cricket
+
+#endif  // TALK_P2P_BASE_SHARDEDTURNSERVER_H_
@@ -0,0 +1,543 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#if defined(LINUX) || defined(ANDROID)
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include <string>
+#include <vector>
+
+#include "talk/base/asyncudpsocket.h"
+#include "talk/base/bytebuffer.h"
+#include "talk/base/gunit.h"
+#include "talk/base/helpers.h"
+#include "talk/base/logging.h"
+#include "talk/base/physicalsocketserver.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/base/socketaddress.h"
+#include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
+#include "talk/p2p/base/basicpacketsocketfactory.h"
+#include "talk/p2p/base/shardedturnserver.h"
+#include "talk/p2p/base/stun.h"
+#include "talk/p2p/base/turnport.h"
+#include "talk/p2p/base/turnserver.h"
+
+using talk_base::SocketAddress;
+using cricket::Port;
+using cricket::ShardedTurnServer;
+using cricket::TurnPort;
+
+static const talk_base::IPAddress kLoopback(INADDR_LOOPBACK);
+static const char kIceUfrag[] = "TESTICEUFRAG0001";
+static const char kIcePwd[] = "TESTICEPWD00000000000001";
+static const char kTurnUsername[] = "test";
+static const char kTurnPassword[] = "test";
+static const char kRealm[] = "example.org";
+static const int kTimeout = 5000;
+
+// CPU time used so far by |thread|, in microseconds, or 0 where that can't be
+// measured.
+static int64 ThreadCpuTimeUs(talk_base::Thread* thread) {
+#if defined(LINUX) || defined(ANDROID)
+  clockid_t clock;
+  timespec ts;
+  if (pthread_getcpuclockid(thread->GetPThread(), &clock) == 0 &&
+      clock_gettime(clock, &ts) == 0) {
+    return static_cast<int64>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+  }
+#endif
+  return 0;
+}
+
+// Drives a ShardedTurnServer over loopback with a set of TurnPorts on the
+// test thread, which relay to one plain UDP peer socket.
+class ShardedTurnServerTest : public testing::Test,
+                              public cricket::TurnAuthInterface,
+                              public sigslot::has_slots<> {
+ public:
+  ShardedTurnServerTest()
+      : pss_(new talk_base::PhysicalSocketServer),
+        ss_scope_(pss_.get()),
+        network_("unittest", "unittest", kLoopback, 32),
+        socket_factory_(talk_base::Thread::Current()),
+        ports_ready_(0),
+        ports_failed_(0),
+        permissions_(0),
+        peer_packets_(0),
+        client_packets_(0) {
+    network_.AddIP(kLoopback);
+  }
+
+  ~ShardedTurnServerTest() {
+    for (size_t i = 0; i < ports_.size(); ++i) {
+      delete ports_[i];
+    }
+  }
+
+  // Succeeds if the password is the same as the username. Called from every
+  // shard's thread, which is fine since it keeps no state.
+  virtual bool GetKey(const std::string& username, const std::string& realm,
+                      std::string* key) {
+    return cricket::ComputeStunCredentialHash(username, realm, username, key);
+  }
+
+  void OnPortComplete(Port* port) {
+    ++ports_ready_;
+  }
+  void OnPortError(Port* port) {
+    ++ports_failed_;
+  }
+  void OnCreatePermissionResult(TurnPort* port, const SocketAddress& addr,
+                                int code) {
+    if (code == 0) {
+      ++permissions_;
+    }
+  }
+  void OnPeerPacket(talk_base::AsyncPacketSocket* socket, const char* data,
+                    size_t size, const SocketAddress& addr) {
+    ++peer_packets_;
+    last_peer_packet_.assign(data, size);
+  }
+  void OnClientPacket(talk_base::AsyncPacketSocket* socket, const char* data,
+                      size_t size, const SocketAddress& addr) {
+    ++client_packets_;
+    last_client_packet_.assign(data, size);
+  }
+
+  bool StartServer(int num_shards, cricket::ProtocolType proto) {
+    server_.reset(new ShardedTurnServer(num_shards));
+    server_->set_realm(kRealm);
+    server_->set_software("ShardedTurnServerTest");
+    server_->set_auth_hook(this);
+    if (!server_->AddInternalSocket(SocketAddress(kLoopback, 0), proto,
+                                    &server_addr_)) {
+      return false;
+    }
+    server_->SetExternalAddress(SocketAddress(kLoopback, 0));
+    return server_->Start();
+  }
+
+  void CreatePorts(int count, cricket::ProtocolType proto) {
+    cricket::RelayCredentials credentials(kTurnUsername, kTurnPassword);
+    for (int i = 0; i < count; ++i) {
+      TurnPort* port = TurnPort::Create(
+          talk_base::Thread::Current(), &socket_factory_, &network_,
+          kLoopback, 0, 0, kIceUfrag, kIcePwd,
+          cricket::ProtocolAddress(server_addr_, proto), credentials);
+      port->SignalPortComplete.connect(
+          this, &ShardedTurnServerTest::OnPortComplete);
+      port->SignalPortError.connect(
+          this, &ShardedTurnServerTest::OnPortError);
+      port->SignalCreatePermissionResult.connect(
+          this, &ShardedTurnServerTest::OnCreatePermissionResult);
+      ports_.push_back(port);
+      port->PrepareAddress();
+    }
+  }
+
+  talk_base::AsyncPacketSocket* CreatePeerSocket() {
+    talk_base::AsyncPacketSocket* peer = talk_base::AsyncUDPSocket::Create(
+        pss_.get(), SocketAddress(kLoopback, 0));
+    if (peer) {
+      peer->SignalReadPacket.connect(
+          this, &ShardedTurnServerTest::OnPeerPacket);
+    }
+    return peer;
+  }
+
+  void CreatePeer() {
+    peer_.reset(CreatePeerSocket());
+    ASSERT_TRUE(peer_ != NULL);
+  }
+
+  // Asks every port's allocation for a permission to reach the peer.
+  void CreatePermissions() {
+    cricket::Candidate peer;
+    peer.set_protocol(cricket::UDP_PROTOCOL_NAME);
+    peer.set_address(peer_->GetLocalAddress());
+    for (size_t i = 0; i < ports_.size(); ++i) {
+      ports_[i]->CreateConnection(peer, Port::ORIGIN_MESSAGE);
+    }
+  }
+
+  // Sends one packet to the peer through every port's allocation.
+  void SendToPeer(const char* data, size_t size) {
+    for (size_t i = 0; i < ports_.size(); ++i) {
+      ports_[i]->SendTo(data, size, peer_->GetLocalAddress(), true);
+    }
+  }
+
+  // Sets up |client_| as a bare TURN client, with a UDP allocation, so tests
+  // can send and check relayed packets byte for byte.
+  bool AllocateRawClient(SocketAddress* relayed_address) {
+    client_.reset(talk_base::AsyncUDPSocket::Create(
+        pss_.get(), SocketAddress(kLoopback, 0)));
+    if (!client_) {
+      return false;
+    }
+    client_->SignalReadPacket.connect(
+        this, &ShardedTurnServerTest::OnClientPacket);
+    // The first attempt is rejected with a nonce to use.
+    for (int attempt = 0; attempt < 2; ++attempt) {
+      cricket::TurnMessage request;
+      request.SetType(cricket::STUN_ALLOCATE_REQUEST);
+      request.AddAttribute(new cricket::StunUInt32Attribute(
+          cricket::STUN_ATTR_REQUESTED_TRANSPORT, IPPROTO_UDP << 24));
+      cricket::TurnMessage response;
+      if (!SendRawRequest(&request, &response)) {
+        return false;
+      }
+      if (response.type() == cricket::STUN_ALLOCATE_RESPONSE) {
+        const cricket::StunAddressAttribute* relayed_attr =
+            response.GetAddress(cricket::STUN_ATTR_XOR_RELAYED_ADDRESS);
+        if (!relayed_attr) {
+          return false;
+        }
+        *relayed_address = relayed_attr->GetAddress();
+        return true;
+      }
+      const cricket::StunByteStringAttribute* nonce_attr =
+          response.GetByteString(cricket::STUN_ATTR_NONCE);
+      if (!nonce_attr) {
+        return false;
+      }
+      nonce_ = nonce_attr->GetString();
+    }
+    return false;
+  }
+
+  // Binds |channel_id| to |peer| on the raw client's allocation, which also
+  // grants a permission for the peer's IP.
+  bool BindRawChannel(int channel_id, const SocketAddress& peer) {
+    cricket::TurnMessage request;
+    request.SetType(cricket::TURN_CHANNEL_BIND_REQUEST);
+    request.AddAttribute(new cricket::StunUInt32Attribute(
+        cricket::STUN_ATTR_CHANNEL_NUMBER, channel_id << 16));
+    request.AddAttribute(new cricket::StunXorAddressAttribute(
+        cricket::STUN_ATTR_XOR_PEER_ADDRESS, peer));
+    cricket::TurnMessage response;
+    return SendRawRequest(&request, &response) &&
+        response.type() == cricket::TURN_CHANNEL_BIND_RESPONSE;
+  }
+
+  // Sends |request| from the raw client, signed once a nonce is known, and
+  // waits for the response.
+  bool SendRawRequest(cricket::TurnMessage* request,
+                      cricket::TurnMessage* response) {
+    request->SetTransactionID(
+        talk_base::CreateRandomString(cricket::kStunTransactionIdLength));
+    if (!nonce_.empty()) {
+      std::string key;
+      cricket::ComputeStunCredentialHash(kTurnUsername, kRealm,
+                                         kTurnPassword, &key);
+      request->AddAttribute(new cricket::StunByteStringAttribute(
+          cricket::STUN_ATTR_USERNAME, kTurnUsername));
+      request->AddAttribute(new cricket::StunByteStringAttribute(
+          cricket::STUN_ATTR_REALM, kRealm));
+      request->AddAttribute(new cricket::StunByteStringAttribute(
+          cricket::STUN_ATTR_NONCE, nonce_));
+      request->AddMessageIntegrity(key);
+    }
+    talk_base::ByteBuffer buf;
+    request->Write(&buf);
+    int received = client_packets_;
+    client_->SendTo(buf.Data(), buf.Length(), server_addr_);
+    WAIT(client_packets_ > received, kTimeout);
+    if (client_packets_ == received) {
+      return false;
+    }
+    talk_base::ByteBuffer response_buf(last_client_packet_.data(),
+                                       last_client_packet_.size());
+    return response->Read(&response_buf) &&
+        response->transaction_id() == request->transaction_id();
+  }
+
+  // Allocates through |count| ports and relays one packet from each.
+  void TestAllocateAndRelay(int count, cricket::ProtocolType proto) {
+    CreatePorts(count, proto);
+    EXPECT_EQ_WAIT(count, ports_ready_, kTimeout);
+    EXPECT_EQ(0, ports_failed_);
+    for (size_t i = 0; i < ports_.size(); ++i) {
+      ASSERT_EQ(1U, ports_[i]->Candidates().size());
+      EXPECT_EQ(kLoopback, ports_[i]->Candidates()[0].address().ipaddr());
+    }
+
+    CreatePeer();
+    CreatePermissions();
+    EXPECT_EQ_WAIT(count, permissions_, kTimeout);
+    char data[100] = { 0 };
+    SendToPeer(data, sizeof(data));
+    EXPECT_EQ_WAIT(count, peer_packets_, kTimeout);
+  }
+
+ protected:
+  talk_base::scoped_ptr<talk_base::PhysicalSocketServer> pss_;
+  talk_base::SocketServerScope ss_scope_;
+  talk_base::Network network_;
+  talk_base::BasicPacketSocketFactory socket_factory_;
+  talk_base::scoped_ptr<ShardedTurnServer> server_;
+  SocketAddress server_addr_;
+  std::vector<TurnPort*> ports_;
+  talk_base::scoped_ptr<talk_base::AsyncPacketSocket> peer_;
+  int ports_ready_;
+  int ports_failed_;
+  int permissions_;
+  int peer_packets_;
+  std::string last_peer_packet_;
+  talk_base::scoped_ptr<talk_base::AsyncPacketSocket> client_;
+  std::string nonce_;
+  int client_packets_;
+  std::string last_client_packet_;
+};
+
+// Every shard signs nonces with the same key, so a client that lands on
+// another shard (e.g. after a NAT rebinding) can keep its nonce.
+TEST_F(ShardedTurnServerTest, ShardsShareNonceKey) {
+  ShardedTurnServer server(3);
+  ASSERT_EQ(3, server.num_shards());
+  EXPECT_FALSE(server.shard(0)->nonce_key().empty());
+  EXPECT_EQ(server.shard(0)->nonce_key(), server.shard(1)->nonce_key());
+  EXPECT_EQ(server.shard(0)->nonce_key(), server.shard(2)->nonce_key());
+  EXPECT_NE(server.shard_thread(0), server.shard_thread(1));
+}
+
+TEST_F(ShardedTurnServerTest, AllocateAndRelayUdp) {
+  ASSERT_TRUE(StartServer(2, cricket::PROTO_UDP));
+  EXPECT_NE(0, server_addr_.port());
+  TestAllocateAndRelay(8, cricket::PROTO_UDP);
+}
+
+TEST_F(ShardedTurnServerTest, AllocateAndRelayTcp) {
+  ASSERT_TRUE(StartServer(2, cricket::PROTO_TCP));
+  EXPECT_NE(0, server_addr_.port());
+  TestAllocateAndRelay(4, cricket::PROTO_TCP);
+}
+
+// Loopback load generator. Allocates through a batch of TURN-UDP clients, then
+// has each client relay a stream of packets to a single peer, and reports
+// allocations/sec and relayed packets/sec, per shard.
+TEST_F(ShardedTurnServerTest, LoadGeneratorPerf) {
+  const int kShards = 2;
+  const int kClients = 64;
+  const int kRounds = 200;
+  const size_t kPacketSize = 160;
+  ASSERT_TRUE(StartServer(kShards, cricket::PROTO_UDP));
+
+  uint32 start = talk_base::Time();
+  CreatePorts(kClients, cricket::PROTO_UDP);
+  ASSERT_EQ_WAIT(kClients, ports_ready_, kTimeout * 2);
+  uint32 alloc_elapsed = talk_base::TimeSince(start);
+
+  CreatePeer();
+  CreatePermissions();
+  ASSERT_EQ_WAIT(kClients, permissions_, kTimeout);
+  // The first packet binds a channel; the rest go out as ChannelData.
+  char data[kPacketSize] = { 0 };
+  SendToPeer(data, sizeof(data));
+  ASSERT_EQ_WAIT(kClients, peer_packets_, kTimeout);
+  WAIT(false, 100);
+
+  peer_packets_ = 0;
+  start = talk_base::Time();
+  for (int i = 0; i < kRounds; ++i) {
+    SendToPeer(data, sizeof(data));
+    // Keep at most one round in flight so no socket buffer overflows.
+    WAIT(peer_packets_ >= (i + 1) * kClients, 100);
+  }
+  WAIT(peer_packets_ == kRounds * kClients, kTimeout);
+  uint32 relay_elapsed = talk_base::TimeSince(start);
+
+  LOG(LS_INFO) << kShards << " shards: "
+               << kClients * 1000 / (alloc_elapsed + 1) / kShards
+               << " allocations/sec per shard, "
+               << peer_packets_ * 1000 / (relay_elapsed + 1) / kShards
+               << " relayed packets/sec per shard ("
+               << peer_packets_ << " of " << kRounds * kClients
+               << " packets arrived)";
+  EXPECT_GT(peer_packets_, 0);
+}
+
+// Relays from one allocation to many peers, each with its own permission and
+// channel, so the server's per-packet channel lookup dominates.
+TEST_F(ShardedTurnServerTest, ManyPeersRelayPerf) {
+  const int kPeers = 256;
+  const int kRounds = 20;
+  const size_t kPacketSize = 160;
+  ASSERT_TRUE(StartServer(1, cricket::PROTO_UDP));
+  CreatePorts(1, cricket::PROTO_UDP);
+  ASSERT_EQ_WAIT(1, ports_ready_, kTimeout);
+
+  std::vector<talk_base::AsyncPacketSocket*> peers;
+  for (int i = 0; i < kPeers; ++i) {
+    talk_base::AsyncPacketSocket* peer = CreatePeerSocket();
+    ASSERT_TRUE(peer != NULL);
+    peers.push_back(peer);
+    cricket::Candidate candidate;
+    candidate.set_protocol(cricket::UDP_PROTOCOL_NAME);
+    candidate.set_address(peer->GetLocalAddress());
+    ports_[0]->CreateConnection(candidate, Port::ORIGIN_MESSAGE);
+  }
+  ASSERT_EQ_WAIT(kPeers, permissions_, kTimeout * 2);
+
+  // The first packet to each peer binds its channel.
+  char data[kPacketSize] = { 0 };
+  for (int i = 0; i < kPeers; ++i) {
+    ports_[0]->SendTo(data, sizeof(data), peers[i]->GetLocalAddress(), true);
+  }
+  ASSERT_EQ_WAIT(kPeers, peer_packets_, kTimeout);
+  WAIT(false, 100);
+
+  peer_packets_ = 0;
+  uint32 start = talk_base::Time();
+  for (int round = 0; round < kRounds; ++round) {
+    for (int i = 0; i < kPeers; ++i) {
+      ports_[0]->SendTo(data, sizeof(data), peers[i]->GetLocalAddress(), true);
+    }
+    WAIT(peer_packets_ >= (round + 1) * kPeers, 100);
+  }
+  WAIT(peer_packets_ == kRounds * kPeers, kTimeout);
+  uint32 elapsed = talk_base::TimeSince(start);
+
+  LOG(LS_INFO) << kPeers << " peers on one allocation: "
+               << peer_packets_ * 1000 / (elapsed + 1)
+               << " relayed packets/sec (" << peer_packets_ << " of "
+               << kRounds * kPeers << " packets arrived)";
+  EXPECT_GT(peer_packets_, 0);
+  for (size_t i = 0; i < peers.size(); ++i) {
+    delete peers[i];
+  }
+}
+
+// Sends |count| packets from |sender| to |dest| a batch at a time, waiting
+// for each batch to arrive, and returns the server thread's CPU time per
+// packet in nanoseconds.
+static int64 RelayAndMeasure(talk_base::Thread* server_thread,
+                             talk_base::AsyncPacketSocket* sender,
+                             const SocketAddress& dest,
+                             const std::string& packet, int count,
+                             const int* received) {
+  const int kBatch = 16;
+  int start_received = *received;
+  int64 start_cpu = ThreadCpuTimeUs(server_thread);
+  for (int sent = 0; sent < count; sent += kBatch) {
+    for (int i = 0; i < kBatch; ++i) {
+      sender->SendTo(packet.data(), packet.size(), dest);
+    }
+    WAIT(*received - start_received >= sent + kBatch, 100);
+  }
+  WAIT(*received - start_received >= count, kTimeout);
+  return (ThreadCpuTimeUs(server_thread) - start_cpu) * 1000 / count;
+}
+
+// Checks each relay path of the server byte for byte, using a bare client,
+// and reports the server's CPU cost per relayed packet on each: ChannelData
+// and Send indications from the client, and ChannelData and Data indications
+// to it.
+TEST_F(ShardedTurnServerTest, RelayPathsPerf) {
+  const int kChannel = 0x4001;
+  const int kPackets = 4000;
+  const std::string kPayload(160, 'x');
+  ASSERT_TRUE(StartServer(1, cricket::PROTO_UDP));
+  SocketAddress relayed;
+  ASSERT_TRUE(AllocateRawClient(&relayed));
+
+  // |peer_| gets a channel; |other_peer| on the same IP only has the
+  // permission that the channel bind created.
+  CreatePeer();
+  talk_base::scoped_ptr<talk_base::AsyncPacketSocket> other_peer(
+      CreatePeerSocket());
+  ASSERT_TRUE(other_peer != NULL);
+  ASSERT_TRUE(BindRawChannel(kChannel, peer_->GetLocalAddress()));
+
+  // Client to peer, as ChannelData.
+  std::string channel_data(cricket::kStunAttributeHeaderSize, 0);
+  talk_base::SetBE16(&channel_data[0], kChannel);
+  talk_base::SetBE16(&channel_data[2], static_cast<uint16>(kPayload.size()));
+  channel_data += kPayload;
+  client_->SendTo(channel_data.data(), channel_data.size(), server_addr_);
+  EXPECT_EQ_WAIT(1, peer_packets_, kTimeout);
+  EXPECT_EQ(kPayload, last_peer_packet_);
+
+  // Client to peer, as a Send indication.
+  cricket::TurnMessage send;
+  send.SetType(cricket::TURN_SEND_INDICATION);
+  send.SetTransactionID(
+      talk_base::CreateRandomString(cricket::kStunTransactionIdLength));
+  send.AddAttribute(new cricket::StunXorAddressAttribute(
+      cricket::STUN_ATTR_XOR_PEER_ADDRESS, other_peer->GetLocalAddress()));
+  send.AddAttribute(new cricket::StunByteStringAttribute(
+      cricket::STUN_ATTR_DATA, kPayload));
+  talk_base::ByteBuffer send_buf;
+  send.Write(&send_buf);
+  std::string send_indication(send_buf.Data(), send_buf.Length());
+  client_->SendTo(send_indication.data(), send_indication.size(),
+                  server_addr_);
+  EXPECT_EQ_WAIT(2, peer_packets_, kTimeout);
+  EXPECT_EQ(kPayload, last_peer_packet_);
+
+  // Peer to client, as ChannelData.
+  int received = client_packets_;
+  peer_->SendTo(kPayload.data(), kPayload.size(), relayed);
+  ASSERT_EQ_WAIT(received + 1, client_packets_, kTimeout);
+  EXPECT_EQ(channel_data, last_client_packet_);
+
+  // Peer to client, as a Data indication.
+  other_peer->SendTo(kPayload.data(), kPayload.size(), relayed);
+  ASSERT_EQ_WAIT(received + 2, client_packets_, kTimeout);
+  cricket::TurnMessage data_ind;
+  talk_base::ByteBuffer data_buf(last_client_packet_.data(),
+                                 last_client_packet_.size());
+  ASSERT_TRUE(data_ind.Read(&data_buf));
+  EXPECT_EQ(cricket::TURN_DATA_INDICATION, data_ind.type());
+  const cricket::StunAddressAttribute* peer_attr =
+      data_ind.GetAddress(cricket::STUN_ATTR_XOR_PEER_ADDRESS);
+  ASSERT_TRUE(peer_attr != NULL);
+  EXPECT_EQ(other_peer->GetLocalAddress(), peer_attr->GetAddress());
+  const cricket::StunByteStringAttribute* data_attr =
+      data_ind.GetByteString(cricket::STUN_ATTR_DATA);
+  ASSERT_TRUE(data_attr != NULL);
+  EXPECT_EQ(kPayload, data_attr->GetString());
+  EXPECT_TRUE(data_ind.GetByteString(cricket::STUN_ATTR_SOFTWARE) != NULL);
+
+  talk_base::Thread* thread = server_->shard_thread(0);
+  int64 channel_in = RelayAndMeasure(thread, client_.get(), server_addr_,
+                                     channel_data, kPackets, &peer_packets_);
+  int64 send_in = RelayAndMeasure(thread, client_.get(), server_addr_,
+                                  send_indication, kPackets, &peer_packets_);
+  int64 channel_out = RelayAndMeasure(thread, peer_.get(), relayed, kPayload,
+                                      kPackets, &client_packets_);
+  int64 data_out = RelayAndMeasure(thread, other_peer.get(), relayed,
+                                   kPayload, kPackets, &client_packets_);
+  LOG(LS_INFO) << "Server CPU per relayed packet: ChannelData in "
+               << channel_in << " ns, Send indication " << send_in
+               << " ns, ChannelData out " << channel_out
+               << " ns, Data indication " << data_out << " ns";
+}
@@ -33,9 +33,9 @@
 #include "talk/base/byteorder.h"
 #include "talk/base/common.h"
 #include "talk/base/crc32.h"
+#include "talk/base/hmacsha1.h"
 #include "talk/base/logging.h"
 #include "talk/base/messagedigest.h"
-#include "talk/base/scoped_ptr.h"
 #include "talk/base/stringencode.h"
 
 using talk_base::ByteBuffer;
@@ -147,6 +147,12 @@ const StunUInt16ListAttribute* StunMessage::GetUnknownAttributes() const {
 // procedure outlined in RFC 5389, section 15.4.
 bool StunMessage::ValidateMessageIntegrity(const char* data, size_t size,
                                            const std::string& password) {
+  talk_base::HmacSha1 hmac(password.data(), password.size());
+  return ValidateMessageIntegrity(data, size, &hmac);
+}
+
+bool StunMessage::ValidateMessageIntegrity(const char* data, size_t size,
+                                           talk_base::HmacSha1* hmac) {
   // Verifying the size of the message.
   if ((size % 4) != 0) {
     return false;
@@ -190,8 +196,8 @@ bool StunMessage::ValidateMessageIntegrity(const char* data, size_t size,
 
   // Getting length of the message to calculate Message Integrity.
   size_t mi_pos = current_pos;
-  talk_base::scoped_array<char> temp_data(new char[current_pos]);
-  memcpy(temp_data.get(), data, current_pos);
+  char length_field[2];
+  memcpy(length_field, data + 2, sizeof(length_field));
   if (size > mi_pos + kStunAttributeHeaderSize + kStunMessageIntegritySize) {
     // Stun message has other attributes after message integrity.
     // Adjust the length parameter in stun message to calculate HMAC.
@@ -199,27 +205,28 @@ bool StunMessage::ValidateMessageIntegrity(const char* data, size_t size,
         (mi_pos + kStunAttributeHeaderSize + kStunMessageIntegritySize);
     size_t new_adjusted_len = size - extra_offset - kStunHeaderSize;
 
-    // Writing new length of the STUN message @ Message Length in temp buffer.
+    // The HMAC is computed as if the Message Length were the new length.
     //      0                   1                   2                   3
     //      0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
     //     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
     //     |0 0|     STUN Message Type     |         Message Length        |
     //     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-    talk_base::SetBE16(temp_data.get() + 2, new_adjusted_len);
+    talk_base::SetBE16(length_field, new_adjusted_len);
   }
 
-  char hmac[kStunMessageIntegritySize];
-  size_t ret = talk_base::ComputeHmac(talk_base::DIGEST_SHA_1,
-                                      password.c_str(), password.size(),
-                                      temp_data.get(), mi_pos,
-                                      hmac, sizeof(hmac));
-  ASSERT(ret == sizeof(hmac));
-  if (ret != sizeof(hmac))
+  // Hash the message in place, substituting the length field.
+  char hmac_value[kStunMessageIntegritySize];
+  hmac->Update(data, 2);
+  hmac->Update(length_field, sizeof(length_field));
+  hmac->Update(data + 4, mi_pos - 4);
+  size_t ret = hmac->Finish(hmac_value, sizeof(hmac_value));
+  ASSERT(ret == sizeof(hmac_value));
+  if (ret != sizeof(hmac_value))
     return false;
 
   // Comparing the calculated HMAC with the one present in the message.
   return (std::memcmp(data + current_pos + kStunAttributeHeaderSize,
-                      hmac, sizeof(hmac)) == 0);
+                      hmac_value, sizeof(hmac_value)) == 0);
 }
 
 bool StunMessage::AddMessageIntegrity(const std::string& password) {
@@ -228,6 +235,11 @@ bool StunMessage::AddMessageIntegrity(const std::string& password) {
 
 bool StunMessage::AddMessageIntegrity(const char* key,
                                       size_t keylen) {
+  talk_base::HmacSha1 hmac(key, keylen);
+  return AddMessageIntegrity(&hmac);
+}
+
+bool StunMessage::AddMessageIntegrity(talk_base::HmacSha1* hmac) {
   // Add the attribute with a dummy value. Since this is a known attribute, it
   // can't fail.
   StunByteStringAttribute* msg_integrity_attr =
@@ -242,20 +254,56 @@ bool StunMessage::AddMessageIntegrity(const char* key,
 
   int msg_len_for_hmac = buf.Length() -
       kStunAttributeHeaderSize - msg_integrity_attr->length();
-  char hmac[kStunMessageIntegritySize];
-  size_t ret = talk_base::ComputeHmac(talk_base::DIGEST_SHA_1,
-                                      key, keylen,
-                                      buf.Data(), msg_len_for_hmac,
-                                      hmac, sizeof(hmac));
-  ASSERT(ret == sizeof(hmac));
-  if (ret != sizeof(hmac)) {
+  char hmac_value[kStunMessageIntegritySize];
+  size_t ret = hmac->Compute(buf.Data(), msg_len_for_hmac,
+                             hmac_value, sizeof(hmac_value));
+  ASSERT(ret == sizeof(hmac_value));
+  if (ret != sizeof(hmac_value)) {
     LOG(LS_ERROR) << "HMAC computation failed. Message-Integrity "
                   << "has dummy value.";
     return false;
   }
 
   // Insert correct HMAC into the attribute.
-  msg_integrity_attr->CopyBytes(hmac, sizeof(hmac));
+  msg_integrity_attr->CopyBytes(hmac_value, sizeof(hmac_value));
+  return true;
+}
+
+bool StunMessage::AppendMessageIntegrity(talk_base::ByteBuffer* buf,
+                                         const std::string& password) {
+  return AppendMessageIntegrity(buf, password.c_str(), password.size());
+}
+
+bool StunMessage::AppendMessageIntegrity(talk_base::ByteBuffer* buf,
+                                         const char* key, size_t keylen) {
+  talk_base::HmacSha1 hmac(key, keylen);
+  return AppendMessageIntegrity(buf, &hmac);
+}
+
+bool StunMessage::AppendMessageIntegrity(talk_base::ByteBuffer* buf,
+                                         talk_base::HmacSha1* hmac) {
+  if (buf->Length() < kStunHeaderSize)
+    return false;
+
+  // The HMAC covers everything before the attribute, with the header length
+  // already counting the attribute itself.
+  size_t msg_len_for_hmac = buf->Length();
+  if (!buf->WriteUInt16At(2, msg_len_for_hmac - kStunHeaderSize +
+                          kStunAttributeHeaderSize + kStunMessageIntegritySize))
+    return false;
+
+  char hmac_value[kStunMessageIntegritySize];
+  size_t ret = hmac->Compute(buf->Data(), msg_len_for_hmac,
+                             hmac_value, sizeof(hmac_value));
+  ASSERT(ret == sizeof(hmac_value));
+  if (ret != sizeof(hmac_value)) {
+    LOG(LS_ERROR) << "HMAC computation failed.";
+    return false;
+  }
+
+  buf->WriteUInt16(STUN_ATTR_MESSAGE_INTEGRITY);
+  buf->WriteUInt16(kStunMessageIntegritySize);
+  buf->WriteBytes(hmac_value, sizeof(hmac_value));
   return true;
 }
 
@@ -310,6 +358,22 @@ bool StunMessage::AddFingerprint() {
   return true;
 }
 
+bool StunMessage::AppendFingerprint(talk_base::ByteBuffer* buf) {
+  if (buf->Length() < kStunHeaderSize)
+    return false;
+
+  size_t msg_len_for_crc32 = buf->Length();
+  if (!buf->WriteUInt16At(2, msg_len_for_crc32 - kStunHeaderSize +
+                          kStunAttributeHeaderSize + StunUInt32Attribute::SIZE))
+    return false;
+
+  uint32 c = talk_base::ComputeCrc32(buf->Data(), msg_len_for_crc32);
+  buf->WriteUInt16(STUN_ATTR_FINGERPRINT);
+  buf->WriteUInt16(StunUInt32Attribute::SIZE);
+  buf->WriteUInt32(c ^ STUN_FINGERPRINT_XOR_VALUE);
+  return true;
+}
+
 bool StunMessage::Read(ByteBuffer* buf) {
   if (!buf->ReadUInt16(&type_))
     return false;
@@ -478,6 +542,181 @@ bool StunMessage::IsValidTransactionId(const std::string& transaction_id) {
       transaction_id.size() == kStunLegacyTransactionIdLength;
 }
 
+// StunMessageView
+
+StunMessageView::StunMessageView()
+    : data_(NULL), size_(0), type_(0), legacy_(false), num_attrs_(0),
+      overflow_offset_(0) {
+}
+
+bool StunMessageView::Parse(const char* data, size_t size) {
+  num_attrs_ = 0;
+  overflow_offset_ = 0;
+  // RTP and RTCP set the MSB of the first byte; see StunMessage::Read.
+  if (size < kStunHeaderSize || (data[0] & 0x80) ||
+      talk_base::GetBE16(data + 2) != size - kStunHeaderSize) {
+    return false;
+  }
+  data_ = data;
+  size_ = size;
+  type_ = talk_base::GetBE16(data);
+  legacy_ = talk_base::GetBE32(data + kStunTransactionIdOffset -
+                               kStunMagicCookieLength) != kStunMagicCookie;
+
+  size_t pos = kStunHeaderSize;
+  while (pos < size) {
+    Attribute attr;
+    if (!ReadAttributeHeader(&pos, &attr)) {
+      return false;
+    }
+    if (num_attrs_ < kMaxAttributes) {
+      attrs_[num_attrs_++] = attr;
+    } else if (!overflow_offset_) {
+      // Keep validating, but leave the rest for Find to walk.
+      overflow_offset_ = attr.offset - kStunAttributeHeaderSize;
+    }
+  }
+  return true;
+}
+
+bool StunMessageView::ReadAttributeHeader(size_t* pos, Attribute* attr) const {
+  if (*pos + kStunAttributeHeaderSize > size_) {
+    return false;
+  }
+  attr->type = talk_base::GetBE16(data_ + *pos);
+  attr->length = talk_base::GetBE16(data_ + *pos + 2);
+  attr->offset = static_cast<uint32>(*pos + kStunAttributeHeaderSize);
+  if (attr->offset + attr->length > size_) {
+    return false;
+  }
+  // Attributes are padded to a multiple of 4 bytes, but like
+  // StunMessage::Read, let the padding of the last one be left off.
+  *pos = attr->offset + ((attr->length + 3) & ~3);
+  if (*pos > size_) {
+    *pos = size_;
+  }
+  return true;
+}
+
+std::string StunMessageView::transaction_id() const {
+  if (legacy_) {
+    return std::string(data_ + kStunTransactionIdOffset - kStunMagicCookieLength,
+                       kStunLegacyTransactionIdLength);
+  }
+  return std::string(data_ + kStunTransactionIdOffset,
+                     kStunTransactionIdLength);
+}
+
+const StunMessageView::Attribute* StunMessageView::Find(int type) const {
+  for (size_t i = 0; i < num_attrs_; ++i) {
+    if (attrs_[i].type == type)
+      return &attrs_[i];
+  }
+  // Parse has already checked the attributes past the table, so this walk
+  // can't fail.
+  size_t pos = overflow_offset_;
+  while (pos && pos < size_) {
+    ReadAttributeHeader(&pos, &overflow_attr_);
+    if (overflow_attr_.type == type)
+      return &overflow_attr_;
+  }
+  return NULL;
+}
+
+bool StunMessageView::GetRawAttribute(int type, const char** value,
+                                      size_t* length) const {
+  const Attribute* attr = Find(type);
+  if (!attr)
+    return false;
+  *value = data_ + attr->offset;
+  *length = attr->length;
+  return true;
+}
+
+bool StunMessageView::GetByteString(int type, std::string* value) const {
+  const Attribute* attr = Find(type);
+  if (!attr)
+    return false;
+  value->assign(data_ + attr->offset, attr->length);
+  return true;
+}
+
+bool StunMessageView::GetUInt32(int type, uint32* value) const {
+  const Attribute* attr = Find(type);
+  if (!attr || attr->length != 4)
+    return false;
+  *value = talk_base::GetBE32(data_ + attr->offset);
+  return true;
+}
+
+bool StunMessageView::GetUInt64(int type, uint64* value) const {
+  const Attribute* attr = Find(type);
+  if (!attr || attr->length != 8)
+    return false;
+  *value = talk_base::GetBE64(data_ + attr->offset);
+  return true;
+}
+
+bool StunMessageView::GetAddress(int type,
+                                 talk_base::SocketAddress* addr) const {
+  return DecodeAddress(type, false, addr);
+}
+
+bool StunMessageView::GetXorAddress(int type,
+                                    talk_base::SocketAddress* addr) const {
+  // The XOR mask is the magic cookie and transaction ID; it means nothing in
+  // an RFC3489 message.
+  return !legacy_ && DecodeAddress(type, true, addr);
+}
+
+bool StunMessageView::DecodeAddress(int type, bool xored,
+                                    talk_base::SocketAddress* addr) const {
+  const Attribute* attr = Find(type);
+  if (!attr || attr->length < 4)
+    return false;
+  const char* value = data_ + attr->offset;
+  // The mask starts with the magic cookie, which is followed by the
+  // transaction ID for IPv6 addresses.
+  const char* mask = data_ + kStunTransactionIdOffset - kStunMagicCookieLength;
+  char bytes[16];
+  size_t ip_length;
+  if (value[1] == STUN_ADDRESS_IPV4 && attr->length == 4 + 4) {
+    ip_length = 4;
+  } else if (value[1] == STUN_ADDRESS_IPV6 && attr->length == 4 + 16) {
+    ip_length = 16;
+  } else {
+    return false;
+  }
+  uint16 port = talk_base::GetBE16(value + 2);
+  memcpy(bytes, value + 4, ip_length);
+  if (xored) {
+    port ^= talk_base::GetBE16(mask);
+    for (size_t i = 0; i < ip_length; ++i) {
+      bytes[i] ^= mask[i];
+    }
+  }
+  if (ip_length == 4) {
+    in_addr v4addr;
+    memcpy(&v4addr, bytes, sizeof(v4addr));
+    addr->SetIP(talk_base::IPAddress(v4addr));
+  } else {
+    in6_addr v6addr;
+    memcpy(&v6addr, bytes, sizeof(v6addr));
+    addr->SetIP(talk_base::IPAddress(v6addr));
+  }
+  addr->SetPort(port);
+  return true;
+}
+
+bool StunMessageView::GetErrorCode(int* code) const {
+  const Attribute* attr = Find(STUN_ATTR_ERROR_CODE);
+  if (!attr || attr->length < 4)
+    return false;
+  const char* value = data_ + attr->offset;
+  *code = (value[2] & 0x7) * 100 + static_cast<uint8>(value[3]);
+  return true;
+}
+
 // StunAttribute
 
 StunAttribute::StunAttribute(uint16 type, uint16 length)
@@ -36,8 +36,13 @@
 
 #include "talk/base/basictypes.h"
 #include "talk/base/bytebuffer.h"
+#include "talk/base/constructormagic.h"
 #include "talk/base/socketaddress.h"
 
+namespace talk_base {
+class HmacSha1;
+}
+
 namespace cricket {
 
 // These are the types of STUN messages defined in RFC 5389.
@@ -132,6 +137,10 @@ const size_t kStunLegacyTransactionIdLength = 16;
 // STUN Message Integrity HMAC length.
 const size_t kStunMessageIntegritySize = 20;
 
+// Stack storage that fits any STUN message we send without a large DATA
+// attribute. Bigger messages still serialize, but on the heap.
+const size_t kStunMessageBufferSize = 2048;
+
 class StunAttribute;
 class StunAddressAttribute;
 class StunXorAddressAttribute;
@@ -185,9 +194,14 @@ class StunMessage {
   // padding data (which we discard when reading a StunMessage).
   static bool ValidateMessageIntegrity(const char* data, size_t size,
                                        const std::string& password);
+  // Like the above, but with an HMAC already keyed with the password, which
+  // saves setting up the key on every message.
+  static bool ValidateMessageIntegrity(const char* data, size_t size,
+                                       talk_base::HmacSha1* hmac);
   // Adds a MESSAGE-INTEGRITY attribute that is valid for the current message.
   bool AddMessageIntegrity(const std::string& password);
   bool AddMessageIntegrity(const char* key, size_t keylen);
+  bool AddMessageIntegrity(talk_base::HmacSha1* hmac);
 
   // Verifies that a given buffer is STUN by checking for a correct FINGERPRINT.
   static bool ValidateFingerprint(const char* data, size_t size);
@@ -195,6 +209,18 @@ class StunMessage {
   // Adds a FINGERPRINT attribute that is valid for the current message.
   bool AddFingerprint();
 
+  // Append a MESSAGE-INTEGRITY or FINGERPRINT attribute to a message that
+  // has already been written to |buf|, patching the length in its header.
+  // The bytes are the same as from AddMessageIntegrity/AddFingerprint
+  // followed by Write, but the message is only serialized once.
+  static bool AppendMessageIntegrity(talk_base::ByteBuffer* buf,
+                                     const std::string& password);
+  static bool AppendMessageIntegrity(talk_base::ByteBuffer* buf,
+                                     const char* key, size_t keylen);
+  static bool AppendMessageIntegrity(talk_base::ByteBuffer* buf,
+                                     talk_base::HmacSha1* hmac);
+  static bool AppendFingerprint(talk_base::ByteBuffer* buf);
+
   // Parses the STUN packet in the given buffer and records it here. The
   // return value indicates whether this was successful.
   bool Read(talk_base::ByteBuffer* buf);
@@ -225,6 +251,79 @@ class StunMessage {
   std::vector<StunAttribute*>* attrs_;
 };
 
+// A read-only view of a serialized STUN/TURN message, for hot paths that only
+// need to look at a few attributes.  Parse() checks the header and records
+// where each attribute is in a small fixed array; nothing is copied or
+// allocated, and attribute values are only decoded when asked for.  The packet
+// must outlive the view.  Use StunMessage to build a message, or when all of it
+// is needed.
+class StunMessageView {
+ public:
+  // Attributes past this many are still accepted, but looking them up walks
+  // the message.
+  static const size_t kMaxAttributes = 24;
+
+  StunMessageView();
+
+  // Returns true if |data| holds exactly one well-formed STUN message, in the
+  // same sense as StunMessage::Read.
+  bool Parse(const char* data, size_t size);
+
+  int type() const { return type_; }
+  size_t length() const { return size_ - kStunHeaderSize; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  // See StunMessage::IsLegacy.
+  bool IsLegacy() const { return legacy_; }
+  // Copies out the transaction ID, as StunMessage::transaction_id returns it.
+  std::string transaction_id() const;
+
+  bool HasAttribute(int type) const { return Find(type) != NULL; }
+  // Points |value| at the undecoded value of the first attribute of |type|.
+  bool GetRawAttribute(int type, const char** value, size_t* length) const;
+  bool GetByteString(int type, std::string* value) const;
+  bool GetUInt32(int type, uint32* value) const;
+  bool GetUInt64(int type, uint64* value) const;
+  // Decodes MAPPED-ADDRESS style attributes, and the XOR-*-ADDRESS ones with
+  // GetXorAddress.
+  bool GetAddress(int type, talk_base::SocketAddress* addr) const;
+  bool GetXorAddress(int type, talk_base::SocketAddress* addr) const;
+  // Gets the code (e.g. 401) from the ERROR-CODE attribute.
+  bool GetErrorCode(int* code) const;
+
+  bool ValidateMessageIntegrity(const std::string& password) const {
+    return StunMessage::ValidateMessageIntegrity(data_, size_, password);
+  }
+  bool ValidateMessageIntegrity(talk_base::HmacSha1* hmac) const {
+    return StunMessage::ValidateMessageIntegrity(data_, size_, hmac);
+  }
+
+ private:
+  struct Attribute {
+    uint16 type;
+    uint16 length;
+    uint32 offset;  // Of the value, from the start of the message.
+  };
+
+  const Attribute* Find(int type) const;
+  // Reads the attribute header at |*pos| and advances |*pos| past the value.
+  bool ReadAttributeHeader(size_t* pos, Attribute* attr) const;
+  bool DecodeAddress(int type, bool xored,
+                     talk_base::SocketAddress* addr) const;
+
+  const char* data_;
+  size_t size_;
+  uint16 type_;
+  bool legacy_;
+  size_t num_attrs_;
+  Attribute attrs_[kMaxAttributes];
+  // Offset of the first attribute that didn't fit in |attrs_|, or 0.
+  size_t overflow_offset_;
+  mutable Attribute overflow_attr_;
+
+  DISALLOW_COPY_AND_ASSIGN(StunMessageView);
+};
+
 // Base class for all STUN/TURN attributes.
 class StunAttribute {
  public:
@@ -33,6 +33,7 @@
 #include "talk/base/messagedigest.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/socketaddress.h"
+#include "talk/base/timeutils.h"
 #include "talk/p2p/base/stun.h"
 
 namespace cricket {
@@ -1317,6 +1318,251 @@ TEST_F(StunTest, AddFingerprint) {
       reinterpret_cast<const char*>(buf1.Data()), buf1.Length()));
 }
 
+// Appending MESSAGE-INTEGRITY and FINGERPRINT to a message that is already
+// serialized must give the same bytes as adding them to the message first.
+TEST_F(StunTest, AppendMessageIntegrityAndFingerprint) {
+  IceMessage msg;
+  talk_base::ByteBuffer buf(
+      reinterpret_cast<const char*>(kRfc5769SampleRequestWithoutMI),
+      sizeof(kRfc5769SampleRequestWithoutMI));
+  EXPECT_TRUE(msg.Read(&buf));
+
+  char storage[kStunMessageBufferSize];
+  talk_base::ByteBuffer appended(talk_base::ByteBuffer::ORDER_NETWORK,
+                                 storage, sizeof(storage));
+  EXPECT_TRUE(msg.Write(&appended));
+  EXPECT_TRUE(StunMessage::AppendMessageIntegrity(&appended,
+                                                  kRfc5769SampleMsgPassword));
+  EXPECT_TRUE(StunMessage::AppendFingerprint(&appended));
+  EXPECT_EQ(storage, appended.Data());
+  EXPECT_TRUE(StunMessage::ValidateMessageIntegrity(
+      appended.Data(), appended.Length(), kRfc5769SampleMsgPassword));
+  EXPECT_TRUE(StunMessage::ValidateFingerprint(
+      appended.Data(), appended.Length()));
+
+  EXPECT_TRUE(msg.AddMessageIntegrity(kRfc5769SampleMsgPassword));
+  EXPECT_TRUE(msg.AddFingerprint());
+  talk_base::ByteBuffer added;
+  EXPECT_TRUE(msg.Write(&added));
+  ASSERT_EQ(added.Length(), appended.Length());
+  EXPECT_EQ(0, std::memcmp(added.Data(), appended.Data(), added.Length()));
+
+  // There has to be a header to patch.
+  talk_base::ByteBuffer empty;
+  EXPECT_FALSE(StunMessage::AppendMessageIntegrity(&empty,
+                                                   kRfc5769SampleMsgPassword));
+  EXPECT_FALSE(StunMessage::AppendFingerprint(&empty));
+}
+
+#define ParseStunMessageView(X, Y) \
+    (X)->Parse(reinterpret_cast<const char*>(Y), sizeof(Y))
+
+// The view finds the same values in the RFC5769 request as StunMessage does.
+TEST_F(StunTest, ViewRfc5769RequestMessage) {
+  StunMessageView view;
+  ASSERT_TRUE(ParseStunMessageView(&view, kRfc5769SampleRequest));
+  EXPECT_EQ(STUN_BINDING_REQUEST, view.type());
+  EXPECT_EQ(sizeof(kRfc5769SampleRequest) - kStunHeaderSize, view.length());
+  EXPECT_FALSE(view.IsLegacy());
+  EXPECT_EQ(std::string(
+      reinterpret_cast<const char*>(kRfc5769SampleMsgTransactionId),
+      kStunTransactionIdLength), view.transaction_id());
+
+  std::string value;
+  ASSERT_TRUE(view.GetByteString(STUN_ATTR_SOFTWARE, &value));
+  EXPECT_EQ(kRfc5769SampleMsgClientSoftware, value);
+  ASSERT_TRUE(view.GetByteString(STUN_ATTR_USERNAME, &value));
+  EXPECT_EQ(kRfc5769SampleMsgUsername, value);
+  uint32 fingerprint;
+  ASSERT_TRUE(view.GetUInt32(STUN_ATTR_FINGERPRINT, &fingerprint));
+  EXPECT_EQ(0xe57a3bcf, fingerprint);
+  EXPECT_TRUE(view.HasAttribute(STUN_ATTR_MESSAGE_INTEGRITY));
+  EXPECT_FALSE(view.HasAttribute(STUN_ATTR_NONCE));
+  EXPECT_FALSE(view.GetByteString(STUN_ATTR_NONCE, &value));
+
+  EXPECT_TRUE(view.ValidateMessageIntegrity(kRfc5769SampleMsgPassword));
+  EXPECT_FALSE(view.ValidateMessageIntegrity("InvalidPassword"));
+}
+
+TEST_F(StunTest, ViewXorAddresses) {
+  talk_base::SocketAddress addr;
+  StunMessageView view;
+  ASSERT_TRUE(ParseStunMessageView(&view, kRfc5769SampleResponse));
+  EXPECT_EQ(STUN_BINDING_RESPONSE, view.type());
+  ASSERT_TRUE(view.GetXorAddress(STUN_ATTR_XOR_MAPPED_ADDRESS, &addr));
+  EXPECT_EQ(kRfc5769SampleMsgMappedAddress, addr);
+
+  ASSERT_TRUE(ParseStunMessageView(&view, kRfc5769SampleResponseIPv6));
+  ASSERT_TRUE(view.GetXorAddress(STUN_ATTR_XOR_MAPPED_ADDRESS, &addr));
+  EXPECT_EQ(kRfc5769SampleMsgIPv6MappedAddress, addr);
+
+  ASSERT_TRUE(ParseStunMessageView(&view,
+                                   kStunMessageWithIPv4XorMappedAddress));
+  ASSERT_TRUE(view.GetXorAddress(STUN_ATTR_XOR_MAPPED_ADDRESS, &addr));
+  EXPECT_EQ(talk_base::IPAddress(kIPv4TestAddress1), addr.ipaddr());
+  EXPECT_EQ(kTestMessagePort3, addr.port());
+}
+
+TEST_F(StunTest, ViewAddressAndErrorCode) {
+  talk_base::SocketAddress addr;
+  StunMessageView view;
+  ASSERT_TRUE(ParseStunMessageView(&view, kStunMessageWithIPv4MappedAddress));
+  ASSERT_TRUE(view.GetAddress(STUN_ATTR_MAPPED_ADDRESS, &addr));
+  EXPECT_EQ(talk_base::IPAddress(kIPv4TestAddress1), addr.ipaddr());
+  EXPECT_EQ(kTestMessagePort4, addr.port());
+
+  // A bad address family is only noticed when the address is asked for.
+  ASSERT_TRUE(ParseStunMessageView(&view,
+                                   kStunMessageWithInvalidAddressFamily));
+  EXPECT_FALSE(view.GetAddress(STUN_ATTR_MAPPED_ADDRESS, &addr));
+
+  int code;
+  ASSERT_TRUE(ParseStunMessageView(&view, kStunMessageWithErrorAttribute));
+  ASSERT_TRUE(view.GetErrorCode(&code));
+  EXPECT_EQ(kTestErrorCode, code);
+}
+
+TEST_F(StunTest, ViewLegacyMessage) {
+  unsigned char rfc3489_packet[sizeof(kStunMessageWithIPv4MappedAddress)];
+  memcpy(rfc3489_packet, kStunMessageWithIPv4MappedAddress,
+      sizeof(kStunMessageWithIPv4MappedAddress));
+  memcpy(&rfc3489_packet[4], "ABCD", 4);
+
+  StunMessageView view;
+  ASSERT_TRUE(ParseStunMessageView(&view, rfc3489_packet));
+  EXPECT_TRUE(view.IsLegacy());
+  EXPECT_EQ(std::string(reinterpret_cast<const char*>(&rfc3489_packet[4]),
+                        kStunLegacyTransactionIdLength),
+            view.transaction_id());
+  talk_base::SocketAddress addr;
+  EXPECT_TRUE(view.GetAddress(STUN_ATTR_MAPPED_ADDRESS, &addr));
+  EXPECT_FALSE(view.GetXorAddress(STUN_ATTR_MAPPED_ADDRESS, &addr));
+}
+
+TEST_F(StunTest, ViewRejectsInvalidMessages) {
+  StunMessageView view;
+  EXPECT_FALSE(view.Parse(
+      reinterpret_cast<const char*>(kStunMessageWithZeroLength),
+      kRealLengthOfInvalidLengthTestCases));
+  EXPECT_FALSE(view.Parse(
+      reinterpret_cast<const char*>(kStunMessageWithSmallLength),
+      kRealLengthOfInvalidLengthTestCases));
+  EXPECT_FALSE(view.Parse(
+      reinterpret_cast<const char*>(kStunMessageWithExcessLength),
+      kRealLengthOfInvalidLengthTestCases));
+  EXPECT_FALSE(ParseStunMessageView(&view, kRtcpPacket));
+
+  // An attribute running past the end of the message.
+  unsigned char truncated[sizeof(kStunMessageWithByteStringAttribute)];
+  memcpy(truncated, kStunMessageWithByteStringAttribute, sizeof(truncated));
+  truncated[kStunHeaderSize + 3] += 4;
+  EXPECT_FALSE(ParseStunMessageView(&view, truncated));
+}
+
+// StunMessage::Read lets the last attribute go without its padding, and so
+// must the view.
+TEST_F(StunTest, ViewUnpaddedLastAttribute) {
+  static const unsigned char kUnpaddedMessage[] = {
+    0x00, 0x01, 0x00, 0x09,
+    0x21, 0x12, 0xa4, 0x42,
+    0xe3, 0xa9, 0x46, 0xe1,
+    0x7c, 0x00, 0xc2, 0x62,
+    0x54, 0x08, 0x01, 0x00,
+    0x00, 0x06, 0x00, 0x05,  // USERNAME, 5 bytes, no padding
+    'a', 'b', 'c', 'd', 'e'
+  };
+  StunMessage msg;
+  talk_base::ByteBuffer buf(reinterpret_cast<const char*>(kUnpaddedMessage),
+                            sizeof(kUnpaddedMessage));
+  ASSERT_TRUE(msg.Read(&buf));
+
+  StunMessageView view;
+  ASSERT_TRUE(ParseStunMessageView(&view, kUnpaddedMessage));
+  std::string value;
+  ASSERT_TRUE(view.GetByteString(STUN_ATTR_USERNAME, &value));
+  EXPECT_EQ(msg.GetByteString(STUN_ATTR_USERNAME)->GetString(), value);
+}
+
+// Attributes past StunMessageView::kMaxAttributes must still be found, since
+// StunMessage::Read accepts such messages.
+TEST_F(StunTest, ViewMoreAttributesThanTable) {
+  StunMessage msg;
+  msg.SetType(STUN_BINDING_REQUEST);
+  msg.SetTransactionID("0123456789ab");
+  for (size_t i = 0; i < StunMessageView::kMaxAttributes + 6; ++i) {
+    StunByteStringAttribute* software =
+        StunAttribute::CreateByteString(STUN_ATTR_SOFTWARE);
+    software->CopyBytes("padding");
+    msg.AddAttribute(software);
+  }
+  StunByteStringAttribute* username =
+      StunAttribute::CreateByteString(STUN_ATTR_USERNAME);
+  username->CopyBytes("rfrag:lfrag");
+  msg.AddAttribute(username);
+  StunUInt32Attribute* count = StunAttribute::CreateUInt32(
+      STUN_ATTR_RETRANSMIT_COUNT);
+  count->SetValue(12345);
+  msg.AddAttribute(count);
+  talk_base::ByteBuffer out;
+  ASSERT_TRUE(msg.Write(&out));
+
+  StunMessage read_msg;
+  talk_base::ByteBuffer in(out.Data(), out.Length());
+  ASSERT_TRUE(read_msg.Read(&in));
+
+  StunMessageView view;
+  ASSERT_TRUE(view.Parse(out.Data(), out.Length()));
+  EXPECT_EQ(STUN_BINDING_REQUEST, view.type());
+  std::string value;
+  ASSERT_TRUE(view.GetByteString(STUN_ATTR_USERNAME, &value));
+  EXPECT_EQ("rfrag:lfrag", value);
+  uint32 count_value;
+  ASSERT_TRUE(view.GetUInt32(STUN_ATTR_RETRANSMIT_COUNT, &count_value));
+  EXPECT_EQ(12345U, count_value);
+  EXPECT_FALSE(view.HasAttribute(STUN_ATTR_MESSAGE_INTEGRITY));
+
+  // An attribute past the table that runs off the end still fails the parse.
+  std::string bad(out.Data(), out.Length());
+  bad[bad.size() - 8 + 3] += 4;  // RETRANSMIT-COUNT's length.
+  EXPECT_FALSE(view.Parse(bad.data(), bad.size()));
+}
+
+// Compares reading the RFC5769 request with StunMessage to looking at it with
+// a StunMessageView, as Port does for each connectivity check: find the
+// username and check the M-I.
+TEST_F(StunTest, ViewParsePerf) {
+  const int kIterations = 100000;
+  const char* data = reinterpret_cast<const char*>(kRfc5769SampleRequest);
+  const size_t size = sizeof(kRfc5769SampleRequest);
+  int found = 0;
+
+  uint32 start = talk_base::Time();
+  for (int i = 0; i < kIterations; ++i) {
+    StunMessage msg;
+    talk_base::ByteBuffer buf(data, size);
+    if (msg.Read(&buf) && msg.GetByteString(STUN_ATTR_USERNAME))
+      ++found;
+  }
+  uint32 read_elapsed = talk_base::TimeSince(start);
+
+  start = talk_base::Time();
+  for (int i = 0; i < kIterations; ++i) {
+    StunMessageView view;
+    const char* username;
+    size_t username_length;
+    if (view.Parse(data, size) &&
+        view.GetRawAttribute(STUN_ATTR_USERNAME, &username, &username_length))
+      ++found;
+  }
+  uint32 view_elapsed = talk_base::TimeSince(start);
+  EXPECT_EQ(2 * kIterations, found);
+
+  LOG(LS_INFO) << "StunMessage::Read: "
+               << read_elapsed * 1000000LL / kIterations
+               << " ns/message, StunMessageView::Parse: "
+               << view_elapsed * 1000000LL / kIterations << " ns/message";
+}
+
 // Sample "GTURN" relay message.
 static const unsigned char kRelayMessage[] = {
   0x00, 0x01, 0x00, 88,    // message header
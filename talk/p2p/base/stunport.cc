@@ -33,6 +33,7 @@
 #include "talk/base/nethelpers.h"
 #include "talk/p2p/base/common.h"
 #include "talk/p2p/base/stun.h"
+#include "talk/p2p/base/udpportmux.h"
 
 namespace cricket {
 
@@ -41,6 +42,9 @@ const int KEEPALIVE_DELAY = 10 * 1000;  // 10 seconds - sort timeouts
 const int RETRY_DELAY = 50;             // 50ms, from ICE spec
 const int RETRY_TIMEOUT = 50 * 1000;    // ICE says 50 secs
 
+// Number of packets read per system call from a socket the port owns.
+static const size_t kRecvBatchSize = 16;
+
 // Handles a binding request sent to the STUN server.
 class StunBindingRequest : public StunRequest {
  public:
@@ -135,7 +139,8 @@ UDPPort::UDPPort(talk_base::Thread* thread,
       error_(0),
       resolver_(NULL),
       ready_(false),
-      stun_keepalive_delay_(KEEPALIVE_DELAY) {
+      stun_keepalive_delay_(KEEPALIVE_DELAY),
+      mux_(NULL) {
 }
 
 UDPPort::UDPPort(talk_base::Thread* thread,
@@ -150,7 +155,8 @@ UDPPort::UDPPort(talk_base::Thread* thread,
       error_(0),
       resolver_(NULL),
       ready_(false),
-      stun_keepalive_delay_(KEEPALIVE_DELAY) {
+      stun_keepalive_delay_(KEEPALIVE_DELAY),
+      mux_(NULL) {
 }
 
 bool UDPPort::Init() {
@@ -162,6 +168,8 @@ bool UDPPort::Init() {
       LOG_J(LS_WARNING, this) << "UDP socket creation failed";
       return false;
     }
+    // Sends stay unbatched so that errors reach the caller right away.
+    socket_->SetRecvBatchSize(kRecvBatchSize);
     socket_->SignalReadPacket.connect(this, &UDPPort::OnReadPacket);
   }
   socket_->SignalReadyToSend.connect(this, &UDPPort::OnReadyToSend);
@@ -176,6 +184,8 @@ UDPPort::~UDPPort() {
   }
   if (!SharedSocket())
     delete socket_;
+  if (mux_)
+    mux_->RemovePort(this);
 }
 
 void UDPPort::PrepareAddress() {
@@ -226,6 +236,17 @@ int UDPPort::SendTo(const void* data, size_t size,
   return sent;
 }
 
+int UDPPort::SendBufferTo(talk_base::PacketBuffer* packet,
+                          const talk_base::SocketAddress& addr, bool payload) {
+  int sent = socket_->SendBufferTo(packet, addr);
+  if (sent < 0) {
+    error_ = socket_->GetError();
+    LOG_J(LS_ERROR, this) << "UDP send of " << packet->length()
+                          << " bytes failed with error " << error_;
+  }
+  return sent;
+}
+
 int UDPPort::SetOption(talk_base::Socket::Option opt, int value) {
   return socket_->SetOption(opt, value);
 }
@@ -42,6 +42,8 @@ class SignalThread;
 
 namespace cricket {
 
+class UDPPortMux;
+
 // Communicates using the address on the outside of a NAT.
 class UDPPort : public Port {
  public:
@@ -101,6 +103,12 @@ class UDPPort : public Port {
     return true;
   }
 
+  // Returns whether |id| is the transaction ID of one of our outstanding
+  // requests to the STUN server.
+  bool HasStunRequest(const std::string& id) const {
+    return requests_.HasRequest(id);
+  }
+
   void set_stun_keepalive_delay(int delay) {
     stun_keepalive_delay_ = delay;
   }
@@ -122,6 +130,9 @@ class UDPPort : public Port {
 
   virtual int SendTo(const void* data, size_t size,
                      const talk_base::SocketAddress& addr, bool payload);
+  virtual int SendBufferTo(talk_base::PacketBuffer* packet,
+                           const talk_base::SocketAddress& addr,
+                           bool payload);
 
   void OnLocalAddressReady(talk_base::AsyncPacketSocket* socket,
                            const talk_base::SocketAddress& address);
@@ -159,8 +170,12 @@ class UDPPort : public Port {
   talk_base::AsyncResolver* resolver_;
   bool ready_;
   int stun_keepalive_delay_;
+  // Set if our socket is shared through a mux, which needs to know when we
+  // go away.
+  UDPPortMux* mux_;
 
   friend class StunBindingRequest;
+  friend class UDPPortMux;
 };
 
 class StunPort : public UDPPort {
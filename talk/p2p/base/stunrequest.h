@@ -62,6 +62,11 @@ public:
   bool CheckResponse(StunMessage* msg);
   bool CheckResponse(const char* data, size_t size);
 
+  // Returns whether the request with the given transaction ID is outstanding.
+  bool HasRequest(const std::string& id) const {
+    return requests_.find(id) != requests_.end();
+  }
+
   bool empty() { return requests_.empty(); }
 
   // Raised when there are bytes to be sent.
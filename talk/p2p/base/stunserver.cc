@@ -100,7 +100,9 @@ void StunServer::SendErrorResponse(
 
 void StunServer::SendResponse(
     const StunMessage& msg, const talk_base::SocketAddress& addr) {
-  talk_base::ByteBuffer buf;
+  char storage[kStunMessageBufferSize];
+  talk_base::ByteBuffer buf(talk_base::ByteBuffer::ORDER_NETWORK,
+                            storage, sizeof(storage));
   msg.Write(&buf);
   if (socket_->SendTo(buf.Data(), buf.Length(), addr) < 0)
     LOG_ERR(LS_ERROR) << "sendto";
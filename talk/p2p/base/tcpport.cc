@@ -277,6 +277,25 @@ int TCPConnection::Send(const void* data, size_t size) {
   return sent;
 }
 
+int TCPConnection::SendBuffer(talk_base::PacketBuffer* packet) {
+  if (!socket_) {
+    error_ = ENOTCONN;
+    return SOCKET_ERROR;
+  }
+
+  if (write_state() != STATE_WRITABLE) {
+    error_ = EWOULDBLOCK;
+    return SOCKET_ERROR;
+  }
+  int sent = socket_->SendBuffer(packet);
+  if (sent < 0) {
+    error_ = socket_->GetError();
+  } else {
+    send_rate_tracker_.Update(sent);
+  }
+  return sent;
+}
+
 int TCPConnection::GetError() {
   return error_;
 }
@@ -125,6 +125,7 @@ class TCPConnection : public Connection {
   virtual ~TCPConnection();
 
   virtual int Send(const void* data, size_t size);
+  virtual int SendBuffer(talk_base::PacketBuffer* packet);
   virtual int GetError();
 
   talk_base::AsyncPacketSocket* socket() { return socket_; }
@@ -32,6 +32,7 @@
 #include <vector>
 
 #include "talk/base/basictypes.h"
+#include "talk/base/packetbuffer.h"
 #include "talk/base/sigslot.h"
 #include "talk/base/socket.h"
 #include "talk/base/sslidentity.h"
@@ -85,6 +86,13 @@ class TransportChannel : public sigslot::has_slots<> {
   // TODO: Remove the default argument once channel code is updated.
   virtual int SendPacket(const char* data, size_t len, int flags = 0) = 0;
 
+  // Like SendPacket, but takes a ref-counted packet that the transport may
+  // frame in its headroom and hold on to instead of copying.  The packet
+  // view is unchanged on return.
+  virtual int SendBuffer(talk_base::PacketBuffer* packet, int flags) {
+    return SendPacket(packet->data(), packet->length(), flags);
+  }
+
   // Sets a socket option on this channel.  Note that not all options are
   // supported by all transport types.
   virtual int SetOption(talk_base::Socket::Option opt, int value) = 0;
@@ -127,7 +135,7 @@ class TransportChannel : public sigslot::has_slots<> {
 
   // Signalled each time a packet is received on this channel.
   sigslot::signal4<TransportChannel*, const char*,
-                   size_t, int> SignalReadPacket;
+                   size_t, int, sigslot::thread_confined> SignalReadPacket;
 
   // This signal occurs when there is a change in the way that packets are
   // being routed, i.e. to a different remote location. The candidate
@@ -102,6 +102,15 @@ int TransportChannelProxy::SendPacket(const char* data, size_t len, int flags) {
   return impl_->SendPacket(data, len, flags);
 }
 
+int TransportChannelProxy::SendBuffer(talk_base::PacketBuffer* packet,
+                                      int flags) {
+  ASSERT(talk_base::Thread::Current() == worker_thread_);
+  if (!impl_) {
+    return -1;
+  }
+  return impl_->SendBuffer(packet, flags);
+}
+
 int TransportChannelProxy::SetOption(talk_base::Socket::Option opt, int value) {
   ASSERT(talk_base::Thread::Current() == worker_thread_);
   if (!impl_) {
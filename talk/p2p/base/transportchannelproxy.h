@@ -64,6 +64,7 @@ class TransportChannelProxy : public TransportChannel,
   // Implementation of the TransportChannel interface.  These simply forward to
   // the implementation.
   virtual int SendPacket(const char* data, size_t len, int flags);
+  virtual int SendBuffer(talk_base::PacketBuffer* packet, int flags);
   virtual int SetOption(talk_base::Socket::Option opt, int value);
   virtual int GetError();
   virtual TransportRole GetRole() const;
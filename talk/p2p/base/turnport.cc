@@ -157,6 +157,9 @@ class TurnEntry : public sigslot::has_slots<> {
   // Sends a packet to the given destination address.
   // This will wrap the packet in STUN if necessary.
   int Send(const void* data, size_t size, bool payload);
+  // Sends |packet| as ChannelData by writing the header into its headroom.
+  // Falls back to Send when the channel is not bound yet or there is no room.
+  int SendBuffer(talk_base::PacketBuffer* packet, bool payload);
 
   void OnCreatePermissionSuccess();
   void OnCreatePermissionError(StunMessage* response, int code);
@@ -322,6 +325,28 @@ int TurnPort::SendTo(const void* data, size_t size,
   return size;
 }
 
+int TurnPort::SendBufferTo(talk_base::PacketBuffer* packet,
+                           const talk_base::SocketAddress& addr,
+                           bool payload) {
+  TurnEntry* entry = FindEntry(addr);
+  ASSERT(entry != NULL);
+  if (!entry) {
+    return 0;
+  }
+
+  if (!connected()) {
+    error_ = EWOULDBLOCK;
+    return SOCKET_ERROR;
+  }
+
+  size_t size = packet->length();
+  int sent = entry->SendBuffer(packet, payload);
+  if (sent <= 0) {
+    return SOCKET_ERROR;
+  }
+  return size;
+}
+
 void TurnPort::OnReadPacket(talk_base::AsyncPacketSocket* socket,
                            const char* data, size_t size,
                            const talk_base::SocketAddress& remote_addr) {
@@ -346,7 +371,7 @@ void TurnPort::OnReadPacket(talk_base::AsyncPacketSocket* socket,
     // This must be a response for one of our requests.
     // Check success responses, but not errors, for MESSAGE-INTEGRITY.
     if (IsStunSuccessResponseType(msg_type) &&
-        !StunMessage::ValidateMessageIntegrity(data, size, hash())) {
+        !StunMessage::ValidateMessageIntegrity(data, size, &hash_hmac_)) {
       LOG_J(LS_WARNING, this) << "Received TURN message with invalid "
                               << "message integrity, msg_type=" << msg_type;
       return;
@@ -519,16 +544,21 @@ void TurnPort::AddRequestAuthInfo(StunMessage* msg) {
       STUN_ATTR_REALM, realm_)));
   VERIFY(msg->AddAttribute(new StunByteStringAttribute(
       STUN_ATTR_NONCE, nonce_)));
-  VERIFY(msg->AddMessageIntegrity(hash()));
+  VERIFY(msg->AddMessageIntegrity(&hash_hmac_));
 }
 
 int TurnPort::Send(const void* data, size_t len) {
   return socket_->SendTo(data, len, server_address_.address);
 }
 
+int TurnPort::SendBuffer(talk_base::PacketBuffer* packet) {
+  return socket_->SendBufferTo(packet, server_address_.address);
+}
+
 void TurnPort::UpdateHash() {
   VERIFY(ComputeStunCredentialHash(credentials_.username, realm_,
                                    credentials_.password, &hash_));
+  hash_hmac_.SetKey(hash_);
 }
 
 bool TurnPort::UpdateNonce(StunMessage* response) {
@@ -883,6 +913,22 @@ int TurnEntry::Send(const void* data, size_t size, bool payload) {
   return port_->Send(buf.Data(), buf.Length());
 }
 
+int TurnEntry::SendBuffer(talk_base::PacketBuffer* packet, bool payload) {
+  size_t size = packet->length();
+  if (state_ != STATE_BOUND) {
+    return Send(packet->data(), size, payload);
+  }
+  char* header = packet->Prepend(TURN_CHANNEL_HEADER_SIZE);
+  if (!header) {
+    return Send(packet->data(), size, payload);
+  }
+  talk_base::SetBE16(header, channel_id_);
+  talk_base::SetBE16(header + 2, static_cast<uint16>(size));
+  int sent = port_->SendBuffer(packet);
+  packet->Consume(TURN_CHANNEL_HEADER_SIZE);
+  return sent;
+}
+
 void TurnEntry::OnCreatePermissionSuccess() {
   LOG_J(LS_INFO, port_) << "Create permission for "
                         << ext_addr_.ToSensitiveString()
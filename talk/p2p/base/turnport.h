@@ -88,6 +88,9 @@ class TurnPort : public Port {
   virtual int SendTo(const void* data, size_t size,
                      const talk_base::SocketAddress& addr,
                      bool payload);
+  virtual int SendBufferTo(talk_base::PacketBuffer* packet,
+                           const talk_base::SocketAddress& addr,
+                           bool payload);
   virtual int SetOption(talk_base::Socket::Option opt, int value);
   virtual int GetOption(talk_base::Socket::Option opt, int* value);
   virtual int GetError();
@@ -149,6 +152,7 @@ class TurnPort : public Port {
   bool ScheduleRefresh(int lifetime);
   void SendRequest(StunRequest* request, int delay);
   int Send(const void* data, size_t size);
+  int SendBuffer(talk_base::PacketBuffer* packet);
   void UpdateHash();
   bool UpdateNonce(StunMessage* response);
 
@@ -170,6 +174,7 @@ class TurnPort : public Port {
   std::string realm_;       // From 401/438 response message.
   std::string nonce_;       // From 401/438 response message.
   std::string hash_;        // Digest of username:realm:password
+  talk_base::HmacSha1 hash_hmac_;  // Keyed with |hash_|.
 
   int next_channel_number_;
   EntryList entries_;
@@ -31,7 +31,9 @@
 #include "talk/base/logging.h"
 #include "talk/base/gunit.h"
 #include "talk/base/helpers.h"
+#include "talk/base/packetbuffer.h"
 #include "talk/base/physicalsocketserver.h"
+#include "talk/base/scoped_ref_ptr.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/socketaddress.h"
 #include "talk/base/thread.h"
@@ -188,7 +190,7 @@ class TurnPortTest : public testing::Test,
     EXPECT_EQ(Connection::STATE_READABLE, conn2->read_state());
   }
 
-  void TestTurnSendData() {
+  void TestTurnSendData(bool use_packet_buffers) {
     turn_port_->PrepareAddress();
     EXPECT_TRUE_WAIT(turn_ready_, kTimeout);
     CreateUdpPort();
@@ -217,8 +219,16 @@ class TurnPortTest : public testing::Test,
       for (size_t j = 0; j < i + 1; ++j) {
         buf[j] = 0xFF - j;
       }
-      conn1->Send(buf, i + 1);
-      conn2->Send(buf, i + 1);
+      if (use_packet_buffers) {
+        talk_base::scoped_refptr<talk_base::PacketBuffer> packet(
+            talk_base::PacketBuffer::Create(buf, i + 1));
+        conn1->SendBuffer(packet);
+        conn2->SendBuffer(packet);
+        EXPECT_EQ(i + 1, packet->length());
+      } else {
+        conn1->Send(buf, i + 1);
+        conn2->Send(buf, i + 1);
+      }
       main_->ProcessMessages(0);
     }
 
@@ -315,7 +325,14 @@ TEST_F(TurnPortTest, TestTurnConnectionUsingOTUNonce) {
 TEST_F(TurnPortTest, TestTurnSendDataTurnUdpToUdp) {
   // Create ports and prepare addresses.
   CreateTurnPort(kTurnUsername, kTurnPassword, kTurnUdpProtoAddr);
-  TestTurnSendData();
+  TestTurnSendData(false);
+}
+
+// Same as above, but hand the connections ref-counted packets so that the
+// ChannelData header is written into the packet headroom.
+TEST_F(TurnPortTest, TestTurnSendPacketBuffersTurnUdpToUdp) {
+  CreateTurnPort(kTurnUsername, kTurnPassword, kTurnUdpProtoAddr);
+  TestTurnSendData(true);
 }
 
 TEST_F(TurnPortTest, TestTurnSendDataTurnTcpToUdp) {
@@ -325,5 +342,5 @@ TEST_F(TurnPortTest, TestTurnSendDataTurnTcpToUdp) {
       tcp_server_socket, cricket::PROTO_TCP);
   // Create ports and prepare addresses.
   CreateTurnPort(kTurnUsername, kTurnPassword, kTurnTcpProtoAddr);
-  TestTurnSendData();
+  TestTurnSendData(false);
 }
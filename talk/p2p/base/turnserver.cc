@@ -28,9 +28,14 @@
 #include "talk/p2p/base/turnserver.h"
 
 #include "talk/base/bytebuffer.h"
+#include "talk/base/byteorder.h"
 #include "talk/base/helpers.h"
+#include "talk/base/hmacsha1.h"
 #include "talk/base/logging.h"
 #include "talk/base/messagedigest.h"
+#include "talk/base/packetbuffer.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/base/scoped_ref_ptr.h"
 #include "talk/base/socketadapters.h"
 #include "talk/base/stringencode.h"
 #include "talk/base/thread.h"
@@ -59,11 +64,66 @@ static const size_t TURN_CHANNEL_HEADER_SIZE = 4U;
 // TODO(mallinath) - Move these to a common place.
 static const size_t kMaxPacketSize = 64 * 1024;
 
+// Number of UDP packets read, and held for sending, per system call.
+static const size_t kPacketBatchSize = 32;
+
 inline bool IsTurnChannelData(uint16 msg_type) {
   // The first two bits of a channel data message are 0b01.
   return ((msg_type & 0xC000) == 0x4000);
 }
 
+// XOR-PEER-ADDRESS is XORed with the 16 bytes of the STUN header that follow
+// the message length: the magic cookie, then the transaction ID.
+static const size_t kStunXorKeyOffset = 4;
+static const size_t kStunXorAddressMaxSize = 20;  // IPv6.
+
+inline size_t StunPadding(size_t length) {
+  return (4 - (length % 4)) % 4;
+}
+
+// Writes an XOR-PEER-ADDRESS attribute for |addr| at |out|, inside the STUN
+// message |msg| whose header has already been written. Returns the number of
+// bytes written, or 0 if the address family isn't supported.
+static size_t WriteXorPeerAddress(const char* msg, char* out,
+                                  const talk_base::SocketAddress& addr) {
+  const char* key = msg + kStunXorKeyOffset;
+  const talk_base::IPAddress& ip = addr.ipaddr();
+  char* value = out + kStunAttributeHeaderSize;
+  size_t ip_length;
+  if (ip.family() == AF_INET) {
+    in_addr v4addr = ip.ipv4_address();
+    memcpy(value + 4, &v4addr, sizeof(v4addr));
+    value[1] = STUN_ADDRESS_IPV4;
+    ip_length = sizeof(v4addr);
+  } else if (ip.family() == AF_INET6) {
+    in6_addr v6addr = ip.ipv6_address();
+    memcpy(value + 4, &v6addr, sizeof(v6addr));
+    value[1] = STUN_ADDRESS_IPV6;
+    ip_length = sizeof(v6addr);
+  } else {
+    return 0;
+  }
+  for (size_t i = 0; i < ip_length; ++i) {
+    value[4 + i] ^= key[i];
+  }
+  value[0] = 0;
+  talk_base::SetBE16(value + 2, addr.port() ^ talk_base::GetBE16(key));
+  talk_base::SetBE16(out, STUN_ATTR_XOR_PEER_ADDRESS);
+  talk_base::SetBE16(out + 2, static_cast<uint16>(4 + ip_length));
+  return kStunAttributeHeaderSize + 4 + ip_length;
+}
+
+// Finds the peer address and DATA of a Send indication through a view of the
+// packet, so relaying it needs no StunMessage or copy.
+static bool ParseSendIndication(const char* data, size_t size,
+                                talk_base::SocketAddress* peer,
+                                const char** payload, size_t* payload_size) {
+  StunMessageView view;
+  return view.Parse(data, size) &&
+      view.GetXorAddress(STUN_ATTR_XOR_PEER_ADDRESS, peer) &&
+      view.GetRawAttribute(STUN_ATTR_DATA, payload, payload_size);
+}
+
 // IDs used for posted messages.
 enum {
   MSG_TIMEOUT,
@@ -85,6 +145,7 @@ class TurnServer::Allocation : public talk_base::MessageHandler,
 
   Connection* conn() { return &conn_; }
   const std::string& key() const { return key_; }
+  talk_base::HmacSha1* hmac() { return &hmac_; }
   const std::string& transaction_id() const { return transaction_id_; }
   const std::string& username() const { return username_; }
   const std::string& last_nonce() const { return last_nonce_; }
@@ -94,16 +155,21 @@ class TurnServer::Allocation : public talk_base::MessageHandler,
 
   void HandleTurnMessage(const TurnMessage* msg);
   void HandleChannelData(const char* data, size_t size);
+  void HandleSendIndication(const char* data, size_t size);
 
   sigslot::signal1<Allocation*> SignalDestroyed;
 
  private:
-  typedef std::list<Permission*> PermissionList;
-  typedef std::list<Channel*> ChannelList;
+  // Channels are indexed both by number, for data from the client, and by
+  // peer address, for data from the peer; |channels_| owns them.
+  typedef talk_base::FlatHashMap<int, Channel*> ChannelMap;
+  typedef talk_base::FlatHashMap<talk_base::SocketAddress, Channel*,
+                                 talk_base::SocketAddressHash> ChannelPeerMap;
+  typedef talk_base::FlatHashMap<talk_base::IPAddress, Permission*,
+                                 talk_base::IPAddressHash> PermissionMap;
 
   void HandleAllocateRequest(const TurnMessage* msg);
   void HandleRefreshRequest(const TurnMessage* msg);
-  void HandleSendIndication(const TurnMessage* msg);
   void HandleCreatePermissionRequest(const TurnMessage* msg);
   void HandleChannelBindRequest(const TurnMessage* msg);
 
@@ -124,6 +190,9 @@ class TurnServer::Allocation : public talk_base::MessageHandler,
                          const std::string& reason);
   void SendExternal(const void* data, size_t size,
                     const talk_base::SocketAddress& peer);
+  void SendChannelData(const Channel* channel, const char* data, size_t size);
+  void SendDataIndication(const talk_base::SocketAddress& peer,
+                          const char* data, size_t size);
 
   void OnPermissionDestroyed(Permission* perm);
   void OnChannelDestroyed(Channel* channel);
@@ -131,14 +200,21 @@ class TurnServer::Allocation : public talk_base::MessageHandler,
 
   TurnServer* server_;
   talk_base::Thread* thread_;
+  talk_base::TimerHandle timer_;
   Connection conn_;
   talk_base::scoped_ptr<talk_base::AsyncPacketSocket> external_socket_;
   std::string key_;
+  talk_base::HmacSha1 hmac_;  // Keyed with |key_|.
   std::string transaction_id_;
   std::string username_;
   std::string last_nonce_;
-  PermissionList perms_;
-  ChannelList channels_;
+  // Data indications use this random prefix and a counter as their
+  // transaction ID, which spares a random string per relayed packet.
+  std::string indication_id_prefix_;
+  uint32 indication_count_;
+  PermissionMap perms_;
+  ChannelMap channels_;
+  ChannelPeerMap channels_by_peer_;
 };
 
 // Encapsulates a TURN permission.
@@ -158,6 +234,7 @@ class TurnServer::Permission : public talk_base::MessageHandler {
   virtual void OnMessage(talk_base::Message* msg);
 
   talk_base::Thread* thread_;
+  talk_base::TimerHandle timer_;
   talk_base::IPAddress peer_;
 };
 
@@ -180,6 +257,7 @@ class TurnServer::Channel : public talk_base::MessageHandler {
   virtual void OnMessage(talk_base::Message* msg);
 
   talk_base::Thread* thread_;
+  talk_base::TimerHandle timer_;
   int id_;
   talk_base::SocketAddress peer_;
 };
@@ -215,7 +293,7 @@ TurnServer::TurnServer(talk_base::Thread* thread)
 TurnServer::~TurnServer() {
   for (AllocationMap::iterator it = allocations_.begin();
        it != allocations_.end(); ++it) {
-    delete it->second;
+    delete it.value();
   }
 
   for (InternalSocketMap::iterator it = server_sockets_.begin();
@@ -234,7 +312,11 @@ TurnServer::~TurnServer() {
 void TurnServer::AddInternalSocket(talk_base::AsyncPacketSocket* socket,
                                    ProtocolType proto) {
   ASSERT(server_sockets_.end() == server_sockets_.find(socket));
-  server_sockets_[socket] = proto;
+  InternalSocket& info = server_sockets_[socket];
+  info.proto = proto;
+  info.local_address = socket->GetLocalAddress();
+  socket->SetRecvBatchSize(kPacketBatchSize);
+  socket->SetSendBatchSize(kPacketBatchSize);
   socket->SignalReadPacket.connect(this, &TurnServer::OnInternalPacket);
 }
 
@@ -290,17 +372,24 @@ void TurnServer::OnInternalPacket(talk_base::AsyncPacketSocket* socket,
   }
   InternalSocketMap::iterator iter = server_sockets_.find(socket);
   ASSERT(iter != server_sockets_.end());
-  Connection conn(addr, iter->second, socket);
+  Connection conn(addr, iter->second.local_address, iter->second.proto, socket);
   uint16 msg_type = talk_base::GetBE16(data);
-  if (!IsTurnChannelData(msg_type)) {
-    // This is a STUN message.
-    HandleStunMessage(&conn, data, size);
-  } else {
+  if (IsTurnChannelData(msg_type)) {
     // This is a channel message; let the allocation handle it.
     Allocation* allocation = FindAllocation(&conn);
     if (allocation) {
       allocation->HandleChannelData(data, size);
     }
+  } else if (msg_type == TURN_SEND_INDICATION) {
+    // Send indications are relayed straight from the packet, without being
+    // parsed into a TurnMessage. They carry no credentials to check.
+    Allocation* allocation = FindAllocation(&conn);
+    if (allocation) {
+      allocation->HandleSendIndication(data, size);
+    }
+  } else {
+    // This is a STUN message.
+    HandleStunMessage(&conn, data, size);
   }
 }
 
@@ -320,18 +409,25 @@ void TurnServer::HandleStunMessage(Connection* conn, const char* data,
   }
 
   // Look up the key that we'll use to validate the M-I. If we have an
-  // existing allocation, the key will already be cached.
+  // existing allocation, the key, and the HMAC keyed with it, will already
+  // be cached.
   Allocation* allocation = FindAllocation(conn);
   std::string key;
+  talk_base::scoped_ptr<talk_base::HmacSha1> new_hmac;
+  talk_base::HmacSha1* hmac;
   if (!allocation) {
     GetKey(&msg, &key);
+    new_hmac.reset(new talk_base::HmacSha1());
+    new_hmac->SetKey(key);
+    hmac = new_hmac.get();
   } else {
     key = allocation->key();
+    hmac = allocation->hmac();
   }
 
   // Ensure the message is authorized; only needed for requests.
   if (IsStunRequestType(msg.type())) {
-    if (!CheckAuthorization(conn, &msg, data, size, key)) {
+    if (!CheckAuthorization(conn, &msg, data, size, hmac)) {
       return;
     }
   }
@@ -373,7 +469,7 @@ bool TurnServer::GetKey(const StunMessage* msg, std::string* key) {
 bool TurnServer::CheckAuthorization(Connection* conn,
                                     const StunMessage* msg,
                                     const char* data, size_t size,
-                                    const std::string& key) {
+                                    talk_base::HmacSha1* hmac) {
   // RFC 5389, 10.2.2.
   ASSERT(IsStunRequestType(msg->type()));
   const StunByteStringAttribute* mi_attr =
@@ -408,7 +504,8 @@ bool TurnServer::CheckAuthorization(Connection* conn,
 
   // Fail if bad username or M-I.
   // We need |data| and |size| for the call to ValidateMessageIntegrity.
-  if (key.empty() || !StunMessage::ValidateMessageIntegrity(data, size, key)) {
+  if (hmac->key().empty() ||
+      !StunMessage::ValidateMessageIntegrity(data, size, hmac)) {
     SendErrorResponseWithRealmAndNonce(conn, msg, STUN_ERROR_UNAUTHORIZED,
                                        STUN_ERROR_REASON_UNAUTHORIZED);
     return false;
@@ -511,8 +608,8 @@ bool TurnServer::ValidateNonce(const std::string& nonce) const {
 }
 
 TurnServer::Allocation* TurnServer::FindAllocation(Connection* conn) {
-  AllocationMap::const_iterator it = allocations_.find(*conn);
-  return (it != allocations_.end()) ? it->second : NULL;
+  Allocation** allocation = allocations_.Find(*conn);
+  return allocation ? *allocation : NULL;
 }
 
 TurnServer::Allocation* TurnServer::CreateAllocation(Connection* conn,
@@ -523,12 +620,14 @@ TurnServer::Allocation* TurnServer::CreateAllocation(Connection* conn,
   if (!external_socket) {
     return NULL;
   }
+  external_socket->SetRecvBatchSize(kPacketBatchSize);
+  external_socket->SetSendBatchSize(kPacketBatchSize);
 
   // The Allocation takes ownership of the socket.
   Allocation* allocation = new Allocation(this,
       thread_, *conn, external_socket, key);
   allocation->SignalDestroyed.connect(this, &TurnServer::OnAllocationDestroyed);
-  allocations_[*conn] = allocation;
+  VERIFY(allocations_.Insert(*conn, allocation));
   return allocation;
 }
 
@@ -555,14 +654,30 @@ void TurnServer::SendErrorResponseWithRealmAndNonce(
 }
 
 void TurnServer::SendStun(Connection* conn, StunMessage* msg) {
-  talk_base::ByteBuffer buf;
+  char storage[kStunMessageBufferSize];
+  talk_base::ByteBuffer buf(talk_base::ByteBuffer::ORDER_NETWORK,
+                            storage, sizeof(storage));
+  WriteStun(msg, &buf);
+  Send(conn, buf);
+}
+
+void TurnServer::SendStunWithIntegrity(Connection* conn, StunMessage* msg,
+                                       talk_base::HmacSha1* hmac) {
+  char storage[kStunMessageBufferSize];
+  talk_base::ByteBuffer buf(talk_base::ByteBuffer::ORDER_NETWORK,
+                            storage, sizeof(storage));
+  WriteStun(msg, &buf);
+  VERIFY(StunMessage::AppendMessageIntegrity(&buf, hmac));
+  Send(conn, buf);
+}
+
+void TurnServer::WriteStun(StunMessage* msg, talk_base::ByteBuffer* buf) {
   // Add a SOFTWARE attribute if one is set.
   if (!software_.empty()) {
     VERIFY(msg->AddAttribute(
         new StunByteStringAttribute(STUN_ATTR_SOFTWARE, software_)));
   }
-  msg->Write(&buf);
-  Send(conn, buf);
+  msg->Write(buf);
 }
 
 void TurnServer::Send(Connection* conn,
@@ -570,6 +685,11 @@ void TurnServer::Send(Connection* conn,
   conn->socket()->SendTo(buf.Data(), buf.Length(), conn->src());
 }
 
+void TurnServer::SendPacket(Connection* conn,
+                            talk_base::PacketBuffer* packet) {
+  conn->socket()->SendBufferTo(packet, conn->src());
+}
+
 void TurnServer::OnAllocationDestroyed(Allocation* allocation) {
   // Removing the internal socket if the connection is not udp.
   talk_base::AsyncPacketSocket* socket = allocation->conn()->socket();
@@ -577,13 +697,11 @@ void TurnServer::OnAllocationDestroyed(Allocation* allocation) {
   ASSERT(iter != server_sockets_.end());
   // Skip if the socket serving this allocation is UDP, as this will be shared
   // by all allocations.
-  if (iter->second != cricket::PROTO_UDP) {
+  if (iter->second.proto != cricket::PROTO_UDP) {
     DestroyInternalSocket(socket);
   }
 
-  AllocationMap::iterator it = allocations_.find(*(allocation->conn()));
-  if (it != allocations_.end())
-    allocations_.erase(it);
+  allocations_.Erase(*allocation->conn());
 }
 
 void TurnServer::DestroyInternalSocket(talk_base::AsyncPacketSocket* socket) {
@@ -596,10 +714,11 @@ void TurnServer::DestroyInternalSocket(talk_base::AsyncPacketSocket* socket) {
 }
 
 TurnServer::Connection::Connection(const talk_base::SocketAddress& src,
+                                   const talk_base::SocketAddress& dst,
                                    ProtocolType proto,
                                    talk_base::AsyncPacketSocket* socket)
     : src_(src),
-      dst_(socket->GetRemoteAddress()),
+      dst_(dst),
       proto_(proto),
       socket_(socket) {
 }
@@ -609,7 +728,15 @@ bool TurnServer::Connection::operator==(const Connection& c) const {
 }
 
 bool TurnServer::Connection::operator<(const Connection& c) const {
-  return src_ < c.src_ || dst_ < c.dst_ || proto_ < c.proto_;
+  if (src_ != c.src_)
+    return src_ < c.src_;
+  if (dst_ != c.dst_)
+    return dst_ < c.dst_;
+  return proto_ < c.proto_;
+}
+
+size_t TurnServer::Connection::Hash() const {
+  return src_.Hash() ^ (dst_.Hash() * 31) ^ proto_;
 }
 
 std::string TurnServer::Connection::ToString() const {
@@ -630,21 +757,25 @@ TurnServer::Allocation::Allocation(TurnServer* server,
       thread_(thread),
       conn_(conn),
       external_socket_(socket),
-      key_(key) {
+      key_(key),
+      hmac_(key.data(), key.size()),
+      indication_id_prefix_(talk_base::CreateRandomString(
+          kStunTransactionIdLength - sizeof(uint32))),
+      indication_count_(0) {
   external_socket_->SignalReadPacket.connect(
       this, &TurnServer::Allocation::OnExternalPacket);
 }
 
 TurnServer::Allocation::~Allocation() {
-  for (ChannelList::iterator it = channels_.begin();
+  for (ChannelMap::iterator it = channels_.begin();
        it != channels_.end(); ++it) {
-    delete *it;
+    delete it.value();
   }
-  for (PermissionList::iterator it = perms_.begin();
+  for (PermissionMap::iterator it = perms_.begin();
        it != perms_.end(); ++it) {
-    delete *it;
+    delete it.value();
   }
-  thread_->Clear(this, MSG_TIMEOUT);
+  thread_->CancelDelayed(timer_);
   LOG_J(LS_INFO, this) << "Allocation destroyed";
 }
 
@@ -663,9 +794,6 @@ void TurnServer::Allocation::HandleTurnMessage(const TurnMessage* msg) {
     case TURN_REFRESH_REQUEST:
       HandleRefreshRequest(msg);
       break;
-    case TURN_SEND_INDICATION:
-      HandleSendIndication(msg);
-      break;
     case TURN_CREATE_PERMISSION_REQUEST:
       HandleCreatePermissionRequest(msg);
       break;
@@ -689,7 +817,7 @@ void TurnServer::Allocation::HandleAllocateRequest(const TurnMessage* msg) {
 
   // Figure out the lifetime and start the allocation timer.
   int lifetime_secs = ComputeLifetime(msg);
-  thread_->PostDelayed(lifetime_secs * 1000, this, MSG_TIMEOUT);
+  timer_ = thread_->PostDelayedTimer(lifetime_secs * 1000, this, MSG_TIMEOUT);
 
   LOG_J(LS_INFO, this) << "Created allocation, lifetime=" << lifetime_secs;
 
@@ -716,8 +844,8 @@ void TurnServer::Allocation::HandleRefreshRequest(const TurnMessage* msg) {
   int lifetime_secs = ComputeLifetime(msg);
 
   // Reset the expiration timer.
-  thread_->Clear(this, MSG_TIMEOUT);
-  thread_->PostDelayed(lifetime_secs * 1000, this, MSG_TIMEOUT);
+  thread_->CancelDelayed(timer_);
+  timer_ = thread_->PostDelayedTimer(lifetime_secs * 1000, this, MSG_TIMEOUT);
 
   LOG_J(LS_INFO, this) << "Refreshed allocation, lifetime=" << lifetime_secs;
 
@@ -732,23 +860,23 @@ void TurnServer::Allocation::HandleRefreshRequest(const TurnMessage* msg) {
   SendResponse(&response);
 }
 
-void TurnServer::Allocation::HandleSendIndication(const TurnMessage* msg) {
+void TurnServer::Allocation::HandleSendIndication(const char* data,
+                                                  size_t size) {
   // Check mandatory attributes.
-  const StunByteStringAttribute* data_attr = msg->GetByteString(STUN_ATTR_DATA);
-  const StunAddressAttribute* peer_attr =
-      msg->GetAddress(STUN_ATTR_XOR_PEER_ADDRESS);
-  if (!data_attr || !peer_attr) {
+  talk_base::SocketAddress peer;
+  const char* payload;
+  size_t payload_size;
+  if (!ParseSendIndication(data, size, &peer, &payload, &payload_size)) {
     LOG_J(LS_WARNING, this) << "Received invalid send indication";
     return;
   }
 
   // If a permission exists, send the data on to the peer.
-  if (HasPermission(peer_attr->GetAddress().ipaddr())) {
-    SendExternal(data_attr->bytes(), data_attr->length(),
-                 peer_attr->GetAddress());
+  if (HasPermission(peer.ipaddr())) {
+    SendExternal(payload, payload_size, peer);
   } else {
     LOG_J(LS_WARNING, this) << "Received send indication without permission"
-                            << "peer=" << peer_attr->GetAddress();
+                            << "peer=" << peer;
   }
 }
 
@@ -806,7 +934,8 @@ void TurnServer::Allocation::HandleChannelBindRequest(const TurnMessage* msg) {
     channel1 = new Channel(thread_, channel_id, peer_attr->GetAddress());
     channel1->SignalDestroyed.connect(this,
         &TurnServer::Allocation::OnChannelDestroyed);
-    channels_.push_back(channel1);
+    channels_.Insert(channel_id, channel1);
+    channels_by_peer_.Insert(channel1->peer(), channel1);
   } else {
     channel1->Refresh();
   }
@@ -824,13 +953,19 @@ void TurnServer::Allocation::HandleChannelBindRequest(const TurnMessage* msg) {
 }
 
 void TurnServer::Allocation::HandleChannelData(const char* data, size_t size) {
-  // Extract the channel number from the data.
+  // Extract the channel number and length from the data. Anything past the
+  // length is padding.
   uint16 channel_id = talk_base::GetBE16(data);
+  size_t length = talk_base::GetBE16(data + 2);
+  if (length > size - TURN_CHANNEL_HEADER_SIZE) {
+    LOG_J(LS_WARNING, this) << "Received truncated channel data, id="
+                            << channel_id;
+    return;
+  }
   Channel* channel = FindChannel(channel_id);
   if (channel) {
-    // Send the data to the peer address.
-    SendExternal(data + TURN_CHANNEL_HEADER_SIZE,
-                 size - TURN_CHANNEL_HEADER_SIZE, channel->peer());
+    // Send the data to the peer address, straight from the packet.
+    SendExternal(data + TURN_CHANNEL_HEADER_SIZE, length, channel->peer());
   } else {
     LOG_J(LS_WARNING, this) << "Received channel data for invalid channel, id="
                             << channel_id;
@@ -845,22 +980,10 @@ void TurnServer::Allocation::OnExternalPacket(
   Channel* channel = FindChannel(addr);
   if (channel) {
     // There is a channel bound to this address. Send as a channel message.
-    talk_base::ByteBuffer buf;
-    buf.WriteUInt16(channel->id());
-    buf.WriteUInt16(size);
-    buf.WriteBytes(data, size);
-    server_->Send(&conn_, buf);
+    SendChannelData(channel, data, size);
   } else if (HasPermission(addr.ipaddr())) {
     // No channel, but a permission exists. Send as a data indication.
-    TurnMessage msg;
-    msg.SetType(TURN_DATA_INDICATION);
-    msg.SetTransactionID(
-        talk_base::CreateRandomString(kStunTransactionIdLength));
-    VERIFY(msg.AddAttribute(new StunXorAddressAttribute(
-        STUN_ATTR_XOR_PEER_ADDRESS, addr)));
-    VERIFY(msg.AddAttribute(new StunByteStringAttribute(
-        STUN_ATTR_DATA, data, size)));
-    server_->SendStun(&conn_, &msg);
+    SendDataIndication(addr, data, size);
   } else {
     LOG_J(LS_WARNING, this) << "Received external packet without permission, "
                             << "peer=" << addr;
@@ -887,7 +1010,7 @@ void TurnServer::Allocation::AddPermission(const talk_base::IPAddress& addr) {
     perm = new Permission(thread_, addr);
     perm->SignalDestroyed.connect(
         this, &TurnServer::Allocation::OnPermissionDestroyed);
-    perms_.push_back(perm);
+    perms_.Insert(addr, perm);
   } else {
     perm->Refresh();
   }
@@ -895,37 +1018,24 @@ void TurnServer::Allocation::AddPermission(const talk_base::IPAddress& addr) {
 
 TurnServer::Permission* TurnServer::Allocation::FindPermission(
     const talk_base::IPAddress& addr) const {
-  for (PermissionList::const_iterator it = perms_.begin();
-       it != perms_.end(); ++it) {
-    if ((*it)->peer() == addr)
-      return *it;
-  }
-  return NULL;
+  Permission* const* perm = perms_.Find(addr);
+  return perm ? *perm : NULL;
 }
 
 TurnServer::Channel* TurnServer::Allocation::FindChannel(int channel_id) const {
-  for (ChannelList::const_iterator it = channels_.begin();
-       it != channels_.end(); ++it) {
-    if ((*it)->id() == channel_id)
-      return *it;
-  }
-  return NULL;
+  Channel* const* channel = channels_.Find(channel_id);
+  return channel ? *channel : NULL;
 }
 
 TurnServer::Channel* TurnServer::Allocation::FindChannel(
     const talk_base::SocketAddress& addr) const {
-  for (ChannelList::const_iterator it = channels_.begin();
-       it != channels_.end(); ++it) {
-    if ((*it)->peer() == addr)
-      return *it;
-  }
-  return NULL;
+  Channel* const* channel = channels_by_peer_.Find(addr);
+  return channel ? *channel : NULL;
 }
 
 void TurnServer::Allocation::SendResponse(TurnMessage* msg) {
   // Success responses always have M-I.
-  msg->AddMessageIntegrity(key_);
-  server_->SendStun(&conn_, msg);
+  server_->SendStunWithIntegrity(&conn_, msg, &hmac_);
 }
 
 void TurnServer::Allocation::SendBadRequestResponse(const TurnMessage* req) {
@@ -942,6 +1052,64 @@ void TurnServer::Allocation::SendExternal(const void* data, size_t size,
   external_socket_->SendTo(data, size, peer);
 }
 
+void TurnServer::Allocation::SendChannelData(const Channel* channel,
+                                             const char* data, size_t size) {
+  // Copy the data once, into a pooled packet, and put the ChannelData header
+  // in its headroom. TCP sockets add the padding.
+  talk_base::scoped_refptr<talk_base::PacketBuffer> packet(
+      talk_base::PacketBuffer::Create(size));
+  memcpy(packet->data(), data, size);
+  char* header = packet->Prepend(TURN_CHANNEL_HEADER_SIZE);
+  talk_base::SetBE16(header, static_cast<uint16>(channel->id()));
+  talk_base::SetBE16(header + 2, static_cast<uint16>(size));
+  server_->SendPacket(&conn_, packet);
+}
+
+void TurnServer::Allocation::SendDataIndication(
+    const talk_base::SocketAddress& peer, const char* data, size_t size) {
+  // Writes the indication directly; it's the same message that TurnMessage
+  // would produce, with XOR-PEER-ADDRESS, DATA and SOFTWARE attributes.
+  const std::string& software = server_->software_;
+  size_t max_length = kStunHeaderSize +
+      kStunAttributeHeaderSize + kStunXorAddressMaxSize +
+      kStunAttributeHeaderSize + size + StunPadding(size) +
+      kStunAttributeHeaderSize + software.size() + StunPadding(software.size());
+  talk_base::scoped_refptr<talk_base::PacketBuffer> packet(
+      talk_base::PacketBuffer::Create(max_length));
+  char* msg = packet->data();
+  talk_base::SetBE16(msg, TURN_DATA_INDICATION);
+  talk_base::SetBE32(msg + kStunXorKeyOffset, kStunMagicCookie);
+  memcpy(msg + kStunTransactionIdOffset, indication_id_prefix_.data(),
+         indication_id_prefix_.size());
+  talk_base::SetBE32(msg + kStunHeaderSize - sizeof(uint32),
+                     ++indication_count_);
+
+  size_t pos = kStunHeaderSize;
+  size_t written = WriteXorPeerAddress(msg, msg + pos, peer);
+  if (!written) {
+    return;
+  }
+  pos += written;
+  talk_base::SetBE16(msg + pos, STUN_ATTR_DATA);
+  talk_base::SetBE16(msg + pos + 2, static_cast<uint16>(size));
+  memcpy(msg + pos + kStunAttributeHeaderSize, data, size);
+  pos += kStunAttributeHeaderSize + size;
+  memset(msg + pos, 0, StunPadding(size));
+  pos += StunPadding(size);
+  if (!software.empty()) {
+    talk_base::SetBE16(msg + pos, STUN_ATTR_SOFTWARE);
+    talk_base::SetBE16(msg + pos + 2, static_cast<uint16>(software.size()));
+    memcpy(msg + pos + kStunAttributeHeaderSize, software.data(),
+           software.size());
+    pos += kStunAttributeHeaderSize + software.size();
+    memset(msg + pos, 0, StunPadding(software.size()));
+    pos += StunPadding(software.size());
+  }
+  talk_base::SetBE16(msg + 2, static_cast<uint16>(pos - kStunHeaderSize));
+  packet->SetLength(pos);
+  server_->SendPacket(&conn_, packet);
+}
+
 void TurnServer::Allocation::OnMessage(talk_base::Message* msg) {
   ASSERT(msg->message_id == MSG_TIMEOUT);
   SignalDestroyed(this);
@@ -949,16 +1117,12 @@ void TurnServer::Allocation::OnMessage(talk_base::Message* msg) {
 }
 
 void TurnServer::Allocation::OnPermissionDestroyed(Permission* perm) {
-  PermissionList::iterator it = std::find(perms_.begin(), perms_.end(), perm);
-  ASSERT(it != perms_.end());
-  perms_.erase(it);
+  VERIFY(perms_.Erase(perm->peer()));
 }
 
 void TurnServer::Allocation::OnChannelDestroyed(Channel* channel) {
-  ChannelList::iterator it =
-      std::find(channels_.begin(), channels_.end(), channel);
-  ASSERT(it != channels_.end());
-  channels_.erase(it);
+  VERIFY(channels_.Erase(channel->id()));
+  VERIFY(channels_by_peer_.Erase(channel->peer()));
 }
 
 TurnServer::Permission::Permission(talk_base::Thread* thread,
@@ -968,12 +1132,12 @@ TurnServer::Permission::Permission(talk_base::Thread* thread,
 }
 
 TurnServer::Permission::~Permission() {
-  thread_->Clear(this, MSG_TIMEOUT);
+  thread_->CancelDelayed(timer_);
 }
 
 void TurnServer::Permission::Refresh() {
-  thread_->Clear(this, MSG_TIMEOUT);
-  thread_->PostDelayed(kPermissionTimeout, this, MSG_TIMEOUT);
+  thread_->CancelDelayed(timer_);
+  timer_ = thread_->PostDelayedTimer(kPermissionTimeout, this, MSG_TIMEOUT);
 }
 
 void TurnServer::Permission::OnMessage(talk_base::Message* msg) {
@@ -989,12 +1153,12 @@ TurnServer::Channel::Channel(talk_base::Thread* thread, int id,
 }
 
 TurnServer::Channel::~Channel() {
-  thread_->Clear(this, MSG_TIMEOUT);
+  thread_->CancelDelayed(timer_);
 }
 
 void TurnServer::Channel::Refresh() {
-  thread_->Clear(this, MSG_TIMEOUT);
-  thread_->PostDelayed(kChannelTimeout, this, MSG_TIMEOUT);
+  thread_->CancelDelayed(timer_);
+  timer_ = thread_->PostDelayedTimer(kChannelTimeout, this, MSG_TIMEOUT);
 }
 
 void TurnServer::Channel::OnMessage(talk_base::Message* msg) {
@@ -28,11 +28,11 @@
 #ifndef TALK_P2P_BASE_TURNSERVER_H_
 #define TALK_P2P_BASE_TURNSERVER_H_
 
-#include <list>
 #include <map>
 #include <set>
 #include <string>
 
+#include "talk/base/flathashmap.h"
 #include "talk/base/messagequeue.h"
 #include "talk/base/sigslot.h"
 #include "talk/base/socketaddress.h"
@@ -41,6 +41,8 @@
 namespace talk_base {
 class AsyncPacketSocket;
 class ByteBuffer;
+class HmacSha1;
+class PacketBuffer;
 class PacketSocketFactory;
 class Thread;
 }
@@ -85,6 +87,11 @@ class TurnServer : public sigslot::has_slots<> {
 
   void set_enable_otu_nonce(bool enable) { enable_otu_nonce_ = enable; }
 
+  // Gets/sets the secret that nonces are signed with. Servers with the same
+  // key accept each other's nonces. A random key is used by default.
+  const std::string& nonce_key() const { return nonce_key_; }
+  void set_nonce_key(const std::string& key) { nonce_key_ = key; }
+
   // Starts listening for packets from internal clients.
   void AddInternalSocket(talk_base::AsyncPacketSocket* socket,
                          ProtocolType proto);
@@ -98,17 +105,20 @@ class TurnServer : public sigslot::has_slots<> {
                                 const talk_base::SocketAddress& address);
 
  private:
-  // Encapsulates the client's connection to the server.
+  // Encapsulates the client's connection to the server, identified by its
+  // 5-tuple: the client and server addresses and the protocol.
   class Connection {
    public:
     Connection() : proto_(PROTO_UDP), socket_(NULL) {}
     Connection(const talk_base::SocketAddress& src,
+               const talk_base::SocketAddress& dst,
                ProtocolType proto,
                talk_base::AsyncPacketSocket* socket);
     const talk_base::SocketAddress& src() const { return src_; }
     talk_base::AsyncPacketSocket* socket() { return socket_; }
     bool operator==(const Connection& t) const;
     bool operator<(const Connection& t) const;
+    size_t Hash() const;
     std::string ToString() const;
 
    private:
@@ -117,10 +127,14 @@ class TurnServer : public sigslot::has_slots<> {
     cricket::ProtocolType proto_;
     talk_base::AsyncPacketSocket* socket_;
   };
+  struct ConnectionHash {
+    size_t operator()(const Connection& c) const { return c.Hash(); }
+  };
   class Allocation;
   class Permission;
   class Channel;
-  typedef std::map<Connection, Allocation*> AllocationMap;
+  typedef talk_base::FlatHashMap<Connection, Allocation*, ConnectionHash>
+      AllocationMap;
 
   void OnInternalPacket(talk_base::AsyncPacketSocket* socket, const char* data,
                         size_t size, const talk_base::SocketAddress& address);
@@ -139,7 +153,7 @@ class TurnServer : public sigslot::has_slots<> {
   bool GetKey(const StunMessage* msg, std::string* key);
   bool CheckAuthorization(Connection* conn, const StunMessage* msg,
                           const char* data, size_t size,
-                          const std::string& key);
+                          talk_base::HmacSha1* hmac);
   std::string GenerateNonce() const;
   bool ValidateNonce(const std::string& nonce) const;
 
@@ -155,13 +169,22 @@ class TurnServer : public sigslot::has_slots<> {
                                           int code,
                                           const std::string& reason);
   void SendStun(Connection* conn, StunMessage* msg);
+  void SendStunWithIntegrity(Connection* conn, StunMessage* msg,
+                             talk_base::HmacSha1* hmac);
+  void WriteStun(StunMessage* msg, talk_base::ByteBuffer* buf);
   void Send(Connection* conn, const talk_base::ByteBuffer& buf);
+  void SendPacket(Connection* conn, talk_base::PacketBuffer* packet);
 
   void OnAllocationDestroyed(Allocation* allocation);
   void DestroyInternalSocket(talk_base::AsyncPacketSocket* socket);
 
+  // The local address is looked up once, rather than for every packet.
+  struct InternalSocket {
+    ProtocolType proto;
+    talk_base::SocketAddress local_address;
+  };
   typedef std::map<talk_base::AsyncPacketSocket*,
-                   ProtocolType> InternalSocketMap;
+                   InternalSocket> InternalSocketMap;
   typedef std::map<talk_base::AsyncSocket*,
                    ProtocolType> ServerSocketMap;
 
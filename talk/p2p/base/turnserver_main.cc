@@ -32,6 +32,7 @@
 #include "talk/base/thread.h"
 #include "talk/base/stringencode.h"
 #include "talk/p2p/base/basicpacketsocketfactory.h"
+#include "talk/p2p/base/shardedturnserver.h"
 #include "talk/p2p/base/turnserver.h"
 
 static const char kSoftware[] = "libjingle TurnServer";
@@ -57,8 +58,8 @@ class TurnFileAuth : public cricket::TurnAuthInterface {
 };
 
 int main(int argc, char **argv) {
-  if (argc != 5) {
-    std::cerr << "usage: turnserver int-addr ext-ip realm auth-file"
+  if (argc != 5 && argc != 6) {
+    std::cerr << "usage: turnserver int-addr ext-ip realm auth-file [shards]"
               << std::endl;
     return 1;
   }
@@ -75,7 +76,39 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  int shards = 1;
+  if (argc == 6 && (!talk_base::FromString(argv[5], &shards) || shards < 1)) {
+    std::cerr << "Invalid number of shards: " << argv[5] << std::endl;
+    return 1;
+  }
+
   talk_base::Thread* main = talk_base::Thread::Current();
+  TurnFileAuth auth(argv[4]);
+  if (shards > 1) {
+    // Each shard binds |int_addr| with SO_REUSEPORT and runs on its own
+    // thread; the main thread only waits.
+    cricket::ShardedTurnServer server(shards);
+    server.set_realm(argv[3]);
+    server.set_software(kSoftware);
+    server.set_auth_hook(&auth);
+    if (!server.AddInternalSocket(int_addr, cricket::PROTO_UDP, NULL)) {
+      std::cerr << "Failed to bind " << shards << " UDP sockets at "
+                << int_addr.ToString() << std::endl;
+      return 1;
+    }
+    server.SetExternalAddress(talk_base::SocketAddress(ext_addr, 0));
+    if (!server.Start()) {
+      std::cerr << "Failed to start the shard threads" << std::endl;
+      return 1;
+    }
+
+    std::cout << "Listening internally at " << int_addr.ToString()
+              << " with " << shards << " shards" << std::endl;
+
+    main->Run();
+    return 0;
+  }
+
   talk_base::AsyncUDPSocket* int_socket =
       talk_base::AsyncUDPSocket::Create(main->socketserver(), int_addr);
   if (!int_socket) {
@@ -85,7 +118,6 @@ int main(int argc, char **argv) {
   }
 
   cricket::TurnServer server(main);
-  TurnFileAuth auth(argv[4]);
   server.set_realm(argv[3]);
   server.set_software(kSoftware);
   server.set_auth_hook(&auth);
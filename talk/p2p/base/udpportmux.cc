@@ -0,0 +1,193 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/p2p/base/udpportmux.h"
+
+#include <algorithm>
+
+#include "talk/base/asyncpacketsocket.h"
+#include "talk/base/logging.h"
+#include "talk/p2p/base/common.h"
+#include "talk/p2p/base/stun.h"
+#include "talk/p2p/base/stunport.h"
+
+namespace cricket {
+
+UDPPortMux::UDPPortMux(talk_base::AsyncPacketSocket* socket)
+    : socket_(socket) {
+  socket_->SignalReadPacket.connect(this, &UDPPortMux::OnReadPacket);
+}
+
+UDPPortMux::~UDPPortMux() {
+  ASSERT(ports_.empty());
+}
+
+UDPPort* UDPPortMux::CreatePort(talk_base::Thread* thread,
+                                talk_base::Network* network,
+                                const std::string& username,
+                                const std::string& password) {
+  UDPPort* port = UDPPort::Create(thread, network, socket_.get(),
+                                  username, password);
+  if (!port)
+    return NULL;
+
+  ports_.push_back(port);
+  port->mux_ = this;
+  port->SignalUfragChanged.connect(this, &UDPPortMux::OnUfragChanged);
+  IndexUfrags();
+  return port;
+}
+
+void UDPPortMux::RemovePort(UDPPort* port) {
+  std::vector<UDPPort*>::iterator it =
+      std::find(ports_.begin(), ports_.end(), port);
+  ASSERT(it != ports_.end());
+  ports_.erase(it);
+
+  // Forget the addresses that were going to it.
+  std::vector<AddressKey> remotes;
+  for (RemoteMap::iterator it = remotes_.begin(); it != remotes_.end(); ++it) {
+    if (it.value() == port)
+      remotes.push_back(it.key());
+  }
+  for (size_t i = 0; i < remotes.size(); ++i)
+    remotes_.Erase(remotes[i]);
+  IndexUfrags();
+}
+
+void UDPPortMux::OnUfragChanged(Port* port) {
+  IndexUfrags();
+}
+
+void UDPPortMux::OnReadPacket(talk_base::AsyncPacketSocket* socket,
+                              const char* data, size_t size,
+                              const talk_base::SocketAddress& remote_addr) {
+  ASSERT(socket == socket_.get());
+  UDPPort* port = FindPort(data, size, remote_addr);
+  if (!port) {
+    LOG(LS_VERBOSE) << "Dropping packet from "
+                    << remote_addr.ToSensitiveString()
+                    << " that is for none of our ports";
+    return;
+  }
+  port->HandleIncomingPacket(socket, data, size, remote_addr);
+}
+
+UDPPort* UDPPortMux::FindPort(const char* data, size_t size,
+                              const talk_base::SocketAddress& remote_addr) {
+  AddressKey key(remote_addr);
+  UDPPort** remote_port = remotes_.Find(key);
+
+  // Binding requests say which port they are for.
+  StunMessageView msg;
+  bool is_stun = msg.Parse(data, size);
+  std::string username;
+  if (is_stun && msg.type() == STUN_BINDING_REQUEST &&
+      msg.GetByteString(STUN_ATTR_USERNAME, &username)) {
+    UDPPort* port = FindPortByUsername(username);
+    if (port && (!remote_port || *remote_port != port)) {
+      remotes_.Erase(key);
+      remotes_.Insert(key, port);
+    }
+    return port;
+  }
+
+  // Responses go by transaction ID, since several ports may have connections
+  // to the same remote address, or use the same STUN server.
+  if (is_stun && (IsStunSuccessResponseType(msg.type()) ||
+                  IsStunErrorResponseType(msg.type()))) {
+    std::string id = msg.transaction_id();
+    for (size_t i = 0; i < ports_.size(); ++i) {
+      UDPPort* port = ports_[i];
+      if (port->server_addr() == remote_addr && port->HasStunRequest(id))
+        return port;
+      Connection* conn = port->GetConnection(remote_addr);
+      if (conn && conn->HasStunRequest(id))
+        return port;
+    }
+    return NULL;
+  }
+
+  // Anything else has to come from an address that a port has a connection
+  // to.  The one that last had it usually still does.
+  if (remote_port && (*remote_port)->GetConnection(remote_addr))
+    return *remote_port;
+  for (size_t i = 0; i < ports_.size(); ++i) {
+    UDPPort* port = ports_[i];
+    if (port->GetConnection(remote_addr)) {
+      remotes_.Erase(key);
+      remotes_.Insert(key, port);
+      return port;
+    }
+  }
+  return NULL;
+}
+
+// The username is "LFRAG:RFRAG" with ICE, or the two just run together with
+// GICE, where the local one comes first in requests.
+UDPPort* UDPPortMux::FindPortByUsername(const std::string& username) const {
+  size_t colon_pos = username.find(':');
+  if (colon_pos != std::string::npos) {
+    UDPPort* port = LookupUfrag(username.substr(0, colon_pos));
+    if (port)
+      return port;
+  }
+  for (size_t i = 0; i < ufrag_lengths_.size(); ++i) {
+    if (ufrag_lengths_[i] <= username.size()) {
+      UDPPort* port = LookupUfrag(username.substr(0, ufrag_lengths_[i]));
+      if (port)
+        return port;
+    }
+  }
+  return NULL;
+}
+
+UDPPort* UDPPortMux::LookupUfrag(const std::string& ufrag) const {
+  UfragMap::const_iterator it = ufrags_.find(ufrag);
+  if (it == ufrags_.end())
+    return NULL;
+  return it->second;
+}
+
+void UDPPortMux::IndexUfrags() {
+  ufrags_.clear();
+  ufrag_lengths_.clear();
+  for (size_t i = 0; i < ports_.size(); ++i) {
+    std::string ufrag = ports_[i]->username_fragment();
+    if (!ufrags_.insert(UfragMap::value_type(ufrag, ports_[i])).second) {
+      LOG_J(LS_WARNING, ports_[i]) << "Shares its ufrag with another port on "
+                                   << "the same socket";
+      continue;
+    }
+    if (std::find(ufrag_lengths_.begin(), ufrag_lengths_.end(),
+                  ufrag.size()) == ufrag_lengths_.end()) {
+      ufrag_lengths_.push_back(ufrag.size());
+    }
+  }
+}
+
+}  // namespace cricket
@@ -0,0 +1,113 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_P2P_BASE_UDPPORTMUX_H_
+#define TALK_P2P_BASE_UDPPORTMUX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "talk/base/constructormagic.h"
+#include "talk/base/flathashmap.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/base/sigslot.h"
+#include "talk/p2p/base/port.h"
+
+namespace talk_base {
+class AsyncPacketSocket;
+class Network;
+class Thread;
+}
+
+namespace cricket {
+
+class UDPPort;
+
+// Lets many UDPPorts, e.g. those of every session on a network, share one
+// socket.  Each received packet is handed to the port that has a connection
+// to where it came from.  STUN binding requests are handed to the port whose
+// ICE ufrag is in their USERNAME, so that ports learn new remote addresses
+// as usual, and STUN responses, whether to pings or to requests to a STUN
+// server, go to the port that sent the request.  The ports must each have a
+// different ufrag, and must be destroyed before the mux.
+//
+// Other packets carry nothing that says which port they are for.  Should
+// several ports have connections to the same remote address, its media goes
+// to the one that last got a binding request from there, so sessions that
+// share a socket should not also share a remote address.
+class UDPPortMux : public sigslot::has_slots<> {
+ public:
+  // Takes ownership of |socket|.
+  explicit UDPPortMux(talk_base::AsyncPacketSocket* socket);
+  ~UDPPortMux();
+
+  talk_base::AsyncPacketSocket* socket() { return socket_.get(); }
+  size_t port_count() const { return ports_.size(); }
+
+  // Creates a port that sends and receives through our socket.  Returns NULL
+  // if that fails.
+  UDPPort* CreatePort(talk_base::Thread* thread, talk_base::Network* network,
+                      const std::string& username,
+                      const std::string& password);
+
+ private:
+  typedef talk_base::FlatHashMap<AddressKey, UDPPort*, AddressKeyHash>
+      RemoteMap;
+  typedef std::map<std::string, UDPPort*> UfragMap;
+
+  void OnReadPacket(talk_base::AsyncPacketSocket* socket,
+                    const char* data, size_t size,
+                    const talk_base::SocketAddress& remote_addr);
+  // Called by the port as it is deleted.
+  void RemovePort(UDPPort* port);
+  void OnUfragChanged(Port* port);
+
+  UDPPort* FindPort(const char* data, size_t size,
+                    const talk_base::SocketAddress& remote_addr);
+  UDPPort* FindPortByUsername(const std::string& username) const;
+  UDPPort* LookupUfrag(const std::string& ufrag) const;
+  void IndexUfrags();
+
+  talk_base::scoped_ptr<talk_base::AsyncPacketSocket> socket_;
+  std::vector<UDPPort*> ports_;
+  // Which port last took packets from each remote address.
+  RemoteMap remotes_;
+  // The ports by ufrag.  A port's ufrag depends on its ICE protocol, which
+  // may be set after it is created, so this is rebuilt whenever a port says
+  // that its ufrag changed.
+  UfragMap ufrags_;
+  // The distinct lengths of the ufrags, for finding them in GICE usernames.
+  std::vector<size_t> ufrag_lengths_;
+
+  friend class UDPPort;
+  DISALLOW_COPY_AND_ASSIGN(UDPPortMux);
+};
+
+}  // namespace cricket
+
+#endif  // TALK_P2P_BASE_UDPPORTMUX_H_
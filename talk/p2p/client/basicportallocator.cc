@@ -30,6 +30,7 @@
 #include <string>
 #include <vector>
 
+#include "talk/base/bind.h"
 #include "talk/base/common.h"
 #include "talk/base/helpers.h"
 #include "talk/base/host.h"
@@ -42,6 +43,7 @@
 #include "talk/p2p/base/tcpport.h"
 #include "talk/p2p/base/turnport.h"
 #include "talk/p2p/base/udpport.h"
+#include "talk/p2p/base/udpportmux.h"
 #include "talk/p2p/base/timeouts.h"
 
 using talk_base::CreateRandomId;
@@ -227,9 +229,55 @@ BasicPortAllocator::BasicPortAllocator(
 
 void BasicPortAllocator::Construct() {
   allow_tcp_listen_ = true;
+  mux_thread_ = NULL;
 }
 
 BasicPortAllocator::~BasicPortAllocator() {
+  // The muxes' sockets belong to the network thread, so delete them there.
+  if (mux_thread_) {
+    mux_thread_->Invoke<void>(
+        talk_base::Bind(&BasicPortAllocator::DeleteUdpPortMuxes, this));
+  }
+  // Does nothing, unless that thread has already stopped or gone away.
+  DeleteUdpPortMuxes();
+}
+
+void BasicPortAllocator::DeleteUdpPortMuxes() {
+  for (UdpPortMuxMap::iterator it = udp_port_muxes_.begin();
+       it != udp_port_muxes_.end(); ++it) {
+    delete it->second;
+  }
+  udp_port_muxes_.clear();
+}
+
+UDPPortMux* BasicPortAllocator::GetUdpPortMux(
+    const talk_base::IPAddress& ip, int component,
+    talk_base::PacketSocketFactory* factory) {
+  ASSERT(!mux_thread_ || mux_thread_->IsCurrent());
+  std::pair<talk_base::IPAddress, int> key(ip, component);
+  UdpPortMuxMap::iterator it = udp_port_muxes_.find(key);
+  if (it != udp_port_muxes_.end())
+    return it->second;
+
+  talk_base::AsyncPacketSocket* socket = factory->CreateUdpSocket(
+      talk_base::SocketAddress(ip, 0), min_port(), max_port());
+  if (!socket) {
+    LOG(LS_WARNING) << "Failed to create the shared UDP socket on "
+                    << ip.ToSensitiveString();
+    return NULL;
+  }
+  UDPPortMux* mux = new UDPPortMux(socket);
+  udp_port_muxes_[key] = mux;
+  if (!mux_thread_) {
+    mux_thread_ = talk_base::Thread::Current();
+    mux_thread_->SignalQueueDestroyed.connect(
+        this, &BasicPortAllocator::OnMuxThreadDestroyed);
+  }
+  return mux;
+}
+
+void BasicPortAllocator::OnMuxThreadDestroyed() {
+  mux_thread_ = NULL;
 }
 
 PortAllocatorSession *BasicPortAllocator::CreateSessionInternal(
@@ -682,7 +730,7 @@ void BasicPortAllocatorSession::OnShake() {
     for (iter = ports[i]->connections().begin();
          iter != ports[i]->connections().end();
          ++iter) {
-      connections.push_back(iter->second);
+      connections.push_back(iter.value());
     }
   }
 
@@ -889,10 +937,16 @@ void AllocationSequence::CreateUDPPorts() {
   // TODO(mallinath) - Remove UDPPort creating socket after shared socket
   // is enabled completely.
   UDPPort* port = NULL;
+  UDPPortMux* mux = NULL;
   if (IsFlagSet(PORTALLOCATOR_ENABLE_SHARED_SOCKET) && udp_socket_) {
     port = UDPPort::Create(session_->network_thread(), network_,
                            udp_socket_.get(),
                            session_->username(), session_->password());
+  } else if (IsFlagSet(PORTALLOCATOR_ENABLE_UDP_MUX) &&
+             (mux = session_->allocator()->GetUdpPortMux(
+                 ip_, session_->component(), session_->socket_factory()))) {
+    port = mux->CreatePort(session_->network_thread(), network_,
+                           session_->username(), session_->password());
   } else {
     port = UDPPort::Create(session_->network_thread(),
                            session_->socket_factory(),
@@ -906,7 +960,8 @@ void AllocationSequence::CreateUDPPorts() {
     ports.push_back(port);
     // If shared socket is enabled, STUN candidate will be allocated by the
     // UDPPort.
-    if (IsFlagSet(PORTALLOCATOR_ENABLE_SHARED_SOCKET) &&
+    if ((IsFlagSet(PORTALLOCATOR_ENABLE_SHARED_SOCKET) ||
+         IsFlagSet(PORTALLOCATOR_ENABLE_UDP_MUX)) &&
         !IsFlagSet(PORTALLOCATOR_DISABLE_STUN)) {
       ASSERT(config_ && !config_->stun_address.IsNil());
       if (!(config_ && !config_->stun_address.IsNil())) {
@@ -948,7 +1003,8 @@ void AllocationSequence::CreateStunPorts() {
     return;
   }
 
-  if (IsFlagSet(PORTALLOCATOR_ENABLE_SHARED_SOCKET)) {
+  if (IsFlagSet(PORTALLOCATOR_ENABLE_SHARED_SOCKET) ||
+      IsFlagSet(PORTALLOCATOR_ENABLE_UDP_MUX)) {
     LOG(LS_INFO) << "AllocationSequence: "
                  << "UDPPort will be handling the STUN candidate generation.";
     return;
@@ -28,7 +28,9 @@
 #ifndef TALK_P2P_CLIENT_BASICPORTALLOCATOR_H_
 #define TALK_P2P_CLIENT_BASICPORTALLOCATOR_H_
 
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "talk/base/messagequeue.h"
@@ -40,6 +42,8 @@
 
 namespace cricket {
 
+class UDPPortMux;
+
 struct RelayCredentials {
   RelayCredentials() {}
   RelayCredentials(const std::string& username,
@@ -115,14 +119,31 @@ class BasicPortAllocator : public PortAllocator {
   void set_allow_tcp_listen(bool allow_tcp_listen) {
     allow_tcp_listen_ = allow_tcp_listen;
   }
+
+  // Returns the mux through which the UDP ports of |component| on the network
+  // with |ip| share a socket, creating its socket with |factory| if need be.
+  // Returns NULL if that fails.  Used with PORTALLOCATOR_ENABLE_UDP_MUX; the
+  // muxes last as long as we do, and must all be made on the same thread,
+  // where they are also deleted, unless that thread is gone by then.
+  UDPPortMux* GetUdpPortMux(const talk_base::IPAddress& ip, int component,
+                            talk_base::PacketSocketFactory* factory);
+
  private:
+  typedef std::map<std::pair<talk_base::IPAddress, int>, UDPPortMux*>
+      UdpPortMuxMap;
+
   void Construct();
+  void DeleteUdpPortMuxes();
+  void OnMuxThreadDestroyed();
 
   talk_base::NetworkManager* network_manager_;
   talk_base::PacketSocketFactory* socket_factory_;
   const talk_base::SocketAddress stun_address_;
   std::vector<RelayServerConfig> relays_;
   bool allow_tcp_listen_;
+  UdpPortMuxMap udp_port_muxes_;
+  // The thread the muxes were made on, or NULL once it is destroyed.
+  talk_base::Thread* mux_thread_;
 };
 
 struct PortConfiguration;
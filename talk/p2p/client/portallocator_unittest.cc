@@ -740,6 +740,66 @@ TEST_F(PortAllocatorTest, TestEnableSharedSocketNoUdpAllowed) {
   EXPECT_EQ(1U, candidates_.size());
 }
 
+// Test that when PORTALLOCATOR_ENABLE_UDP_MUX is enabled the UDP ports of
+// different sessions share a socket, and so have the same address, and that
+// each still gets its own response from the STUN server.
+TEST_F(PortAllocatorTest, TestEnableUdpMux) {
+  AddInterface(kClientAddr);
+  allocator().set_flags(allocator().flags() |
+                        cricket::PORTALLOCATOR_DISABLE_RELAY |
+                        cricket::PORTALLOCATOR_DISABLE_TCP |
+                        cricket::PORTALLOCATOR_ENABLE_UDP_MUX);
+  EXPECT_TRUE(CreateSession(cricket::ICE_CANDIDATE_COMPONENT_RTP));
+  talk_base::scoped_ptr<cricket::PortAllocatorSession> session2(
+      CreateSession("session2", cricket::ICE_CANDIDATE_COMPONENT_RTP));
+  session_->StartGettingPorts();
+  session2->StartGettingPorts();
+  ASSERT_EQ_WAIT(2U, candidates_.size(), kDefaultAllocationTimeout);
+  EXPECT_EQ(2U, ports_.size());
+  EXPECT_PRED5(CheckCandidate, candidates_[0],
+      cricket::ICE_CANDIDATE_COMPONENT_RTP, "local", "udp", kClientAddr);
+  EXPECT_PRED5(CheckCandidate, candidates_[1],
+      cricket::ICE_CANDIDATE_COMPONENT_RTP, "local", "udp", kClientAddr);
+  EXPECT_EQ(candidates_[0].address(), candidates_[1].address());
+  EXPECT_NE(candidates_[0].username(), candidates_[1].username());
+  EXPECT_TRUE_WAIT(candidate_allocation_done_, kDefaultAllocationTimeout);
+  EXPECT_EQ(2U, candidates_.size());
+}
+
+// Test that with PORTALLOCATOR_ENABLE_UDP_MUX, the responses from the STUN
+// server to two ports sharing a socket each reach the port that sent the
+// request, so that both ports get a STUN candidate behind a NAT.
+TEST_F(PortAllocatorTest, TestEnableUdpMuxWithNat) {
+  AddInterface(kClientAddr);
+  talk_base::scoped_ptr<talk_base::NATServer> nat_server(
+      CreateNatServer(kNatAddr, talk_base::NAT_OPEN_CONE));
+  allocator_.reset(new cricket::BasicPortAllocator(
+      &network_manager_, &nat_socket_factory_, kStunAddr));
+  allocator_->set_step_delay(cricket::kMinimumStepDelay);
+  allocator_->set_flags(allocator().flags() |
+                        cricket::PORTALLOCATOR_DISABLE_RELAY |
+                        cricket::PORTALLOCATOR_DISABLE_TCP |
+                        cricket::PORTALLOCATOR_ENABLE_UDP_MUX);
+  EXPECT_TRUE(CreateSession(cricket::ICE_CANDIDATE_COMPONENT_RTP));
+  talk_base::scoped_ptr<cricket::PortAllocatorSession> session2(
+      CreateSession("session2", cricket::ICE_CANDIDATE_COMPONENT_RTP));
+  session_->StartGettingPorts();
+  session2->StartGettingPorts();
+  ASSERT_EQ_WAIT(4U, candidates_.size(), kDefaultAllocationTimeout);
+  EXPECT_EQ(2U, ports_.size());
+  std::vector<std::string> stun_usernames;
+  for (size_t i = 0; i < candidates_.size(); ++i) {
+    if (candidates_[i].type() == "stun") {
+      EXPECT_PRED5(CheckCandidate, candidates_[i],
+          cricket::ICE_CANDIDATE_COMPONENT_RTP, "stun", "udp",
+          talk_base::SocketAddress(kNatAddr.ipaddr(), 0));
+      stun_usernames.push_back(candidates_[i].username());
+    }
+  }
+  ASSERT_EQ(2U, stun_usernames.size());
+  EXPECT_NE(stun_usernames[0], stun_usernames[1]);
+}
+
 // Test that the httpportallocator correctly maintains its lists of stun and
 // relay servers, by never allowing an empty list.
 TEST(HttpPortAllocatorTest, TestHttpPortAllocatorHostLists) {
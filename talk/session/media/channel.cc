@@ -31,6 +31,8 @@
 #include "talk/base/byteorder.h"
 #include "talk/base/common.h"
 #include "talk/base/logging.h"
+#include "talk/base/packetbuffer.h"
+#include "talk/base/scoped_ref_ptr.h"
 #include "talk/media/base/rtputils.h"
 #include "talk/p2p/base/transportchannel.h"
 #include "talk/session/media/channelmanager.h"
@@ -65,6 +67,7 @@ enum {
   MSG_SCREENCASTWINDOWEVENT,
   MSG_RTPPACKET,
   MSG_RTCPPACKET,
+  MSG_SENDQUEUE,
   MSG_CHANNEL_ERROR,
   MSG_SETCHANNELOPTIONS,
   MSG_SCALEVOLUME,
@@ -78,6 +81,7 @@ enum {
   MSG_SETSCREENCASTFACTORY,
   MSG_FIRSTPACKETRECEIVED,
   MSG_SESSION_ERROR,
+  MSG_SETSSRCDEMUXER,
 };
 
 // Value specified in RFC 5764.
@@ -85,6 +89,10 @@ static const char kDtlsSrtpExporterLabel[] = "EXTRACTOR-dtls_srtp";
 
 static const int kAgcMinus10db = -10;
 
+// Number of RTP packets the encoder thread can have in flight to the worker
+// before SendPacket falls back to posting each one. A power of two.
+static const size_t kSendQueueSize = 256;
+
 // TODO(hellner): use the device manager for creation of screen capturers when
 // the cl enabling it has landed.
 class NullScreenCapturerFactory : public VideoChannel::ScreenCapturerFactory {
@@ -140,6 +148,7 @@ struct PlayRingbackToneMessageData : public talk_base::MessageData {
   bool result;
 };
 typedef talk_base::TypedMessageData<bool> BoolMessageData;
+typedef talk_base::TypedMessageData<SsrcDemuxer*> SsrcDemuxerMessageData;
 struct DtmfMessageData : public talk_base::MessageData {
   DtmfMessageData(uint32 ssrc, int event, int duration, int flags)
       : ssrc(ssrc),
@@ -186,7 +195,7 @@ struct VideoStatsMessageData : public talk_base::MessageData {
 };
 
 struct PacketMessageData : public talk_base::MessageData {
-  talk_base::Buffer packet;
+  talk_base::scoped_refptr<talk_base::PacketBuffer> packet;
 };
 
 struct AudioRenderMessageData: public talk_base::MessageData {
@@ -353,11 +362,10 @@ static const char* PacketType(bool rtcp) {
   return (!rtcp) ? "RTP" : "RTCP";
 }
 
-static bool ValidPacket(bool rtcp, const talk_base::Buffer* packet) {
+static bool ValidPacket(bool rtcp, size_t length) {
   // Check the packet size. We could check the header too if needed.
-  return (packet &&
-      packet->length() >= (!rtcp ? kMinRtpPacketLen : kMinRtcpPacketLen) &&
-      packet->length() <= kMaxRtpPacketLen);
+  return (length >= (!rtcp ? kMinRtpPacketLen : kMinRtcpPacketLen) &&
+      length <= kMaxRtpPacketLen);
 }
 
 static bool IsReceiveContentDirection(MediaContentDirection direction) {
@@ -387,6 +395,7 @@ BaseChannel::BaseChannel(talk_base::Thread* thread,
       rtcp_(rtcp),
       transport_channel_(NULL),
       rtcp_transport_channel_(NULL),
+      ssrc_demuxer_(NULL),
       enabled_(false),
       writable_(false),
       rtp_ready_to_send_(false),
@@ -397,7 +406,10 @@ BaseChannel::BaseChannel(talk_base::Thread* thread,
       remote_content_direction_(MD_INACTIVE),
       has_received_packet_(false),
       dtls_keyed_(false),
-      secure_required_(false) {
+      secure_required_(false),
+      send_sinks_(0),
+      recv_sinks_(0),
+      send_queue_(kSendQueueSize * sizeof(talk_base::PacketBuffer*)) {
   ASSERT(worker_thread_ == talk_base::Thread::Current());
   LOG(LS_INFO) << "Created channel for " << content_name;
 }
@@ -411,6 +423,9 @@ BaseChannel::~BaseChannel() {
   // the media channel may try to send on the dead transport channel. NULLing
   // is not an effective strategy since the sends will come on another thread.
   delete media_channel_;
+  ClearSendQueue_w();
+  if (ssrc_demuxer_ != NULL)
+    ssrc_demuxer_->RemoveSink(this);
   set_rtcp_transport_channel(NULL);
   if (transport_channel_ != NULL)
     session_->DestroyChannel(content_name_, transport_channel_->component());
@@ -479,6 +494,11 @@ bool BaseChannel::RemoveRecvStream(uint32 ssrc) {
   return data.result;
 }
 
+void BaseChannel::SetSsrcDemuxer(SsrcDemuxer* demuxer) {
+  SsrcDemuxerMessageData data(demuxer);
+  Send(MSG_SETSSRCDEMUXER, &data);
+}
+
 bool BaseChannel::SetLocalContent(const MediaContentDescription* content,
                                   ContentAction action) {
   SetContentData data(content, action);
@@ -550,10 +570,23 @@ bool BaseChannel::IsReadyToSend() const {
 }
 
 bool BaseChannel::SendPacket(talk_base::Buffer* packet) {
-  return SendPacket(false, packet);
+  // Take over the packet data rather than copying it.
+  talk_base::scoped_refptr<talk_base::PacketBuffer> buffer(
+      talk_base::PacketBuffer::Adopt(packet));
+  return SendPacket(false, buffer);
 }
 
 bool BaseChannel::SendRtcp(talk_base::Buffer* packet) {
+  talk_base::scoped_refptr<talk_base::PacketBuffer> buffer(
+      talk_base::PacketBuffer::Adopt(packet));
+  return SendPacket(true, buffer);
+}
+
+bool BaseChannel::SendPacketBuffer(talk_base::PacketBuffer* packet) {
+  return SendPacket(false, packet);
+}
+
+bool BaseChannel::SendRtcpBuffer(talk_base::PacketBuffer* packet) {
   return SendPacket(true, packet);
 }
 
@@ -585,7 +618,16 @@ void BaseChannel::OnChannelRead(TransportChannel* channel,
   // transport. We feed RTP traffic into the demuxer to determine if it is RTCP.
   bool rtcp = PacketIsRtcp(channel, data, len);
   talk_base::Buffer packet(data, len);
-  HandlePacket(rtcp, &packet);
+  HandlePacket(rtcp, &packet, false);
+}
+
+void BaseChannel::OnDemuxedPacket(const char* data, size_t len,
+                                  bool matched) {
+  ASSERT(worker_thread_ == talk_base::Thread::Current());
+  // The demuxer reads from the RTP transport of one of the bundled channels.
+  bool rtcp = PacketIsRtcp(transport_channel_, data, len);
+  talk_base::Buffer packet(data, len);
+  HandlePacket(rtcp, &packet, matched);
 }
 
 void BaseChannel::OnReadyToSend(TransportChannel* channel) {
@@ -612,13 +654,35 @@ void BaseChannel::SetReadyToSend(TransportChannel* channel, bool ready) {
   }
 }
 
+void BaseChannel::UpdateSendSinks() {
+  int sinks = 0;
+  if (!SignalSendPacketPreCrypto.is_empty()) {
+    sinks |= 1 << SINK_PRE_CRYPTO;
+  }
+  if (!SignalSendPacketPostCrypto.is_empty()) {
+    sinks |= 1 << SINK_POST_CRYPTO;
+  }
+  talk_base::AtomicOps::ReleaseStore(&send_sinks_, sinks);
+}
+
+void BaseChannel::UpdateRecvSinks() {
+  int sinks = 0;
+  if (!SignalRecvPacketPreCrypto.is_empty()) {
+    sinks |= 1 << SINK_PRE_CRYPTO;
+  }
+  if (!SignalRecvPacketPostCrypto.is_empty()) {
+    sinks |= 1 << SINK_POST_CRYPTO;
+  }
+  talk_base::AtomicOps::ReleaseStore(&recv_sinks_, sinks);
+}
+
 bool BaseChannel::PacketIsRtcp(const TransportChannel* channel,
                                const char* data, size_t len) {
   return (channel == rtcp_transport_channel_ ||
           rtcp_mux_filter_.DemuxRtcp(data, len));
 }
 
-bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
+bool BaseChannel::SendPacket(bool rtcp, talk_base::PacketBuffer* packet) {
   // Unless we're sending optimistically, we only allow packets through when we
   // are completely writable.
   if (!optimistic_data_send_ && !writable_) {
@@ -632,15 +696,29 @@ bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
   // SRTP and the inner workings of the transport channels.
   // The only downside is that we can't return a proper failure code if
   // needed. Since UDP is unreliable anyway, this should be a non-issue.
+  // RTP goes through |send_queue_|, so that a burst of packets (such as a
+  // video frame) costs the worker a single message.
   if (talk_base::Thread::Current() != worker_thread_) {
-    // Avoid a copy by transferring the ownership of the packet data.
+    if (!rtcp && QueueRtpPacket(packet)) {
+      return true;
+    }
+    // Avoid a copy by taking a reference to the packet.
     int message_id = (!rtcp) ? MSG_RTPPACKET : MSG_RTCPPACKET;
     PacketMessageData* data = new PacketMessageData;
-    packet->TransferTo(&data->packet);
+    data->packet = packet;
     worker_thread_->Post(this, message_id, data);
     return true;
   }
 
+  TransportChannel* channel = BeginSendPacket_w(rtcp, packet);
+  if (!channel || !ProtectPacket_w(rtcp, packet)) {
+    return false;
+  }
+  return FinishSendPacket_w(rtcp, channel, packet);
+}
+
+TransportChannel* BaseChannel::BeginSendPacket_w(
+    bool rtcp, talk_base::PacketBuffer* packet) {
   // Now that we are on the correct thread, ensure we have a place to send this
   // packet before doing anything. (We might get RTCP packets that we don't
   // intend to send.) If we've negotiated RTCP mux, send RTCP over the RTP
@@ -648,42 +726,41 @@ bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
   TransportChannel* channel = (!rtcp || rtcp_mux_filter_.IsActive()) ?
       transport_channel_ : rtcp_transport_channel_;
   if (!channel || (!optimistic_data_send_ && !channel->writable())) {
-    return false;
+    return NULL;
   }
 
   // Protect ourselves against crazy data.
-  if (!ValidPacket(rtcp, packet)) {
+  if (!ValidPacket(rtcp, packet->length())) {
     LOG(LS_ERROR) << "Dropping outgoing " << content_name_ << " "
                   << PacketType(rtcp) << " packet: wrong size="
                   << packet->length();
-    return false;
+    return NULL;
   }
 
   // Signal to the media sink before protecting the packet.
-  {
+  if (HasSink(&send_sinks_, SINK_PRE_CRYPTO)) {
     talk_base::CritScope cs(&signal_send_packet_cs_);
     SignalSendPacketPreCrypto(packet->data(), packet->length(), rtcp);
   }
+  return channel;
+}
 
+bool BaseChannel::ProtectPacket_w(bool rtcp, talk_base::PacketBuffer* packet) {
   // Protect if needed.
   if (srtp_filter_.IsActive()) {
     bool res;
+    // The auth tag is written into the packet's tailroom.
     char* data = packet->data();
     int len = packet->length();
+    int max_len = static_cast<int>(packet->length() + packet->tailroom());
     if (!rtcp) {
-      res = srtp_filter_.ProtectRtp(data, len, packet->capacity(), &len);
+      res = srtp_filter_.ProtectRtp(data, len, max_len, &len);
       if (!res) {
-        int seq_num = -1;
-        uint32 ssrc = 0;
-        GetRtpSeqNum(data, len, &seq_num);
-        GetRtpSsrc(data, len, &ssrc);
-        LOG(LS_ERROR) << "Failed to protect " << content_name_
-                      << " RTP packet: size=" << len
-                      << ", seqnum=" << seq_num << ", SSRC=" << ssrc;
+        LogProtectRtpFailure(data, len);
         return false;
       }
     } else {
-      res = srtp_filter_.ProtectRtcp(data, len, packet->capacity(), &len);
+      res = srtp_filter_.ProtectRtcp(data, len, max_len, &len);
       if (!res) {
         int type = -1;
         GetRtcpType(data, len, &type);
@@ -703,17 +780,32 @@ bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
     ASSERT(false);
     return false;
   }
+  return true;
+}
 
+void BaseChannel::LogProtectRtpFailure(const char* data, int len) {
+  int seq_num = -1;
+  uint32 ssrc = 0;
+  GetRtpSeqNum(data, len, &seq_num);
+  GetRtpSsrc(data, len, &ssrc);
+  LOG(LS_ERROR) << "Failed to protect " << content_name_
+                << " RTP packet: size=" << len
+                << ", seqnum=" << seq_num << ", SSRC=" << ssrc;
+}
+
+bool BaseChannel::FinishSendPacket_w(bool rtcp, TransportChannel* channel,
+                                     talk_base::PacketBuffer* packet) {
   // Signal to the media sink after protecting the packet.
-  {
+  if (HasSink(&send_sinks_, SINK_POST_CRYPTO)) {
     talk_base::CritScope cs(&signal_send_packet_cs_);
     SignalSendPacketPostCrypto(packet->data(), packet->length(), rtcp);
   }
 
   // Bon voyage.
-  int ret = channel->SendPacket(packet->data(), packet->length(),
+  int len = static_cast<int>(packet->length());
+  int ret = channel->SendBuffer(packet,
       (secure() && secure_dtls()) ? PF_SRTP_BYPASS : 0);
-  if (ret != static_cast<int>(packet->length())) {
+  if (ret != len) {
     if (channel->GetError() == EWOULDBLOCK) {
       LOG(LS_WARNING) << "Got EWOULDBLOCK from socket.";
       SetReadyToSend(channel, false);
@@ -723,9 +815,10 @@ bool BaseChannel::SendPacket(bool rtcp, talk_base::Buffer* packet) {
   return true;
 }
 
-bool BaseChannel::WantsPacket(bool rtcp, talk_base::Buffer* packet) {
+bool BaseChannel::WantsPacket(bool rtcp, talk_base::Buffer* packet,
+                              bool ssrc_matched) {
   // Protect ourselves against crazy data.
-  if (!ValidPacket(rtcp, packet)) {
+  if (!ValidPacket(rtcp, packet->length())) {
     LOG(LS_ERROR) << "Dropping incoming " << content_name_ << " "
                   << PacketType(rtcp) << " packet: wrong size="
                   << packet->length();
@@ -735,7 +828,7 @@ bool BaseChannel::WantsPacket(bool rtcp, talk_base::Buffer* packet) {
   // If this channel is suppose to handle RTP data, that is determined by
   // checking against ssrc filter. This is necessary to do it here to avoid
   // double decryption.
-  if (ssrc_filter_.IsActive() &&
+  if (!ssrc_matched && ssrc_filter_.IsActive() &&
       !ssrc_filter_.DemuxPacket(packet->data(), packet->length(), rtcp)) {
     return false;
   }
@@ -743,8 +836,9 @@ bool BaseChannel::WantsPacket(bool rtcp, talk_base::Buffer* packet) {
   return true;
 }
 
-void BaseChannel::HandlePacket(bool rtcp, talk_base::Buffer* packet) {
-  if (!WantsPacket(rtcp, packet)) {
+void BaseChannel::HandlePacket(bool rtcp, talk_base::Buffer* packet,
+                               bool ssrc_matched) {
+  if (!WantsPacket(rtcp, packet, ssrc_matched)) {
     return;
   }
 
@@ -754,7 +848,7 @@ void BaseChannel::HandlePacket(bool rtcp, talk_base::Buffer* packet) {
   }
 
   // Signal to the media sink before unprotecting the packet.
-  {
+  if (HasSink(&recv_sinks_, SINK_POST_CRYPTO)) {
     talk_base::CritScope cs(&signal_recv_packet_cs_);
     SignalRecvPacketPostCrypto(packet->data(), packet->length(), rtcp);
   }
@@ -805,7 +899,7 @@ void BaseChannel::HandlePacket(bool rtcp, talk_base::Buffer* packet) {
   }
 
   // Signal to the media sink after unprotecting the packet.
-  {
+  if (HasSink(&recv_sinks_, SINK_PRE_CRYPTO)) {
     talk_base::CritScope cs(&signal_recv_packet_cs_);
     SignalRecvPacketPreCrypto(packet->data(), packet->length(), rtcp);
   }
@@ -1122,15 +1216,47 @@ bool BaseChannel::AddRecvStream_w(const StreamParams& sp) {
   if (!media_channel()->AddRecvStream(sp))
     return false;
 
-  return ssrc_filter_.AddStream(sp);
+  if (!ssrc_filter_.AddStream(sp))
+    return false;
+  if (ssrc_demuxer_ != NULL)
+    ssrc_demuxer_->AddRecvStream(this, sp);
+  return true;
 }
 
 bool BaseChannel::RemoveRecvStream_w(uint32 ssrc) {
   ASSERT(worker_thread() == talk_base::Thread::Current());
   ssrc_filter_.RemoveStream(ssrc);
+  if (ssrc_demuxer_ != NULL)
+    ssrc_demuxer_->RemoveRecvStream(this, ssrc);
   return media_channel()->RemoveRecvStream(ssrc);
 }
 
+void BaseChannel::SetSsrcDemuxer_w(SsrcDemuxer* demuxer) {
+  ASSERT(worker_thread() == talk_base::Thread::Current());
+  ASSERT(transport_channel_ != NULL);
+  if (demuxer == ssrc_demuxer_)
+    return;
+
+  if (ssrc_demuxer_ != NULL) {
+    ssrc_demuxer_->RemoveSink(this);
+    transport_channel_->SignalReadPacket.connect(
+        this, &BaseChannel::OnChannelRead);
+  }
+  ssrc_demuxer_ = demuxer;
+  if (ssrc_demuxer_ != NULL) {
+    // Packets on the RTP transport now arrive through the demuxer, once.
+    // RTCP on a separate transport is still read and filtered here.
+    transport_channel_->SignalReadPacket.disconnect(this);
+    ssrc_demuxer_->AddSink(this, transport_channel_);
+    const std::vector<StreamParams>& streams = ssrc_filter_.streams();
+    for (size_t i = 0; i < streams.size(); ++i) {
+      ssrc_demuxer_->AddRecvStream(this, streams[i]);
+    }
+    ssrc_demuxer_->SetSendStreams(this, local_streams_);
+    ssrc_demuxer_->SetPayloadTypes(this, recv_payload_types_);
+  }
+}
+
 bool BaseChannel::UpdateLocalStreams_w(const std::vector<StreamParams>& streams,
                                        ContentAction action) {
   if (!VERIFY(action == CA_OFFER || action == CA_ANSWER ||
@@ -1147,6 +1273,8 @@ bool BaseChannel::UpdateLocalStreams_w(const std::vector<StreamParams>& streams,
       if (!stream_exist && it->has_ssrcs()) {
         if (media_channel()->AddSendStream(*it)) {
           local_streams_.push_back(*it);
+          if (ssrc_demuxer_ != NULL)
+            ssrc_demuxer_->SetSendStreams(this, local_streams_);
           LOG(LS_INFO) << "Add send stream ssrc: " << it->first_ssrc();
         } else {
           LOG(LS_INFO) << "Failed to add send stream ssrc: "
@@ -1160,6 +1288,8 @@ bool BaseChannel::UpdateLocalStreams_w(const std::vector<StreamParams>& streams,
             return false;
         }
         RemoveStreamBySsrc(&local_streams_, existing_stream.first_ssrc());
+        if (ssrc_demuxer_ != NULL)
+          ssrc_demuxer_->SetSendStreams(this, local_streams_);
       } else {
         LOG(LS_WARNING) << "Ignore unsupported stream update";
       }
@@ -1193,6 +1323,8 @@ bool BaseChannel::UpdateLocalStreams_w(const std::vector<StreamParams>& streams,
     }
   }
   local_streams_ = streams;
+  if (ssrc_demuxer_ != NULL)
+    ssrc_demuxer_->SetSendStreams(this, local_streams_);
   return ret;
 }
 
@@ -1341,6 +1473,12 @@ void BaseChannel::OnMessage(talk_base::Message *pmsg) {
       data->result = RemoveRecvStream_w(data->ssrc);
       break;
     }
+    case MSG_SETSSRCDEMUXER: {
+      SsrcDemuxerMessageData* data =
+          static_cast<SsrcDemuxerMessageData*>(pmsg->pdata);
+      SetSsrcDemuxer_w(data->data());
+      break;
+    }
     case MSG_SETMAXSENDBANDWIDTH: {
       SetBandwidthData* data = static_cast<SetBandwidthData*>(pmsg->pdata);
       data->result = SetMaxSendBandwidth_w(data->value);
@@ -1350,10 +1488,14 @@ void BaseChannel::OnMessage(talk_base::Message *pmsg) {
     case MSG_RTPPACKET:
     case MSG_RTCPPACKET: {
       PacketMessageData* data = static_cast<PacketMessageData*>(pmsg->pdata);
-      SendPacket(pmsg->message_id == MSG_RTCPPACKET, &data->packet);
+      SendPacket(pmsg->message_id == MSG_RTCPPACKET, data->packet);
       delete data;  // because it is Posted
       break;
     }
+    case MSG_SENDQUEUE: {
+      SendQueuedPackets_w();
+      break;
+    }
     case MSG_FIRSTPACKETRECEIVED: {
       SignalFirstPacketReceived(this);
       break;
@@ -1384,6 +1526,96 @@ void BaseChannel::Clear(uint32 id, talk_base::MessageList* removed) {
   worker_thread_->Clear(this, id, removed);
 }
 
+bool BaseChannel::QueueRtpPacket(talk_base::PacketBuffer* packet) {
+  // The MSG_SENDQUEUE is posted under the lock too, so whenever a packet is
+  // in the ring, the message that will send it is already queued. A packet
+  // that finds the ring full and is posted on its own therefore can't get
+  // ahead of the ones its thread queued before it.
+  talk_base::CritScope cs(&send_queue_cs_);
+  if (send_queue_.WriteRemaining() < sizeof(packet)) {
+    return false;
+  }
+  packet->AddRef();  // Released by SendQueuedPackets_w.
+  send_queue_.Write(&packet, sizeof(packet));
+  if (send_queue_post_.Request()) {
+    worker_thread_->Post(this, MSG_SENDQUEUE);
+  }
+  return true;
+}
+
+void BaseChannel::SendQueuedPackets_w() {
+  ASSERT(talk_base::Thread::Current() == worker_thread_);
+  send_queue_post_.Clear();
+  // Only what is there now is sent, so a busy encoder can't starve the
+  // worker; anything later comes with its own message.
+  talk_base::PacketBuffer* packet;
+  size_t count = send_queue_.ReadAvailable() / sizeof(packet);
+  TransportChannel* channel = NULL;
+  send_batch_.clear();
+  for (size_t i = 0; i < count; ++i) {
+    send_queue_.Read(&packet, sizeof(packet));
+    if (!optimistic_data_send_ && !writable_) {
+      packet->Release();
+      continue;
+    }
+    channel = BeginSendPacket_w(false, packet);
+    if (!channel) {
+      packet->Release();
+      continue;
+    }
+    send_batch_.push_back(packet);
+  }
+  if (send_batch_.empty()) {
+    return;
+  }
+
+  // The batch is protected with a single call into the SRTP session, rather
+  // than one per packet. The auth tags are written into the tailroom.
+  bool protect = srtp_filter_.IsActive();
+  if (protect) {
+    srtp_batch_.resize(send_batch_.size());
+    for (size_t i = 0; i < send_batch_.size(); ++i) {
+      packet = send_batch_[i];
+      srtp_batch_[i] = SrtpPacket(packet->data(),
+          static_cast<int>(packet->length()),
+          static_cast<int>(packet->length() + packet->tailroom()));
+    }
+    srtp_filter_.ProtectRtp(&srtp_batch_[0],
+                            static_cast<int>(srtp_batch_.size()));
+  } else if (secure_required_) {
+    // This is a double check for something that supposedly can't happen.
+    LOG(LS_ERROR) << "Can't send outgoing RTP packets when SRTP is inactive"
+                  << " and crypto is required";
+    ASSERT(false);
+  }
+
+  for (size_t i = 0; i < send_batch_.size(); ++i) {
+    packet = send_batch_[i];
+    bool ok = !secure_required_;
+    if (protect) {
+      ok = srtp_batch_[i].ok;
+      if (ok) {
+        packet->SetLength(srtp_batch_[i].len);
+      } else {
+        LogProtectRtpFailure(packet->data(),
+                             static_cast<int>(packet->length()));
+      }
+    }
+    if (ok) {
+      FinishSendPacket_w(false, channel, packet);
+    }
+    packet->Release();
+  }
+}
+
+void BaseChannel::ClearSendQueue_w() {
+  ASSERT(talk_base::Thread::Current() == worker_thread_);
+  talk_base::PacketBuffer* packet;
+  while (send_queue_.Read(&packet, sizeof(packet)) == sizeof(packet)) {
+    packet->Release();
+  }
+}
+
 void BaseChannel::FlushRtcpMessages() {
   // Flush all remaining RTCP messages. This should only be called in
   // destructor.
@@ -1576,6 +1808,17 @@ void VoiceChannel::OnChannelRead(TransportChannel* channel,
   }
 }
 
+void VoiceChannel::OnDemuxedPacket(const char* data, size_t len,
+                                   bool matched) {
+  BaseChannel::OnDemuxedPacket(data, len, matched);
+
+  // Once attached to an SsrcDemuxer, packets arrive here instead of through
+  // OnChannelRead.
+  if (!received_media_ && !PacketIsRtcp(transport_channel(), data, len)) {
+    received_media_ = true;
+  }
+}
+
 void VoiceChannel::ChangeState() {
   // Render incoming data if we're the active call, and we have the local
   // content. We receive data on the default channel and multiplexed streams.
@@ -1617,6 +1860,7 @@ bool VoiceChannel::SetLocalContent_w(const MediaContentDescription* content,
   // is set properly.
   if (action != CA_UPDATE || audio->has_codecs()) {
     ret &= media_channel()->SetRecvCodecs(audio->codecs());
+    SetRecvPayloadTypes_w(audio->codecs());
   }
 
   // If everything worked, see if we can start receiving.
@@ -2026,6 +2270,7 @@ bool VideoChannel::SetLocalContent_w(const MediaContentDescription* content,
   // Set local video codecs (what we want to receive).
   if (action != CA_UPDATE || video->has_codecs()) {
     ret &= media_channel()->SetRecvCodecs(video->codecs());
+    SetRecvPayloadTypes_w(video->codecs());
   }
 
   if (action != CA_UPDATE) {
@@ -2441,13 +2686,14 @@ static bool IsRtpPacket(const talk_base::Buffer* packet) {
   return version == 2;
 }
 
-bool DataChannel::WantsPacket(bool rtcp, talk_base::Buffer* packet) {
+bool DataChannel::WantsPacket(bool rtcp, talk_base::Buffer* packet,
+                              bool ssrc_matched) {
   if (data_channel_type_ == DCT_SCTP) {
     // TODO(pthatcher): Do this in a more robust way by checking for
     // SCTP or DTLS.
     return !IsRtpPacket(packet);
   } else if (data_channel_type_ == DCT_RTP) {
-    return BaseChannel::WantsPacket(rtcp, packet);
+    return BaseChannel::WantsPacket(rtcp, packet, ssrc_matched);
   }
   return false;
 }
@@ -2511,6 +2757,7 @@ bool DataChannel::SetLocalContent_w(const MediaContentDescription* content,
 
     if (action != CA_UPDATE || data->has_codecs()) {
       ret &= media_channel()->SetRecvCodecs(data->codecs());
+      SetRecvPayloadTypes_w(data->codecs());
     }
   }
 
@@ -33,6 +33,7 @@
 
 #include "talk/base/asyncudpsocket.h"
 #include "talk/base/criticalsection.h"
+#include "talk/base/lockfreeringbuffer.h"
 #include "talk/base/network.h"
 #include "talk/base/sigslot.h"
 #include "talk/base/window.h"
@@ -48,6 +49,7 @@
 #include "talk/session/media/mediasession.h"
 #include "talk/session/media/rtcpmuxfilter.h"
 #include "talk/session/media/srtpfilter.h"
+#include "talk/session/media/ssrcdemuxer.h"
 #include "talk/session/media/ssrcmuxfilter.h"
 
 namespace cricket {
@@ -68,7 +70,7 @@ enum SinkType {
 // connection and media monitors.
 class BaseChannel
     : public talk_base::MessageHandler, public sigslot::has_slots<>,
-      public MediaChannel::NetworkInterface {
+      public MediaChannel::NetworkInterface, public SsrcDemuxer::Sink {
  public:
   BaseChannel(talk_base::Thread* thread, MediaEngineInterface* media_engine,
               MediaChannel* channel, BaseSession* session,
@@ -119,6 +121,10 @@ class BaseChannel
   // Multiplexing
   bool AddRecvStream(const StreamParams& sp);
   bool RemoveRecvStream(uint32 ssrc);
+  // Takes incoming packets from |demuxer| rather than from the transport
+  // channel directly; used for channels bundled on one transport, which
+  // should all share the same demuxer. NULL detaches the channel again.
+  void SetSsrcDemuxer(SsrcDemuxer* demuxer);
 
   // Monitoring
   void StartConnectionMonitor(int cms);
@@ -151,6 +157,7 @@ class BaseChannel
       SignalSendPacketPreCrypto.disconnect(sink);
       SignalSendPacketPreCrypto.connect(sink, OnPacket);
     }
+    UpdateSendSinks();
   }
 
   void UnregisterSendSink(sigslot::has_slots<>* sink,
@@ -161,15 +168,11 @@ class BaseChannel
     } else {
       SignalSendPacketPreCrypto.disconnect(sink);
     }
+    UpdateSendSinks();
   }
 
   bool HasSendSinks(SinkType type) {
-    talk_base::CritScope cs(&signal_send_packet_cs_);
-    if (SINK_POST_CRYPTO == type) {
-      return !SignalSendPacketPostCrypto.is_empty();
-    } else {
-      return !SignalSendPacketPreCrypto.is_empty();
-    }
+    return HasSink(&send_sinks_, type);
   }
 
   template <class T>
@@ -184,6 +187,7 @@ class BaseChannel
       SignalRecvPacketPreCrypto.disconnect(sink);
       SignalRecvPacketPreCrypto.connect(sink, OnPacket);
     }
+    UpdateRecvSinks();
   }
 
   void UnregisterRecvSink(sigslot::has_slots<>* sink,
@@ -194,15 +198,11 @@ class BaseChannel
     } else {
       SignalRecvPacketPreCrypto.disconnect(sink);
     }
+    UpdateRecvSinks();
   }
 
   bool HasRecvSinks(SinkType type) {
-    talk_base::CritScope cs(&signal_recv_packet_cs_);
-    if (SINK_POST_CRYPTO == type) {
-      return !SignalRecvPacketPostCrypto.is_empty();
-    } else {
-      return !SignalRecvPacketPreCrypto.is_empty();
-    }
+    return HasSink(&recv_sinks_, type);
   }
 
   SsrcMuxFilter* ssrc_filter() { return &ssrc_filter_; }
@@ -253,6 +253,8 @@ class BaseChannel
   // NetworkInterface implementation, called by MediaEngine
   virtual bool SendPacket(talk_base::Buffer* packet);
   virtual bool SendRtcp(talk_base::Buffer* packet);
+  virtual bool SendPacketBuffer(talk_base::PacketBuffer* packet);
+  virtual bool SendRtcpBuffer(talk_base::PacketBuffer* packet);
   virtual int SetOption(SocketType type, talk_base::Socket::Option o, int val);
 
   // From TransportChannel
@@ -261,11 +263,30 @@ class BaseChannel
                              size_t len, int flags);
   void OnReadyToSend(TransportChannel* channel);
 
+  // From SsrcDemuxer::Sink
+  virtual void OnDemuxedPacket(const char* data, size_t len, bool matched);
+
   bool PacketIsRtcp(const TransportChannel* channel, const char* data,
                     size_t len);
-  bool SendPacket(bool rtcp, talk_base::Buffer* packet);
-  virtual bool WantsPacket(bool rtcp, talk_base::Buffer* packet);
-  void HandlePacket(bool rtcp, talk_base::Buffer* packet);
+  bool SendPacket(bool rtcp, talk_base::PacketBuffer* packet);
+  // The steps of SendPacket on the worker thread. BeginSendPacket_w returns
+  // the transport to send on, or NULL if the packet must be dropped.
+  TransportChannel* BeginSendPacket_w(bool rtcp,
+                                      talk_base::PacketBuffer* packet);
+  bool ProtectPacket_w(bool rtcp, talk_base::PacketBuffer* packet);
+  bool FinishSendPacket_w(bool rtcp, TransportChannel* channel,
+                          talk_base::PacketBuffer* packet);
+  void LogProtectRtpFailure(const char* data, int len);
+  // Hands an RTP packet from another thread to the worker through
+  // |send_queue_|. Returns false if the packet must be posted on its own.
+  bool QueueRtpPacket(talk_base::PacketBuffer* packet);
+  void SendQueuedPackets_w();
+  void ClearSendQueue_w();
+  // |ssrc_matched| is set when the SsrcDemuxer already matched the packet to
+  // one of our streams, so the SSRC filter need not run again.
+  virtual bool WantsPacket(bool rtcp, talk_base::Buffer* packet,
+                           bool ssrc_matched);
+  void HandlePacket(bool rtcp, talk_base::Buffer* packet, bool ssrc_matched);
 
   // Apply the new local/remote session description.
   void OnNewLocalDescription(BaseSession* session, ContentAction action);
@@ -279,6 +300,18 @@ class BaseChannel
   void ChannelNotWritable_w();
   bool AddRecvStream_w(const StreamParams& sp);
   bool RemoveRecvStream_w(uint32 ssrc);
+  void SetSsrcDemuxer_w(SsrcDemuxer* demuxer);
+  // Records the payload types of the codecs we receive, for the demuxer.
+  template <class C>
+  void SetRecvPayloadTypes_w(const std::vector<C>& codecs) {
+    recv_payload_types_.clear();
+    for (size_t i = 0; i < codecs.size(); ++i) {
+      recv_payload_types_.push_back(codecs[i].id);
+    }
+    if (ssrc_demuxer_) {
+      ssrc_demuxer_->SetPayloadTypes(this, recv_payload_types_);
+    }
+  }
   // Do the DTLS key expansion and impose it on the SRTP/SRTCP filters.
   // |rtcp_channel| indicates whether to set up the RTP or RTCP filter.
   bool SetupDtlsSrtp(bool rtcp_channel);
@@ -312,6 +345,15 @@ class BaseChannel
   // From MessageHandler
   virtual void OnMessage(talk_base::Message* pmsg);
 
+  // Called with the matching critical section held, after a sink changes.
+  void UpdateSendSinks();
+  void UpdateRecvSinks();
+  // A plain load, without a barrier: a sink added meanwhile may miss a
+  // packet or two.
+  static bool HasSink(volatile const int* sinks, SinkType type) {
+    return (*sinks & (1 << type)) != 0;
+  }
+
   // Handled in derived classes
   // Get the SRTP ciphers to use for RTP media
   virtual void GetSrtpCiphers(std::vector<std::string>* ciphers) const = 0;
@@ -326,6 +368,10 @@ class BaseChannel
   sigslot::signal3<const void*, size_t, bool> SignalRecvPacketPostCrypto;
   talk_base::CriticalSection signal_send_packet_cs_;
   talk_base::CriticalSection signal_recv_packet_cs_;
+  // Bit (1 << SinkType) is set while the matching signal has a sink. The
+  // packet path checks these before taking the critical sections above.
+  volatile int send_sinks_;
+  volatile int recv_sinks_;
 
   talk_base::Thread* worker_thread_;
   MediaEngineInterface* media_engine_;
@@ -341,6 +387,8 @@ class BaseChannel
   SrtpFilter srtp_filter_;
   RtcpMuxFilter rtcp_mux_filter_;
   SsrcMuxFilter ssrc_filter_;
+  SsrcDemuxer* ssrc_demuxer_;
+  std::vector<int> recv_payload_types_;
   talk_base::scoped_ptr<SocketMonitor> socket_monitor_;
   bool enabled_;
   bool writable_;
@@ -354,6 +402,16 @@ class BaseChannel
   bool has_received_packet_;
   bool dtls_keyed_;
   bool secure_required_;
+  // RTP packets from the encoder thread, as PacketBuffer pointers holding a
+  // reference each. A single MSG_SENDQUEUE sends all that have piled up.
+  talk_base::LockFreeRingBuffer send_queue_;
+  // Serializes the threads writing to |send_queue_|, which takes one writer.
+  talk_base::CriticalSection send_queue_cs_;
+  // Posts a MSG_SENDQUEUE for each batch of queued packets.
+  talk_base::PostOnce send_queue_post_;
+  // The packets drained from |send_queue_|, kept to reuse their storage.
+  std::vector<talk_base::PacketBuffer*> send_batch_;
+  std::vector<SrtpPacket> srtp_batch_;
 };
 
 // VoiceChannel is a specialization that adds support for early media, DTMF,
@@ -432,6 +490,7 @@ class VoiceChannel : public BaseChannel {
   // overrides from BaseChannel
   virtual void OnChannelRead(TransportChannel* channel,
                              const char* data, size_t len, int flags);
+  virtual void OnDemuxedPacket(const char* data, size_t len, bool matched);
   virtual void ChangeState();
   virtual const ContentInfo* GetFirstContent(const SessionDescription* sdesc);
   virtual bool SetLocalContent_w(const MediaContentDescription* content,
@@ -666,7 +725,8 @@ class DataChannel : public BaseChannel {
   virtual bool SetRemoteContent_w(const MediaContentDescription* content,
                                   ContentAction action);
   virtual void ChangeState();
-  virtual bool WantsPacket(bool rtcp, talk_base::Buffer* packet);
+  virtual bool WantsPacket(bool rtcp, talk_base::Buffer* packet,
+                           bool ssrc_matched);
 
   virtual void OnMessage(talk_base::Message* pmsg);
   virtual void GetSrtpCiphers(std::vector<std::string>* ciphers) const;
@@ -44,6 +44,7 @@
 #include "talk/session/media/mediamessages.h"
 #include "talk/session/media/mediarecorder.h"
 #include "talk/session/media/mediasessionclient.h"
+#include "talk/session/media/ssrcdemuxer.h"
 #include "talk/session/media/typingmonitor.h"
 
 #define MAYBE_SKIP_TEST(feature)                    \
@@ -73,7 +74,10 @@ static const cricket::DataCodec kGoogleDataCodec(101, "google-data", 0);
 static const uint32 kSsrc1 = 0x1111;
 static const uint32 kSsrc2 = 0x2222;
 static const uint32 kSsrc3 = 0x3333;
+static const uint32 kSsrc4 = 0x4444;
+static const uint32 kUnknownSsrc = 0x5555;
 static const char kCName[] = "a@b.com";
+static const int kBurstPackets = 100;
 
 template<class ChannelT,
          class MediaChannelT,
@@ -132,6 +136,19 @@ class FakeScreenCaptureFactory
   cricket::CaptureState capture_state_;
 };
 
+// Counts the packets an SsrcDemuxer hands it.
+class FakeDemuxerSink : public cricket::SsrcDemuxer::Sink {
+ public:
+  FakeDemuxerSink() : packets_(0) {}
+  virtual void OnDemuxedPacket(const char* data, size_t len, bool matched) {
+    ++packets_;
+  }
+  int packets() const { return packets_; }
+
+ private:
+  int packets_;
+};
+
 // Controls how long we wait for a session to send messages that we
 // expect, in milliseconds.  We put it high to avoid flaky tests.
 static const int kEventTimeout = 5000;
@@ -399,6 +416,15 @@ class ChannelTest : public testing::Test, public sigslot::has_slots<> {
     std::string data(CreateRtpData(ssrc, sequence_number));
     return media_channel2_->SendRtp(data.c_str(), data.size());
   }
+  // Sends RTP packets numbered 1 to kBurstPackets, as an encoder would for
+  // a large frame.
+  bool SendRtpBurst1() {
+    bool result = true;
+    for (int i = 1; i <= kBurstPackets; ++i) {
+      result &= SendCustomRtp1(kSsrc1, i);
+    }
+    return result;
+  }
   bool SendCustomRtcp1(uint32 ssrc) {
     std::string data(CreateRtcpData(ssrc));
     return media_channel1_->SendRtcp(data.c_str(), data.size());
@@ -451,6 +477,16 @@ class ChannelTest : public testing::Test, public sigslot::has_slots<> {
     talk_base::SetBE32(const_cast<char*>(data.c_str()) + 4, ssrc);
     return data;
   }
+  // Creates a receiver report from |ssrc| with one report block, about
+  // |media_ssrc|.
+  std::string CreateRtcpReportData(uint32 ssrc, uint32 media_ssrc) {
+    std::string data(CreateRtcpData(ssrc));
+    data[0] = static_cast<char>(0x81);
+    talk_base::SetBE16(const_cast<char*>(data.c_str()) + 2,
+                       static_cast<uint16>(data.size() / 4 - 1));
+    talk_base::SetBE32(const_cast<char*>(data.c_str()) + 8, media_ssrc);
+    return data;
+  }
 
   bool CheckNoRtp1() {
     return media_channel1_->CheckNoRtp();
@@ -1335,6 +1371,20 @@ class ChannelTest : public testing::Test, public sigslot::has_slots<> {
     EXPECT_TRUE(CheckNoRtcp2());
   }
 
+  // Test that a burst of RTP from a thread arrives complete and in order.
+  void SendRtpBurstOnThread() {
+    bool sent_rtp1;
+    CreateChannels(RTCP, RTCP);
+    EXPECT_TRUE(SendInitiate());
+    EXPECT_TRUE(SendAccept());
+    CallOnThread(&ChannelTest<T>::SendRtpBurst1, &sent_rtp1);
+    EXPECT_TRUE_WAIT(sent_rtp1, 1000);
+    for (int i = 1; i <= kBurstPackets; ++i) {
+      EXPECT_TRUE_WAIT(CheckCustomRtp2(kSsrc1, i), 1000);
+    }
+    EXPECT_TRUE(CheckNoRtp2());
+  }
+
   // Test that we properly send SRTP with RTCP from a thread.
   void SendSrtpToSrtpOnThread() {
     bool sent_rtp1, sent_rtp2, sent_rtcp1, sent_rtcp2;
@@ -1486,6 +1536,69 @@ class ChannelTest : public testing::Test, public sigslot::has_slots<> {
     EXPECT_FALSE(CheckCustomRtcp2(kSsrc2));
   }
 
+  // Test that a channel attached to an SsrcDemuxer reads its packets through
+  // it, and keeps the demuxer up to date with the streams it receives and
+  // sends.
+  void TestSsrcDemuxer() {
+    CreateChannels(SSRC_MUX | RTCP | RTCP_MUX, SSRC_MUX | RTCP | RTCP_MUX);
+    EXPECT_TRUE(SendInitiate());
+    EXPECT_TRUE(SendAccept());
+    cricket::SsrcDemuxer demuxer;
+    FakeDemuxerSink other_sink;
+    EXPECT_TRUE(demuxer.AddSink(&other_sink, NULL));
+    EXPECT_TRUE(demuxer.AddRecvStream(&other_sink,
+                                      StreamParams::CreateLegacy(kSsrc3)));
+    channel1_->SetSsrcDemuxer(&demuxer);
+    EXPECT_TRUE(demuxer.HasSink(channel1_.get()));
+
+    // channel1 gets the RTP of the stream it receives, and of unsignaled
+    // streams with a payload type it receives, but not that of other sinks.
+    EXPECT_TRUE(SendCustomRtp2(kSsrc2, 1));
+    EXPECT_TRUE(CheckCustomRtp1(kSsrc2, 1));
+    EXPECT_TRUE(SendCustomRtp2(kUnknownSsrc, 2));
+    EXPECT_TRUE(CheckCustomRtp1(kUnknownSsrc, 2));
+    EXPECT_TRUE(SendCustomRtp2(kSsrc3, 3));
+    EXPECT_TRUE(CheckNoRtp1());
+    EXPECT_EQ(1, other_sink.packets());
+
+    // Reports about the stream channel1 sends reach it, even from a sender
+    // its own filter doesn't know.
+    std::string rtcp(CreateRtcpReportData(kUnknownSsrc, kSsrc1));
+    EXPECT_TRUE(media_channel2_->SendRtcp(rtcp.c_str(), rtcp.size()));
+    EXPECT_TRUE(media_channel1_->CheckRtcp(rtcp.c_str(), rtcp.size()));
+    EXPECT_TRUE(CheckNoRtcp1());
+
+    // Receive streams added and removed later are passed on.
+    std::string rtp(CreateRtpData(kSsrc4, 4));
+    rtp[1] = 127;  // A payload type channel1 doesn't receive.
+    EXPECT_TRUE(NULL == demuxer.FindSink(rtp.c_str(), rtp.size()));
+    EXPECT_TRUE(AddStream1(kSsrc4));
+    EXPECT_EQ(channel1_.get(), demuxer.FindSink(rtp.c_str(), rtp.size()));
+    EXPECT_TRUE(RemoveStream1(kSsrc4));
+    EXPECT_TRUE(NULL == demuxer.FindSink(rtp.c_str(), rtp.size()));
+
+    // So are send streams.
+    rtcp = CreateRtcpReportData(kUnknownSsrc, kSsrc4);
+    EXPECT_TRUE(NULL == demuxer.FindSink(rtcp.c_str(), rtcp.size()));
+    cricket::StreamParams stream;
+    stream.id = "stream4";
+    stream.ssrcs.push_back(kSsrc4);
+    stream.cname = kCName;
+    typename T::Content update;
+    update.AddStream(stream);
+    update.set_partial(true);
+    EXPECT_TRUE(channel1_->SetLocalContent(&update, CA_UPDATE));
+    EXPECT_EQ(channel1_.get(), demuxer.FindSink(rtcp.c_str(), rtcp.size()));
+
+    // Once detached, channel1 reads its transport by itself again.
+    channel1_->SetSsrcDemuxer(NULL);
+    EXPECT_FALSE(demuxer.HasSink(channel1_.get()));
+    EXPECT_TRUE(SendCustomRtp2(kSsrc2, 5));
+    EXPECT_TRUE(CheckCustomRtp1(kSsrc2, 5));
+    EXPECT_EQ(1, other_sink.packets());
+    EXPECT_TRUE(demuxer.RemoveSink(&other_sink));
+  }
+
   // Test that the media monitor can be run and gives timely callbacks.
   void TestMediaMonitor() {
     static const int kTimeout = 500;
@@ -1894,7 +2007,27 @@ class VoiceChannelTest
   typedef ChannelTest<VoiceTraits>
   Base;
   VoiceChannelTest() : Base(kPcmuFrame, sizeof(kPcmuFrame),
-                            kRtcpReport, sizeof(kRtcpReport)) {
+                            kRtcpReport, sizeof(kRtcpReport)),
+                       early_media_timeouts_(0) {
+  }
+
+  // Test that early media read through an SsrcDemuxer stops the early media
+  // timeout, as it does when the channel reads its own transport.
+  void TestEarlyMediaWithSsrcDemuxer() {
+    CreateChannels(SSRC_MUX | RTCP | RTCP_MUX, SSRC_MUX | RTCP | RTCP_MUX);
+    EXPECT_TRUE(SendInitiate());
+    EXPECT_TRUE(SendAccept());
+    cricket::SsrcDemuxer demuxer;
+    channel1_->SetSsrcDemuxer(&demuxer);
+    channel1_->SignalEarlyMediaTimeout.connect(
+        this, &VoiceChannelTest::OnEarlyMediaTimeout);
+    channel1_->SetEarlyMedia(true);
+    EXPECT_TRUE(SendCustomRtp2(kSsrc2, 1));
+    EXPECT_TRUE(CheckCustomRtp1(kSsrc2, 1));
+    // The timeout is 1 second.
+    talk_base::Thread::Current()->ProcessMessages(1500);
+    EXPECT_EQ(0, early_media_timeouts_);
+    channel1_->SetSsrcDemuxer(NULL);
   }
 
   void TestSetChannelOptions() {
@@ -1920,6 +2053,13 @@ class VoiceChannelTest
     ASSERT_TRUE(media_channel2_->GetOptions(&actual_options));
     EXPECT_EQ(options2, actual_options);
   }
+
+ private:
+  void OnEarlyMediaTimeout(cricket::VoiceChannel* channel) {
+    ++early_media_timeouts_;
+  }
+
+  int early_media_timeouts_;
 };
 
 // override to add NULL parameter
@@ -2146,6 +2286,10 @@ TEST_F(VoiceChannelTest, SendRtpToRtpOnThread) {
   Base::SendRtpToRtpOnThread();
 }
 
+TEST_F(VoiceChannelTest, SendRtpBurstOnThread) {
+  Base::SendRtpBurstOnThread();
+}
+
 TEST_F(VoiceChannelTest, SendSrtpToSrtpOnThread) {
   Base::SendSrtpToSrtpOnThread();
 }
@@ -2390,6 +2534,14 @@ TEST_F(VoiceChannelTest, SendSsrcMuxToSsrcMux) {
   Base::SendSsrcMuxToSsrcMux();
 }
 
+TEST_F(VoiceChannelTest, TestSsrcDemuxer) {
+  Base::TestSsrcDemuxer();
+}
+
+TEST_F(VoiceChannelTest, TestEarlyMediaWithSsrcDemuxer) {
+  TestEarlyMediaWithSsrcDemuxer();
+}
+
 TEST_F(VoiceChannelTest, SendSsrcMuxToSsrcMuxWithRtcpMux) {
   Base::SendSsrcMuxToSsrcMuxWithRtcpMux();
 }
@@ -2561,6 +2713,10 @@ TEST_F(VideoChannelTest, SendRtpToRtpOnThread) {
   Base::SendRtpToRtpOnThread();
 }
 
+TEST_F(VideoChannelTest, SendRtpBurstOnThread) {
+  Base::SendRtpBurstOnThread();
+}
+
 TEST_F(VideoChannelTest, SendSrtpToSrtpOnThread) {
   Base::SendSrtpToSrtpOnThread();
 }
@@ -2605,6 +2761,10 @@ TEST_F(VideoChannelTest, SendSsrcMuxToSsrcMux) {
   Base::SendSsrcMuxToSsrcMux();
 }
 
+TEST_F(VideoChannelTest, TestSsrcDemuxer) {
+  Base::TestSsrcDemuxer();
+}
+
 TEST_F(VideoChannelTest, SendSsrcMuxToSsrcMuxWithRtcpMux) {
   Base::SendSsrcMuxToSsrcMuxWithRtcpMux();
 }
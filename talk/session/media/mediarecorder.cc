@@ -39,17 +39,50 @@
 
 namespace cricket {
 
+// Bytes of packets a sink can hold for its writer thread. A power of two.
+static const size_t kQueueSize = 512 * 1024;
+
+// Precedes each packet in RtpDumpSink's queue.
+struct QueuedPacketHeader {
+  uint32 size;
+  uint32 rtcp;
+};
+
 ///////////////////////////////////////////////////////////////////////////
 // Implementation of RtpDumpSink.
 ///////////////////////////////////////////////////////////////////////////
 RtpDumpSink::RtpDumpSink(talk_base::StreamInterface* stream)
-    : max_size_(INT_MAX),
-      recording_(false),
+    : writer_thread_(NULL),
+      dropped_packets_(0),
+      queued_size_(0),
+      queued_rtcp_(false),
+      max_size_(INT_MAX),
+      recording_(0),
       packet_filter_(PF_NONE) {
   stream_.reset(stream);
 }
 
-RtpDumpSink::~RtpDumpSink() {}
+RtpDumpSink::RtpDumpSink(talk_base::StreamInterface* stream,
+                         talk_base::Thread* writer_thread)
+    : writer_thread_(writer_thread),
+      queue_(new talk_base::LockFreeRingBuffer(kQueueSize)),
+      dropped_packets_(0),
+      queued_size_(0),
+      queued_rtcp_(false),
+      max_size_(INT_MAX),
+      recording_(0),
+      packet_filter_(PF_NONE) {
+  stream_.reset(stream);
+}
+
+RtpDumpSink::~RtpDumpSink() {
+  // Once disconnected, nothing is queued any more; write what is left.
+  disconnect_all();
+  WaitForQueuedPackets();
+  if (writer_thread_) {
+    writer_thread_->Clear(this);
+  }
+}
 
 void RtpDumpSink::SetMaxSize(size_t size) {
   talk_base::CritScope cs(&critical_section_);
@@ -57,26 +90,90 @@ void RtpDumpSink::SetMaxSize(size_t size) {
 }
 
 bool RtpDumpSink::Enable(bool enable) {
+  if (!enable) {
+    // Packets queued while recording are still written.
+    WaitForQueuedPackets();
+  }
   talk_base::CritScope cs(&critical_section_);
 
-  recording_ = enable;
+  // OnPacket reads this without the lock, to skip queueing while disabled.
+  talk_base::AtomicOps::ReleaseStore(&recording_, enable);
 
   // Create a file and the RTP writer if we have not done yet.
-  if (recording_ && !writer_) {
+  if (enable && !writer_) {
     if (!stream_) {
       return false;
     }
     writer_.reset(new RtpDumpWriter(stream_.get()));
     writer_->set_packet_filter(packet_filter_);
-  } else if (!recording_ && stream_) {
+  } else if (!enable && stream_) {
     stream_->Flush();
   }
   return true;
 }
 
 void RtpDumpSink::OnPacket(const void* data, size_t size, bool rtcp) {
+  if (!writer_thread_) {
+    talk_base::CritScope cs(&critical_section_);
+    WritePacket(data, size, rtcp);
+    return;
+  }
+
+  // The channel calls this on its worker thread, the queue's only writer.
+  // As with WritePacket, nothing is kept while disabled.
+  if (size == 0 || !talk_base::AtomicOps::AcquireLoad(&recording_)) {
+    return;
+  }
+  QueuedPacketHeader header;
+  if (queue_->WriteRemaining() < sizeof(header) + size) {
+    talk_base::AtomicOps::Increment(&dropped_packets_);
+    return;
+  }
+  header.size = static_cast<uint32>(size);
+  header.rtcp = rtcp;
+  queue_->Write(&header, sizeof(header));
+  queue_->Write(data, size);
+  if (write_post_.Request()) {
+    writer_thread_->Post(this);
+  }
+}
+
+void RtpDumpSink::OnMessage(talk_base::Message* pmsg) {
+  WriteQueuedPackets();
+}
+
+void RtpDumpSink::WriteQueuedPackets() {
+  ASSERT(writer_thread_->IsCurrent());
+  write_post_.Clear();
   talk_base::CritScope cs(&critical_section_);
+  while (true) {
+    if (queued_size_ == 0) {
+      QueuedPacketHeader header;
+      if (queue_->ReadAvailable() < sizeof(header)) {
+        break;
+      }
+      queue_->Read(&header, sizeof(header));
+      queued_size_ = header.size;
+      queued_rtcp_ = (header.rtcp != 0);
+    }
+    // The data may still be on its way in; its message will bring us back.
+    if (queue_->ReadAvailable() < queued_size_) {
+      break;
+    }
+    queued_packet_.SetLength(queued_size_);
+    queue_->Read(queued_packet_.data(), queued_size_);
+    WritePacket(queued_packet_.data(), queued_size_, queued_rtcp_);
+    queued_size_ = 0;
+  }
+}
+
+void RtpDumpSink::WaitForQueuedPackets() {
+  if (writer_thread_) {
+    writer_thread_->Send(this);
+  }
+}
 
+void RtpDumpSink::WritePacket(const void* data, size_t size, bool rtcp) {
   if (recording_ && writer_) {
     size_t current_size;
     if (writer_->GetDumpSize(&current_size) &&
@@ -99,6 +196,7 @@ void RtpDumpSink::set_packet_filter(int filter) {
 }
 
 void RtpDumpSink::Flush() {
+  WaitForQueuedPackets();
   talk_base::CritScope cs(&critical_section_);
   if (stream_) {
     stream_->Flush();
@@ -108,7 +206,11 @@ void RtpDumpSink::Flush() {
 ///////////////////////////////////////////////////////////////////////////
 // Implementation of MediaRecorder.
 ///////////////////////////////////////////////////////////////////////////
-MediaRecorder::MediaRecorder() {}
+MediaRecorder::MediaRecorder()
+    : writer_thread_(new talk_base::Thread) {
+  writer_thread_->SetName("MediaRecorder", this);
+  writer_thread_->Start();
+}
 
 MediaRecorder::~MediaRecorder() {
   talk_base::CritScope cs(&critical_section_);
@@ -150,9 +252,11 @@ bool MediaRecorder::InternalAddChannel(BaseChannel* channel,
   SinkPair* sink_pair = new SinkPair;
   sink_pair->video_channel = video_channel;
   sink_pair->filter = filter;
-  sink_pair->send_sink.reset(new RtpDumpSink(send_stream));
+  sink_pair->send_sink.reset(
+      new RtpDumpSink(send_stream, writer_thread_.get()));
   sink_pair->send_sink->set_packet_filter(filter);
-  sink_pair->recv_sink.reset(new RtpDumpSink(recv_stream));
+  sink_pair->recv_sink.reset(
+      new RtpDumpSink(recv_stream, writer_thread_.get()));
   sink_pair->recv_sink->set_packet_filter(filter);
   sinks_[channel] = sink_pair;
 
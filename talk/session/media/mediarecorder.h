@@ -31,9 +31,13 @@
 #include <map>
 #include <string>
 
+#include "talk/base/buffer.h"
 #include "talk/base/criticalsection.h"
+#include "talk/base/lockfreeringbuffer.h"
+#include "talk/base/messagehandler.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/sigslot.h"
+#include "talk/base/thread.h"
 #include "talk/session/media/channel.h"
 #include "talk/session/media/mediasink.h"
 
@@ -50,24 +54,58 @@ class VoiceChannel;
 class RtpDumpWriter;
 
 // RtpDumpSink implements MediaSinkInterface by dumping the RTP/RTCP packets to
-// a file.
-class RtpDumpSink : public MediaSinkInterface, public sigslot::has_slots<> {
+// a file. Given a writer thread, OnPacket only copies the packet into a
+// bounded queue and the file is written on that thread, so the channel's
+// worker never waits for the disk. Packets that don't fit are dropped.
+class RtpDumpSink : public MediaSinkInterface,
+                    public talk_base::MessageHandler,
+                    public sigslot::has_slots<> {
  public:
   // Takes ownership of stream.
   explicit RtpDumpSink(talk_base::StreamInterface* stream);
+  // Takes ownership of stream, but not of writer_thread.
+  RtpDumpSink(talk_base::StreamInterface* stream,
+              talk_base::Thread* writer_thread);
   virtual ~RtpDumpSink();
 
   virtual void SetMaxSize(size_t size);
   virtual bool Enable(bool enable);
-  virtual bool IsEnabled() const { return recording_; }
+  virtual bool IsEnabled() const {
+    return talk_base::AtomicOps::AcquireLoad(&recording_) != 0;
+  }
   virtual void OnPacket(const void* data, size_t size, bool rtcp);
   virtual void set_packet_filter(int filter);
   int packet_filter() const { return packet_filter_; }
+  // Waits for the queued packets to be written, then flushes the stream.
   void Flush();
+  // Packets dropped because the queue was full.
+  int dropped_packets() const { return dropped_packets_; }
 
  private:
+  // From MessageHandler. Writes the queued packets on the writer thread.
+  virtual void OnMessage(talk_base::Message* pmsg);
+  void WriteQueuedPackets();
+  // Sends WriteQueuedPackets to the writer thread, if there is one, and waits
+  // for it to finish.
+  void WaitForQueuedPackets();
+  // Called with |critical_section_| held.
+  void WritePacket(const void* data, size_t size, bool rtcp);
+
+  talk_base::Thread* writer_thread_;
+  // Each packet is queued as a QueuedPacketHeader followed by its data.
+  talk_base::scoped_ptr<talk_base::LockFreeRingBuffer> queue_;
+  // Posts the message that writes the queue.
+  talk_base::PostOnce write_post_;
+  int dropped_packets_;
+  // The writer thread's copy of the packet being read from the queue, and
+  // the size it should have once its data is in; 0 between packets.
+  talk_base::Buffer queued_packet_;
+  size_t queued_size_;
+  bool queued_rtcp_;
+
   size_t max_size_;
-  bool recording_;
+  // A bool, read without |critical_section_| by OnPacket; see AtomicOps.
+  volatile int recording_;
   int packet_filter_;
   talk_base::scoped_ptr<talk_base::StreamInterface> stream_;
   talk_base::scoped_ptr<RtpDumpWriter> writer_;
@@ -110,6 +148,8 @@ class MediaRecorder {
 
   std::map<BaseChannel*, SinkPair*> sinks_;
   talk_base::CriticalSection critical_section_;
+  // Writes the files, so that disk I/O stays off the channels' worker.
+  talk_base::scoped_ptr<talk_base::Thread> writer_thread_;
 
   DISALLOW_COPY_AND_ASSIGN(MediaRecorder);
 };
@@ -167,6 +167,47 @@ TEST_F(RtpDumpSinkTest, TestRtpDumpSinkFilter) {
   EXPECT_EQ(talk_base::SR_EOS, ReadPacket(&packet));
 }
 
+TEST_F(RtpDumpSinkTest, TestRtpDumpSinkWriterThread) {
+  // The packets are queued and written on the writer thread.
+  talk_base::Thread writer_thread;
+  writer_thread.Start();
+  sink_.reset(new RtpDumpSink(Open(path_.pathname()), &writer_thread));
+  EXPECT_TRUE(sink_->Enable(true));
+  sink_->set_packet_filter(PF_ALL);
+  for (int i = 0; i < ARRAY_SIZE(rtp_buf_); ++i) {
+    OnRtpPacket(RtpTestUtility::kTestRawRtpPackets[i]);
+  }
+  EXPECT_EQ(0, sink_->dropped_packets());
+
+  // Read the recorded file and verify it contains all the packets.
+  RtpDumpPacket packet;
+  for (int i = 0; i < ARRAY_SIZE(rtp_buf_); ++i) {
+    EXPECT_EQ(talk_base::SR_SUCCESS, ReadPacket(&packet));
+    EXPECT_TRUE(RtpTestUtility::VerifyPacket(
+        &packet, &RtpTestUtility::kTestRawRtpPackets[i], false));
+  }
+  EXPECT_EQ(talk_base::SR_EOS, ReadPacket(&packet));
+}
+
+TEST_F(RtpDumpSinkTest, TestRtpDumpSinkWriterThreadDisabled) {
+  // The writer thread only starts once the sink is enabled, so a packet
+  // queued while disabled would be written.
+  talk_base::Thread writer_thread;
+  sink_.reset(new RtpDumpSink(Open(path_.pathname()), &writer_thread));
+  sink_->set_packet_filter(PF_ALL);
+  OnRtpPacket(RtpTestUtility::kTestRawRtpPackets[0]);
+  EXPECT_TRUE(sink_->Enable(true));
+  writer_thread.Start();
+  OnRtpPacket(RtpTestUtility::kTestRawRtpPackets[1]);
+
+  // Read the recorded file and verify it contains only the 2nd packet.
+  RtpDumpPacket packet;
+  EXPECT_EQ(talk_base::SR_SUCCESS, ReadPacket(&packet));
+  EXPECT_TRUE(RtpTestUtility::VerifyPacket(
+      &packet, &RtpTestUtility::kTestRawRtpPackets[1], false));
+  EXPECT_EQ(talk_base::SR_EOS, ReadPacket(&packet));
+}
+
 /////////////////////////////////////////////////////////////////////////
 // Test MediaRecorder
 /////////////////////////////////////////////////////////////////////////
@@ -32,10 +32,12 @@
 #include <set>
 #include <utility>
 
+#include "talk/base/base64.h"
 #include "talk/base/helpers.h"
 #include "talk/base/logging.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/media/base/constants.h"
+#include "talk/media/base/cpuid.h"
 #include "talk/media/base/cryptoparams.h"
 #include "talk/p2p/base/constants.h"
 #include "talk/session/media/channelmanager.h"
@@ -73,12 +75,27 @@ static bool IsMediaContentOfType(const ContentInfo* content,
 
 static bool CreateCryptoParams(int tag, const std::string& cipher,
                                CryptoParams *out) {
-  std::string key;
-  key.reserve(SRTP_MASTER_KEY_BASE64_LEN);
-
-  if (!talk_base::CreateRandomString(SRTP_MASTER_KEY_BASE64_LEN, &key)) {
+  int key_len, salt_len;
+  if (!GetSrtpKeyAndSaltLengths(cipher, &key_len, &salt_len)) {
     return false;
   }
+
+  std::string key;
+  if (key_len == SRTP_MASTER_KEY_KEY_LEN &&
+      salt_len == SRTP_MASTER_KEY_SALT_LEN) {
+    key.reserve(SRTP_MASTER_KEY_BASE64_LEN);
+    if (!talk_base::CreateRandomString(SRTP_MASTER_KEY_BASE64_LEN, &key)) {
+      return false;
+    }
+  } else {
+    // The AEAD key lengths aren't a multiple of 3 bytes, so the key can't be
+    // made of random base64 characters; encode random bytes instead.
+    std::string data;
+    if (!talk_base::CreateRandomData(key_len + salt_len, &data)) {
+      return false;
+    }
+    key = talk_base::Base64::Encode(data);
+  }
   out->tag = tag;
   out->cipher_suite = cipher;
   out->key_params = kInline;
@@ -163,11 +180,33 @@ void GetSupportedDefaultCryptoSuites(
 #endif
 }
 
+// AES-GCM encrypts and authenticates in one pass, which beats AES-CM with
+// HMAC-SHA1 when the CPU has AES-NI and CLMUL; it is then offered first,
+// except for audio, where the 32-bit HMAC tag keeps packets smaller.
+static void AddGcmCryptoSuites(bool prefer,
+                               std::vector<std::string>* crypto_suites) {
+  if (!IsSrtpCipherSuiteSupported(CS_AEAD_AES_128_GCM)) {
+    return;
+  }
+  if (prefer && HasAesNiAndClmul()) {
+    crypto_suites->insert(crypto_suites->begin(), CS_AEAD_AES_128_GCM);
+  } else {
+    crypto_suites->push_back(CS_AEAD_AES_128_GCM);
+  }
+}
+
+static bool IsGcmCryptoSuite(const std::string& cipher_suite) {
+  return cipher_suite == CS_AEAD_AES_128_GCM ||
+      cipher_suite == CS_AEAD_AES_256_GCM;
+}
+
 // For video support only 80-bit SHA1 HMAC. For audio 32-bit HMAC is
 // tolerated unless bundle is enabled because it is low overhead. Pick the
-// crypto in the list that is supported.
+// crypto in the list that is supported. The AES-GCM suites are accepted
+// only when |gcm| is set.
 static bool SelectCrypto(const MediaContentDescription* offer,
                          bool bundle,
+                         bool gcm,
                          CryptoParams *crypto) {
   bool audio = offer->type() == MEDIA_TYPE_AUDIO;
   const CryptoParamsVec& cryptos = offer->cryptos();
@@ -175,7 +214,9 @@ static bool SelectCrypto(const MediaContentDescription* offer,
   for (CryptoParamsVec::const_iterator i = cryptos.begin();
        i != cryptos.end(); ++i) {
     if (CS_AES_CM_128_HMAC_SHA1_80 == i->cipher_suite ||
-        (CS_AES_CM_128_HMAC_SHA1_32 == i->cipher_suite && audio && !bundle)) {
+        (CS_AES_CM_128_HMAC_SHA1_32 == i->cipher_suite && audio && !bundle) ||
+        (gcm && IsGcmCryptoSuite(i->cipher_suite) &&
+         IsSrtpCipherSuiteSupported(i->cipher_suite))) {
       return CreateCryptoParams(i->tag, i->cipher_suite, crypto);
     }
   }
@@ -878,7 +919,8 @@ static bool CreateMediaContentAnswer(
 #ifdef HAVE_SRTP
   if (sdes_policy != SEC_DISABLED) {
     CryptoParams crypto;
-    if (SelectCrypto(offer, bundle_enabled, &crypto)) {
+    if (SelectCrypto(offer, bundle_enabled, options.gcm_crypto_enabled,
+                     &crypto)) {
       if (current_cryptos) {
         FindMatchingCrypto(*current_cryptos, crypto, &crypto);
       }
@@ -1020,6 +1062,9 @@ SessionDescription* MediaSessionDescriptionFactory::CreateOffer(
     scoped_ptr<AudioContentDescription> audio(new AudioContentDescription());
     std::vector<std::string> crypto_suites;
     GetSupportedAudioCryptoSuites(&crypto_suites);
+    if (options.gcm_crypto_enabled) {
+      AddGcmCryptoSuites(false, &crypto_suites);
+    }
     if (!CreateMediaContentOffer(
             options,
             audio_codecs,
@@ -1047,6 +1092,9 @@ SessionDescription* MediaSessionDescriptionFactory::CreateOffer(
     scoped_ptr<VideoContentDescription> video(new VideoContentDescription());
     std::vector<std::string> crypto_suites;
     GetSupportedVideoCryptoSuites(&crypto_suites);
+    if (options.gcm_crypto_enabled) {
+      AddGcmCryptoSuites(true, &crypto_suites);
+    }
     if (!CreateMediaContentOffer(
             options,
             video_codecs,
@@ -1088,6 +1136,9 @@ SessionDescription* MediaSessionDescriptionFactory::CreateOffer(
           secure_transport ? kMediaProtocolSctpDtls : kMediaProtocolSctp);
     } else {
       GetSupportedDataCryptoSuites(&crypto_suites);
+      if (options.gcm_crypto_enabled) {
+        AddGcmCryptoSuites(true, &crypto_suites);
+      }
     }
 
     if (!CreateMediaContentOffer(
@@ -95,6 +95,7 @@ struct MediaSessionOptions {
       vad_enabled(true),  // When disabled, removes all CN codecs from SDP.
       rtcp_mux_enabled(true),
       bundle_enabled(false),
+      gcm_crypto_enabled(false),
       video_bandwidth(kAutoBandwidth),
       data_bandwidth(kDataMaxBandwidth) {
   }
@@ -116,6 +117,8 @@ struct MediaSessionOptions {
   bool vad_enabled;
   bool rtcp_mux_enabled;
   bool bundle_enabled;
+  // Offer and accept the AEAD AES-GCM SRTP suites (RFC 7714) with SDES.
+  bool gcm_crypto_enabled;
   // bps. -1 == auto.
   int video_bandwidth;
   int data_bandwidth;
@@ -32,6 +32,7 @@
 #include "talk/base/fakesslidentity.h"
 #include "talk/base/messagedigest.h"
 #include "talk/media/base/codec.h"
+#include "talk/media/base/cpuid.h"
 #include "talk/media/base/testutils.h"
 #include "talk/p2p/base/constants.h"
 #include "talk/p2p/base/transportdescription.h"
@@ -85,6 +86,7 @@ using cricket::SEC_ENABLED;
 using cricket::SEC_REQUIRED;
 using cricket::CS_AES_CM_128_HMAC_SHA1_32;
 using cricket::CS_AES_CM_128_HMAC_SHA1_80;
+using cricket::CS_AEAD_AES_128_GCM;
 
 static const AudioCodec kAudioCodecs1[] = {
   AudioCodec(103, "ISAC",   16000, -1,    1, 6),
@@ -744,6 +746,44 @@ TEST_F(MediaSessionDescriptionFactoryTest,
   EXPECT_EQ(protocol, dcd_answer->protocol());
 }
 
+// Test that AES-GCM is offered when enabled and supported by libsrtp, and
+// that it is only chosen for video when the CPU has AES-NI and CLMUL.
+TEST_F(MediaSessionDescriptionFactoryTest, TestCreateVideoAnswerWithGcm) {
+  MediaSessionOptions opts;
+  opts.has_video = true;
+  opts.gcm_crypto_enabled = true;
+  f1_.set_secure(SEC_ENABLED);
+  f2_.set_secure(SEC_ENABLED);
+  talk_base::scoped_ptr<SessionDescription> offer(f1_.CreateOffer(opts, NULL));
+  ASSERT_TRUE(offer.get() != NULL);
+  const VideoContentDescription* offer_vcd =
+      GetFirstVideoContentDescription(offer.get());
+  ASSERT_TRUE(offer_vcd != NULL);
+  bool gcm = cricket::IsSrtpCipherSuiteSupported(CS_AEAD_AES_128_GCM);
+  bool gcm_offered = false;
+  for (size_t i = 0; i < offer_vcd->cryptos().size(); ++i) {
+    if (offer_vcd->cryptos()[i].cipher_suite == CS_AEAD_AES_128_GCM) {
+      gcm_offered = true;
+    }
+  }
+  EXPECT_EQ(gcm, gcm_offered);
+
+  talk_base::scoped_ptr<SessionDescription> answer(
+      f2_.CreateAnswer(offer.get(), opts, NULL));
+  const AudioContentDescription* acd =
+      GetFirstAudioContentDescription(answer.get());
+  const VideoContentDescription* vcd =
+      GetFirstVideoContentDescription(answer.get());
+  ASSERT_TRUE(acd != NULL);
+  ASSERT_TRUE(vcd != NULL);
+  ASSERT_CRYPTO(acd, 1U, CS_AES_CM_128_HMAC_SHA1_32);
+  if (gcm && cricket::HasAesNiAndClmul()) {
+    ASSERT_CRYPTO(vcd, 1U, CS_AEAD_AES_128_GCM);
+  } else {
+    ASSERT_CRYPTO(vcd, 1U, CS_AES_CM_128_HMAC_SHA1_80);
+  }
+}
+
 // Test that the media protocol is RTP/AVPF if DTLS and SDES are disabled.
 TEST_F(MediaSessionDescriptionFactoryTest, AudioOfferAnswerWithCryptoDisabled) {
   MediaSessionOptions opts;
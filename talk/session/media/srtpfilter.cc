@@ -33,9 +33,11 @@
 #include <cstring>
 
 #include "talk/base/base64.h"
+#include "talk/base/criticalsection.h"
 #include "talk/base/logging.h"
 #include "talk/base/stringencode.h"
 #include "talk/base/timeutils.h"
+#include "talk/media/base/cpuid.h"
 #include "talk/media/base/rtputils.h"
 
 // Enable this line to turn on SRTP debugging
@@ -56,6 +58,15 @@ extern "C" debug_module_t mod_alloc;
 extern "C" debug_module_t mod_aes_icm;
 extern "C" debug_module_t mod_aes_hmac;
 #endif
+// libsrtp only has the AEAD suites of RFC 7714 when it does its crypto with
+// OpenSSL, whose AES-GCM uses AES-NI and CLMUL where the CPU has them.
+#if defined(OPENSSL) && defined(AES_128_GCM)
+#define SRTP_HAVE_AES_GCM
+#endif
+// srtp_set_user_data and srtp_get_user_data came with libsrtp 1.5, which has
+// no version macro to test; the libsrtp_has_user_data gyp variable defines
+// SRTP_HAVE_USER_DATA when building against it. Otherwise the sessions are
+// looked up in a locked table.
 #else
 // SrtpFilter needs that constant.
 #define SRTP_MASTER_KEY_LEN 30
@@ -65,9 +76,16 @@ namespace cricket {
 
 const char CS_AES_CM_128_HMAC_SHA1_80[] = "AES_CM_128_HMAC_SHA1_80";
 const char CS_AES_CM_128_HMAC_SHA1_32[] = "AES_CM_128_HMAC_SHA1_32";
+const char CS_AEAD_AES_128_GCM[] = "AEAD_AES_128_GCM";
+const char CS_AEAD_AES_256_GCM[] = "AEAD_AES_256_GCM";
 const int SRTP_MASTER_KEY_BASE64_LEN = SRTP_MASTER_KEY_LEN * 4 / 3;
 const int SRTP_MASTER_KEY_KEY_LEN = 16;
 const int SRTP_MASTER_KEY_SALT_LEN = 14;
+// AEAD_AES_256_GCM: 256-bit key, 96-bit salt.
+const int SRTP_MAX_MASTER_KEY_LEN = 32 + 12;
+
+// The AEAD suites use a 96-bit salt (RFC 7714 section 12).
+static const int kSrtpAeadSaltLen = 12;
 
 #ifndef HAVE_SRTP
 
@@ -82,6 +100,54 @@ bool SrtpNotAvailable(const char *func) {
 
 #endif  // !HAVE_SRTP
 
+bool GetSrtpKeyAndSaltLengths(const std::string& cs, int* key_len,
+                              int* salt_len) {
+  if (cs == CS_AES_CM_128_HMAC_SHA1_80 || cs == CS_AES_CM_128_HMAC_SHA1_32) {
+    *key_len = SRTP_MASTER_KEY_KEY_LEN;
+    *salt_len = SRTP_MASTER_KEY_SALT_LEN;
+  } else if (cs == CS_AEAD_AES_128_GCM) {
+    *key_len = 16;
+    *salt_len = kSrtpAeadSaltLen;
+  } else if (cs == CS_AEAD_AES_256_GCM) {
+    *key_len = 32;
+    *salt_len = kSrtpAeadSaltLen;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool IsSrtpCipherSuiteSupported(const std::string& cs) {
+#ifdef HAVE_SRTP
+  if (cs == CS_AES_CM_128_HMAC_SHA1_80 || cs == CS_AES_CM_128_HMAC_SHA1_32) {
+    return true;
+  }
+#ifdef SRTP_HAVE_AES_GCM
+  if (cs == CS_AEAD_AES_128_GCM || cs == CS_AEAD_AES_256_GCM) {
+    return true;
+  }
+#endif
+#endif  // HAVE_SRTP
+  return false;
+}
+
+// Adds |stat| to |stats|, merging it with an entry for the same SSRC.
+static void MergeFailureStats(const SrtpFailureStats& stat,
+                              std::vector<SrtpFailureStats>* stats) {
+  for (size_t i = 0; i < stats->size(); ++i) {
+    SrtpFailureStats* entry = &(*stats)[i];
+    if (entry->ssrc == stat.ssrc && entry->overflow == stat.overflow) {
+      for (int m = 0; m < SrtpFailureStats::kNumModes; ++m) {
+        for (int e = 0; e < SrtpFailureStats::kNumErrors; ++e) {
+          entry->failures[m][e] += stat.failures[m][e];
+        }
+      }
+      return;
+    }
+  }
+  stats->push_back(stat);
+}
+
 void EnableSrtpDebugging() {
 #ifdef HAVE_SRTP
 #ifdef _DEBUG
@@ -231,6 +297,28 @@ bool SrtpFilter::UnprotectRtcp(void* p, int in_len, int* out_len) {
   }
 }
 
+int SrtpFilter::ProtectRtp(SrtpPacket* packets, int count) {
+  if (!IsActive()) {
+    LOG(LS_WARNING) << "Failed to ProtectRtp: SRTP not active";
+    for (int i = 0; i < count; ++i) {
+      packets[i].ok = false;
+    }
+    return 0;
+  }
+  return send_session_->ProtectRtp(packets, count);
+}
+
+int SrtpFilter::UnprotectRtp(SrtpPacket* packets, int count) {
+  if (!IsActive()) {
+    LOG(LS_WARNING) << "Failed to UnprotectRtp: SRTP not active";
+    for (int i = 0; i < count; ++i) {
+      packets[i].ok = false;
+    }
+    return 0;
+  }
+  return recv_session_->UnprotectRtp(packets, count);
+}
+
 void SrtpFilter::set_signal_silent_time(uint32 signal_silent_time_in_ms) {
   signal_silent_time_in_ms_ = signal_silent_time_in_ms;
   if (state_ == ST_ACTIVE) {
@@ -243,6 +331,22 @@ void SrtpFilter::set_signal_silent_time(uint32 signal_silent_time_in_ms) {
   }
 }
 
+void SrtpFilter::GetFailureStats(std::vector<SrtpFailureStats>* stats) const {
+  std::vector<SrtpFailureStats> session_stats;
+  const SrtpSession* sessions[] = {
+    send_session_.get(), recv_session_.get(),
+    send_rtcp_session_.get(), recv_rtcp_session_.get()
+  };
+  for (size_t i = 0; i < ARRAY_SIZE(sessions); ++i) {
+    if (sessions[i]) {
+      sessions[i]->GetFailureStats(&session_stats);
+    }
+  }
+  for (size_t i = 0; i < session_stats.size(); ++i) {
+    MergeFailureStats(session_stats[i], stats);
+  }
+}
+
 bool SrtpFilter::ExpectOffer(ContentSource source) {
   return ((state_ == ST_INIT) ||
           (state_ == ST_ACTIVE) ||
@@ -374,15 +478,24 @@ bool SrtpFilter::ApplyParams(const CryptoParams& send_params,
   }
   // TODO(juberti): Zero these buffers after use.
   bool ret;
-  uint8 send_key[SRTP_MASTER_KEY_LEN], recv_key[SRTP_MASTER_KEY_LEN];
-  ret = (ParseKeyParams(send_params.key_params, send_key, sizeof(send_key)) &&
-         ParseKeyParams(recv_params.key_params, recv_key, sizeof(recv_key)));
+  uint8 send_key[SRTP_MAX_MASTER_KEY_LEN], recv_key[SRTP_MAX_MASTER_KEY_LEN];
+  int send_key_len, send_salt_len, recv_key_len, recv_salt_len;
+  ret = (GetSrtpKeyAndSaltLengths(send_params.cipher_suite,
+                                  &send_key_len, &send_salt_len) &&
+         GetSrtpKeyAndSaltLengths(recv_params.cipher_suite,
+                                  &recv_key_len, &recv_salt_len));
+  if (ret) {
+    send_key_len += send_salt_len;
+    recv_key_len += recv_salt_len;
+    ret = (ParseKeyParams(send_params.key_params, send_key, send_key_len) &&
+           ParseKeyParams(recv_params.key_params, recv_key, recv_key_len));
+  }
   if (ret) {
     CreateSrtpSessions();
     ret = (send_session_->SetSend(send_params.cipher_suite,
-                                  send_key, sizeof(send_key)) &&
+                                  send_key, send_key_len) &&
            recv_session_->SetRecv(recv_params.cipher_suite,
-                                  recv_key, sizeof(recv_key)));
+                                  recv_key, recv_key_len));
   }
   if (ret) {
     LOG(LS_INFO) << "SRTP activated with negotiated parameters:"
@@ -437,13 +550,15 @@ SrtpSession::SrtpSession()
       rtcp_auth_tag_len_(0),
       srtp_stat_(new SrtpStat()),
       last_send_seq_num_(-1) {
-  sessions()->push_back(this);
   SignalSrtpError.repeat(srtp_stat_->SignalSrtpError);
 }
 
 SrtpSession::~SrtpSession() {
-  sessions()->erase(std::find(sessions()->begin(), sessions()->end(), this));
   if (session_) {
+#ifndef SRTP_HAVE_USER_DATA
+    talk_base::CritScope cs(sessions_lock());
+    sessions()->Erase(session_);
+#endif
     srtp_dealloc(session_);
   }
 }
@@ -545,6 +660,81 @@ bool SrtpSession::UnprotectRtcp(void* p, int in_len, int* out_len) {
   return true;
 }
 
+// libsrtp transforms one packet per call, so the batch versions save the
+// per-packet checks and bookkeeping around it: only failures are reported to
+// |srtp_stat_|, and the send sequence number is recorded once per batch.
+int SrtpSession::ProtectRtp(SrtpPacket* packets, int count) {
+  if (!session_) {
+    LOG(LS_WARNING) << "Failed to protect SRTP packets: no SRTP Session";
+    for (int i = 0; i < count; ++i) {
+      packets[i].ok = false;
+    }
+    return 0;
+  }
+
+  int done = 0;
+  SrtpPacket* last = NULL;
+  for (int i = 0; i < count; ++i) {
+    SrtpPacket* packet = &packets[i];
+    packet->ok = false;
+    if (packet->max_len < packet->len + rtp_auth_tag_len_) {
+      LOG(LS_WARNING) << "Failed to protect SRTP packet: The buffer length "
+                      << packet->max_len << " is less than the needed "
+                      << packet->len + rtp_auth_tag_len_;
+      continue;
+    }
+    int len = packet->len;
+    int err = srtp_protect(session_, packet->data, &len);
+    if (err != err_status_ok) {
+      uint32 ssrc;
+      if (GetRtpSsrc(packet->data, packet->len, &ssrc)) {
+        srtp_stat_->AddProtectRtpResult(ssrc, err);
+      }
+      LOG(LS_WARNING) << "Failed to protect SRTP packet, err=" << err
+                      << ", last seqnum=" << last_send_seq_num_;
+      continue;
+    }
+    packet->len = len;
+    packet->ok = true;
+    last = packet;
+    ++done;
+  }
+  // The RTP header stays in the clear.
+  if (last) {
+    GetRtpSeqNum(last->data, last->len, &last_send_seq_num_);
+  }
+  return done;
+}
+
+int SrtpSession::UnprotectRtp(SrtpPacket* packets, int count) {
+  if (!session_) {
+    LOG(LS_WARNING) << "Failed to unprotect SRTP packets: no SRTP Session";
+    for (int i = 0; i < count; ++i) {
+      packets[i].ok = false;
+    }
+    return 0;
+  }
+
+  int done = 0;
+  for (int i = 0; i < count; ++i) {
+    SrtpPacket* packet = &packets[i];
+    int len = packet->len;
+    int err = srtp_unprotect(session_, packet->data, &len);
+    packet->ok = (err == err_status_ok);
+    if (!packet->ok) {
+      uint32 ssrc;
+      if (GetRtpSsrc(packet->data, packet->len, &ssrc)) {
+        srtp_stat_->AddUnprotectRtpResult(ssrc, err);
+      }
+      LOG(LS_WARNING) << "Failed to unprotect SRTP packet, err=" << err;
+      continue;
+    }
+    packet->len = len;
+    ++done;
+  }
+  return done;
+}
+
 void SrtpSession::set_signal_silent_time(uint32 signal_silent_time_in_ms) {
   srtp_stat_->set_signal_silent_time(signal_silent_time_in_ms);
 }
@@ -570,13 +760,23 @@ bool SrtpSession::SetKey(int type, const std::string& cs,
   } else if (cs == CS_AES_CM_128_HMAC_SHA1_32) {
     crypto_policy_set_aes_cm_128_hmac_sha1_32(&policy.rtp);   // rtp is 32,
     crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy.rtcp);  // rtcp still 80
+#ifdef SRTP_HAVE_AES_GCM
+  } else if (cs == CS_AEAD_AES_128_GCM) {
+    crypto_policy_set_aes_gcm_128_16_auth(&policy.rtp);
+    crypto_policy_set_aes_gcm_128_16_auth(&policy.rtcp);
+  } else if (cs == CS_AEAD_AES_256_GCM) {
+    crypto_policy_set_aes_gcm_256_16_auth(&policy.rtp);
+    crypto_policy_set_aes_gcm_256_16_auth(&policy.rtcp);
+#endif
   } else {
     LOG(LS_WARNING) << "Failed to create SRTP session: unsupported"
                     << " cipher_suite " << cs.c_str();
     return false;
   }
 
-  if (!key || len != SRTP_MASTER_KEY_LEN) {
+  int key_len, salt_len;
+  if (!key || !GetSrtpKeyAndSaltLengths(cs, &key_len, &salt_len) ||
+      len != key_len + salt_len) {
     LOG(LS_WARNING) << "Failed to create SRTP session: invalid key";
     return false;
   }
@@ -594,6 +794,15 @@ bool SrtpSession::SetKey(int type, const std::string& cs,
     LOG(LS_ERROR) << "Failed to create SRTP session, err=" << err;
     return false;
   }
+  // Lets HandleEventThunk find this session.
+#ifdef SRTP_HAVE_USER_DATA
+  srtp_set_user_data(session_, this);
+#else
+  {
+    talk_base::CritScope cs(sessions_lock());
+    sessions()->Insert(session_, this);
+  }
+#endif
 
   rtp_auth_tag_len_ = policy.rtp.auth_tag_len;
   rtcp_auth_tag_len_ = policy.rtcp.auth_tag_len;
@@ -615,6 +824,12 @@ bool SrtpSession::Init() {
       return false;
     }
 
+    LOG(LS_INFO) << "SRTP initialized, AES-GCM "
+                 << (IsSrtpCipherSuiteSupported(CS_AEAD_AES_128_GCM) ?
+                     "supported" : "not supported")
+                 << ", AES-NI and CLMUL "
+                 << (HasAesNiAndClmul() ? "available" : "not available");
+
     inited_ = true;
   }
 
@@ -641,21 +856,40 @@ void SrtpSession::HandleEvent(const srtp_event_data_t* ev) {
   }
 }
 
+#ifdef SRTP_HAVE_USER_DATA
+
 void SrtpSession::HandleEventThunk(srtp_event_data_t* ev) {
-  for (std::list<SrtpSession*>::iterator it = sessions()->begin();
-       it != sessions()->end(); ++it) {
-    if ((*it)->session_ == ev->session) {
-      (*it)->HandleEvent(ev);
-      break;
-    }
+  SrtpSession* session = static_cast<SrtpSession*>(
+      srtp_get_user_data(ev->session));
+  if (session) {
+    session->HandleEvent(ev);
   }
 }
 
-std::list<SrtpSession*>* SrtpSession::sessions() {
-  LIBJINGLE_DEFINE_STATIC_LOCAL(std::list<SrtpSession*>, sessions, ());
+#else  // !SRTP_HAVE_USER_DATA
+
+void SrtpSession::HandleEventThunk(srtp_event_data_t* ev) {
+  // Events come from whichever thread is protecting or unprotecting, so hold
+  // the lock until the session is done with them.
+  talk_base::CritScope cs(sessions_lock());
+  SrtpSession** session = sessions()->Find(ev->session);
+  if (session) {
+    (*session)->HandleEvent(ev);
+  }
+}
+
+SrtpSession::SessionMap* SrtpSession::sessions() {
+  LIBJINGLE_DEFINE_STATIC_LOCAL(SessionMap, sessions, ());
   return &sessions;
 }
 
+talk_base::CriticalSection* SrtpSession::sessions_lock() {
+  LIBJINGLE_DEFINE_STATIC_LOCAL(talk_base::CriticalSection, lock, ());
+  return &lock;
+}
+
+#endif  // SRTP_HAVE_USER_DATA
+
 #else   // !HAVE_SRTP
 
 // On some systems, SRTP is not (yet) available.
@@ -693,57 +927,152 @@ bool SrtpSession::UnprotectRtcp(void* data, int in_len, int* out_len) {
   return SrtpNotAvailable(__FUNCTION__);
 }
 
+int SrtpSession::ProtectRtp(SrtpPacket* packets, int count) {
+  SrtpNotAvailable(__FUNCTION__);
+  for (int i = 0; i < count; ++i) {
+    packets[i].ok = false;
+  }
+  return 0;
+}
+
+int SrtpSession::UnprotectRtp(SrtpPacket* packets, int count) {
+  SrtpNotAvailable(__FUNCTION__);
+  for (int i = 0; i < count; ++i) {
+    packets[i].ok = false;
+  }
+  return 0;
+}
+
 void SrtpSession::set_signal_silent_time(uint32 signal_silent_time) {
   // Do nothing.
 }
 
 #endif  // HAVE_SRTP
 
+void SrtpSession::GetFailureStats(std::vector<SrtpFailureStats>* stats) const {
+  srtp_stat_->GetFailureStats(stats);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // SrtpStat
 
+// Slot states.
+static const int kSlotEmpty = 0;
+static const int kSlotClaimed = 1;
+static const int kSlotReady = 2;
+
+SrtpStat::Slot* SrtpStat::FindSlot(uint32 ssrc) {
+  // Multiplicative hashing, then linear probing.
+  int start = static_cast<int>(((ssrc * 2654435761U) >> 16) % kMaxSsrcs);
+  for (int i = 0; i < kMaxSsrcs; ++i) {
+    Slot* slot = &slots_[(start + i) % kMaxSsrcs];
+    int state = talk_base::AtomicOps::AcquireLoad(&slot->state);
+    if (state == kSlotEmpty) {
+      state = talk_base::AtomicOps::CompareAndSwap(&slot->state, kSlotEmpty,
+                                                   kSlotClaimed);
+      if (state == kSlotEmpty) {
+        slot->ssrc = ssrc;
+        talk_base::AtomicOps::ReleaseStore(&slot->state, kSlotReady);
+        return slot;
+      }
+    }
+    // A slot still being claimed is skipped. Should that be for the same
+    // SSRC, the SSRC ends up with two slots, which GetFailureStats merges.
+    if (state == kSlotReady && slot->ssrc == ssrc) {
+      return slot;
+    }
+  }
+  return &slots_[kMaxSsrcs];
+}
+
+void SrtpStat::HandleSrtpResult(uint32 ssrc, SrtpFilter::Mode mode,
+                                SrtpFilter::Error error) {
+  if (error == SrtpFilter::ERROR_NONE) {
+    return;
+  }
+  Slot* slot = FindSlot(ssrc);
+  talk_base::AtomicOps::Increment(&slot->failures[mode][error]);
+
+  // Signal an error the first time it's seen. After that, silence the same
+  // error for a certain amount of time (default 1 sec). If several threads
+  // see it at once, the compare-and-swap picks the one that signals.
+  int* last_signal_time = &slot->last_signal_time[mode][error];
+  int last = talk_base::AtomicOps::AcquireLoad(last_signal_time);
+  uint32 current_time = talk_base::Time();
+  if (last == 0 ||
+      talk_base::TimeDiff(current_time, static_cast<uint32>(last)) >
+      static_cast<int>(signal_silent_time_)) {
+    if (talk_base::AtomicOps::CompareAndSwap(
+            last_signal_time, last, static_cast<int>(current_time)) == last) {
+      SignalSrtpError(ssrc, mode, error);
+    }
+  }
+}
+
+void SrtpStat::GetFailureStats(std::vector<SrtpFailureStats>* stats) const {
+  for (int i = 0; i <= kMaxSsrcs; ++i) {
+    const Slot& slot = slots_[i];
+    SrtpFailureStats stat;
+    stat.overflow = (i == kMaxSsrcs);
+    if (!stat.overflow) {
+      if (talk_base::AtomicOps::AcquireLoad(&slot.state) != kSlotReady) {
+        continue;
+      }
+      stat.ssrc = slot.ssrc;
+    }
+    int total = 0;
+    for (int m = 0; m < SrtpFailureStats::kNumModes; ++m) {
+      for (int e = 0; e < SrtpFailureStats::kNumErrors; ++e) {
+        stat.failures[m][e] =
+            talk_base::AtomicOps::AcquireLoad(&slot.failures[m][e]);
+        total += stat.failures[m][e];
+      }
+    }
+    if (total > 0) {
+      MergeFailureStats(stat, stats);
+    }
+  }
+}
+
 #ifdef HAVE_SRTP
 
 SrtpStat::SrtpStat()
     : signal_silent_time_(1000) {
+  memset(slots_, 0, sizeof(slots_));
 }
 
 void SrtpStat::AddProtectRtpResult(uint32 ssrc, int result) {
-  FailureKey key;
-  key.ssrc = ssrc;
-  key.mode = SrtpFilter::PROTECT;
+  SrtpFilter::Error error;
   switch (result) {
     case err_status_ok:
-      key.error = SrtpFilter::ERROR_NONE;
+      error = SrtpFilter::ERROR_NONE;
       break;
     case err_status_auth_fail:
-      key.error = SrtpFilter::ERROR_AUTH;
+      error = SrtpFilter::ERROR_AUTH;
       break;
     default:
-      key.error = SrtpFilter::ERROR_FAIL;
+      error = SrtpFilter::ERROR_FAIL;
   }
-  HandleSrtpResult(key);
+  HandleSrtpResult(ssrc, SrtpFilter::PROTECT, error);
 }
 
 void SrtpStat::AddUnprotectRtpResult(uint32 ssrc, int result) {
-  FailureKey key;
-  key.ssrc = ssrc;
-  key.mode = SrtpFilter::UNPROTECT;
+  SrtpFilter::Error error;
   switch (result) {
     case err_status_ok:
-      key.error = SrtpFilter::ERROR_NONE;
+      error = SrtpFilter::ERROR_NONE;
       break;
     case err_status_auth_fail:
-      key.error = SrtpFilter::ERROR_AUTH;
+      error = SrtpFilter::ERROR_AUTH;
       break;
     case err_status_replay_fail:
     case err_status_replay_old:
-      key.error = SrtpFilter::ERROR_REPLAY;
+      error = SrtpFilter::ERROR_REPLAY;
       break;
     default:
-      key.error = SrtpFilter::ERROR_FAIL;
+      error = SrtpFilter::ERROR_FAIL;
   }
-  HandleSrtpResult(key);
+  HandleSrtpResult(ssrc, SrtpFilter::UNPROTECT, error);
 }
 
 void SrtpStat::AddProtectRtcpResult(int result) {
@@ -754,23 +1083,6 @@ void SrtpStat::AddUnprotectRtcpResult(int result) {
   AddUnprotectRtpResult(0U, result);
 }
 
-void SrtpStat::HandleSrtpResult(const SrtpStat::FailureKey& key) {
-  // Handle some cases where error should be signalled right away. For other
-  // errors, trigger error for the first time seeing it.  After that, silent
-  // the same error for a certain amount of time (default 1 sec).
-  if (key.error != SrtpFilter::ERROR_NONE) {
-    // For errors, signal first time and wait for 1 sec.
-    FailureStat* stat = &(failures_[key]);
-    uint32 current_time = talk_base::Time();
-    if (stat->last_signal_time == 0 ||
-        talk_base::TimeDiff(current_time, stat->last_signal_time) >
-        static_cast<int>(signal_silent_time_)) {
-      SignalSrtpError(key.ssrc, key.mode, key.error);
-      stat->last_signal_time = current_time;
-    }
-  }
-}
-
 #else   // !HAVE_SRTP
 
 // On some systems, SRTP is not (yet) available.
@@ -778,6 +1090,7 @@ void SrtpStat::HandleSrtpResult(const SrtpStat::FailureKey& key) {
 SrtpStat::SrtpStat()
     : signal_silent_time_(1000) {
   LOG(WARNING) << "SRTP implementation is missing.";
+  memset(slots_, 0, sizeof(slots_));
 }
 
 void SrtpStat::AddProtectRtpResult(uint32 ssrc, int result) {
@@ -796,10 +1109,6 @@ void SrtpStat::AddUnprotectRtcpResult(int result) {
   SrtpNotAvailable(__FUNCTION__);
 }
 
-void SrtpStat::HandleSrtpResult(const SrtpStat::FailureKey& key) {
-  SrtpNotAvailable(__FUNCTION__);
-}
-
 #endif  // HAVE_SRTP
 
 }  // namespace cricket
@@ -28,17 +28,20 @@
 #ifndef TALK_SESSION_MEDIA_SRTPFILTER_H_
 #define TALK_SESSION_MEDIA_SRTPFILTER_H_
 
-#include <list>
-#include <map>
 #include <string>
 #include <vector>
 
 #include "talk/base/basictypes.h"
+#include "talk/base/flathashmap.h"
 #include "talk/base/scoped_ptr.h"
 #include "talk/base/sigslotrepeater.h"
 #include "talk/media/base/cryptoparams.h"
 #include "talk/p2p/base/sessiondescription.h"
 
+namespace talk_base {
+class CriticalSection;
+}
+
 // Forward declaration to avoid pulling in libsrtp headers here
 struct srtp_event_data_t;
 struct srtp_ctx_t;
@@ -54,15 +57,43 @@ namespace cricket {
 extern const char CS_AES_CM_128_HMAC_SHA1_80[];
 // 128-bit AES with 32-bit SHA-1 HMAC.
 extern const char CS_AES_CM_128_HMAC_SHA1_32[];
+// AEAD suites from RFC 7714: 128 or 256-bit AES in Galois/Counter Mode with
+// a 128-bit tag, for both SRTP and SRTCP. Only available when libsrtp is
+// built with them; see IsSrtpCipherSuiteSupported.
+extern const char CS_AEAD_AES_128_GCM[];
+extern const char CS_AEAD_AES_256_GCM[];
 // Key is 128 bits and salt is 112 bits == 30 bytes. B64 bloat => 40 bytes.
 extern const int SRTP_MASTER_KEY_BASE64_LEN;
 
 // Needed for DTLS-SRTP
 extern const int SRTP_MASTER_KEY_KEY_LEN;
 extern const int SRTP_MASTER_KEY_SALT_LEN;
+// The longest master key plus salt of any supported cipher suite.
+extern const int SRTP_MAX_MASTER_KEY_LEN;
+
+// Gets the master key and salt lengths of |cs|, in bytes. Returns false for
+// unknown cipher suites.
+bool GetSrtpKeyAndSaltLengths(const std::string& cs, int* key_len,
+                              int* salt_len);
+// Whether packets can be protected with |cs| in this build.
+bool IsSrtpCipherSuiteSupported(const std::string& cs);
+
+// A packet for the batched protect and unprotect calls, transformed in
+// place. |len| is updated to the new length, and |ok| tells whether the
+// packet was transformed; a packet that wasn't must not be sent or used.
+struct SrtpPacket {
+  SrtpPacket() : data(NULL), len(0), max_len(0), ok(false) {}
+  SrtpPacket(void* data, int len, int max_len)
+      : data(data), len(len), max_len(max_len), ok(false) {}
+  void* data;
+  int len;
+  int max_len;  // The space at |data|; unused when unprotecting.
+  bool ok;
+};
 
 class SrtpSession;
 class SrtpStat;
+struct SrtpFailureStats;
 
 void EnableSrtpDebugging();
 
@@ -126,10 +157,18 @@ class SrtpFilter {
   // If an HMAC is used, this will decrease the packet size.
   bool UnprotectRtp(void* data, int in_len, int* out_len);
   bool UnprotectRtcp(void* data, int in_len, int* out_len);
+  // Encrypts/decrypts a batch of RTP packets, such as the packets of one
+  // video frame, in one call. Returns the number of packets transformed.
+  int ProtectRtp(SrtpPacket* packets, int count);
+  int UnprotectRtp(SrtpPacket* packets, int count);
 
   // Update the silent threshold (in ms) for signaling errors.
   void set_signal_silent_time(uint32 signal_silent_time_in_ms);
 
+  // Appends the protect/unprotect failure counts of each SSRC seen by the
+  // SRTP and SRTCP sessions.
+  void GetFailureStats(std::vector<SrtpFailureStats>* stats) const;
+
   sigslot::repeater3<uint32, Mode, Error> SignalSrtpError;
 
  protected:
@@ -183,6 +222,30 @@ class SrtpFilter {
   CryptoParams applied_recv_params_;
 };
 
+// The SRTP failures counted for one SSRC; SRTCP failures are counted for
+// SSRC 0.
+struct SrtpFailureStats {
+  static const int kNumModes = 2;
+  static const int kNumErrors = 4;
+
+  SrtpFailureStats() : ssrc(0), overflow(false) {
+    for (int i = 0; i < kNumModes; ++i) {
+      for (int j = 0; j < kNumErrors; ++j) {
+        failures[i][j] = 0;
+      }
+    }
+  }
+  int count(SrtpFilter::Mode mode, SrtpFilter::Error error) const {
+    return failures[mode][error];
+  }
+
+  uint32 ssrc;
+  // Set for the failures of all the SSRCs that didn't fit in the table of
+  // the session, in which case |ssrc| is 0.
+  bool overflow;
+  int failures[kNumModes][kNumErrors];
+};
+
 // Class that wraps a libSRTP session.
 class SrtpSession {
  public:
@@ -204,10 +267,17 @@ class SrtpSession {
   // If an HMAC is used, this will decrease the packet size.
   bool UnprotectRtp(void* data, int in_len, int* out_len);
   bool UnprotectRtcp(void* data, int in_len, int* out_len);
+  // Encrypts/decrypts a batch of RTP packets. Returns the number of packets
+  // transformed; failures are reported per packet as above.
+  int ProtectRtp(SrtpPacket* packets, int count);
+  int UnprotectRtp(SrtpPacket* packets, int count);
 
   // Update the silent threshold (in ms) for signaling errors.
   void set_signal_silent_time(uint32 signal_silent_time_in_ms);
 
+  // Appends the failure counts of each SSRC with failures.
+  void GetFailureStats(std::vector<SrtpFailureStats>* stats) const;
+
   sigslot::repeater3<uint32, SrtpFilter::Mode, SrtpFilter::Error>
       SignalSrtpError;
 
@@ -216,7 +286,11 @@ class SrtpSession {
   static bool Init();
   void HandleEvent(const srtp_event_data_t* ev);
   static void HandleEventThunk(srtp_event_data_t* ev);
-  static std::list<SrtpSession*>* sessions();
+  // The live sessions by their libsrtp session, for libsrtp versions without
+  // srtp_get_user_data. Guarded by sessions_lock().
+  typedef talk_base::FlatHashMap<srtp_t, SrtpSession*> SessionMap;
+  static SessionMap* sessions();
+  static talk_base::CriticalSection* sessions_lock();
 
   srtp_t session_;
   int rtp_auth_tag_len_;
@@ -248,51 +322,39 @@ class SrtpStat {
     signal_silent_time_ = signal_silent_time;
   }
 
+  // Appends the failure counts of each SSRC with failures.
+  void GetFailureStats(std::vector<SrtpFailureStats>* stats) const;
+
   // Sigslot for reporting errors.
   sigslot::signal3<uint32, SrtpFilter::Mode, SrtpFilter::Error>
       SignalSrtpError;
 
+  // The number of SSRCs whose failures are counted separately. The failures
+  // of any further SSRCs share one overflow entry.
+  static const int kMaxSsrcs = 16;
+
  private:
-  // For each different ssrc and error, we collect statistics separately.
-  struct FailureKey {
-    FailureKey()
-        : ssrc(0),
-          mode(SrtpFilter::PROTECT),
-          error(SrtpFilter::ERROR_NONE) {
-    }
-    FailureKey(uint32 in_ssrc, SrtpFilter::Mode in_mode,
-               SrtpFilter::Error in_error)
-        : ssrc(in_ssrc),
-          mode(in_mode),
-          error(in_error) {
-    }
-    bool operator <(const FailureKey& key) const {
-      return ssrc < key.ssrc || mode < key.mode || error < key.error;
-    }
+  // The counters of one SSRC. Results may be added from several threads, so
+  // a slot is claimed with a compare-and-swap on |state| and never given
+  // back, and all counters are updated atomically; no lock is taken.
+  struct Slot {
+    int state;
     uint32 ssrc;
-    SrtpFilter::Mode mode;
-    SrtpFilter::Error error;
-  };
-  // For tracing conditions for signaling, currently we only use
-  // last_signal_time.  Wrap this as a struct so that later on, if we need any
-  // other improvements, it will be easier.
-  struct FailureStat {
-    FailureStat()
-        : last_signal_time(0) {
-    }
-    explicit FailureStat(uint32 in_last_signal_time)
-        : last_signal_time(in_last_signal_time) {
-    }
-    void Reset() {
-      last_signal_time = 0;
-    }
-    uint32 last_signal_time;
+    int failures[SrtpFailureStats::kNumModes][SrtpFailureStats::kNumErrors];
+    // talk_base::Time() of the last signal, 0 if none yet.
+    int last_signal_time[SrtpFailureStats::kNumModes]
+                        [SrtpFailureStats::kNumErrors];
   };
 
+  // Returns the slot of |ssrc|, claiming one if needed, or the overflow
+  // slot if the table is full.
+  Slot* FindSlot(uint32 ssrc);
   // Inspect SRTP result and signal error if needed.
-  void HandleSrtpResult(const FailureKey& key);
+  void HandleSrtpResult(uint32 ssrc, SrtpFilter::Mode mode,
+                        SrtpFilter::Error error);
 
-  std::map<FailureKey, FailureStat> failures_;
+  // kMaxSsrcs slots, then the overflow slot.
+  Slot slots_[kMaxSsrcs + 1];
   // Threshold in ms to silent the signaling errors.
   uint32 signal_silent_time_;
 
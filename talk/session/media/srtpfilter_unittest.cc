@@ -28,6 +28,7 @@
 #include "talk/base/byteorder.h"
 #include "talk/base/gunit.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 #include "talk/media/base/cryptoparams.h"
 #include "talk/media/base/fakertp.h"
 #include "talk/p2p/base/sessiondescription.h"
@@ -40,6 +41,8 @@
 
 using cricket::CS_AES_CM_128_HMAC_SHA1_80;
 using cricket::CS_AES_CM_128_HMAC_SHA1_32;
+using cricket::CS_AEAD_AES_128_GCM;
+using cricket::CS_AEAD_AES_256_GCM;
 using cricket::CryptoParams;
 using cricket::CS_LOCAL;
 using cricket::CS_REMOTE;
@@ -59,12 +62,33 @@ static const cricket::CryptoParams kTestCryptoParams1(
     1, "AES_CM_128_HMAC_SHA1_80", kTestKeyParams1, "");
 static const cricket::CryptoParams kTestCryptoParams2(
     1, "AES_CM_128_HMAC_SHA1_80", kTestKeyParams2, "");
-
+static const uint8 kTestKeyGcm128[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ12";
+static const int kTestKeyGcm128Len = 28;
+static const uint8 kTestKeyGcm256[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ123456789ABCDEFGHI";
+static const int kTestKeyGcm256Len = 44;
+static const std::string kTestKeyParamsGcm128_1 =
+    "inline:QUJDREVGR0hJSktMTU5PUFFSU1RVVldYWVoxMg==";
+static const std::string kTestKeyParamsGcm128_2 =
+    "inline:NDMyMVpZWFdWVVRTUlFQT05NTEtKSUhHRkVEQw==";
+static const std::string kTestKeyParamsGcm256_1 =
+    "inline:QUJDREVGR0hJSktMTU5PUFFSU1RVVldYWVoxMjM0NTY3ODlBQkNERUZHSEk=";
+static const std::string kTestKeyParamsGcm256_2 =
+    "inline:NDMyMVpZWFdWVVRTUlFQT05NTEtKSUhHRkVEQ0JBOTg3NjU0MzIxMFpZWFc=";
+// Room for the largest (AES-GCM) authentication tag.
+static const int kMaxAuthTagLen = 16;
+
+static bool IsGcm(const std::string& cs) {
+  return cs == CS_AEAD_AES_128_GCM || cs == CS_AEAD_AES_256_GCM;
+}
 static int rtp_auth_tag_len(const std::string& cs) {
+  if (IsGcm(cs)) {
+    return 16;
+  }
   return (cs == CS_AES_CM_128_HMAC_SHA1_32) ? 4 : 10;
 }
 static int rtcp_auth_tag_len(const std::string& cs) {
-  return 10;
+  return IsGcm(cs) ? 16 : 10;
 }
 
 class SrtpFilterTest : public testing::Test {
@@ -87,9 +111,9 @@ class SrtpFilterTest : public testing::Test {
     EXPECT_TRUE(f1_.IsActive());
   }
   void TestProtectUnprotect(const std::string& cs1, const std::string& cs2) {
-    char rtp_packet[sizeof(kPcmuFrame) + 10];
+    char rtp_packet[sizeof(kPcmuFrame) + kMaxAuthTagLen];
     char original_rtp_packet[sizeof(kPcmuFrame)];
-    char rtcp_packet[sizeof(kRtcpReport) + 4 + 10];
+    char rtcp_packet[sizeof(kRtcpReport) + 4 + kMaxAuthTagLen];
     int rtp_len = sizeof(kPcmuFrame), rtcp_len = sizeof(kRtcpReport), out_len;
     memcpy(rtp_packet, kPcmuFrame, rtp_len);
     // In order to be able to run this test function multiple times we can not
@@ -362,6 +386,86 @@ TEST_F(SrtpFilterTest, TestProtect_AES_CM_128_HMAC_SHA1_32) {
   TestProtectUnprotect(CS_AES_CM_128_HMAC_SHA1_32, CS_AES_CM_128_HMAC_SHA1_32);
 }
 
+// Test that we can encrypt/decrypt after negotiating AEAD_AES_128_GCM and
+// AEAD_AES_256_GCM, if libsrtp supports them.
+TEST_F(SrtpFilterTest, TestProtect_AEAD_AES_GCM) {
+  if (!cricket::IsSrtpCipherSuiteSupported(CS_AEAD_AES_128_GCM)) {
+    LOG(LS_INFO) << "AES-GCM is not supported by libsrtp, skipping.";
+    return;
+  }
+  std::vector<CryptoParams> offer;
+  offer.push_back(CryptoParams(1, CS_AEAD_AES_256_GCM,
+                               kTestKeyParamsGcm256_1, ""));
+  offer.push_back(CryptoParams(2, CS_AEAD_AES_128_GCM,
+                               kTestKeyParamsGcm128_1, ""));
+  offer.push_back(kTestCryptoParams1);
+  offer[2].tag = 3;
+  std::vector<CryptoParams> answer(MakeVector(
+      CryptoParams(2, CS_AEAD_AES_128_GCM, kTestKeyParamsGcm128_2, "")));
+  TestSetParams(offer, answer);
+  TestProtectUnprotect(CS_AEAD_AES_128_GCM, CS_AEAD_AES_128_GCM);
+
+  answer[0] = CryptoParams(1, CS_AEAD_AES_256_GCM, kTestKeyParamsGcm256_2, "");
+  TestSetParams(offer, answer);
+  TestProtectUnprotect(CS_AEAD_AES_256_GCM, CS_AEAD_AES_256_GCM);
+}
+
+// Test that an AES-GCM key must have the AES-GCM length.
+TEST_F(SrtpFilterTest, TestGcmKeyWrongLength) {
+  std::vector<CryptoParams> offer(MakeVector(
+      CryptoParams(1, CS_AEAD_AES_128_GCM, kTestKeyParams1, "")));
+  std::vector<CryptoParams> answer(MakeVector(
+      CryptoParams(1, CS_AEAD_AES_128_GCM, kTestKeyParams2, "")));
+  EXPECT_TRUE(f1_.SetOffer(offer, CS_LOCAL));
+  EXPECT_FALSE(f1_.SetAnswer(answer, CS_REMOTE));
+  EXPECT_FALSE(f1_.IsActive());
+}
+
+// Test that the batch calls protect and unprotect every packet given.
+TEST_F(SrtpFilterTest, TestBatchProtectUnprotect) {
+  static const int kNumPackets = 8;
+  TestSetParams(MakeVector(kTestCryptoParams1),
+                MakeVector(kTestCryptoParams2));
+  char packets[kNumPackets][sizeof(kPcmuFrame) + kMaxAuthTagLen];
+  std::vector<cricket::SrtpPacket> batch;
+  for (int i = 0; i < kNumPackets; ++i) {
+    memcpy(packets[i], kPcmuFrame, sizeof(kPcmuFrame));
+    talk_base::SetBE16(reinterpret_cast<uint8*>(packets[i]) + 2,
+                       ++sequence_number_);
+    batch.push_back(cricket::SrtpPacket(packets[i], sizeof(kPcmuFrame),
+                                        sizeof(packets[i])));
+  }
+  EXPECT_EQ(kNumPackets, f1_.ProtectRtp(&batch[0], kNumPackets));
+  for (int i = 0; i < kNumPackets; ++i) {
+    EXPECT_TRUE(batch[i].ok);
+    EXPECT_EQ(static_cast<int>(sizeof(kPcmuFrame)) +
+              rtp_auth_tag_len(CS_AES_CM_128_HMAC_SHA1_80), batch[i].len);
+  }
+
+  // A tampered packet fails alone.
+  packets[3][sizeof(kPcmuFrame) - 1] ^= 0x01;
+  EXPECT_EQ(kNumPackets - 1, f2_.UnprotectRtp(&batch[0], kNumPackets));
+  for (int i = 0; i < kNumPackets; ++i) {
+    EXPECT_EQ(i != 3, batch[i].ok);
+    if (batch[i].ok) {
+      EXPECT_EQ(static_cast<int>(sizeof(kPcmuFrame)), batch[i].len);
+      EXPECT_EQ(0, memcmp(packets[i] + 4, kPcmuFrame + 4,
+                          sizeof(kPcmuFrame) - 4));
+    }
+  }
+}
+
+// Test that the batch calls fail every packet when SRTP isn't active.
+TEST_F(SrtpFilterTest, TestBatchProtectNotActive) {
+  char packet[sizeof(kPcmuFrame) + kMaxAuthTagLen];
+  memcpy(packet, kPcmuFrame, sizeof(kPcmuFrame));
+  cricket::SrtpPacket batch(packet, sizeof(kPcmuFrame), sizeof(packet));
+  batch.ok = true;
+  EXPECT_EQ(0, f1_.ProtectRtp(&batch, 1));
+  EXPECT_FALSE(batch.ok);
+  EXPECT_EQ(0, memcmp(packet, kPcmuFrame, sizeof(kPcmuFrame)));
+}
+
 // Test that we can change encryption parameters.
 TEST_F(SrtpFilterTest, TestChangeParameters) {
   std::vector<CryptoParams> offer(MakeVector(kTestCryptoParams1));
@@ -560,8 +664,8 @@ class SrtpSessionTest : public testing::Test {
   }
   cricket::SrtpSession s1_;
   cricket::SrtpSession s2_;
-  char rtp_packet_[sizeof(kPcmuFrame) + 10];
-  char rtcp_packet_[sizeof(kRtcpReport) + 4 + 10];
+  char rtp_packet_[sizeof(kPcmuFrame) + kMaxAuthTagLen];
+  char rtcp_packet_[sizeof(kRtcpReport) + 4 + kMaxAuthTagLen];
   int rtp_len_;
   int rtcp_len_;
 };
@@ -580,6 +684,18 @@ TEST_F(SrtpSessionTest, TestBadSetup) {
   EXPECT_FALSE(s2_.SetRecv(CS_AES_CM_128_HMAC_SHA1_80, kTestKey2, kTestKeyLen));
 }
 
+// Test that the batch calls fail every packet before keys are set.
+TEST_F(SrtpSessionTest, TestBatchWithoutKeys) {
+  cricket::SrtpPacket batch(rtp_packet_, rtp_len_, sizeof(rtp_packet_));
+  batch.ok = true;
+  EXPECT_EQ(0, s1_.ProtectRtp(&batch, 1));
+  EXPECT_FALSE(batch.ok);
+  batch.ok = true;
+  EXPECT_EQ(0, s2_.UnprotectRtp(&batch, 1));
+  EXPECT_FALSE(batch.ok);
+  EXPECT_EQ(0, memcmp(rtp_packet_, kPcmuFrame, rtp_len_));
+}
+
 // Test that we fail keys of the wrong length.
 TEST_F(SrtpSessionTest, TestKeysTooShort) {
   EXPECT_FALSE(s1_.SetSend(CS_AES_CM_128_HMAC_SHA1_80, kTestKey1, 1));
@@ -606,6 +722,23 @@ TEST_F(SrtpSessionTest, TestProtect_AES_CM_128_HMAC_SHA1_32) {
   TestUnprotectRtcp(CS_AES_CM_128_HMAC_SHA1_32);
 }
 
+// Test that we can encrypt and decrypt RTP/RTCP using the AES-GCM suites.
+TEST_F(SrtpSessionTest, TestProtect_AEAD_AES_GCM) {
+  if (!cricket::IsSrtpCipherSuiteSupported(CS_AEAD_AES_128_GCM)) {
+    LOG(LS_INFO) << "AES-GCM is not supported by libsrtp, skipping.";
+    return;
+  }
+  EXPECT_FALSE(s1_.SetSend(CS_AEAD_AES_128_GCM, kTestKey1, kTestKeyLen));
+  EXPECT_TRUE(s1_.SetSend(CS_AEAD_AES_128_GCM, kTestKeyGcm128,
+                          kTestKeyGcm128Len));
+  EXPECT_TRUE(s2_.SetRecv(CS_AEAD_AES_128_GCM, kTestKeyGcm128,
+                          kTestKeyGcm128Len));
+  TestProtectRtp(CS_AEAD_AES_128_GCM);
+  TestProtectRtcp(CS_AEAD_AES_128_GCM);
+  TestUnprotectRtp(CS_AEAD_AES_128_GCM);
+  TestUnprotectRtcp(CS_AEAD_AES_128_GCM);
+}
+
 // Test that we fail to unprotect if someone tampers with the RTP/RTCP paylaods.
 TEST_F(SrtpSessionTest, TestTamperReject) {
   int out_len;
@@ -633,9 +766,10 @@ TEST_F(SrtpSessionTest, TestBuffersTooSmall) {
   int out_len;
   EXPECT_TRUE(s1_.SetSend(CS_AES_CM_128_HMAC_SHA1_80, kTestKey1, kTestKeyLen));
   EXPECT_FALSE(s1_.ProtectRtp(rtp_packet_, rtp_len_,
-                              sizeof(rtp_packet_) - 10, &out_len));
+                              sizeof(rtp_packet_) - kMaxAuthTagLen, &out_len));
   EXPECT_FALSE(s1_.ProtectRtcp(rtcp_packet_, rtcp_len_,
-                               sizeof(rtcp_packet_) - 14, &out_len));
+                               sizeof(rtcp_packet_) - kMaxAuthTagLen - 4,
+                               &out_len));
 }
 
 TEST_F(SrtpSessionTest, TestReplay) {
@@ -694,6 +828,56 @@ TEST_F(SrtpSessionTest, TestReplay) {
                              &out_len));
 }
 
+// Measures protect + unprotect throughput of each supported suite, in
+// batches of 1200-byte video-sized packets.
+TEST_F(SrtpSessionTest, ProtectUnprotectPerf) {
+  static const char* kSuites[] = {
+    CS_AES_CM_128_HMAC_SHA1_80, CS_AES_CM_128_HMAC_SHA1_32,
+    CS_AEAD_AES_128_GCM, CS_AEAD_AES_256_GCM
+  };
+  static const int kPayloadLen = 1200;
+  static const int kBatchSize = 16;
+  static const int kNumBatches = 2000;
+  for (size_t s = 0; s < ARRAY_SIZE(kSuites); ++s) {
+    const std::string cs(kSuites[s]);
+    if (!cricket::IsSrtpCipherSuiteSupported(cs)) {
+      LOG(LS_INFO) << cs << " is not supported by libsrtp, skipping.";
+      continue;
+    }
+    const uint8* key = IsGcm(cs) ?
+        (cs == CS_AEAD_AES_128_GCM ? kTestKeyGcm128 : kTestKeyGcm256) :
+        kTestKey1;
+    int key_len = IsGcm(cs) ?
+        (cs == CS_AEAD_AES_128_GCM ? kTestKeyGcm128Len : kTestKeyGcm256Len) :
+        kTestKeyLen;
+    cricket::SrtpSession sender, receiver;
+    ASSERT_TRUE(sender.SetSend(cs, key, key_len));
+    ASSERT_TRUE(receiver.SetRecv(cs, key, key_len));
+
+    std::vector<char> buffer(kBatchSize * (kPayloadLen + kMaxAuthTagLen));
+    std::vector<cricket::SrtpPacket> batch(kBatchSize);
+    uint16 seqnum = 0;
+    uint32 start = talk_base::Time();
+    for (int i = 0; i < kNumBatches; ++i) {
+      for (int j = 0; j < kBatchSize; ++j) {
+        char* packet = &buffer[j * (kPayloadLen + kMaxAuthTagLen)];
+        memcpy(packet, kPcmuFrame, sizeof(kPcmuFrame));
+        talk_base::SetBE16(reinterpret_cast<uint8*>(packet) + 2, ++seqnum);
+        batch[j] = cricket::SrtpPacket(packet, kPayloadLen,
+                                       kPayloadLen + kMaxAuthTagLen);
+      }
+      ASSERT_EQ(kBatchSize, sender.ProtectRtp(&batch[0], kBatchSize));
+      ASSERT_EQ(kBatchSize, receiver.UnprotectRtp(&batch[0], kBatchSize));
+    }
+    uint32 elapsed = talk_base::TimeSince(start);
+    int64 bits = static_cast<int64>(kNumBatches) * kBatchSize * kPayloadLen * 8;
+    LOG(LS_INFO) << cs << ": " << kNumBatches * kBatchSize
+                 << " packets protected and unprotected in " << elapsed
+                 << " ms, " << (elapsed ? bits / 1000 / elapsed : 0)
+                 << " Mbps";
+  }
+}
+
 class SrtpStatTest
     : public testing::Test,
       public sigslot::has_slots<> {
@@ -861,3 +1045,70 @@ TEST_F(SrtpStatTest, TestUnprotectRtcpError) {
   EXPECT_EQ(cricket::SrtpFilter::UNPROTECT, mode_);
   EXPECT_EQ(cricket::SrtpFilter::ERROR_FAIL, error_);
 }
+
+// Test that failures are counted per SSRC, mode and error.
+TEST_F(SrtpStatTest, TestFailureStats) {
+  std::vector<cricket::SrtpFailureStats> stats;
+  srtp_stat_.AddProtectRtpResult(1, err_status_ok);
+  srtp_stat_.GetFailureStats(&stats);
+  EXPECT_TRUE(stats.empty());
+
+  srtp_stat_.AddProtectRtpResult(1, err_status_fail);
+  srtp_stat_.AddUnprotectRtpResult(1, err_status_auth_fail);
+  for (int i = 0; i < 3; ++i) {
+    srtp_stat_.AddUnprotectRtpResult(2, err_status_replay_old);
+  }
+  srtp_stat_.AddUnprotectRtcpResult(err_status_auth_fail);
+  srtp_stat_.GetFailureStats(&stats);
+  ASSERT_EQ(3U, stats.size());
+  for (size_t i = 0; i < stats.size(); ++i) {
+    const cricket::SrtpFailureStats& stat = stats[i];
+    EXPECT_FALSE(stat.overflow);
+    if (stat.ssrc == 1U) {
+      EXPECT_EQ(1, stat.count(cricket::SrtpFilter::PROTECT,
+                              cricket::SrtpFilter::ERROR_FAIL));
+      EXPECT_EQ(1, stat.count(cricket::SrtpFilter::UNPROTECT,
+                              cricket::SrtpFilter::ERROR_AUTH));
+      EXPECT_EQ(0, stat.count(cricket::SrtpFilter::UNPROTECT,
+                              cricket::SrtpFilter::ERROR_REPLAY));
+    } else if (stat.ssrc == 2U) {
+      EXPECT_EQ(3, stat.count(cricket::SrtpFilter::UNPROTECT,
+                              cricket::SrtpFilter::ERROR_REPLAY));
+    } else {
+      EXPECT_EQ(0U, stat.ssrc);
+      EXPECT_EQ(1, stat.count(cricket::SrtpFilter::UNPROTECT,
+                              cricket::SrtpFilter::ERROR_AUTH));
+    }
+  }
+}
+
+// Test that the SSRCs beyond the table size share one entry, which also
+// limits how often their failures are signaled.
+TEST_F(SrtpStatTest, TestFailureStatsOverflow) {
+  const int kNumSsrcs = cricket::SrtpStat::kMaxSsrcs + 4;
+  for (int i = 0; i < kNumSsrcs; ++i) {
+    Reset();
+    srtp_stat_.AddUnprotectRtpResult(1000 + i, err_status_auth_fail);
+    if (i <= cricket::SrtpStat::kMaxSsrcs) {
+      EXPECT_EQ(static_cast<uint32>(1000 + i), ssrc_);
+    } else {
+      EXPECT_EQ(0U, ssrc_);
+    }
+  }
+  std::vector<cricket::SrtpFailureStats> stats;
+  srtp_stat_.GetFailureStats(&stats);
+  ASSERT_EQ(static_cast<size_t>(cricket::SrtpStat::kMaxSsrcs + 1),
+            stats.size());
+  int total = 0;
+  int overflow = 0;
+  for (size_t i = 0; i < stats.size(); ++i) {
+    int count = stats[i].count(cricket::SrtpFilter::UNPROTECT,
+                               cricket::SrtpFilter::ERROR_AUTH);
+    total += count;
+    if (stats[i].overflow) {
+      overflow += count;
+    }
+  }
+  EXPECT_EQ(kNumSsrcs, total);
+  EXPECT_EQ(kNumSsrcs - cricket::SrtpStat::kMaxSsrcs, overflow);
+}
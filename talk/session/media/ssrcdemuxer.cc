@@ -0,0 +1,322 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "talk/session/media/ssrcdemuxer.h"
+
+#include "talk/base/byteorder.h"
+#include "talk/base/common.h"
+#include "talk/base/logging.h"
+#include "talk/media/base/rtputils.h"
+#include "talk/p2p/base/transportchannel.h"
+
+namespace cricket {
+
+static const int kRtpVersion = 2;
+static const uint32 kSsrc01 = 0x01;
+// Where the SSRC of the first report block, or the SSRC of the media source
+// of a feedback message (RFC 4585), is found.
+static const size_t kRtcpSrReportBlockOffset = 28;
+static const size_t kRtcpRrReportBlockOffset = 8;
+static const size_t kRtcpMediaSourceOffset = 8;
+
+SsrcDemuxer::SsrcDemuxer() : transport_(NULL) {
+}
+
+SsrcDemuxer::~SsrcDemuxer() {
+  ASSERT(sinks_.empty());
+  Listen(NULL);
+}
+
+bool SsrcDemuxer::AddSink(Sink* sink, TransportChannel* transport) {
+  if (HasSink(sink)) {
+    LOG(LS_WARNING) << "Sink already added to demuxer";
+    return false;
+  }
+  SinkInfo info;
+  info.sink = sink;
+  info.transport = transport;
+  sinks_.push_back(info);
+  if (!transport_) {
+    Listen(transport);
+  }
+  return true;
+}
+
+bool SsrcDemuxer::RemoveSink(Sink* sink) {
+  std::vector<SinkInfo>::iterator it = sinks_.begin();
+  for (; it != sinks_.end() && it->sink != sink; ++it) {}
+  if (it == sinks_.end()) {
+    return false;
+  }
+  for (size_t i = 0; i < it->recv_streams.size(); ++i) {
+    const std::vector<uint32>& ssrcs = it->recv_streams[i].ssrcs;
+    for (size_t j = 0; j < ssrcs.size(); ++j) {
+      Sink** owner = recv_ssrcs_.Find(ssrcs[j]);
+      if (owner && *owner == sink) {
+        recv_ssrcs_.Erase(ssrcs[j]);
+      }
+    }
+  }
+  TransportChannel* transport = it->transport;
+  sinks_.erase(it);
+  RebuildSendSsrcs();
+  RebuildPayloadTypes();
+
+  // Bundled transports carry the same packets, so keep reading from the
+  // transport of any remaining sink.
+  if (transport && transport == transport_) {
+    TransportChannel* next = NULL;
+    for (size_t i = 0; i < sinks_.size() && !next; ++i) {
+      next = sinks_[i].transport;
+    }
+    Listen(next);
+  }
+  return true;
+}
+
+bool SsrcDemuxer::HasSink(Sink* sink) const {
+  for (size_t i = 0; i < sinks_.size(); ++i) {
+    if (sinks_[i].sink == sink) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SsrcDemuxer::AddRecvStream(Sink* sink, const StreamParams& stream) {
+  SinkInfo* info = GetSinkInfo(sink);
+  if (!info || GetStreamBySsrc(info->recv_streams, stream.first_ssrc(), NULL)) {
+    return false;
+  }
+  info->recv_streams.push_back(stream);
+  for (size_t i = 0; i < stream.ssrcs.size(); ++i) {
+    if (stream.ssrcs[i] != 0 && !recv_ssrcs_.Insert(stream.ssrcs[i], sink) &&
+        *recv_ssrcs_.Find(stream.ssrcs[i]) != sink) {
+      LOG(LS_WARNING) << "SSRC " << stream.ssrcs[i]
+                      << " is already received by another channel";
+    }
+  }
+  return true;
+}
+
+bool SsrcDemuxer::RemoveRecvStream(Sink* sink, uint32 ssrc) {
+  SinkInfo* info = GetSinkInfo(sink);
+  StreamParams stream;
+  if (!info || !GetStreamBySsrc(info->recv_streams, ssrc, &stream)) {
+    return false;
+  }
+  for (size_t i = 0; i < stream.ssrcs.size(); ++i) {
+    Sink** owner = recv_ssrcs_.Find(stream.ssrcs[i]);
+    if (owner && *owner == sink) {
+      recv_ssrcs_.Erase(stream.ssrcs[i]);
+    }
+  }
+  RemoveStreamBySsrc(&info->recv_streams, ssrc);
+  return true;
+}
+
+void SsrcDemuxer::SetSendStreams(Sink* sink,
+                                 const std::vector<StreamParams>& streams) {
+  SinkInfo* info = GetSinkInfo(sink);
+  if (info) {
+    info->send_streams = streams;
+    RebuildSendSsrcs();
+  }
+}
+
+void SsrcDemuxer::SetPayloadTypes(Sink* sink,
+                                  const std::vector<int>& payload_types) {
+  SinkInfo* info = GetSinkInfo(sink);
+  if (info) {
+    info->payload_types = payload_types;
+    RebuildPayloadTypes();
+  }
+}
+
+SsrcDemuxer::Sink* SsrcDemuxer::FindSink(const char* data, size_t len) const {
+  Fallback fallback;
+  return Match(data, len, &fallback);
+}
+
+void SsrcDemuxer::DemuxPacket(const char* data, size_t len) {
+  Fallback fallback;
+  Sink* sink = Match(data, len, &fallback);
+  if (sink) {
+    sink->OnDemuxedPacket(data, len, true);
+  } else {
+    Deliver(fallback, data, len);
+  }
+}
+
+void SsrcDemuxer::OnReadPacket(TransportChannel* channel, const char* data,
+                               size_t len, int flags) {
+  ASSERT(channel == transport_);
+  DemuxPacket(data, len);
+}
+
+SsrcDemuxer::Sink* SsrcDemuxer::Match(const char* data, size_t len,
+                                      Fallback* fallback) const {
+  *fallback = FALLBACK_UNFILTERED;
+  int version = 0;
+  if (len < 2 || !GetRtpVersion(data, len, &version) ||
+      version != kRtpVersion) {
+    // Not RTP or RTCP, e.g. SCTP data; leave it to the sinks.
+    *fallback = FALLBACK_ALL;
+    return NULL;
+  }
+
+  // RTCP packet types map to payload types 64-95 when muxed (RFC 5761).
+  int type = static_cast<uint8>(data[1]) & 0x7F;
+  if (type >= 64 && type < 96) {
+    return MatchRtcp(data, len, fallback);
+  }
+
+  uint32 ssrc = 0;
+  if (GetRtpSsrc(data, len, &ssrc)) {
+    Sink* const* sink = recv_ssrcs_.Find(ssrc);
+    if (sink) {
+      return *sink;
+    }
+  }
+  int payload_type = 0;
+  if (GetRtpPayloadType(data, len, &payload_type)) {
+    Sink* const* sink = payload_types_.Find(payload_type);
+    if (sink) {
+      return *sink;
+    }
+  }
+  return NULL;
+}
+
+SsrcDemuxer::Sink* SsrcDemuxer::MatchRtcp(const char* data, size_t len,
+                                          Fallback* fallback) const {
+  int type = 0;
+  if (!GetRtcpType(data, len, &type)) {
+    return NULL;
+  }
+  if (type == kRtcpTypeSDES) {
+    // SDES packet parsing not supported.
+    *fallback = FALLBACK_ALL;
+    return NULL;
+  }
+  uint32 ssrc = 0;
+  if (!GetRtcpSsrc(data, len, &ssrc)) {
+    return NULL;
+  }
+  if (ssrc == kSsrc01) {
+    // Generic feedback on some systems, which every sink accepts.
+    *fallback = FALLBACK_ALL;
+    return NULL;
+  }
+  Sink* const* sink = recv_ssrcs_.Find(ssrc);
+  if (sink) {
+    return *sink;
+  }
+
+  // Reports and feedback from a receive-only peer; route them by the SSRC
+  // of our stream they refer to.
+  size_t offset = 0;
+  int count = static_cast<uint8>(data[0]) & 0x1F;
+  if (type == kRtcpTypeSR && count > 0) {
+    offset = kRtcpSrReportBlockOffset;
+  } else if (type == kRtcpTypeRR && count > 0) {
+    offset = kRtcpRrReportBlockOffset;
+  } else if (type == kRtcpTypeRTPFB || type == kRtcpTypePSFB) {
+    offset = kRtcpMediaSourceOffset;
+  }
+  if (offset > 0 && len >= offset + 4) {
+    ssrc = talk_base::GetBE32(data + offset);
+    sink = send_ssrcs_.Find(ssrc);
+    if (sink) {
+      return *sink;
+    }
+  }
+  return NULL;
+}
+
+void SsrcDemuxer::Deliver(Fallback fallback, const char* data, size_t len) {
+  // Pick the sinks before delivering, as a sink may leave, or add and remove
+  // streams, while handling the packet.
+  std::vector<Sink*> targets;
+  for (size_t i = 0; i < sinks_.size(); ++i) {
+    if (fallback == FALLBACK_ALL || sinks_[i].recv_streams.empty()) {
+      targets.push_back(sinks_[i].sink);
+    }
+  }
+  for (size_t i = 0; i < targets.size(); ++i) {
+    if (HasSink(targets[i])) {
+      targets[i]->OnDemuxedPacket(data, len, false);
+    }
+  }
+}
+
+SsrcDemuxer::SinkInfo* SsrcDemuxer::GetSinkInfo(Sink* sink) {
+  for (size_t i = 0; i < sinks_.size(); ++i) {
+    if (sinks_[i].sink == sink) {
+      return &sinks_[i];
+    }
+  }
+  return NULL;
+}
+
+void SsrcDemuxer::Listen(TransportChannel* transport) {
+  if (transport == transport_) {
+    return;
+  }
+  if (transport_) {
+    transport_->SignalReadPacket.disconnect(this);
+  }
+  transport_ = transport;
+  if (transport_) {
+    transport_->SignalReadPacket.connect(this, &SsrcDemuxer::OnReadPacket);
+  }
+}
+
+void SsrcDemuxer::RebuildSendSsrcs() {
+  send_ssrcs_.Clear();
+  for (size_t i = 0; i < sinks_.size(); ++i) {
+    const std::vector<StreamParams>& streams = sinks_[i].send_streams;
+    for (size_t j = 0; j < streams.size(); ++j) {
+      for (size_t k = 0; k < streams[j].ssrcs.size(); ++k) {
+        send_ssrcs_.Insert(streams[j].ssrcs[k], sinks_[i].sink);
+      }
+    }
+  }
+}
+
+void SsrcDemuxer::RebuildPayloadTypes() {
+  // If two sinks receive the same payload type the first one added wins.
+  payload_types_.Clear();
+  for (size_t i = 0; i < sinks_.size(); ++i) {
+    const std::vector<int>& payload_types = sinks_[i].payload_types;
+    for (size_t j = 0; j < payload_types.size(); ++j) {
+      payload_types_.Insert(payload_types[j], sinks_[i].sink);
+    }
+  }
+}
+
+}  // namespace cricket
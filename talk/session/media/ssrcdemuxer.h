@@ -0,0 +1,138 @@
+/*
+ * libjingle
+ * Copyright 2013, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TALK_SESSION_MEDIA_SSRCDEMUXER_H_
+#define TALK_SESSION_MEDIA_SSRCDEMUXER_H_
+
+#include <vector>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/flathashmap.h"
+#include "talk/base/sigslot.h"
+#include "talk/media/base/streamparams.h"
+
+namespace cricket {
+
+class TransportChannel;
+
+// Demultiplexes the packets of a transport channel shared by several
+// BaseChannels, as happens when contents are bundled. Without it every
+// bundled channel is handed every packet and runs it through its own
+// SsrcMuxFilter; with it each packet is looked up once in a single SSRC table
+// and handed only to the channel that owns the stream.
+//
+// RTP packets are matched by SSRC, falling back to the payload type for
+// SSRCs that were never signaled. RTCP packets are matched by the sender SSRC
+// against the receive streams, and failing that by the first report block or
+// the feedback media source against the send streams, so that reports about
+// our own streams reach the channel sending them. SRTCP encrypts the latter
+// fields, so that fallback only applies to unencrypted RTCP. Packets that
+// can't be attributed go where the per-channel filters would have let them
+// through: SDES and SSRC 1 reports to every sink, anything else to the sinks
+// that have no receive streams.
+//
+// All methods must be called on the worker thread of the channels.
+class SsrcDemuxer : public sigslot::has_slots<> {
+ public:
+  class Sink {
+   public:
+    // Called with a packet from the transport. |matched| is true if the
+    // packet was attributed to this sink, and false if the sink should still
+    // apply its own filtering.
+    virtual void OnDemuxedPacket(const char* data, size_t len,
+                                 bool matched) = 0;
+
+   protected:
+    virtual ~Sink() {}
+  };
+
+  SsrcDemuxer();
+  ~SsrcDemuxer();
+
+  // Adds a sink whose packets arrive on |transport|. The transports of all
+  // sinks must carry the same packets; the demuxer reads from one of them
+  // and moves to another if that sink is removed. |transport| may be NULL if
+  // packets are fed through DemuxPacket.
+  bool AddSink(Sink* sink, TransportChannel* transport);
+  // Removes |sink| together with its streams and payload types. Sinks must
+  // be removed before the demuxer is destroyed.
+  bool RemoveSink(Sink* sink);
+  bool HasSink(Sink* sink) const;
+
+  // Adds or removes a stream received by |sink|. An SSRC that another sink
+  // already receives is not reassigned.
+  bool AddRecvStream(Sink* sink, const StreamParams& stream);
+  bool RemoveRecvStream(Sink* sink, uint32 ssrc);
+  // Replaces the streams sent by |sink|, used to route RTCP feedback.
+  void SetSendStreams(Sink* sink, const std::vector<StreamParams>& streams);
+  // Replaces the RTP payload types received by |sink|.
+  void SetPayloadTypes(Sink* sink, const std::vector<int>& payload_types);
+
+  // Returns the sink a packet would be delivered to alone, or NULL if it
+  // would be offered to several sinks or dropped.
+  Sink* FindSink(const char* data, size_t len) const;
+  // Delivers a packet to its sink(s).
+  void DemuxPacket(const char* data, size_t len);
+
+ private:
+  struct SinkInfo {
+    SinkInfo() : sink(NULL), transport(NULL) {}
+    Sink* sink;
+    TransportChannel* transport;
+    std::vector<StreamParams> recv_streams;
+    std::vector<StreamParams> send_streams;
+    std::vector<int> payload_types;
+  };
+  typedef talk_base::FlatHashMap<uint32, Sink*> SsrcMap;
+  typedef talk_base::FlatHashMap<int, Sink*> PayloadTypeMap;
+
+  // Who gets a packet that couldn't be matched to a single sink.
+  enum Fallback {
+    FALLBACK_ALL,         // Every sink, each applying its own filter.
+    FALLBACK_UNFILTERED,  // Sinks without receive streams.
+  };
+
+  void OnReadPacket(TransportChannel* channel, const char* data, size_t len,
+                    int flags);
+  Sink* Match(const char* data, size_t len, Fallback* fallback) const;
+  Sink* MatchRtcp(const char* data, size_t len, Fallback* fallback) const;
+  void Deliver(Fallback fallback, const char* data, size_t len);
+  SinkInfo* GetSinkInfo(Sink* sink);
+  void Listen(TransportChannel* transport);
+  void RebuildSendSsrcs();
+  void RebuildPayloadTypes();
+
+  std::vector<SinkInfo> sinks_;
+  SsrcMap recv_ssrcs_;
+  SsrcMap send_ssrcs_;
+  PayloadTypeMap payload_types_;
+  TransportChannel* transport_;
+};
+
+}  // namespace cricket
+
+#endif  // TALK_SESSION_MEDIA_SSRCDEMUXER_H_
@@ -76,10 +76,20 @@ bool SsrcMuxFilter::AddStream(const StreamParams& stream) {
       return false;
   }
   streams_.push_back(stream);
+  for (size_t i = 0; i < stream.ssrcs.size(); ++i) {
+    ssrcs_.Insert(stream.ssrcs[i], true);
+  }
   return true;
 }
 
 bool SsrcMuxFilter::RemoveStream(uint32 ssrc) {
+  StreamParams stream;
+  if (!GetStreamBySsrc(streams_, ssrc, &stream)) {
+    return false;
+  }
+  for (size_t i = 0; i < stream.ssrcs.size(); ++i) {
+    ssrcs_.Erase(stream.ssrcs[i]);
+  }
   return RemoveStreamBySsrc(&streams_, ssrc);
 }
 
@@ -87,7 +97,7 @@ bool SsrcMuxFilter::FindStream(uint32 ssrc) const {
   if (ssrc == 0) {
     return false;
   }
-  return (GetStreamBySsrc(streams_, ssrc, NULL));
+  return ssrcs_.Find(ssrc) != NULL;
 }
 
 }  // namespace cricket
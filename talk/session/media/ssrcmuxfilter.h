@@ -31,6 +31,7 @@
 #include <vector>
 
 #include "talk/base/basictypes.h"
+#include "talk/base/flathashmap.h"
 #include "talk/media/base/streamparams.h"
 
 namespace cricket {
@@ -40,7 +41,8 @@ namespace cricket {
 // ( or media) channels share a common transport channel. Hence they all get
 // SignalReadPacket when packet received on transport channel. This requires
 // cricket::BaseChannel to know all the valid sources, else media channel
-// will decode invalid packets.
+// will decode invalid packets. SsrcDemuxer does the same job once per
+// packet for all the channels on a transport.
 class SsrcMuxFilter {
  public:
   SsrcMuxFilter();
@@ -57,9 +59,12 @@ class SsrcMuxFilter {
   bool RemoveStream(uint32 ssrc);
   // Utility method added for unitest.
   bool FindStream(uint32 ssrc) const;
+  const std::vector<StreamParams>& streams() const { return streams_; }
 
  private:
   std::vector<StreamParams> streams_;
+  // Every SSRC of |streams_|, so that packets are matched in constant time.
+  talk_base::FlatHashMap<uint32, bool> ssrcs_;
 };
 
 }  // namespace cricket
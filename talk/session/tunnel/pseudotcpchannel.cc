@@ -29,7 +29,9 @@
 #include "talk/base/basictypes.h"
 #include "talk/base/common.h"
 #include "talk/base/logging.h"
+#include "talk/base/packetbuffer.h"
 #include "talk/base/scoped_ptr.h"
+#include "talk/base/scoped_ref_ptr.h"
 #include "talk/base/stringutils.h"
 #include "talk/p2p/base/candidate.h"
 #include "talk/p2p/base/transportchannel.h"
@@ -48,6 +50,7 @@ extern const talk_base::ConstantLabel SESSION_STATES[];
 enum {
   MSG_WK_CLOCK = 1,
   MSG_WK_PURGE,
+  MSG_WK_PUMP,
   MSG_ST_EVENT,
   MSG_SI_DESTROYCHANNEL,
   MSG_SI_DESTROY,
@@ -58,6 +61,9 @@ struct EventData : public MessageData {
   EventData(int ev, int err = 0) : event(ev), error(err) { }
 };
 
+// Size of each of the rings between the stream and worker threads.
+static const size_t kRingSize = 64 * 1024;
+
 ///////////////////////////////////////////////////////////////////////////////
 // PseudoTcpChannel::InternalStream
 ///////////////////////////////////////////////////////////////////////////////
@@ -103,9 +109,11 @@ PseudoTcpChannel::PseudoTcpChannel(Thread* stream_thread, Session* session)
   : signal_thread_(session->session_manager()->signaling_thread()),
     worker_thread_(NULL),
     stream_thread_(stream_thread),
-    session_(session), channel_(NULL), tcp_(NULL), stream_(NULL),
-    stream_readable_(false), pending_read_event_(false),
-    ready_to_connect_(false) {
+    session_(session), channel_(NULL), tcp_(NULL),
+    clock_deadline_(0), clock_pending_(false), stream_(NULL),
+    ready_to_connect_(false), close_pending_(false),
+    send_ring_(kRingSize), recv_ring_(kRingSize),
+    stream_state_(SS_OPENING), write_blocked_(0), recv_full_(0) {
   ASSERT(signal_thread_->IsCurrent());
   ASSERT(NULL != session_);
 }
@@ -176,9 +184,11 @@ void PseudoTcpChannel::OnChannelDestroyed(TransportChannel* channel) {
   // When MSG_WK_PURGE is received, we know there will be no more messages from
   // the worker thread.
   worker_thread_->Clear(this, MSG_WK_CLOCK);
+  clock_pending_ = false;
   worker_thread_->Post(this, MSG_WK_PURGE);
   session_ = NULL;
   channel_ = NULL;
+  PublishState();
   if ((stream_ != NULL)
       && ((tcp_ == NULL) || (tcp_->State() != PseudoTcp::TCP_CLOSED)))
     stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_CLOSE, 0));
@@ -198,6 +208,7 @@ void PseudoTcpChannel::OnSessionTerminate(Session* session) {
     ASSERT(tcp_ == NULL);
     LOG(LS_INFO) << "Destroying unconnected PseudoTcpChannel";
     session_ = NULL;
+    PublishState();
     if (stream_ != NULL)
       stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_CLOSE, -1));
   }
@@ -229,75 +240,58 @@ void PseudoTcpChannel::SetOption(PseudoTcp::Option opt, int value) {
 
 StreamState PseudoTcpChannel::GetState() const {
   ASSERT(stream_ != NULL && stream_thread_->IsCurrent());
-  CritScope lock(&cs_);
-  if (!session_)
-    return SS_CLOSED;
-  if (!tcp_)
-    return SS_OPENING;
-  switch (tcp_->State()) {
-    case PseudoTcp::TCP_LISTEN:
-    case PseudoTcp::TCP_SYN_SENT:
-    case PseudoTcp::TCP_SYN_RECEIVED:
-      return SS_OPENING;
-    case PseudoTcp::TCP_ESTABLISHED:
-      return SS_OPEN;
-    case PseudoTcp::TCP_CLOSED:
-    default:
-      return SS_CLOSED;
-  }
+  return static_cast<StreamState>(AtomicOps::AcquireLoad(&stream_state_));
 }
 
 StreamResult PseudoTcpChannel::Read(void* buffer, size_t buffer_len,
                                     size_t* read, int* error) {
   ASSERT(stream_ != NULL && stream_thread_->IsCurrent());
-  CritScope lock(&cs_);
-  if (!tcp_)
-    return SR_BLOCK;
-
-  stream_readable_ = false;
-  int result = tcp_->Recv(static_cast<char*>(buffer), buffer_len);
-  //LOG_F(LS_VERBOSE) << "Recv returned: " << result;
+  size_t result = recv_ring_.Read(buffer, buffer_len);
   if (result > 0) {
     if (read)
       *read = result;
+    // The worker stops filling the ring when it is full; let it resume.
+    if (AtomicOps::CompareAndSwap(&recv_full_, 1, 0) == 1)
+      RequestPump();
     // PseudoTcp doesn't currently support repeated Readable signals.  Simulate
     // them here.
-    stream_readable_ = true;
-    if (!pending_read_event_) {
-      pending_read_event_ = true;
+    if (recv_ring_.ReadAvailable() > 0 && read_event_post_.Request()) {
       stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_READ), true);
     }
     return SR_SUCCESS;
-  } else if (IsBlockingError(tcp_->GetError())) {
+  } else if (GetState() != SS_CLOSED) {
     return SR_BLOCK;
   } else {
     if (error)
-      *error = tcp_->GetError();
+      *error = ENOTCONN;
     return SR_ERROR;
   }
-  // This spot is never reached.
 }
 
 StreamResult PseudoTcpChannel::Write(const void* data, size_t data_len,
                                      size_t* written, int* error) {
   ASSERT(stream_ != NULL && stream_thread_->IsCurrent());
-  CritScope lock(&cs_);
-  if (!tcp_)
-    return SR_BLOCK;
-  int result = tcp_->Send(static_cast<const char*>(data), data_len);
-  //LOG_F(LS_VERBOSE) << "Send returned: " << result;
-  if (result > 0) {
-    if (written)
-      *written = result;
-    return SR_SUCCESS;
-  } else if (IsBlockingError(tcp_->GetError())) {
+  StreamState state = GetState();
+  if (state == SS_OPENING) {
     return SR_BLOCK;
-  } else {
+  } else if (state == SS_CLOSED) {
     if (error)
-      *error = tcp_->GetError();
+      *error = ENOTCONN;
     return SR_ERROR;
   }
-  // This spot is never reached.
+  size_t result = send_ring_.Write(data, data_len);
+  if (result == 0) {
+    // Ask for SE_WRITE, then look again in case the worker drained the ring
+    // before it could see the request.
+    AtomicOps::ReleaseStore(&write_blocked_, 1);
+    result = send_ring_.Write(data, data_len);
+    if (result == 0)
+      return SR_BLOCK;
+  }
+  if (written)
+    *written = result;
+  RequestPump();
+  return SR_SUCCESS;
 }
 
 void PseudoTcpChannel::Close() {
@@ -307,13 +301,25 @@ void PseudoTcpChannel::Close() {
   // Clear out any pending event notifications
   stream_thread_->Clear(this, MSG_ST_EVENT);
   if (tcp_) {
-    tcp_->Close(false);
-    AdjustClock();
+    // The worker closes tcp_ once it has sent what is left in send_ring_.
+    close_pending_ = true;
+    worker_thread_->Post(this, MSG_WK_PUMP);
   } else {
     CheckDestroy();
   }
 }
 
+void PseudoTcpChannel::RequestPump() {
+  if (!pump_post_.Request())
+    return;
+  CritScope lock(&cs_);
+  if (tcp_) {
+    worker_thread_->Post(this, MSG_WK_PUMP);
+  } else {
+    pump_post_.Clear();
+  }
+}
+
 //
 // Worker thread methods
 //
@@ -392,14 +398,76 @@ void PseudoTcpChannel::OnChannelConnectionChanged(TransportChannel* channel,
   AdjustClock();
 }
 
+void PseudoTcpChannel::PumpStreams() {
+  ASSERT(cs_.CurrentThreadIsOwner());
+  ASSERT(worker_thread_->IsCurrent());
+  ASSERT(NULL != tcp_);
+  bool established = (tcp_->State() == PseudoTcp::TCP_ESTABLISHED);
+  if (established) {
+    FlushSendRing();
+    FillRecvRing();
+  }
+  if (close_pending_ && (!established || send_ring_.ReadAvailable() == 0)) {
+    close_pending_ = false;
+    tcp_->Close(false);
+  }
+}
+
+void PseudoTcpChannel::FlushSendRing() {
+  while (true) {
+    size_t len;
+    const void* data = send_ring_.GetReadData(&len);
+    if (len == 0)
+      break;
+    int sent = tcp_->Send(static_cast<const char*>(data), len);
+    // When tcp_ is full, OnTcpWriteable brings us back.
+    if (sent <= 0)
+      break;
+    send_ring_.ConsumeReadData(sent);
+  }
+  if (stream_ && send_ring_.WriteRemaining() > 0 &&
+      AtomicOps::CompareAndSwap(&write_blocked_, 1, 0) == 1) {
+    stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_WRITE));
+  }
+}
+
+void PseudoTcpChannel::FillRecvRing() {
+  if (!stream_)
+    return;
+  bool filled = false;
+  while (true) {
+    size_t space = recv_ring_.WriteRemaining();
+    if (space == 0) {
+      // Have the reader call us back, then look again in case it drained the
+      // ring before it could see the flag.
+      AtomicOps::ReleaseStore(&recv_full_, 1);
+      if (recv_ring_.WriteRemaining() == 0)
+        break;
+      continue;
+    }
+    // Copy straight out of the PseudoTcp receive buffer. When it is empty,
+    // OnTcpReadable brings us back.
+    size_t len;
+    const char* data = tcp_->PeekRecv(&len);
+    if (!data)
+      break;
+    size_t count = recv_ring_.Write(data, _min(len, space));
+    tcp_->ConsumeRecv(count);
+    filled = true;
+  }
+  if (filled && read_event_post_.Request())
+    stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_READ));
+}
+
 void PseudoTcpChannel::OnTcpOpen(PseudoTcp* tcp) {
   LOG_F(LS_VERBOSE) << "[" << channel_name_ << "]";
   ASSERT(cs_.CurrentThreadIsOwner());
   ASSERT(worker_thread_->IsCurrent());
   ASSERT(tcp == tcp_);
+  PublishState();
   if (stream_) {
-    stream_readable_ = true;
-    pending_read_event_ = true;
+    // Posted whether or not an SE_READ is already pending.
+    read_event_post_.Request();
     stream_thread_->Post(this, MSG_ST_EVENT,
                          new EventData(SE_OPEN | SE_READ | SE_WRITE));
   }
@@ -410,13 +478,7 @@ void PseudoTcpChannel::OnTcpReadable(PseudoTcp* tcp) {
   ASSERT(cs_.CurrentThreadIsOwner());
   ASSERT(worker_thread_->IsCurrent());
   ASSERT(tcp == tcp_);
-  if (stream_) {
-    stream_readable_ = true;
-    if (!pending_read_event_) {
-      pending_read_event_ = true;
-      stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_READ));
-    }
-  }
+  PumpStreams();
 }
 
 void PseudoTcpChannel::OnTcpWriteable(PseudoTcp* tcp) {
@@ -424,8 +486,7 @@ void PseudoTcpChannel::OnTcpWriteable(PseudoTcp* tcp) {
   ASSERT(cs_.CurrentThreadIsOwner());
   ASSERT(worker_thread_->IsCurrent());
   ASSERT(tcp == tcp_);
-  if (stream_)
-    stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_WRITE));
+  PumpStreams();
 }
 
 void PseudoTcpChannel::OnTcpClosed(PseudoTcp* tcp, uint32 nError) {
@@ -433,6 +494,7 @@ void PseudoTcpChannel::OnTcpClosed(PseudoTcp* tcp, uint32 nError) {
   ASSERT(cs_.CurrentThreadIsOwner());
   ASSERT(worker_thread_->IsCurrent());
   ASSERT(tcp == tcp_);
+  PublishState();
   if (stream_)
     stream_thread_->Post(this, MSG_ST_EVENT, new EventData(SE_CLOSE, nError));
 }
@@ -447,9 +509,20 @@ void PseudoTcpChannel::OnMessage(Message* pmsg) {
     ASSERT(worker_thread_->IsCurrent());
     //LOG(LS_INFO) << "PseudoTcpChannel::OnMessage(MSG_WK_CLOCK)";
     CritScope lock(&cs_);
+    clock_pending_ = false;
     if (tcp_) {
       tcp_->NotifyClock(PseudoTcp::Now());
-      AdjustClock(false);
+      AdjustClock();
+    }
+
+  } else if (pmsg->message_id == MSG_WK_PUMP) {
+
+    ASSERT(worker_thread_->IsCurrent());
+    pump_post_.Clear();
+    CritScope lock(&cs_);
+    if (tcp_) {
+      PumpStreams();
+      AdjustClock();
     }
 
   } else if (pmsg->message_id == MSG_WK_PURGE) {
@@ -470,10 +543,8 @@ void PseudoTcpChannel::OnMessage(Message* pmsg) {
     //             << data->event << ", " << data->error << ")";
     ASSERT(stream_ != NULL);
     EventData* data = static_cast<EventData*>(pmsg->pdata);
-    if (data->event & SE_READ) {
-      CritScope lock(&cs_);
-      pending_read_event_ = false;
-    }
+    if (data->event & SE_READ)
+      read_event_post_.Clear();
     stream_->SignalEvent(stream_, data->event, data->error);
     delete data;
 
@@ -502,7 +573,29 @@ IPseudoTcpNotify::WriteResult PseudoTcpChannel::TcpWritePacket(
   ASSERT(cs_.CurrentThreadIsOwner());
   ASSERT(tcp == tcp_);
   ASSERT(NULL != channel_);
-  int sent = channel_->SendPacket(buffer, len);
+  return CheckWriteResult(channel_->SendPacket(buffer, len));
+}
+
+IPseudoTcpNotify::WriteResult PseudoTcpChannel::TcpWritePacketV(
+    PseudoTcp* tcp, const PacketFragment* fragments, size_t count) {
+  ASSERT(cs_.CurrentThreadIsOwner());
+  ASSERT(tcp == tcp_);
+  ASSERT(NULL != channel_);
+  size_t len = 0;
+  for (size_t i = 0; i < count; ++i) {
+    len += fragments[i].len;
+  }
+  talk_base::scoped_refptr<talk_base::PacketBuffer> packet(
+      talk_base::PacketBuffer::Create(len));
+  char* pos = packet->data();
+  for (size_t i = 0; i < count; ++i) {
+    memcpy(pos, fragments[i].data, fragments[i].len);
+    pos += fragments[i].len;
+  }
+  return CheckWriteResult(channel_->SendBuffer(packet.get(), 0));
+}
+
+IPseudoTcpNotify::WriteResult PseudoTcpChannel::CheckWriteResult(int sent) {
   if (sent > 0) {
     //LOG_F(LS_VERBOSE) << "(" << sent << ") Sent";
     return IPseudoTcpNotify::WR_SUCCESS;
@@ -519,23 +612,35 @@ IPseudoTcpNotify::WriteResult PseudoTcpChannel::TcpWritePacket(
   }
 }
 
-void PseudoTcpChannel::AdjustClock(bool clear) {
+void PseudoTcpChannel::AdjustClock() {
   ASSERT(cs_.CurrentThreadIsOwner());
   ASSERT(NULL != tcp_);
 
+  uint32 now = PseudoTcp::Now();
   long timeout = 0;
-  if (tcp_->GetNextClock(PseudoTcp::Now(), timeout)) {
+  if (tcp_->GetNextClock(now, timeout)) {
     ASSERT(NULL != channel_);
-    // Reset the next clock, by clearing the old and setting a new one.
-    if (clear)
-      worker_thread_->Clear(this, MSG_WK_CLOCK);
-    worker_thread_->PostDelayed(_max(timeout, 0L), this, MSG_WK_CLOCK);
+    PublishState();
+    // This runs after every packet, but the deadline rarely moves earlier.
+    // A pending clock that fires no later than needed is left alone; an
+    // early tick costs one NotifyClock, which re-arms it.
+    uint32 deadline = now + _max(timeout, 0L);
+    if (clock_pending_ && TimeIsLaterOrEqual(clock_deadline_, deadline))
+      return;
+    if (clock_pending_)
+      worker_thread_->CancelDelayed(clock_timer_);
+    clock_timer_ = worker_thread_->PostDelayedTimer(_max(timeout, 0L), this,
+                                                    MSG_WK_CLOCK);
+    clock_deadline_ = deadline;
+    clock_pending_ = true;
     return;
   }
 
   delete tcp_;
   tcp_ = NULL;
   ready_to_connect_ = false;
+  close_pending_ = false;
+  PublishState();
 
   if (channel_) {
     // If TCP has failed, no need for channel_ anymore
@@ -543,6 +648,29 @@ void PseudoTcpChannel::AdjustClock(bool clear) {
   }
 }
 
+StreamState PseudoTcpChannel::ComputeState() const {
+  ASSERT(cs_.CurrentThreadIsOwner());
+  if (!session_)
+    return SS_CLOSED;
+  if (!tcp_)
+    return SS_OPENING;
+  switch (tcp_->State()) {
+    case PseudoTcp::TCP_LISTEN:
+    case PseudoTcp::TCP_SYN_SENT:
+    case PseudoTcp::TCP_SYN_RECEIVED:
+      return SS_OPENING;
+    case PseudoTcp::TCP_ESTABLISHED:
+      return SS_OPEN;
+    case PseudoTcp::TCP_CLOSED:
+    default:
+      return SS_CLOSED;
+  }
+}
+
+void PseudoTcpChannel::PublishState() {
+  AtomicOps::ReleaseStore(&stream_state_, ComputeState());
+}
+
 void PseudoTcpChannel::CheckDestroy() {
   ASSERT(cs_.CurrentThreadIsOwner());
   if ((worker_thread_ != NULL) || (stream_ != NULL))
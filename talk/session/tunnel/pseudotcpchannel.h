@@ -29,6 +29,7 @@
 #define TALK_SESSION_TUNNEL_PSEUDOTCPCHANNEL_H_
 
 #include "talk/base/criticalsection.h"
+#include "talk/base/lockfreeringbuffer.h"
 #include "talk/base/messagequeue.h"
 #include "talk/base/stream.h"
 #include "talk/p2p/base/pseudotcp.h"
@@ -55,6 +56,15 @@ class TransportChannel;
 // These indicators are checked by CheckDestroy, invoked whenever one of them
 // changes.
 ///////////////////////////////////////////////////////////////////////////////
+// PseudoTcpChannel threading
+// The PseudoTcp engine runs only on the worker thread, under cs_.  The stream
+// thread doesn't take cs_ per byte: bytes pass through a lock-free ring in
+// each direction, and the worker publishes the stream state for GetState.
+// Once per batch, when it fills an empty send ring or drains a full receive
+// ring, the stream thread takes cs_ briefly in RequestPump to post
+// MSG_WK_PUMP (tcp_ may be going away), and the worker moves as much as it
+// can in one go.
+///////////////////////////////////////////////////////////////////////////////
 // PseudoTcpChannel::GetStream
 // Note: The stream pointer returned by GetStream is owned by the caller.
 // They can close & immediately delete the stream while PseudoTcpChannel still
@@ -100,10 +110,15 @@ class PseudoTcpChannel
                                 size_t* written, int* error);
   void Close();
 
+  // Asks the worker thread to move data between the rings and tcp_.
+  void RequestPump();
+
   // Multi-thread methods
   void OnMessage(talk_base::Message* pmsg);
-  void AdjustClock(bool clear = true);
+  void AdjustClock();
   void CheckDestroy();
+  talk_base::StreamState ComputeState() const;
+  void PublishState();
 
   // Signal thread methods
   void OnChannelDestroyed(TransportChannel* channel);
@@ -115,6 +130,10 @@ class PseudoTcpChannel
   void OnChannelConnectionChanged(TransportChannel* channel,
                                   const Candidate& candidate);
 
+  void PumpStreams();
+  void FlushSendRing();
+  void FillRecvRing();
+
   virtual void OnTcpOpen(PseudoTcp* ptcp);
   virtual void OnTcpReadable(PseudoTcp* ptcp);
   virtual void OnTcpWriteable(PseudoTcp* ptcp);
@@ -122,6 +141,12 @@ class PseudoTcpChannel
   virtual IPseudoTcpNotify::WriteResult TcpWritePacket(PseudoTcp* tcp,
                                                        const char* buffer,
                                                        size_t len);
+  // Gathers the fragments into one pooled PacketBuffer and hands it to the
+  // channel, which frames it in its headroom instead of copying it again.
+  virtual IPseudoTcpNotify::WriteResult TcpWritePacketV(
+      PseudoTcp* tcp, const PacketFragment* fragments, size_t count);
+  // Maps the result of sending a packet on |channel_| to a WriteResult.
+  IPseudoTcpNotify::WriteResult CheckWriteResult(int sent);
 
   talk_base::Thread* signal_thread_, * worker_thread_, * stream_thread_;
   Session* session_;
@@ -129,10 +154,25 @@ class PseudoTcpChannel
   std::string content_name_;
   std::string channel_name_;
   PseudoTcp* tcp_;
+  // The pending MSG_WK_CLOCK on worker_thread_, and when it fires.
+  talk_base::TimerHandle clock_timer_;
+  uint32 clock_deadline_;
+  bool clock_pending_;
   InternalStream* stream_;
-  bool stream_readable_, pending_read_event_;
   bool ready_to_connect_;
+  // The stream has closed; tcp_ closes once the send ring has drained.
+  bool close_pending_;
   mutable talk_base::CriticalSection cs_;
+
+  // Stream thread to worker thread, and back.
+  talk_base::LockFreeRingBuffer send_ring_;
+  talk_base::LockFreeRingBuffer recv_ring_;
+  // Shared between the threads without cs_; see AtomicOps.
+  volatile int stream_state_;  // A StreamState, set by PublishState.
+  talk_base::PostOnce pump_post_;  // Posts MSG_WK_PUMP.
+  talk_base::PostOnce read_event_post_;  // Posts an SE_READ.
+  volatile int write_blocked_;  // The stream found the send ring full.
+  volatile int recv_full_;  // The worker found the receive ring full.
 };
 
 }  // namespace cricket
@@ -105,7 +105,8 @@ struct TunnelContentDescription : public ContentDescription {
 
 TunnelSessionClientBase::TunnelSessionClientBase(const buzz::Jid& jid,
                                 SessionManager* manager, const std::string &ns)
-  : jid_(jid), session_manager_(manager), namespace_(ns), shutdown_(false) {
+  : jid_(jid), session_manager_(manager), namespace_(ns), shutdown_(false),
+    next_stream_thread_(0) {
   session_manager_->AddClient(namespace_, this);
 }
 
@@ -126,7 +127,7 @@ void TunnelSessionClientBase::OnSessionCreate(Session* session, bool received) {
   ASSERT(session_manager_->signaling_thread()->IsCurrent());
   if (received)
     sessions_.push_back(
-        MakeTunnelSession(session, talk_base::Thread::Current(), RESPONDER));
+        MakeTunnelSession(session, NextStreamThread(), RESPONDER));
 }
 
 void TunnelSessionClientBase::OnSessionDestroy(Session* session) {
@@ -184,6 +185,21 @@ void TunnelSessionClientBase::DeclineTunnel(Session* session) {
   session->Reject(STR_TERMINATE_DECLINE);
 }
 
+void TunnelSessionClientBase::SetStreamThreadPool(
+    const std::vector<talk_base::Thread*>& threads) {
+  ASSERT(session_manager_->signaling_thread()->IsCurrent());
+  stream_threads_ = threads;
+  next_stream_thread_ = 0;
+}
+
+talk_base::Thread* TunnelSessionClientBase::NextStreamThread() {
+  if (stream_threads_.empty())
+    return talk_base::Thread::Current();
+  talk_base::Thread* thread = stream_threads_[next_stream_thread_];
+  next_stream_thread_ = (next_stream_thread_ + 1) % stream_threads_.size();
+  return thread;
+}
+
 void TunnelSessionClientBase::OnMessage(talk_base::Message* pmsg) {
   if (pmsg->message_id == MSG_CREATE_TUNNEL) {
     ASSERT(session_manager_->signaling_thread()->IsCurrent());
@@ -75,6 +75,12 @@ public:
   talk_base::StreamInterface* AcceptTunnel(Session* session);
   void DeclineTunnel(Session* session);
 
+  // Spreads incoming tunnels over |threads|, round robin: each tunnel's
+  // stream signals its events, and must be used, on the thread it was given.
+  // By default incoming tunnels use the signaling thread. The threads are
+  // not owned, and must outlive the tunnels. Signaling thread only.
+  void SetStreamThreadPool(const std::vector<talk_base::Thread*>& threads);
+
   // Invoked on an incoming tunnel
   virtual void OnIncomingTunnel(const buzz::Jid &jid, Session *session) = 0;
 
@@ -97,11 +103,16 @@ protected:
                                            talk_base::Thread* stream_thread,
                                            TunnelSessionRole role);
 
+  // Picks the stream thread for an incoming tunnel.
+  talk_base::Thread* NextStreamThread();
+
   buzz::Jid jid_;
   SessionManager* session_manager_;
   std::vector<TunnelSession*> sessions_;
   std::string namespace_;
   bool shutdown_;
+  std::vector<talk_base::Thread*> stream_threads_;
+  size_t next_stream_thread_;
 };
 
 class TunnelSessionClient
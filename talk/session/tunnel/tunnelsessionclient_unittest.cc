@@ -26,6 +26,8 @@
  */
 
 #include <string>
+#include <vector>
+
 #include "talk/base/gunit.h"
 #include "talk/base/messagehandler.h"
 #include "talk/base/scoped_ptr.h"
@@ -68,6 +70,12 @@ class TunnelSessionClientTest : public testing::Test,
         &TunnelSessionClientTest::OnIncomingTunnel);
   }
 
+  // Runs the remote end of the tunnel on |thread| rather than this one.
+  void SetRemoteStreamThread(talk_base::Thread* thread) {
+    remote_client_.SetStreamThreadPool(
+        std::vector<talk_base::Thread*>(1, thread));
+  }
+
   // Transfer the desired amount of data from the local to the remote client.
   void TestTransfer(int size) {
     // Create some dummy data to send.
@@ -169,6 +177,7 @@ class TunnelSessionClientTest : public testing::Test,
     if (events & talk_base::SE_CLOSE) {
       if (stream == remote_tunnel_.get()) {
         remote_tunnel_->Close();
+        // Last, as the remote stream may be on another thread.
         done_ = true;
       }
     }
@@ -217,10 +226,19 @@ class TunnelSessionClientTest : public testing::Test,
   talk_base::scoped_ptr<talk_base::StreamInterface> remote_tunnel_;
   talk_base::MemoryStream send_stream_;
   talk_base::MemoryStream recv_stream_;
-  bool done_;
+  volatile bool done_;
 };
 
 // Test the normal case of sending data from one side to the other.
 TEST_F(TunnelSessionClientTest, TestTransfer) {
   TestTransfer(1000000);
 }
+
+// Test a transfer whose receiving stream runs on its own thread.
+TEST_F(TunnelSessionClientTest, TestTransferWithStreamThreadPool) {
+  talk_base::Thread stream_thread;
+  stream_thread.Start();
+  SetRemoteStreamThread(&stream_thread);
+  TestTransfer(1000000);
+  stream_thread.Stop();
+}
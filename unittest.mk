@@ -36,6 +36,7 @@ LOCAL_MODULE_TAGS := optional
 #
 LOCAL_BASE_SRC_FILES := \
 	talk/base/asynchttprequest_unittest.cc \
+	talk/base/asyncudpsocket_unittest.cc \
 	talk/base/autodetectproxy_unittest.cc \
 	talk/base/bandwidthsmoother_unittest.cc \
 	talk/base/base64_unittest.cc \
@@ -46,12 +47,15 @@ LOCAL_BASE_SRC_FILES := \
 	talk/base/crc32_unittest.cc \
 	talk/base/event_unittest.cc \
 	talk/base/fileutils_unittest.cc \
+	talk/base/flathashmap_unittest.cc \
 	talk/base/helpers_unittest.cc \
+	talk/base/hmacsha1_unittest.cc \
 	talk/base/host_unittest.cc \
 	talk/base/httpbase_unittest.cc \
 	talk/base/httpcommon_unittest.cc \
 	talk/base/httpserver_unittest.cc \
 	talk/base/ipaddress_unittest.cc \
+	talk/base/lockfreeringbuffer_unittest.cc \
 	talk/base/logging_unittest.cc \
 	talk/base/md5digest_unittest.cc \
 	talk/base/messagedigest_unittest.cc \
@@ -61,6 +65,7 @@ LOCAL_BASE_SRC_FILES := \
 	talk/base/network_unittest.cc \
 	talk/base/nullsocketserver_unittest.cc \
 	talk/base/optionsfile_unittest.cc \
+	talk/base/packetbuffer_unittest.cc \
 	talk/base/pathutils_unittest.cc \
 	talk/base/physicalsocketserver_unittest.cc \
 	talk/base/proxy_unittest.cc \
@@ -184,13 +189,16 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_SRC_FILES := \
 	talk/media/base/testutils.cc \
 	talk/p2p/base/dtlstransportchannel_unittest.cc \
+	talk/p2p/base/icecheckscheduler_unittest.cc \
 	talk/p2p/base/p2ptransportchannel_unittest.cc \
 	talk/p2p/base/port_unittest.cc \
 	talk/p2p/base/portallocatorsessionproxy_unittest.cc \
 	talk/p2p/base/pseudotcp_unittest.cc \
+	talk/p2p/base/pseudotcpcongestion_unittest.cc \
 	talk/p2p/base/relayport_unittest.cc \
 	talk/p2p/base/relayserver_unittest.cc \
 	talk/p2p/base/session_unittest.cc \
+	talk/p2p/base/shardedturnserver_unittest.cc \
 	talk/p2p/base/stun_unittest.cc \
 	talk/p2p/base/stunport_unittest.cc \
 	talk/p2p/base/stunrequest_unittest.cc \
@@ -208,6 +216,7 @@ LOCAL_SRC_FILES := \
 	talk/session/media/mediasessionclient_unittest.cc \
 	talk/session/media/rtcpmuxfilter_unittest.cc \
 	talk/session/media/srtpfilter_unittest.cc \
+	talk/session/media/ssrcdemuxer_unittest.cc \
 	talk/session/media/ssrcmuxfilter_unittest.cc
 
 LOCAL_CPP_EXTENSION:= .cc